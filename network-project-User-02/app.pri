@@ -0,0 +1,60 @@
+# The call engine shared by the app and by the tools and benchmarks that run it
+# headless: everything but main.cpp and the QML front end.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/audiobackend.cpp \
+    $$PWD/audioconverter.cpp \
+    $$PWD/audioencoder.cpp \
+    $$PWD/audioinput.cpp \
+    $$PWD/audiomixer.cpp \
+    $$PWD/audiooutput.cpp \
+    $$PWD/audiostream.cpp \
+    $$PWD/bitratecontroller.cpp \
+    $$PWD/candidatecache.cpp \
+    $$PWD/captureprocessing.cpp \
+    $$PWD/certificatecache.cpp \
+    $$PWD/jitterbuffer.cpp \
+    $$PWD/mediaengine.cpp \
+    $$PWD/opuslayout.cpp \
+    $$PWD/pcmringdevice.cpp \
+    $$PWD/peerconnectionpool.cpp \
+    $$PWD/qtaudiobackend.cpp \
+    $$PWD/resampler.cpp \
+    $$PWD/rtpframedepacketizer.cpp \
+    $$PWD/rtpstatistics.cpp \
+    $$PWD/signalingclient.cpp \
+    $$PWD/syntheticaudiobackend.cpp \
+    $$PWD/tracing.cpp \
+    $$PWD/wavaudiobackend.cpp \
+    $$PWD/webrtc.cpp
+
+HEADERS += \
+    $$PWD/audiobackend.h \
+    $$PWD/audioconverter.h \
+    $$PWD/audioencoder.h \
+    $$PWD/audioinput.h \
+    $$PWD/audiomixer.h \
+    $$PWD/audiooutput.h \
+    $$PWD/audiostream.h \
+    $$PWD/bitratecontroller.h \
+    $$PWD/candidatecache.h \
+    $$PWD/captureprocessing.h \
+    $$PWD/certificatecache.h \
+    $$PWD/jitterbuffer.h \
+    $$PWD/mediaengine.h \
+    $$PWD/mpscpacketring.h \
+    $$PWD/opuslayout.h \
+    $$PWD/pcmringdevice.h \
+    $$PWD/peerconnectionpool.h \
+    $$PWD/qtaudiobackend.h \
+    $$PWD/resampler.h \
+    $$PWD/rtpframedepacketizer.h \
+    $$PWD/rtpstatistics.h \
+    $$PWD/signalingclient.h \
+    $$PWD/spscringbuffer.h \
+    $$PWD/syntheticaudiobackend.h \
+    $$PWD/tracing.h \
+    $$PWD/wavaudiobackend.h \
+    $$PWD/webrtc.h
@@ -0,0 +1,214 @@
+#include "audiobackend.h"
+#include <QDebug>
+#include "audiomixer.h"
+#include "qtaudiobackend.h"
+#include "syntheticaudiobackend.h"
+#include "wavaudiobackend.h"
+
+namespace {
+
+const int sampleRate = 48000;
+// Like a sound card's period.
+const int realTimeTickMs = 10;
+// The source only mixes ahead every 10 ms, so polling faster than this gains nothing.
+const int fastPlayoutTickMs = 1;
+
+// Samples per channel.
+qint64 dueSamples(const QElapsedTimer &clock, qint64 doneSamples)
+{
+    return clock.nsecsElapsed() * sampleRate / 1000000000 - doneSamples;
+}
+
+}
+
+
+void AudioCaptureBackend::setChannelCount(int channels)
+{
+    m_channelCount = qMax(1, channels);
+}
+
+int AudioCaptureBackend::channelCount() const
+{
+    return m_channelCount;
+}
+
+void AudioPlayoutBackend::setChannelCount(int channels)
+{
+    m_channelCount = qMax(1, channels);
+}
+
+int AudioPlayoutBackend::channelCount() const
+{
+    return m_channelCount;
+}
+
+namespace AudioBackends {
+
+AudioCaptureBackend *createCapture(const QString &spec, Pacing pacing, QObject *parent)
+{
+    const QString kind = spec.section(':', 0, 0);
+    const QString argument = spec.section(':', 1);
+
+    if (kind == "qt") {
+        QtCaptureBackend *backend = new QtCaptureBackend(parent);
+        if (!argument.isEmpty())
+            backend->setMaxConversionLatencyMs(argument.toDouble());
+        return backend;
+    }
+
+    if (kind == "wav" && !argument.isEmpty())
+        return new WavCaptureBackend(argument, pacing, parent);
+
+    if (kind == "generator") {
+        GeneratorCaptureBackend::Waveform waveform;
+        if (GeneratorCaptureBackend::waveformFromString(argument.isEmpty() ? "tone" : argument, &waveform))
+            return new GeneratorCaptureBackend(waveform, pacing, parent);
+    }
+
+    qWarning() << "Unknown capture backend:" << spec;
+    return nullptr;
+}
+
+AudioPlayoutBackend *createPlayout(const QString &spec, Pacing pacing, QObject *parent)
+{
+    const QString kind = spec.section(':', 0, 0);
+    const QString argument = spec.section(':', 1);
+
+    if (kind == "qt") {
+        QtPlayoutBackend *backend = new QtPlayoutBackend(parent);
+        if (!argument.isEmpty())
+            backend->setMaxConversionLatencyMs(argument.toDouble());
+        return backend;
+    }
+
+    if (kind == "null")
+        return new NullPlayoutBackend(pacing, parent);
+
+    if (kind == "wav" && !argument.isEmpty())
+        return new WavPlayoutBackend(argument, pacing, parent);
+
+    qWarning() << "Unknown playout backend:" << spec;
+    return nullptr;
+}
+
+Pacing pacingFromString(const QString &name)
+{
+    return name.compare("fast", Qt::CaseInsensitive) == 0 ? Pacing::Fast : Pacing::RealTime;
+}
+
+}
+
+
+PacedCaptureBackend::PacedCaptureBackend(AudioBackends::Pacing pacing, QObject *parent)
+    : AudioCaptureBackend(parent),
+    m_pacing(pacing),
+    m_device(sampleRate)
+{
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(m_pacing == AudioBackends::Pacing::Fast ? 0 : realTimeTickMs);
+    connect(&m_timer, &QTimer::timeout, this, &PacedCaptureBackend::tick);
+
+    m_chunk.fill(0, sampleRate);
+}
+
+QIODevice *PacedCaptureBackend::start()
+{
+    if (!openSource())
+        return nullptr;
+
+    m_device.clear();
+    m_interleaved.resize(m_channelCount > 1 ? m_chunk.size() * m_channelCount : 0);
+    m_producedSamples = 0;
+    m_clock.start();
+    m_timer.start();
+    return &m_device;
+}
+
+void PacedCaptureBackend::stop()
+{
+    if (!m_timer.isActive())
+        return;
+
+    m_timer.stop();
+    closeSource();
+}
+
+void PacedCaptureBackend::tick()
+{
+    qint64 due;
+    if (m_pacing == AudioBackends::Pacing::Fast)
+        due = m_device.freeSpace() / m_channelCount;
+    else
+        due = dueSamples(m_clock, m_producedSamples);
+
+    const int count = static_cast<int>(qMin<qint64>(due, m_chunk.size()));
+    if (count <= 0)
+        return;
+
+    produce(m_chunk.data(), count);
+    if (m_interleaved.isEmpty()) {
+        m_device.pushSamples(m_chunk.constData(), count);
+    } else {
+        AudioMixer::remix(m_chunk.constData(), 1, m_interleaved.data(), m_channelCount, count);
+        m_device.pushSamples(m_interleaved.constData(), count * m_channelCount);
+    }
+    m_producedSamples += count;
+}
+
+
+PacedPlayoutBackend::PacedPlayoutBackend(AudioBackends::Pacing pacing, QObject *parent)
+    : AudioPlayoutBackend(parent),
+    m_pacing(pacing)
+{
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(m_pacing == AudioBackends::Pacing::Fast ? fastPlayoutTickMs : realTimeTickMs);
+    connect(&m_timer, &QTimer::timeout, this, &PacedPlayoutBackend::tick);
+
+    m_chunk.fill(0, sampleRate);
+}
+
+bool PacedPlayoutBackend::start(QIODevice *source)
+{
+    if (!source || !openSink())
+        return false;
+
+    m_source = source;
+    m_interleaved.resize(m_chunk.size() * m_channelCount);
+    m_consumedSamples = 0;
+    m_clock.start();
+    m_timer.start();
+    return true;
+}
+
+void PacedPlayoutBackend::stop()
+{
+    if (!m_source)
+        return;
+
+    m_timer.stop();
+    m_source = nullptr;
+    closeSink();
+}
+
+void PacedPlayoutBackend::tick()
+{
+    const qint64 frameBytes = qint64(sizeof(opus_int16)) * m_channelCount;
+    qint64 due;
+    if (m_pacing == AudioBackends::Pacing::Fast)
+        due = m_source->bytesAvailable() / frameBytes;
+    else
+        due = dueSamples(m_clock, m_consumedSamples);
+
+    const int count = static_cast<int>(qMin<qint64>(due, m_chunk.size()));
+    if (count <= 0)
+        return;
+
+    const qint64 bytesRead = m_source->read(reinterpret_cast<char*>(m_interleaved.data()), count * frameBytes);
+    if (bytesRead <= 0)
+        return;
+
+    const int samplesRead = static_cast<int>(bytesRead / frameBytes);
+    AudioMixer::remix(m_interleaved.constData(), m_channelCount, m_chunk.data(), 1, samplesRead);
+    consume(m_chunk.constData(), samplesRead);
+    m_consumedSamples += samplesRead;
+}
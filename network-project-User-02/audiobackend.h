@@ -0,0 +1,130 @@
+#ifndef AUDIOBACKEND_H
+#define AUDIOBACKEND_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <opus.h>
+#include "pcmringdevice.h"
+
+// Where AudioInput's samples come from and where AudioOutput's go. Every backend
+// carries interleaved 16-bit PCM at 48 kHz, mono unless another channel count
+// is set before start(), and runs on the thread that owns it; the Qt ones
+// convert to and from whatever the device itself prefers.
+
+class AudioCaptureBackend : public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+    void setChannelCount(int channels);
+    int channelCount() const;
+
+    // Returns a push-mode device that signals readyRead as samples arrive, or nullptr.
+    virtual QIODevice *start() = 0;
+    virtual void stop() = 0;
+
+protected:
+    int m_channelCount = 1;
+};
+
+class AudioPlayoutBackend : public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+    void setChannelCount(int channels);
+    int channelCount() const;
+
+    // Pulls from source until stopped.
+    virtual bool start(QIODevice *source) = 0;
+    virtual void stop() = 0;
+
+protected:
+    int m_channelCount = 1;
+};
+
+namespace AudioBackends {
+
+enum class Pacing {
+    RealTime,   // samples move at 48 kHz, as they would through a sound card
+    Fast        // as fast as the pipeline takes them, for offline runs and load tests
+};
+
+// Capture specs are "qt", "wav:<file>" and "generator:<tone|noise|speech|silence>";
+// playout specs are "qt", "null" and "wav:<file>". Unknown specs give nullptr.
+// "qt:<ms>" bounds the latency of the conversion to the device's format.
+AudioCaptureBackend *createCapture(const QString &spec, Pacing pacing, QObject *parent = nullptr);
+AudioPlayoutBackend *createPlayout(const QString &spec, Pacing pacing, QObject *parent = nullptr);
+
+Pacing pacingFromString(const QString &name);
+
+}
+
+// Base for capture backends that produce samples themselves. In real time it asks
+// for whatever the clock says is due, dropping what does not fit like a device
+// would; in fast mode it keeps the device full and lets AudioInput set the pace.
+// Sources are mono and copied to every channel.
+class PacedCaptureBackend : public AudioCaptureBackend
+{
+    Q_OBJECT
+public:
+    explicit PacedCaptureBackend(AudioBackends::Pacing pacing, QObject *parent = nullptr);
+
+    QIODevice *start() override;
+    void stop() override;
+
+protected:
+    virtual bool openSource() { return true; }
+    virtual void closeSource() {}
+    // Fills pcm with exactly count samples.
+    virtual void produce(opus_int16 *pcm, int count) = 0;
+
+private:
+    void tick();
+
+    const AudioBackends::Pacing m_pacing;
+    PcmRingDevice m_device;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_producedSamples = 0;
+    QVector<opus_int16> m_chunk;
+    QVector<opus_int16> m_interleaved;
+};
+
+// Base for playout backends that consume samples themselves. In real time it pulls
+// what the clock says is due, so the source underruns just as it would under a
+// sound card; in fast mode it takes only what the source has mixed. Sinks are
+// mono and get the channels averaged.
+class PacedPlayoutBackend : public AudioPlayoutBackend
+{
+    Q_OBJECT
+public:
+    explicit PacedPlayoutBackend(AudioBackends::Pacing pacing, QObject *parent = nullptr);
+
+    bool start(QIODevice *source) override;
+    void stop() override;
+
+protected:
+    virtual bool openSink() { return true; }
+    virtual void closeSink() {}
+    virtual void consume(const opus_int16 *pcm, int count) = 0;
+
+private:
+    void tick();
+
+    const AudioBackends::Pacing m_pacing;
+    QIODevice *m_source = nullptr;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_consumedSamples = 0;
+    QVector<opus_int16> m_chunk;
+    QVector<opus_int16> m_interleaved;
+};
+
+#endif
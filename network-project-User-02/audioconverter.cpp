@@ -0,0 +1,284 @@
+#include "audioconverter.h"
+#include <QtGlobal>
+#include <cstring>
+
+namespace {
+
+bool isSupportedFormat(const QAudioFormat &format)
+{
+    switch (format.sampleFormat()) {
+    case QAudioFormat::UInt8:
+    case QAudioFormat::Int16:
+    case QAudioFormat::Int32:
+    case QAudioFormat::Float:
+        return format.channelCount() > 0 && format.sampleRate() > 0;
+    default:
+        return false;
+    }
+}
+
+float sampleToFloat(const char *sample, QAudioFormat::SampleFormat format)
+{
+    switch (format) {
+    case QAudioFormat::UInt8:
+        return (static_cast<int>(*reinterpret_cast<const quint8 *>(sample)) - 128) / 128.0f;
+    case QAudioFormat::Int16: {
+        qint16 value;
+        std::memcpy(&value, sample, sizeof(value));
+        return value / 32768.0f;
+    }
+    case QAudioFormat::Int32: {
+        qint32 value;
+        std::memcpy(&value, sample, sizeof(value));
+        return static_cast<float>(value / 2147483648.0);
+    }
+    case QAudioFormat::Float: {
+        float value;
+        std::memcpy(&value, sample, sizeof(value));
+        return value;
+    }
+    default:
+        return 0.0f;
+    }
+}
+
+void floatToSample(float value, char *sample, QAudioFormat::SampleFormat format)
+{
+    value = qBound(-1.0f, value, 1.0f);
+    switch (format) {
+    case QAudioFormat::UInt8:
+        *reinterpret_cast<quint8 *>(sample) = static_cast<quint8>(qBound(0, qRound(value * 128.0f) + 128, 255));
+        break;
+    case QAudioFormat::Int16: {
+        const qint16 converted = static_cast<qint16>(qBound(-32768, qRound(value * 32768.0f), 32767));
+        std::memcpy(sample, &converted, sizeof(converted));
+        break;
+    }
+    case QAudioFormat::Int32: {
+        const qint32 converted = static_cast<qint32>(qBound(-2147483648.0, value * 2147483648.0, 2147483647.0));
+        std::memcpy(sample, &converted, sizeof(converted));
+        break;
+    }
+    case QAudioFormat::Float:
+        std::memcpy(sample, &value, sizeof(value));
+        break;
+    default:
+        break;
+    }
+}
+
+}
+
+AudioConverter::AudioConverter(const QAudioFormat &inputFormat, const QAudioFormat &outputFormat, double maxLatencyMs)
+    : m_inputFormat(inputFormat),
+    m_outputFormat(outputFormat),
+    m_channels(qMax(1, qMin(inputFormat.channelCount(), outputFormat.channelCount())))
+{
+    for (int channel = 0; channel < m_channels; ++channel) {
+        m_resamplers.emplace_back(inputFormat.sampleRate(), outputFormat.sampleRate(), maxLatencyMs);
+    }
+    if (!isValid())
+        return;
+
+    const size_t inputFrames = static_cast<size_t>(inputFormat.sampleRate());
+    const size_t outputFrames = static_cast<size_t>(m_resamplers.front().outputFor(inputFormat.sampleRate())) + Resampler::maxTaps;
+    m_input.assign(m_channels, std::vector<float>(inputFrames));
+    m_output.assign(m_channels, std::vector<float>(outputFrames));
+}
+
+bool AudioConverter::isSupported(const QAudioFormat &inputFormat, const QAudioFormat &outputFormat)
+{
+    return isSupportedFormat(inputFormat) && isSupportedFormat(outputFormat)
+           && Resampler::isSupported(inputFormat.sampleRate(), outputFormat.sampleRate());
+}
+
+bool AudioConverter::isValid() const
+{
+    return isSupported(m_inputFormat, m_outputFormat);
+}
+
+bool AudioConverter::isPassthrough() const
+{
+    return m_inputFormat == m_outputFormat;
+}
+
+double AudioConverter::latencyMs() const
+{
+    return m_resamplers.front().latencyMs();
+}
+
+QAudioFormat AudioConverter::inputFormat() const
+{
+    return m_inputFormat;
+}
+
+QAudioFormat AudioConverter::outputFormat() const
+{
+    return m_outputFormat;
+}
+
+qint64 AudioConverter::inputBytesFor(qint64 outputBytes) const
+{
+    const int frames = static_cast<int>(outputBytes / m_outputFormat.bytesPerFrame());
+    return static_cast<qint64>(m_resamplers.front().inputFor(frames)) * m_inputFormat.bytesPerFrame();
+}
+
+qint64 AudioConverter::outputBytesFor(qint64 inputBytes) const
+{
+    const int frames = static_cast<int>(inputBytes / m_inputFormat.bytesPerFrame());
+    return static_cast<qint64>(m_resamplers.front().outputFor(frames)) * m_outputFormat.bytesPerFrame();
+}
+
+qint64 AudioConverter::convert(const char *input, qint64 inputBytes, char *output, qint64 maxOutputBytes)
+{
+    if (!isValid())
+        return 0;
+
+    if (isPassthrough()) {
+        const qint64 bytes = qMin(inputBytes, maxOutputBytes);
+        std::memcpy(output, input, static_cast<size_t>(bytes));
+        return bytes;
+    }
+
+    const int inputFrameBytes = m_inputFormat.bytesPerFrame();
+    const int outputFrameBytes = m_outputFormat.bytesPerFrame();
+    int inputFrames = static_cast<int>(inputBytes / inputFrameBytes);
+    int outputRoom = static_cast<int>(maxOutputBytes / outputFrameBytes);
+    qint64 written = 0;
+
+    // A second of input at a time, so the scratch space never grows.
+    while (inputFrames > 0) {
+        const int frames = qMin(inputFrames, static_cast<int>(m_input.front().size()));
+        toPlanar(input, frames);
+
+        // The resamplers move in step, so each produces the same count.
+        const int room = qMin(outputRoom, static_cast<int>(m_output.front().size()));
+        int produced = 0;
+        for (int channel = 0; channel < m_channels; ++channel) {
+            produced = m_resamplers[channel].process(m_input[channel].data(), frames, m_output[channel].data(), room);
+        }
+        fromPlanar(produced, output + written);
+
+        input += static_cast<qint64>(frames) * inputFrameBytes;
+        inputFrames -= frames;
+        outputRoom -= produced;
+        written += static_cast<qint64>(produced) * outputFrameBytes;
+    }
+    return written;
+}
+
+void AudioConverter::reset()
+{
+    for (Resampler &resampler : m_resamplers) {
+        resampler.reset();
+    }
+}
+
+void AudioConverter::toPlanar(const char *input, int frames)
+{
+    const int channels = m_inputFormat.channelCount();
+    const int sampleBytes = m_inputFormat.bytesPerSample();
+    const QAudioFormat::SampleFormat format = m_inputFormat.sampleFormat();
+    float *first = m_input[0].data();
+    float *second = m_channels > 1 ? m_input[1].data() : nullptr;
+
+    // The common cases get loops the compiler can vectorize.
+    if (format == QAudioFormat::Int16 && channels <= 2) {
+        const qint16 *pcm = reinterpret_cast<const qint16 *>(input);
+        if (channels == 1) {
+            for (int i = 0; i < frames; ++i) {
+                first[i] = pcm[i] * (1.0f / 32768.0f);
+            }
+        } else if (m_channels == 1) {
+            for (int i = 0; i < frames; ++i) {
+                first[i] = (pcm[2 * i] + pcm[2 * i + 1]) * (0.5f / 32768.0f);
+            }
+        } else {
+            for (int i = 0; i < frames; ++i) {
+                first[i] = pcm[2 * i] * (1.0f / 32768.0f);
+                second[i] = pcm[2 * i + 1] * (1.0f / 32768.0f);
+            }
+        }
+        return;
+    }
+    if (format == QAudioFormat::Float && channels <= 2) {
+        const float *pcm = reinterpret_cast<const float *>(input);
+        if (channels == 1) {
+            std::memcpy(first, pcm, frames * sizeof(float));
+        } else if (m_channels == 1) {
+            for (int i = 0; i < frames; ++i) {
+                first[i] = (pcm[2 * i] + pcm[2 * i + 1]) * 0.5f;
+            }
+        } else {
+            for (int i = 0; i < frames; ++i) {
+                first[i] = pcm[2 * i];
+                second[i] = pcm[2 * i + 1];
+            }
+        }
+        return;
+    }
+
+    if (m_channels == 1) {
+        const float scale = 1.0f / channels;
+        for (int i = 0; i < frames; ++i) {
+            float sum = 0.0f;
+            for (int channel = 0; channel < channels; ++channel) {
+                sum += sampleToFloat(input, format);
+                input += sampleBytes;
+            }
+            first[i] = sum * scale;
+        }
+        return;
+    }
+
+    for (int i = 0; i < frames; ++i) {
+        for (int channel = 0; channel < channels; ++channel) {
+            if (channel < m_channels)
+                m_input[channel][i] = sampleToFloat(input, format);
+            input += sampleBytes;
+        }
+    }
+}
+
+void AudioConverter::fromPlanar(int frames, char *output) const
+{
+    const int channels = m_outputFormat.channelCount();
+    const int sampleBytes = m_outputFormat.bytesPerSample();
+    const QAudioFormat::SampleFormat format = m_outputFormat.sampleFormat();
+    const float *first = m_output[0].data();
+    const float *second = m_channels > 1 ? m_output[1].data() : first;
+
+    if (format == QAudioFormat::Int16 && channels <= 2) {
+        qint16 *pcm = reinterpret_cast<qint16 *>(output);
+        for (int i = 0; i < frames; ++i) {
+            const float value = qBound(-32768.0f, first[i] * 32768.0f, 32767.0f);
+            pcm[i * channels] = static_cast<qint16>(value + (value >= 0.0f ? 0.5f : -0.5f));
+            if (channels == 2) {
+                const float right = qBound(-32768.0f, second[i] * 32768.0f, 32767.0f);
+                pcm[i * 2 + 1] = static_cast<qint16>(right + (right >= 0.0f ? 0.5f : -0.5f));
+            }
+        }
+        return;
+    }
+    if (format == QAudioFormat::Float && channels <= 2) {
+        float *pcm = reinterpret_cast<float *>(output);
+        for (int i = 0; i < frames; ++i) {
+            pcm[i * channels] = qBound(-1.0f, first[i], 1.0f);
+            if (channels == 2)
+                pcm[i * 2 + 1] = qBound(-1.0f, second[i], 1.0f);
+        }
+        return;
+    }
+
+    for (int i = 0; i < frames; ++i) {
+        for (int channel = 0; channel < channels; ++channel) {
+            float value = 0.0f;
+            if (m_channels == 1)
+                value = first[i];
+            else if (channel < m_channels)
+                value = m_output[channel][i];
+            floatToSample(value, output, format);
+            output += sampleBytes;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef AUDIOCONVERTER_H
+#define AUDIOCONVERTER_H
+
+#include <QAudioFormat>
+#include <vector>
+#include "resampler.h"
+
+// Interleaved PCM from one QAudioFormat to another: to float, down to the
+// smaller of the two channel counts, resampled, then out to every output
+// channel in the output's sample format. Going to mono averages the input
+// channels and coming from mono copies to all of them; otherwise channels
+// pair up in order and the extra ones are dropped or left silent, which keeps
+// a stereo pair on a surround device's front left and right (Qt's order).
+// Only the channels kept are resampled. Scratch space for a second of audio
+// per call is allocated up front; within that, convert() does not allocate.
+class AudioConverter
+{
+public:
+    AudioConverter(const QAudioFormat &inputFormat, const QAudioFormat &outputFormat,
+                   double maxLatencyMs = Resampler::defaultMaxLatencyMs);
+
+    static bool isSupported(const QAudioFormat &inputFormat, const QAudioFormat &outputFormat);
+    bool isValid() const;
+    bool isPassthrough() const;
+    double latencyMs() const;
+
+    QAudioFormat inputFormat() const;
+    QAudioFormat outputFormat() const;
+
+    // Input bytes convert() needs to produce exactly outputBytes.
+    qint64 inputBytesFor(qint64 outputBytes) const;
+    // Bytes convert() writes for inputBytes more bytes of input.
+    qint64 outputBytesFor(qint64 inputBytes) const;
+
+    // Whole frames of input only; writes at most maxOutputBytes and returns how many it wrote.
+    qint64 convert(const char *input, qint64 inputBytes, char *output, qint64 maxOutputBytes);
+    void reset();
+
+private:
+    void toPlanar(const char *input, int frames);
+    void fromPlanar(int frames, char *output) const;
+
+    QAudioFormat m_inputFormat;
+    QAudioFormat m_outputFormat;
+    // The channels carried between the two formats, one resampler and one pair of buffers each.
+    int m_channels;
+    std::vector<Resampler> m_resamplers;
+    std::vector<std::vector<float>> m_input;
+    std::vector<std::vector<float>> m_output;
+};
+
+#endif
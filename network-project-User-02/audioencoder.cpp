@@ -0,0 +1,147 @@
+#include "audioencoder.h"
+#include <QDebug>
+#include "tracing.h"
+
+AudioEncoder::AudioEncoder(int sampleRate, int channels, int bitrate, int packetLossPercent)
+    : m_opusEncoder(nullptr),
+    m_sampleRate(sampleRate),
+    m_packetLossPercent(packetLossPercent),
+    m_bitrate(bitrate)
+{
+    setLayout(OpusLayout::forChannels(channels));
+}
+
+AudioEncoder::~AudioEncoder()
+{
+    if (m_opusEncoder) {
+        opus_multistream_encoder_destroy(m_opusEncoder);
+        m_opusEncoder = nullptr;
+    }
+}
+
+bool AudioEncoder::isValid() const
+{
+    return m_opusEncoder != nullptr;
+}
+
+bool AudioEncoder::setLayout(const OpusLayout &layout)
+{
+    if (!layout.isValid()) {
+        qWarning() << "Invalid Opus channel layout with" << layout.channels << "channels";
+        return false;
+    }
+
+    // libopus's own layouts get its surround encoder, which shares bits between
+    // the streams by what each channel masks; others are taken as given.
+    int error = OPUS_OK;
+    OpusMSEncoder *encoder;
+    if (layout == OpusLayout::forChannels(layout.channels)) {
+        int streams;
+        int coupledStreams;
+        unsigned char mapping[OpusLayout::maxChannels];
+        encoder = opus_multistream_surround_encoder_create(m_sampleRate, layout.channels, layout.channels > 2 ? 1 : 0,
+                                                           &streams, &coupledStreams, mapping,
+                                                           OPUS_APPLICATION_AUDIO, &error);
+    } else {
+        encoder = opus_multistream_encoder_create(m_sampleRate, layout.channels, layout.streams, layout.coupledStreams,
+                                                  layout.mapping.constData(), OPUS_APPLICATION_AUDIO, &error);
+    }
+    if (error != OPUS_OK || !encoder) {
+        qWarning() << "Opus encoder initialization failed with error code:" << error;
+        return false;
+    }
+
+    if (m_opusEncoder)
+        opus_multistream_encoder_destroy(m_opusEncoder);
+    m_opusEncoder = encoder;
+    m_layout = layout;
+
+    // Matches useinbandfec=1 in the SDP: each packet carries a low-bitrate copy of the previous frame.
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_INBAND_FEC(1));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_PACKET_LOSS_PERC(m_packetLossPercent));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_BITRATE(m_bitrate.load()));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_BANDWIDTH(m_bandwidth));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_DTX(m_dtx ? 1 : 0));
+    if (m_complexity >= 0)
+        opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_COMPLEXITY(m_complexity));
+
+    opus_int32 currentBitrate = 0;
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_GET_BITRATE(&currentBitrate));
+    m_bitrate = currentBitrate;
+    return true;
+}
+
+OpusLayout AudioEncoder::layout() const
+{
+    return m_layout;
+}
+
+int AudioEncoder::channels() const
+{
+    return m_layout.channels;
+}
+
+int AudioEncoder::encode(const opus_int16 *pcm, int frameSize, QByteArray &packet)
+{
+    if (!m_opusEncoder) {
+        TRACE_WARNING(Codec) << "Opus encoder is not initialized";
+        return OPUS_INVALID_STATE;
+    }
+
+    // The caller keeps maxPacketSize reserved, so neither resize allocates.
+    packet.resize(maxPacketSize);
+    const int compressedSize = opus_multistream_encode(m_opusEncoder,
+                                                       pcm,
+                                                       frameSize,
+                                                       reinterpret_cast<unsigned char*>(packet.data()),
+                                                       packet.size());
+
+    if (compressedSize < 0) {
+        TRACE_WARNING(Codec) << "Opus encoding error:" << opus_strerror(compressedSize);
+        packet.resize(0);
+        return compressedSize;
+    }
+
+    packet.resize(compressedSize);
+    return compressedSize;
+}
+
+void AudioEncoder::setDtx(bool enabled)
+{
+    m_dtx = enabled;
+    if (m_opusEncoder)
+        opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_DTX(enabled ? 1 : 0));
+}
+
+// Each stream but the last is self-delimited, which costs it one more byte.
+bool AudioEncoder::isDtxPacket(int size) const
+{
+    return size <= 3 * m_layout.streams - 1;
+}
+
+int AudioEncoder::bitrate() const
+{
+    return m_bitrate;
+}
+
+void AudioEncoder::setSettings(int bitrate, int bandwidth, int packetLossPercent)
+{
+    if (!m_opusEncoder) {
+        qWarning() << "Opus encoder is not initialized";
+        return;
+    }
+
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_BITRATE(bitrate));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_BANDWIDTH(bandwidth));
+    opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_PACKET_LOSS_PERC(packetLossPercent));
+    m_bitrate = bitrate;
+    m_bandwidth = bandwidth;
+    m_packetLossPercent = packetLossPercent;
+}
+
+void AudioEncoder::setComplexity(int complexity)
+{
+    m_complexity = complexity;
+    if (m_opusEncoder)
+        opus_multistream_encoder_ctl(m_opusEncoder, OPUS_SET_COMPLEXITY(complexity));
+}
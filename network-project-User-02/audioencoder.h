@@ -0,0 +1,55 @@
+#ifndef AUDIOENCODER_H
+#define AUDIOENCODER_H
+
+#include <QByteArray>
+#include <opus.h>
+#include <opus_multistream.h>
+#include <atomic>
+#include "opuslayout.h"
+
+// Opus encoder configured the way calls use it: in-band FEC to match
+// useinbandfec=1 in the SDP. DTX is off unless asked for; calls gate silence
+// in AudioInput instead. Has no Qt Multimedia dependency, so the
+// benchmarks can drive it without a capture device. Every layout goes through
+// the multistream API; with one stream its packets are plain Opus packets.
+class AudioEncoder
+{
+public:
+    explicit AudioEncoder(int sampleRate = 48000, int channels = 1, int bitrate = 64000, int packetLossPercent = 10);
+    ~AudioEncoder();
+
+    AudioEncoder(const AudioEncoder &) = delete;
+    AudioEncoder &operator=(const AudioEncoder &) = delete;
+
+    bool isValid() const;
+
+    // Replaces the encoder state, keeping every setting; false leaves the old layout in place.
+    bool setLayout(const OpusLayout &layout);
+    OpusLayout layout() const;
+    int channels() const;
+
+    // pcm holds frameSize interleaved samples per channel. Resizes packet to the
+    // encoded length and returns it, or returns a negative Opus error.
+    int encode(const opus_int16 *pcm, int frameSize, QByteArray &packet);
+    // With DTX on, Opus sends a byte or two per stream for frames it decides need not be sent.
+    void setDtx(bool enabled);
+    bool isDtxPacket(int size) const;
+
+    int bitrate() const;
+    void setSettings(int bitrate, int bandwidth, int packetLossPercent);
+    void setComplexity(int complexity);
+
+    static const int maxPacketSize = 4000;
+
+private:
+    OpusMSEncoder* m_opusEncoder;
+    OpusLayout m_layout;
+    const int m_sampleRate;
+    int m_bandwidth = OPUS_AUTO;
+    int m_packetLossPercent;
+    int m_complexity = -1;
+    bool m_dtx = false;
+    std::atomic<int> m_bitrate{0};
+};
+
+#endif
@@ -1,17 +1,31 @@
 #include "audioinput.h"
-#include <QAudioFormat>
-#include <QMediaDevices>
-#include <QAudioDevice>
 #include <QDebug>
+#include <cstring>
+#include "audiomixer.h"
+#include "qtaudiobackend.h"
+#include "tracing.h"
+
+namespace {
+
+// Opus only accepts 2.5, 5, 10, 20, 40 and 60 ms frames (in tenths of a millisecond here).
+bool isValidOpusFrameSize(int sampleRate, int frameSize)
+{
+    static const int durations[] = { 25, 50, 100, 200, 400, 600 };
+    for (int duration : durations) {
+        if (static_cast<qint64>(frameSize) * 10000 == static_cast<qint64>(sampleRate) * duration)
+            return true;
+    }
+    return false;
+}
+
+}
 
 AudioInput::AudioInput(QObject *parent)
     : QIODevice(parent),
-    opusEncoder(nullptr),
-    m_audioSource(nullptr),
+    m_captureBackend(new QtCaptureBackend(this)),
     m_audioInputDevice(nullptr)
 {
-    initializeAudio();
-    initializeOpusEncoder();
+    allocateCaptureBuffers();
 }
 
 AudioInput::~AudioInput()
@@ -19,59 +33,46 @@ AudioInput::~AudioInput()
     cleanup();
 }
 
-void AudioInput::initializeAudio()
-{
-
-    QAudioFormat format;
-    format.setSampleRate(sampleRate);
-    format.setChannelCount(channels);
-    format.setSampleFormat(QAudioFormat::Int16);
-
-
-    QAudioDevice defaultAudioInput = QMediaDevices::defaultAudioInput();
-
-
-    m_audioSource = new QAudioSource(defaultAudioInput, format, this);
-    if (!m_audioSource) {
-        qWarning() << "Failed to initialize audio source";
-    }
-}
-
-void AudioInput::initializeOpusEncoder()
+void AudioInput::cleanup()
 {
 
-    int error;
-    opusEncoder = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &error);
-    if (error != OPUS_OK) {
-        qWarning() << "Opus encoder initialization failed with error code:" << error;
-        opusEncoder = nullptr;
+    if (m_captureBackend) {
+        m_captureBackend->stop();
+        delete m_captureBackend;
+        m_captureBackend = nullptr;
     }
 }
 
-void AudioInput::cleanup()
+void AudioInput::setCaptureBackend(AudioCaptureBackend *backend)
 {
-
-    if (m_audioSource) {
-        m_audioSource->stop();
-        delete m_audioSource;
-        m_audioSource = nullptr;
+    if (m_audioInputDevice) {
+        qWarning() << "Capture backend cannot be changed while capture is running";
+        delete backend;
+        return;
     }
 
-    if (opusEncoder) {
-        opus_encoder_destroy(opusEncoder);
-        opusEncoder = nullptr;
-    }
+    delete m_captureBackend;
+    m_captureBackend = backend;
+    if (m_captureBackend)
+        m_captureBackend->setParent(this);
 }
 
-bool AudioInput::startAudioCapture()
+// Captures from the capture backend, or from captureDevice when one is given (16-bit PCM
+// at 48 kHz with channels() channels, signalling readyRead like QAudioSource's push-mode
+// device does).
+bool AudioInput::startAudioCapture(QIODevice *captureDevice)
 {
-    if (!m_audioSource) {
-        qWarning() << "Audio source not initialized";
+    if (!captureDevice && !m_captureBackend) {
+        qWarning() << "No capture backend";
         return false;
     }
 
 
-    m_audioInputDevice = m_audioSource->start();
+    resetCaptureBuffer();
+    m_externalCaptureDevice = captureDevice != nullptr;
+    if (!captureDevice)
+        m_captureBackend->setChannelCount(m_channels);
+    m_audioInputDevice = captureDevice ? captureDevice : m_captureBackend->start();
     if (!m_audioInputDevice) {
         qWarning() << "Failed to start audio source";
         return false;
@@ -88,52 +89,245 @@ void AudioInput::stopAudioCapture()
 {
     if (m_audioInputDevice) {
         disconnect(m_audioInputDevice, &QIODevice::readyRead, this, &AudioInput::processAudioInput);
-        m_audioSource->stop();
+        if (!m_externalCaptureDevice)
+            m_captureBackend->stop();
         m_audioInputDevice = nullptr;
+        m_externalCaptureDevice = false;
     }
 
-
+    resetCaptureBuffer();
     QIODevice::close();
 }
 
+bool AudioInput::setFrameSize(int frameSize)
+{
+    if (!isValidOpusFrameSize(sampleRate, frameSize)) {
+        qWarning() << "Unsupported Opus frame size:" << frameSize << "samples at" << sampleRate << "Hz";
+        return false;
+    }
+
+    if (m_audioInputDevice) {
+        qWarning() << "Frame size cannot be changed while capture is running";
+        return false;
+    }
+
+    m_frameSize = frameSize;
+    allocateCaptureBuffers();
+    return true;
+}
+
+int AudioInput::frameSize() const
+{
+    return m_frameSize;
+}
+
+bool AudioInput::setChannels(int channels)
+{
+    if (channels < 1 || channels > OpusLayout::maxChannels) {
+        qWarning() << "Unsupported capture channel count:" << channels;
+        return false;
+    }
+
+    if (m_audioInputDevice) {
+        qWarning() << "Channel count cannot be changed while capture is running";
+        return false;
+    }
+
+    m_channels = channels;
+    allocateCaptureBuffers();
+    return true;
+}
+
+int AudioInput::channels() const
+{
+    return m_channels;
+}
+
+bool AudioInput::setEncoderLayout(const OpusLayout &layout)
+{
+    if (layout == m_encoder.layout())
+        return true;
+    return m_encoder.setLayout(layout);
+}
+
+OpusLayout AudioInput::encoderLayout() const
+{
+    return m_encoder.layout();
+}
+
+int AudioInput::encoderBitrate() const
+{
+    return m_encoder.bitrate();
+}
+
+void AudioInput::setEncoderSettings(int bitrate, int bandwidth, int packetLossPercent)
+{
+    m_encoder.setSettings(bitrate, bandwidth, packetLossPercent);
+}
+
+CaptureProcessingChain *AudioInput::captureProcessing()
+{
+    return &m_processing;
+}
+
+void AudioInput::allocateCaptureBuffers()
+{
+    const int frameSamples = m_frameSize * m_channels;
+
+    // The ring never holds more than one partial frame once drained, so four
+    // frames leave plenty of room for whatever chunk size the device delivers.
+    m_captureRing.fill(0, frameSamples * 4);
+    m_frameBuffer.fill(0, frameSamples);
+    m_encodeBuffer.fill(0, m_frameSize * OpusLayout::maxChannels);
+
+    m_encodedData.reserve(AudioEncoder::maxPacketSize);
+    m_processing.prepare(sampleRate, m_channels, m_frameSize);
+
+    resetCaptureBuffer();
+}
+
+void AudioInput::resetCaptureBuffer()
+{
+    m_ringReadPos = 0;
+    m_ringWritePos = 0;
+    m_ringFill = 0;
+
+    m_processing.reset();
+    m_noiseFloor.reset();
+    m_hangover = 0;
+    m_silentFrames = 0;
+}
+
+bool AudioInput::silenceSuppression() const
+{
+    return m_silenceSuppression;
+}
+
+void AudioInput::setSilenceSuppression(bool enabled)
+{
+    m_silenceSuppression = enabled;
+    m_hangover = 0;
+    m_silentFrames = 0;
+}
+
+quint64 AudioInput::suppressedFrames() const
+{
+    return m_suppressedFrames.load(std::memory_order_relaxed);
+}
+
 void AudioInput::processAudioInput()
 {
     if (!m_audioInputDevice)
         return;
 
-    QByteArray inputData = m_audioInputDevice->readAll();
-    if (!inputData.isEmpty()) {
-        encodeAudioData(inputData);
+    const int capacity = m_captureRing.size();
+
+    for (;;) {
+        const qint64 availableSamples = m_audioInputDevice->bytesAvailable() / qint64(sizeof(opus_int16));
+        const int contiguous = qMin(capacity - m_ringFill, capacity - m_ringWritePos);
+        const int wanted = static_cast<int>(qMin<qint64>(availableSamples, contiguous));
+        if (wanted <= 0)
+            break;
+
+        const qint64 bytesRead = m_audioInputDevice->read(reinterpret_cast<char*>(m_captureRing.data() + m_ringWritePos),
+                                                          wanted * qint64(sizeof(opus_int16)));
+        if (bytesRead <= 0)
+            break;
+
+        const int samplesRead = static_cast<int>(bytesRead / qint64(sizeof(opus_int16)));
+        m_ringWritePos = (m_ringWritePos + samplesRead) % capacity;
+        m_ringFill += samplesRead;
+        TRACE_COUNTER(Capture, "captureRingFill", m_ringFill);
+
+        drainCaptureBuffer();
     }
 }
 
-void AudioInput::encodeAudioData(const QByteArray &inputData)
+void AudioInput::drainCaptureBuffer()
 {
-    if (!opusEncoder) {
-        qWarning() << "Opus encoder is not initialized";
-        return;
+    const int capacity = m_captureRing.size();
+    const int frameSamples = m_frameSize * m_channels;
+
+    while (m_ringFill >= frameSamples) {
+        opus_int16 *frame = m_captureRing.data() + m_ringReadPos;
+
+        const int tail = capacity - m_ringReadPos;
+        if (tail < frameSamples) {
+            std::memcpy(m_frameBuffer.data(), frame, tail * sizeof(opus_int16));
+            std::memcpy(m_frameBuffer.data() + tail, m_captureRing.constData(), (frameSamples - tail) * sizeof(opus_int16));
+            frame = m_frameBuffer.data();
+        }
+
+        m_ringReadPos = (m_ringReadPos + frameSamples) % capacity;
+        m_ringFill -= frameSamples;
+
+        // In place: the ring has already given the slot up. Every frame goes
+        // through, suppressed or not, so the stages never see a gap.
+        m_processing.process(frame, m_frameSize);
+
+        // The RTP timestamp keeps advancing through suppressed frames, so the far
+        // end sees a jump in time rather than a gap in sequence numbers.
+        const quint32 timestamp = m_capturePosition;
+        m_capturePosition += m_frameSize;
+
+        if (!m_silenceSuppression || isSpeech(frame, m_frameSize)) {
+            m_silentFrames = 0;
+        } else if (++m_silentFrames % comfortNoiseInterval != 1) {
+            // Only every 20th silent frame is encoded, to keep the far end's comfort
+            // noise current. The encoder runs without DTX, so that frame always goes out.
+            m_suppressedFrames.fetch_add(1, std::memory_order_relaxed);
+            TRACE_INSTANT(Capture, "silentFrame", timestamp);
+            continue;
+        }
+
+        encodeAudioData(frame, m_frameSize, timestamp);
     }
+}
 
+// Energy gate against a tracked noise floor, with a hangover so word endings are not clipped.
+bool AudioInput::isSpeech(const opus_int16 *pcm, int frameSize)
+{
+    const int samples = frameSize * m_channels;
+    qint64 sumOfSquares = 0;
+    for (int i = 0; i < samples; ++i) {
+        sumOfSquares += static_cast<qint32>(pcm[i]) * pcm[i];
+    }
+    const double energy = static_cast<double>(sumOfSquares) / samples;
 
-    QByteArray encodedData(4000, 0);
+    m_noiseFloor.update(energy, 0.002);
 
+    // Roughly 6 dB over the floor, and never for anything below about -60 dBFS.
+    if (energy > qMax(m_noiseFloor.floor() * 4.0, minimumSpeechEnergy)) {
+        m_hangover = hangoverFrames;
+        return true;
+    }
 
-    int compressedSize = opus_encode(opusEncoder,
-                                     reinterpret_cast<const opus_int16*>(inputData.data()),
-                                     inputData.size() / 2,  // Sample count for encoding
-                                     reinterpret_cast<unsigned char*>(encodedData.data()),
-                                     encodedData.size());
+    if (m_hangover > 0) {
+        --m_hangover;
+        return true;
+    }
 
-    if (compressedSize < 0) {
-        qWarning() << "Opus encoding error:" << compressedSize;
-        return;
+    return false;
+}
+
+void AudioInput::encodeAudioData(const opus_int16 *pcm, int frameSize, quint32 timestamp)
+{
+    TRACE_SCOPE(Codec, "encode");
+
+    const int encoderChannels = m_encoder.channels();
+    if (encoderChannels != m_channels) {
+        AudioMixer::remix(pcm, m_channels, m_encodeBuffer.data(), encoderChannels, frameSize);
+        pcm = m_encodeBuffer.constData();
     }
 
-    encodedData.resize(compressedSize);
-    qDebug() << "Encoded audio data size:" << compressedSize;
+    const int compressedSize = m_encoder.encode(pcm, frameSize, m_encodedData);
+    if (compressedSize < 0)
+        return;
+
+    TRACE_COUNTER(Codec, "encodedBytes", compressedSize);
 
 
-    emit encodedAudioReady(encodedData);
+    emit encodedAudioReady(m_encodedData, timestamp);
 }
 
 qint64 AudioInput::readData(char *data, qint64 maxlen)
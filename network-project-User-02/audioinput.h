@@ -2,10 +2,14 @@
 #define AUDIOINPUT_H
 
 #include <QIODevice>
-#include <QAudioSource>
 #include <QByteArray>
+#include <QVector>
 #include <QMutex>
 #include <opus.h>
+#include <atomic>
+#include "audioencoder.h"
+#include "audiobackend.h"
+#include "captureprocessing.h"
 
 class AudioInput : public QIODevice
 {
@@ -14,11 +18,37 @@ public:
     explicit AudioInput(QObject *parent = nullptr);
     ~AudioInput();
 
-    bool startAudioCapture();
+    bool startAudioCapture(QIODevice *captureDevice = nullptr);
     void stopAudioCapture();
 
+    // Takes ownership. The system's default input is used until this is called.
+    void setCaptureBackend(AudioCaptureBackend *backend);
+
+    bool setFrameSize(int frameSize);
+    int frameSize() const;
+
+    // Channels captured; set before capture starts.
+    bool setChannels(int channels);
+    int channels() const;
+
+    // What is sent, negotiated per call and changeable at any time. Captured
+    // channels are remixed to the layout's when the two differ.
+    bool setEncoderLayout(const OpusLayout &layout);
+    OpusLayout encoderLayout() const;
+
+    int encoderBitrate() const;
+    void setEncoderSettings(int bitrate, int bandwidth, int packetLossPercent);
+
+    // Runs on every captured frame, ahead of silence detection and the encoder.
+    // Configure it on the capture thread; its statistics can be read from any.
+    CaptureProcessingChain *captureProcessing();
+
+    bool silenceSuppression() const;
+    void setSilenceSuppression(bool enabled);
+    quint64 suppressedFrames() const;
+
 signals:
-    void encodedAudioReady(const QByteArray& encodedData);
+    void encodedAudioReady(const QByteArray& encodedData, quint32 timestamp);
 
 protected:
 
@@ -29,19 +59,41 @@ private slots:
     void processAudioInput();
 
 private:
-    void initializeAudio();
-    void initializeOpusEncoder();
     void cleanup();
-    void encodeAudioData(const QByteArray &inputData);
+    void allocateCaptureBuffers();
+    void resetCaptureBuffer();
+    void drainCaptureBuffer();
+    bool isSpeech(const opus_int16 *pcm, int frameSize);
+    void encodeAudioData(const opus_int16 *pcm, int frameSize, quint32 timestamp);
 
-    QByteArray buffer;
-    OpusEncoder* opusEncoder;
-    QAudioSource* m_audioSource;
+    QVector<opus_int16> m_captureRing;
+    QVector<opus_int16> m_frameBuffer;
+    QVector<opus_int16> m_encodeBuffer;
+    int m_ringReadPos = 0;
+    int m_ringWritePos = 0;
+    int m_ringFill = 0;
+
+    QByteArray m_encodedData;
+    CaptureProcessingChain m_processing;
+    AudioEncoder m_encoder;
+    AudioCaptureBackend* m_captureBackend;
     QIODevice* m_audioInputDevice;
+    bool m_externalCaptureDevice = false;
 
     const int sampleRate = 48000;
-    const int channels = 1;
-    const int bitrate = 64000;
+    int m_channels = 1;
+    int m_frameSize = 960;
+
+    const int hangoverFrames = 10;
+    const int comfortNoiseInterval = 20;
+    // Roughly -60 dBFS; nothing quieter is ever speech.
+    const double minimumSpeechEnergy = 1000.0;
+    bool m_silenceSuppression = true;
+    NoiseFloorTracker m_noiseFloor{minimumSpeechEnergy / 4.0};
+    int m_hangover = 0;
+    int m_silentFrames = 0;
+    quint32 m_capturePosition = 0;
+    std::atomic<quint64> m_suppressedFrames{0};
 
     QMutex mutex;
 };
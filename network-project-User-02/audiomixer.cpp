@@ -0,0 +1,264 @@
+#include "audiomixer.h"
+#include <QtGlobal>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AUDIOMIXER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void mixScalar(opus_int16 *destination, const opus_int16 *source, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int sum = destination[i] + source[i];
+        destination[i] = static_cast<opus_int16>(qBound(-32768, sum, 32767));
+    }
+}
+
+int peakScalar(const opus_int16 *pcm, int count)
+{
+    int peak = 0;
+    for (int i = 0; i < count; ++i) {
+        peak = qMax(peak, qAbs(static_cast<int>(pcm[i])));
+    }
+    return qMin(peak, 32767);
+}
+
+#ifdef AUDIOMIXER_X86
+
+__attribute__((target("sse2")))
+void mixSse2(opus_int16 *destination, const opus_int16 *source, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_adds_epi16(a, b));
+    }
+    mixScalar(destination + i, source + i, count - i);
+}
+
+__attribute__((target("sse2")))
+int peakSse2(const opus_int16 *pcm, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i peak = zero;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pcm + i));
+        // subs saturates -32768 to 32767, so the max is a safe absolute value.
+        peak = _mm_max_epi16(peak, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+    }
+
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 8));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 4));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 2));
+
+    return qMax(_mm_extract_epi16(peak, 0), peakScalar(pcm + i, count - i));
+}
+
+__attribute__((target("avx2")))
+void mixAvx2(opus_int16 *destination, const opus_int16 *source, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destination + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), _mm256_adds_epi16(a, b));
+    }
+    mixScalar(destination + i, source + i, count - i);
+}
+
+__attribute__((target("avx2")))
+int peakAvx2(const opus_int16 *pcm, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i peak = zero;
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pcm + i));
+        peak = _mm256_max_epi16(peak, _mm256_abs_epi16(_mm256_max_epi16(x, _mm256_set1_epi16(-32767))));
+    }
+
+    __m128i folded = _mm_max_epi16(_mm256_castsi256_si128(peak), _mm256_extracti128_si256(peak, 1));
+    folded = _mm_max_epi16(folded, _mm_srli_si128(folded, 8));
+    folded = _mm_max_epi16(folded, _mm_srli_si128(folded, 4));
+    folded = _mm_max_epi16(folded, _mm_srli_si128(folded, 2));
+
+    return qMax(_mm_extract_epi16(folded, 0), peakScalar(pcm + i, count - i));
+}
+
+#endif
+
+struct Kernels {
+    void (*mix)(opus_int16 *, const opus_int16 *, int);
+    int (*peak)(const opus_int16 *, int);
+    const char *name;
+};
+
+Kernels selectKernels()
+{
+#ifdef AUDIOMIXER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { mixAvx2, peakAvx2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { mixSse2, peakSse2, "sse2" };
+#endif
+    return { mixScalar, peakScalar, "scalar" };
+}
+
+const Kernels kernels = selectKernels();
+
+// Where each channel of an n-channel Opus layout sits, indexed by n - 1: the
+// front pair comes first of its side, 'C' is centre and 'E' the LFE.
+const char *const channelRoles[] = { "C", "LR", "LCR", "LRLR", "LCRLR", "LCRLRE", "LCRLRCE", "LCRLRLRE" };
+const int maxRemixChannels = 8;
+
+opus_int16 saturate(float value)
+{
+    return static_cast<opus_int16>(qBound(-32768, qRound(value), 32767));
+}
+
+// Front channels at full weight, centre and surrounds at -3 dB, scaled so a
+// full-scale signal on every channel does not clip.
+void downmixToStereo(const opus_int16 *source, int channels, float *left, float *right, int frames)
+{
+    const char *roles = channelRoles[channels - 1];
+    float leftWeights[maxRemixChannels];
+    float rightWeights[maxRemixChannels];
+    float leftTotal = 0.0f;
+    bool haveFrontLeft = false;
+    bool haveFrontRight = false;
+    for (int channel = 0; channel < channels; ++channel) {
+        leftWeights[channel] = 0.0f;
+        rightWeights[channel] = 0.0f;
+        switch (roles[channel]) {
+        case 'L':
+            leftWeights[channel] = haveFrontLeft ? 0.7071f : 1.0f;
+            haveFrontLeft = true;
+            break;
+        case 'R':
+            rightWeights[channel] = haveFrontRight ? 0.7071f : 1.0f;
+            haveFrontRight = true;
+            break;
+        case 'C':
+            leftWeights[channel] = 0.7071f;
+            rightWeights[channel] = 0.7071f;
+            break;
+        default:
+            break;
+        }
+        leftTotal += leftWeights[channel];
+    }
+
+    const float scale = leftTotal > 0.0f ? 1.0f / leftTotal : 1.0f;
+    for (int i = 0; i < frames; ++i) {
+        float l = 0.0f;
+        float r = 0.0f;
+        for (int channel = 0; channel < channels; ++channel) {
+            l += source[channel] * leftWeights[channel];
+            r += source[channel] * rightWeights[channel];
+        }
+        left[i] = l * scale;
+        right[i] = r * scale;
+        source += channels;
+    }
+}
+
+void stereoToLayout(const float *left, const float *right, opus_int16 *destination, int channels, int frames)
+{
+    const char *roles = channelRoles[channels - 1];
+    const int leftChannel = static_cast<int>(std::strchr(roles, 'L') - roles);
+    const int rightChannel = static_cast<int>(std::strchr(roles, 'R') - roles);
+
+    std::memset(destination, 0, static_cast<size_t>(frames) * channels * sizeof(opus_int16));
+    for (int i = 0; i < frames; ++i) {
+        destination[leftChannel] = saturate(left[i]);
+        destination[rightChannel] = saturate(right[i]);
+        destination += channels;
+    }
+}
+
+}
+
+void AudioMixer::mix(opus_int16 *destination, const opus_int16 *source, int count)
+{
+    kernels.mix(destination, source, count);
+}
+
+int AudioMixer::peak(const opus_int16 *pcm, int count)
+{
+    return kernels.peak(pcm, count);
+}
+
+bool AudioMixer::isSilent(const opus_int16 *pcm, int count)
+{
+    return kernels.peak(pcm, count) < silenceThreshold;
+}
+
+void AudioMixer::remix(const opus_int16 *source, int sourceChannels,
+                       opus_int16 *destination, int destinationChannels, int frames)
+{
+    if (sourceChannels == destinationChannels) {
+        std::memcpy(destination, source, static_cast<size_t>(frames) * sourceChannels * sizeof(opus_int16));
+        return;
+    }
+
+    if (sourceChannels == 1) {
+        for (int i = 0; i < frames; ++i) {
+            for (int channel = 0; channel < destinationChannels; ++channel) {
+                *destination++ = source[i];
+            }
+        }
+        return;
+    }
+
+    if (destinationChannels == 1) {
+        for (int i = 0; i < frames; ++i) {
+            int sum = 0;
+            for (int channel = 0; channel < sourceChannels; ++channel) {
+                sum += *source++;
+            }
+            destination[i] = static_cast<opus_int16>(sum / sourceChannels);
+        }
+        return;
+    }
+
+    // Everything else goes through stereo, a block at a time so the scratch stays on the stack.
+    const int blockFrames = 256;
+    float left[blockFrames];
+    float right[blockFrames];
+    for (int done = 0; done < frames; done += blockFrames) {
+        const int count = qMin(blockFrames, frames - done);
+        const opus_int16 *in = source + static_cast<size_t>(done) * sourceChannels;
+        opus_int16 *out = destination + static_cast<size_t>(done) * destinationChannels;
+
+        if (sourceChannels == 2) {
+            for (int i = 0; i < count; ++i) {
+                left[i] = in[2 * i];
+                right[i] = in[2 * i + 1];
+            }
+        } else {
+            downmixToStereo(in, sourceChannels, left, right, count);
+        }
+
+        if (destinationChannels == 2) {
+            for (int i = 0; i < count; ++i) {
+                out[2 * i] = saturate(left[i]);
+                out[2 * i + 1] = saturate(right[i]);
+            }
+        } else {
+            stereoToLayout(left, right, out, destinationChannels, count);
+        }
+    }
+}
+
+const char *AudioMixer::implementation()
+{
+    return kernels.name;
+}
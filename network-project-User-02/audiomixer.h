@@ -0,0 +1,29 @@
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <opus.h>
+
+// Saturating int16 kernels for summing decoded peer frames. The SSE2 or AVX2
+// variant is picked once at startup; other targets use the scalar loop.
+// remix() is scalar: it only runs for streams whose layout differs from playout's.
+class AudioMixer
+{
+public:
+    static void mix(opus_int16 *destination, const opus_int16 *source, int count);
+    static int peak(const opus_int16 *pcm, int count);
+    static bool isSilent(const opus_int16 *pcm, int count);
+
+    // Interleaved frames from one channel count to another, in Opus channel
+    // order (see OpusLayout). Mono is copied to every channel and averaged
+    // from them; surround is folded down to stereo with the LFE left out, and
+    // stereo goes to the front pair. source and destination must not overlap.
+    static void remix(const opus_int16 *source, int sourceChannels,
+                      opus_int16 *destination, int destinationChannels, int frames);
+
+    static const char *implementation();
+
+    // About -60 dBFS; frames whose peak stays below this are left out of the mix.
+    static const int silenceThreshold = 32;
+};
+
+#endif
@@ -1,20 +1,23 @@
 #include "audiooutput.h"
-#include <QAudioFormat>
-#include <QMediaDevices>
 #include <QDebug>
-
+#include "audiomixer.h"
+#include "captureprocessing.h"
+#include "qtaudiobackend.h"
+#include "tracing.h"
+#include <cstring>
 
 AudioOutput::AudioOutput(QObject *parent)
     : QIODevice(parent),
-    m_audioSink(nullptr),
-    m_audioOutputDevice(nullptr),
-    m_opusDecoder(nullptr)
+    m_playoutBackend(new QtPlayoutBackend(this)),
+    m_playoutRing(AudioStream::maxFrameSize * 4 * maxChannels)
 {
-    initializeAudio();
-    initializeOpusDecoder();
-
+    m_streamPcm.fill(0, AudioStream::maxFrameSize * OpusLayout::maxChannels);
+    m_remixPcm.fill(0, AudioStream::maxFrameSize * maxChannels);
+    m_mixPcm.fill(0, AudioStream::maxFrameSize * maxChannels);
 
-    connect(this, &AudioOutput::newPacket, this, &AudioOutput::play);
+    m_playoutTimer.setTimerType(Qt::PreciseTimer);
+    m_playoutTimer.setInterval(10);
+    connect(&m_playoutTimer, &QTimer::timeout, this, &AudioOutput::play);
 }
 
 
@@ -24,156 +27,314 @@ AudioOutput::~AudioOutput()
 }
 
 
-void AudioOutput::initializeAudio()
+void AudioOutput::cleanup()
 {
+    m_playoutTimer.stop();
+
+    if (m_playoutBackend) {
+        m_playoutBackend->stop();
+        delete m_playoutBackend;
+        m_playoutBackend = nullptr;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    qDeleteAll(m_streams);
+    m_streams.clear();
+    m_haveStreams.store(false, std::memory_order_relaxed);
+
+    QMutexLocker statisticsLocker(&m_statisticsMutex);
+    m_streamStatistics.clear();
+}
 
-    QAudioFormat format;
-    format.setSampleRate(48000);
-    format.setChannelCount(1);
-    format.setSampleFormat(QAudioFormat::Int16);
 
+bool AudioOutput::open(QIODevice::OpenMode mode)
+{
+    if (!QIODevice::open(mode | QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return false;
 
-    QAudioDevice defaultAudioOutput = QMediaDevices::defaultAudioOutput();
+    m_playoutRing.clear();
+    m_playoutTimer.start();
 
+    if (!m_playoutBackend)
+        return true;
 
-    m_audioSink = new QAudioSink(defaultAudioOutput, format, this);
-    if (!m_audioSink) {
-        qWarning() << "Failed to initialize audio sink";
+    m_playoutBackend->setChannelCount(m_channels);
+    // Pull mode: the backend calls readData() whenever it needs samples, possibly from its own thread.
+    if (!m_playoutBackend->start(this)) {
+        qWarning() << "Failed to start audio playout backend";
+        m_playoutTimer.stop();
+        QIODevice::close();
+        return false;
     }
-}
 
+    return true;
+}
 
-void AudioOutput::initializeOpusDecoder()
+void AudioOutput::close()
 {
+    m_playoutTimer.stop();
+
+    if (m_playoutBackend)
+        m_playoutBackend->stop();
 
-    int error;
-    m_opusDecoder = opus_decoder_create(48000, 1, &error);
-    if (error != OPUS_OK) {
-        qWarning() << "Failed to initialize Opus decoder with error code:" << error;
-        m_opusDecoder = nullptr;
+    QMutexLocker locker(&m_mutex);
+    for (AudioStream *stream : std::as_const(m_streams)) {
+        stream->reset();
     }
-}
+    locker.unlock();
 
+    QIODevice::close();
+}
 
-void AudioOutput::cleanup()
+void AudioOutput::setPlayoutBackend(AudioPlayoutBackend *backend)
 {
+    if (m_playoutBackend)
+        m_playoutBackend->stop();
+    delete m_playoutBackend;
 
-    if (m_audioSink) {
-        m_audioSink->stop();
-        delete m_audioSink;
-        m_audioSink = nullptr;
-    }
+    m_playoutBackend = backend;
+    if (m_playoutBackend)
+        m_playoutBackend->setParent(this);
+}
 
-    if (m_opusDecoder) {
-        opus_decoder_destroy(m_opusDecoder);
-        m_opusDecoder = nullptr;
+void AudioOutput::addData(const QString &peerId, quint16 sequence, quint32 timestamp, quint8 payloadType,
+                          qint64 arrivalNs, const char *payload, int size)
+{
+    QMutexLocker locker(&m_mutex);
+    AudioStream *&stream = m_streams[peerId];
+    if (!stream) {
+        const AudioStream::PayloadLayouts layouts = streamLayouts(peerId);
+        stream = new AudioStream(sampleRate, frameSize, layouts.value(payloadType));
+        stream->setPayloadLayouts(layouts);
+        m_haveStreams.store(true, std::memory_order_relaxed);
+
+        QMutexLocker statisticsLocker(&m_statisticsMutex);
+        m_streamStatistics.insert(peerId, stream->publishedStatistics());
     }
+
+    stream->insertPacket(sequence, timestamp, payloadType, arrivalNs, payload, size);
 }
 
+void AudioOutput::removePeer(const QString &peerId)
+{
+    QMutexLocker locker(&m_mutex);
+    delete m_streams.take(peerId);
+    m_streamLayouts.remove(peerId);
+    m_haveStreams.store(!m_streams.isEmpty(), std::memory_order_relaxed);
 
-bool AudioOutput::open(QIODevice::OpenMode mode)
+    QMutexLocker statisticsLocker(&m_statisticsMutex);
+    m_streamStatistics.remove(peerId);
+}
+
+void AudioOutput::setStreamLayouts(const QString &peerId, const AudioStream::PayloadLayouts &layouts)
 {
-    if (!QIODevice::open(mode))
+    QMutexLocker locker(&m_mutex);
+    m_streamLayouts.insert(peerId, layouts);
+
+    const QString streamPrefix = peerId + '#';
+    for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+        if (it.key() == peerId || it.key().startsWith(streamPrefix))
+            it.value()->setPayloadLayouts(layouts);
+    }
+}
+
+bool AudioOutput::setChannels(int channels)
+{
+    if (channels < 1 || channels > maxChannels) {
+        qWarning() << "Unsupported playout channel count:" << channels;
         return false;
+    }
 
-    m_audioOutputDevice = m_audioSink->start();
-    if (!m_audioOutputDevice) {
-        qWarning() << "Failed to start audio output device";
+    if (isOpen()) {
+        qWarning() << "Playout channel count cannot be changed while playing";
         return false;
     }
 
+    m_channels = channels;
     return true;
 }
 
-void AudioOutput::addData(const QByteArray &encodedData)
+int AudioOutput::channels() const
 {
-    QMutexLocker locker(&m_mutex);
-    m_audioQueue.enqueue(encodedData);
-    emit newPacket();
+    return m_channels;
+}
+
+AudioStream::PayloadLayouts AudioOutput::streamLayouts(const QString &streamName) const
+{
+    return m_streamLayouts.value(streamName.section('#', 0, 0));
 }
 
 
 void AudioOutput::play()
 {
+    Q_EMIT playoutTick();
+
     QMutexLocker locker(&m_mutex);
 
 
-    if (m_audioQueue.isEmpty() || !m_opusDecoder || !m_audioOutputDevice) {
+    if (!isOpen()) {
         logPlaybackIssues();
         return;
     }
 
-    QByteArray packet = m_audioQueue.dequeue();
-    processPacket(packet);
+    // Keep about two frames mixed ahead of the sink; the jitter buffers hold the rest.
+    while (m_playoutRing.available() < frameSize * 2 * m_channels) {
+        if (!mixNextFrame())
+            break;
+    }
+    TRACE_COUNTER(Playout, "playoutRingFill", m_playoutRing.available());
 }
 
 
-void AudioOutput::processPacket(const QByteArray &packet)
+// Pulls one frame from every peer and sums the audible ones. Returns false when
+// no peer had anything to play, so the sink underruns into silence instead.
+bool AudioOutput::mixNextFrame()
 {
-    QByteArray decodedData;
-    decodeAudioData(packet, decodedData);
+    TRACE_SCOPE(Playout, "mix");
+
+    int mixedSamples = 0;
+    int activeStreams = 0;
+
+    for (AudioStream *stream : std::as_const(m_streams)) {
+        const int frames = stream->decodeNextFrame(m_streamPcm.data());
+        if (frames <= 0)
+            continue;
 
-    if (!decodedData.isEmpty() && m_audioOutputDevice) {
-        qint64 bytesWritten = m_audioOutputDevice->write(decodedData);
-        if (bytesWritten != decodedData.size()) {
-            qWarning() << "Failed to write all decoded data to audio output device";
+        ++activeStreams;
+        if (AudioMixer::isSilent(m_streamPcm.constData(), frames * stream->channels()))
+            continue;
+
+        const opus_int16 *pcm = m_streamPcm.constData();
+        if (stream->channels() != m_channels) {
+            AudioMixer::remix(pcm, stream->channels(), m_remixPcm.data(), m_channels, frames);
+            pcm = m_remixPcm.constData();
+        }
+
+        const int samples = frames * m_channels;
+        if (mixedSamples == 0) {
+            std::memcpy(m_mixPcm.data(), pcm, samples * sizeof(opus_int16));
+            mixedSamples = samples;
+        } else {
+            if (samples > mixedSamples) {
+                std::memset(m_mixPcm.data() + mixedSamples, 0, (samples - mixedSamples) * sizeof(opus_int16));
+                mixedSamples = samples;
+            }
+            AudioMixer::mix(m_mixPcm.data(), pcm, samples);
         }
-    } else {
-        qWarning() << "Failed to write decoded data to audio output device";
     }
-}
 
+    if (activeStreams == 0)
+        return false;
 
-void AudioOutput::decodeAudioData(const QByteArray &packet, QByteArray &decodedData)
-{
-    if (!m_opusDecoder) {
-        qWarning() << "Opus decoder is not initialized";
-        return;
+    if (mixedSamples == 0) {
+        mixedSamples = frameSize * m_channels;
+        std::memset(m_mixPcm.data(), 0, mixedSamples * sizeof(opus_int16));
     }
 
-    int maxFrameSize = 480;
-    decodedData.resize(maxFrameSize * 2);
+    writePcm(m_mixPcm.constData(), mixedSamples);
+    return true;
+}
 
-    int frameSize = opus_decode(m_opusDecoder,
-                                reinterpret_cast<const unsigned char*>(packet.data()),
-                                static_cast<opus_int32>(packet.size()),
-                                reinterpret_cast<opus_int16*>(decodedData.data()),
-                                maxFrameSize, 0);
 
-    if (frameSize < 0) {
-        qWarning() << "Opus decoding error:" << opus_strerror(frameSize);
-        decodedData.clear();
-        return;
+void AudioOutput::writePcm(const opus_int16 *pcm, int samples)
+{
+    const int written = m_playoutRing.write(pcm, samples);
+    if (written < samples) {
+        m_overruns.fetch_add(1, std::memory_order_relaxed);
+        TRACE_INSTANT(Playout, "overrun", samples - written);
     }
-
-    decodedData.resize(frameSize * 2);
 }
 
 
 void AudioOutput::logPlaybackIssues() const
 {
-    if (m_audioQueue.isEmpty()) {
-        qDebug() << "Audio queue is empty";
+    if (!isOpen()) {
+        TRACE_WARNING(Playout) << "Audio output device is not available";
     }
-    if (!m_opusDecoder) {
-        qWarning() << "Opus decoder is not initialized";
-    }
-    if (!m_audioOutputDevice) {
-        qWarning() << "Audio output device is not available";
+}
+
+
+void AudioOutput::setEchoReference(EchoCanceller *echoCanceller)
+{
+    m_echoReference.store(echoCanceller, std::memory_order_release);
+}
+
+
+AudioStream::Statistics AudioOutput::streamStatistics(const QString &peerId) const
+{
+    const QString streamPrefix = peerId + '#';
+    AudioStream::Statistics total;
+
+    QMutexLocker locker(&m_statisticsMutex);
+    for (auto it = m_streamStatistics.constBegin(); it != m_streamStatistics.constEnd(); ++it) {
+        if (it.key() != peerId && !it.key().startsWith(streamPrefix))
+            continue;
+
+        const AudioStream::Statistics stream = it.value()->load();
+        total.jitterBufferDepth = qMax(total.jitterBufferDepth, stream.jitterBufferDepth);
+        total.jitterBufferTargetDepth = qMax(total.jitterBufferTargetDepth, stream.jitterBufferTargetDepth);
+        total.jitterMs = qMax(total.jitterMs, stream.jitterMs);
+        total.latePackets += stream.latePackets;
+        total.discardedPackets += stream.discardedPackets;
+        total.recoveredFrames += stream.recoveredFrames;
+        total.concealedFrames += stream.concealedFrames;
+        total.comfortNoiseFrames += stream.comfortNoiseFrames;
     }
+    return total;
+}
+
+
+quint64 AudioOutput::underruns() const
+{
+    return m_underruns.load(std::memory_order_relaxed);
+}
+
+
+quint64 AudioOutput::overruns() const
+{
+    return m_overruns.load(std::memory_order_relaxed);
 }
 
 
+// Runs on the audio thread: no locks, no allocation, and always a full buffer.
 qint64 AudioOutput::readData(char *data, qint64 maxlen)
 {
-    Q_UNUSED(data)
-    Q_UNUSED(maxlen)
-    return -1;
+    // Whole frames only, so the echo reference gets every sample it is handed.
+    const int wanted = static_cast<int>(maxlen / 2) / m_channels * m_channels;
+    opus_int16 *pcm = reinterpret_cast<opus_int16*>(data);
+
+    const int samplesRead = m_playoutRing.read(pcm, wanted);
+    if (samplesRead < wanted) {
+        std::memset(pcm + samplesRead, 0, (wanted - samplesRead) * sizeof(opus_int16));
+        if (m_haveStreams.load(std::memory_order_relaxed)) {
+            m_underruns.fetch_add(1, std::memory_order_relaxed);
+            TRACE_INSTANT(Playout, "underrun", wanted - samplesRead);
+        }
+    }
+
+    // Underrun silence included: it is what the speaker plays.
+    if (EchoCanceller *echoCanceller = m_echoReference.load(std::memory_order_acquire))
+        echoCanceller->feedReference(pcm, wanted / m_channels, m_channels);
+
+    return wanted * 2;
+}
+
+
+bool AudioOutput::isSequential() const
+{
+    return true;
+}
+
+
+qint64 AudioOutput::bytesAvailable() const
+{
+    return m_playoutRing.available() * 2 + QIODevice::bytesAvailable();
 }
 
 
 qint64 AudioOutput::writeData(const char *data, qint64 len)
 {
-    addData(QByteArray(data, static_cast<int>(len)));
-    return len;
+    Q_UNUSED(data)
+    Q_UNUSED(len)
+    return -1;
 }
@@ -2,11 +2,18 @@
 #define AUDIOOUTPUT_H
 
 #include <QIODevice>
-#include <QAudioSink>
 #include <QByteArray>
 #include <QMutex>
-#include <QQueue>
+#include <QTimer>
+#include <QHash>
+#include <QVector>
 #include <opus.h>
+#include <atomic>
+#include "audiobackend.h"
+#include "audiostream.h"
+#include "spscringbuffer.h"
+
+class EchoCanceller;
 
 class AudioOutput : public QIODevice
 {
@@ -16,49 +23,92 @@ public:
     ~AudioOutput();
 
 
-    void addData(const QByteArray& encodedData);
+    void addData(const QString &peerId, quint16 sequence, quint32 timestamp, quint8 payloadType,
+                 qint64 arrivalNs, const char *payload, int size);
+    void removePeer(const QString &peerId);
+
+    // The decoder layout for each payload type a peer's streams use, including the
+    // "peerId#ssrc" ones an SFU forwards. Running streams switch at their next packet.
+    void setStreamLayouts(const QString &peerId, const AudioStream::PayloadLayouts &layouts);
+
+    // Playout channels, mono or stereo; set before open(). Streams with other
+    // layouts are remixed to it, surround folded down to stereo.
+    bool setChannels(int channels);
+    int channels() const;
 
 
     qint64 readData(char *data, qint64 maxlen) override;
     qint64 writeData(const char *data, qint64 len) override;
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
 
 
     bool open(QIODevice::OpenMode mode) override;
+    void close() override;
 
-signals:
+    // Takes ownership; takes effect at the next open(). With nullptr, playout is
+    // left to whoever reads this device.
+    void setPlayoutBackend(AudioPlayoutBackend *backend);
 
-    void newPacket();
 
-private slots:
-
-    void play();
+    // Everything the sink takes from readData() is also fed to echoCanceller as
+    // its reference. It must outlive playout, or be unset first.
+    void setEchoReference(EchoCanceller *echoCanceller);
 
-private:
+    // Any thread; reads what the streams published, without the playout lock.
+    // A peer's "peerId#ssrc" streams, one per SFU slot, are summed into its own:
+    // counters add up, depths and jitter are the worst of them.
+    AudioStream::Statistics streamStatistics(const QString &peerId) const;
+    quint64 underruns() const;
+    quint64 overruns() const;
 
-    void initializeAudio();
+signals:
+    // Every playout tick, on the thread that owns this object, before anything
+    // is mixed; whatever addData() gets in a handler is played out this tick.
+    void playoutTick();
 
+private slots:
 
-    void initializeOpusDecoder();
+    void play();
 
+private:
 
     void cleanup();
 
 
-    void processPacket(const QByteArray &packet);
+    bool mixNextFrame();
 
-    void decodeAudioData(const QByteArray &packet, QByteArray &decodedData);
+    void writePcm(const opus_int16 *pcm, int samples);
+    AudioStream::PayloadLayouts streamLayouts(const QString &streamName) const;
 
     void logPlaybackIssues() const;
 
 
-    QAudioSink* m_audioSink;
-    QIODevice* m_audioOutputDevice;
-    OpusDecoder* m_opusDecoder;
+    const int sampleRate = 48000;
+    const int frameSize = 960;
+    static const int maxChannels = 2;
+    int m_channels = 1;
+
+    AudioPlayoutBackend* m_playoutBackend;
+
+    mutable QMutex m_mutex;
 
-    QAudioFormat m_audioFormat;
-    QMutex m_mutex;
+    QHash<QString, AudioStream*> m_streams;
+    QHash<QString, AudioStream::PayloadLayouts> m_streamLayouts;
+    // Only held to add or remove a stream and to read; play() never takes it.
+    mutable QMutex m_statisticsMutex;
+    QHash<QString, std::shared_ptr<const AudioStream::PublishedStatistics>> m_streamStatistics;
+    QVector<opus_int16> m_streamPcm;
+    QVector<opus_int16> m_remixPcm;
+    QVector<opus_int16> m_mixPcm;
 
-    QQueue<QByteArray> m_audioQueue;
+    SpscRingBuffer<opus_int16> m_playoutRing;
+    std::atomic<EchoCanceller*> m_echoReference{nullptr};
+    std::atomic<quint64> m_underruns{0};
+    // Whether anybody is playing; an empty ring is only an underrun then.
+    std::atomic<bool> m_haveStreams{false};
+    std::atomic<quint64> m_overruns{0};
+    QTimer m_playoutTimer;
 };
 
 #endif
@@ -0,0 +1,426 @@
+#include "audiostream.h"
+#include <QDebug>
+#include <QtMath>
+#include <algorithm>
+#include "tracing.h"
+
+namespace {
+
+// One frame length from an Opus packet header: one byte below 252, otherwise two.
+bool readFrameLength(const unsigned char *data, int size, int *position, int *length)
+{
+    if (*position >= size)
+        return false;
+    if (data[*position] < 252) {
+        *length = data[(*position)++];
+        return true;
+    }
+    if (*position + 1 >= size)
+        return false;
+    *length = data[*position] + 4 * data[*position + 1];
+    *position += 2;
+    return true;
+}
+
+// Finds the first frame of one Opus packet and how many bytes the packet takes,
+// after RFC 6716 section 3.2. Every stream of a multistream packet but the last
+// uses the self-delimiting framing of its appendix B, which adds one more
+// frame length to the header. False when the packet is malformed.
+bool parseOpusPacket(const unsigned char *data, int size, bool selfDelimited,
+                     int *firstFrameOffset, int *firstFrameSize, int *packetSize)
+{
+    if (size < 1)
+        return false;
+
+    int position = 1;
+    int firstFrame = 0;
+    int framesSize = 0;
+    int padding = 0;
+
+    switch (data[0] & 0x3) {
+    case 0:
+        if (selfDelimited) {
+            if (!readFrameLength(data, size, &position, &firstFrame))
+                return false;
+        } else {
+            firstFrame = size - position;
+        }
+        framesSize = firstFrame;
+        break;
+    case 1:
+        if (selfDelimited) {
+            if (!readFrameLength(data, size, &position, &firstFrame))
+                return false;
+        } else {
+            if ((size - position) % 2 != 0)
+                return false;
+            firstFrame = (size - position) / 2;
+        }
+        framesSize = 2 * firstFrame;
+        break;
+    case 2: {
+        if (!readFrameLength(data, size, &position, &firstFrame))
+            return false;
+        int secondFrame = size - position - firstFrame;
+        if (selfDelimited && !readFrameLength(data, size, &position, &secondFrame))
+            return false;
+        framesSize = firstFrame + secondFrame;
+        break;
+    }
+    default: {
+        if (position >= size)
+            return false;
+        const unsigned char frameCount = data[position++];
+        const int count = frameCount & 0x3f;
+        const bool variable = frameCount & 0x80;
+        if (count == 0)
+            return false;
+
+        if (frameCount & 0x40) {
+            unsigned char paddingByte;
+            do {
+                if (position >= size)
+                    return false;
+                paddingByte = data[position++];
+                padding += paddingByte == 255 ? 254 : paddingByte;
+            } while (paddingByte == 255);
+        }
+
+        int lastFrame = 0;
+        if (variable) {
+            for (int i = 0; i < count - 1; ++i) {
+                int length;
+                if (!readFrameLength(data, size, &position, &length))
+                    return false;
+                if (i == 0)
+                    firstFrame = length;
+                framesSize += length;
+            }
+        }
+        if (selfDelimited) {
+            if (!readFrameLength(data, size, &position, &lastFrame))
+                return false;
+        } else if (variable) {
+            lastFrame = size - position - padding - framesSize;
+        } else {
+            if ((size - position - padding) % count != 0)
+                return false;
+            lastFrame = (size - position - padding) / count;
+        }
+
+        if (variable) {
+            if (count == 1)
+                firstFrame = lastFrame;
+            framesSize += lastFrame;
+        } else {
+            firstFrame = lastFrame;
+            framesSize = count * lastFrame;
+        }
+        break;
+    }
+    }
+
+    if (firstFrame < 0 || position + framesSize + padding > size)
+        return false;
+
+    *firstFrameOffset = position;
+    *firstFrameSize = firstFrame;
+    *packetSize = selfDelimited ? position + framesSize + padding : size;
+    return true;
+}
+
+// Whether the packet's first frame carries LBRR data, which only SILK and
+// hybrid frames can. The flags are the first bits SILK codes: after one VAD
+// flag per 20 ms, one LBRR flag per channel.
+bool hasLbrr(const unsigned char *data, int frameOffset, int frameSize)
+{
+    const int config = data[0] >> 3;
+    if (config >= 16 || frameSize == 0)
+        return false;
+
+    const int silkFrames = qMax(1, opus_packet_get_samples_per_frame(data, 48000) / 960);
+    const unsigned char header = data[frameOffset];
+    bool lbrr = (header >> (7 - silkFrames)) & 0x1;
+    if (opus_packet_get_nb_channels(data) == 2)
+        lbrr = lbrr || ((header >> (6 - 2 * silkFrames)) & 0x1);
+    return lbrr;
+}
+
+}
+
+AudioStream::AudioStream(int sampleRate, int frameSize, const OpusLayout &layout)
+    : m_sampleRate(sampleRate),
+    m_opusDecoder(nullptr),
+    m_jitterBuffer(sampleRate, frameSize),
+    m_lastFrameSize(frameSize)
+{
+    createDecoder(layout);
+
+    m_packet.reserve(1500);
+    m_fecPacket.reserve(1500);
+}
+
+AudioStream::~AudioStream()
+{
+    if (m_opusDecoder) {
+        opus_multistream_decoder_destroy(m_opusDecoder);
+        m_opusDecoder = nullptr;
+    }
+}
+
+// A multistream decoder's streams and mapping are fixed when it is created, so
+// a new layout needs a new decoder rather than a reset.
+void AudioStream::createDecoder(const OpusLayout &layout)
+{
+    if (m_opusDecoder) {
+        opus_multistream_decoder_destroy(m_opusDecoder);
+        m_opusDecoder = nullptr;
+    }
+    m_layout = layout;
+
+    int error = OPUS_BAD_ARG;
+    if (layout.isValid()) {
+        m_opusDecoder = opus_multistream_decoder_create(m_sampleRate, layout.channels, layout.streams, layout.coupledStreams,
+                                                        layout.mapping.constData(), &error);
+    }
+    if (error != OPUS_OK) {
+        qWarning() << "Failed to initialize Opus decoder with error code:" << error;
+        m_opusDecoder = nullptr;
+    }
+}
+
+bool AudioStream::decodesWithCurrentLayout(int payloadType) const
+{
+    auto it = m_payloadLayouts.constFind(payloadType);
+    return it == m_payloadLayouts.constEnd() || it.value() == m_layout;
+}
+
+bool AudioStream::isValid() const
+{
+    return m_opusDecoder != nullptr;
+}
+
+OpusLayout AudioStream::layout() const
+{
+    return m_layout;
+}
+
+int AudioStream::channels() const
+{
+    return m_layout.channels;
+}
+
+void AudioStream::setPayloadLayouts(const PayloadLayouts &layouts)
+{
+    m_payloadLayouts = layouts;
+}
+
+void AudioStream::insertPacket(quint16 sequence, quint32 timestamp, quint8 payloadType, qint64 arrivalNs,
+                               const char *payload, int size)
+{
+    m_jitterBuffer.insert(sequence, timestamp, payloadType, arrivalNs, payload, size);
+}
+
+// Returns the number of samples per channel written to pcm, or 0 when the stream has nothing to play.
+int AudioStream::decodeNextFrame(opus_int16 *pcm)
+{
+    int samples = 0;
+    int payloadType = 0;
+    switch (m_jitterBuffer.pop(m_packet, &payloadType)) {
+    case JitterBuffer::PopResult::Packet:
+        if (!decodesWithCurrentLayout(payloadType))
+            createDecoder(m_payloadLayouts.value(payloadType));
+        samples = qMax(0, decodeAudioData(m_packet, pcm));
+        if (samples > 0) {
+            m_started = true;
+            trackNoiseLevel(pcm, samples * m_layout.channels);
+        }
+        break;
+    case JitterBuffer::PopResult::Lost:
+        samples = qMax(0, concealAudioData(pcm));
+        break;
+    case JitterBuffer::PopResult::Empty:
+        if (m_started)
+            samples = generateComfortNoise(pcm);
+        break;
+    }
+
+    publishStatistics();
+    return samples;
+}
+
+void AudioStream::reset()
+{
+    m_jitterBuffer.reset();
+    m_started = false;
+    m_noiseLevel = 0.0;
+    m_noiseState = 0.0;
+    if (m_opusDecoder)
+        opus_multistream_decoder_ctl(m_opusDecoder, OPUS_RESET_STATE);
+    publishStatistics();
+}
+
+int AudioStream::decodeAudioData(const QByteArray &packet, opus_int16 *pcm)
+{
+    if (!m_opusDecoder) {
+        TRACE_WARNING(Codec) << "Opus decoder is not initialized";
+        return -1;
+    }
+
+    int frameSize = opus_multistream_decode(m_opusDecoder,
+                                            reinterpret_cast<const unsigned char*>(packet.data()),
+                                            static_cast<opus_int32>(packet.size()),
+                                            pcm, maxFrameSize, 0);
+
+    if (frameSize < 0) {
+        TRACE_WARNING(Codec) << "Opus decoding error:" << opus_strerror(frameSize);
+        return frameSize;
+    }
+
+    m_lastFrameSize = frameSize;
+    return frameSize;
+}
+
+int AudioStream::concealAudioData(opus_int16 *pcm)
+{
+    if (!m_opusDecoder)
+        return -1;
+
+    // The lost frame must be rebuilt at its own duration, which we take from the last good one.
+    // Without LBRR data in the next packet, a FEC decode would only run PLC, so
+    // it is not attempted and the frame counts as concealed. Neither is it when
+    // the next packet needs another decoder, which has no history to recover into.
+    int result;
+    int payloadType = 0;
+    const bool recoverable = m_jitterBuffer.peekNext(m_fecPacket, &payloadType)
+                             && decodesWithCurrentLayout(payloadType) && packetHasLbrr(m_fecPacket);
+    if (recoverable) {
+        result = opus_multistream_decode(m_opusDecoder,
+                                         reinterpret_cast<const unsigned char*>(m_fecPacket.constData()),
+                                         static_cast<opus_int32>(m_fecPacket.size()),
+                                         pcm, m_lastFrameSize, 1);
+    } else {
+        result = opus_multistream_decode(m_opusDecoder, nullptr, 0, pcm, m_lastFrameSize, 0);
+    }
+
+    if (result < 0) {
+        TRACE_WARNING(Codec) << "Opus concealment error:" << opus_strerror(result);
+        return result;
+    }
+
+    if (recoverable) {
+        ++m_recoveredFrames;
+        TRACE_INSTANT(Playout, "recoveredFrame", result);
+    } else {
+        ++m_concealedFrames;
+        TRACE_INSTANT(Playout, "concealedFrame", result);
+    }
+
+    return result;
+}
+
+// A multistream packet has one Opus packet per stream; the decoder recovers
+// from whichever streams carry LBRR data and conceals the rest.
+bool AudioStream::packetHasLbrr(const QByteArray &packet) const
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char*>(packet.constData());
+    int remaining = packet.size();
+    for (int stream = 0; stream < m_layout.streams; ++stream) {
+        int frameOffset, frameSize, packetSize;
+        if (!parseOpusPacket(data, remaining, stream < m_layout.streams - 1, &frameOffset, &frameSize, &packetSize))
+            return false;
+        if (hasLbrr(data, frameOffset, frameSize))
+            return true;
+        data += packetSize;
+        remaining -= packetSize;
+    }
+    return false;
+}
+
+int AudioStream::generateComfortNoise(opus_int16 *pcm)
+{
+    const int samples = m_lastFrameSize * m_layout.channels;
+    if (m_noiseLevel < 1.0) {
+        std::fill(pcm, pcm + samples, opus_int16(0));
+    } else {
+        // White noise through a one-pole lowpass; the gain keeps the output RMS near m_noiseLevel.
+        const double smoothing = 0.7;
+        const double gain = m_noiseLevel * qSqrt(3.0 * (1.0 + smoothing) / (1.0 - smoothing));
+        for (int i = 0; i < samples; ++i) {
+            m_noiseSeed ^= m_noiseSeed << 13;
+            m_noiseSeed ^= m_noiseSeed >> 17;
+            m_noiseSeed ^= m_noiseSeed << 5;
+            const double white = static_cast<qint32>(m_noiseSeed) / 2147483648.0;
+            m_noiseState = smoothing * m_noiseState + (1.0 - smoothing) * white;
+            pcm[i] = static_cast<opus_int16>(qBound(-32768.0, m_noiseState * gain, 32767.0));
+        }
+    }
+
+    ++m_comfortNoiseFrames;
+    return m_lastFrameSize;
+}
+
+// Follows the quietest decoded frames, so the estimate settles on background noise rather than speech.
+void AudioStream::trackNoiseLevel(const opus_int16 *pcm, int count)
+{
+    double sumOfSquares = 0.0;
+    for (int i = 0; i < count; ++i) {
+        sumOfSquares += static_cast<double>(pcm[i]) * pcm[i];
+    }
+    const double rms = qSqrt(sumOfSquares / count);
+
+    if (m_noiseLevel <= 0.0 || rms < m_noiseLevel)
+        m_noiseLevel = rms;
+    else
+        m_noiseLevel += (rms - m_noiseLevel) * 0.01;
+
+    // Cap the level so a peer that goes quiet mid-sentence is not followed by loud hiss.
+    const double maxComfortNoiseLevel = 300.0;
+    m_noiseLevel = qMin(m_noiseLevel, maxComfortNoiseLevel);
+}
+
+AudioStream::Statistics AudioStream::statistics() const
+{
+    Statistics stats;
+    stats.jitterBufferDepth = m_jitterBuffer.depth();
+    stats.jitterBufferTargetDepth = m_jitterBuffer.targetDepth();
+    stats.jitterMs = m_jitterBuffer.jitterMs();
+    stats.latePackets = m_jitterBuffer.latePackets();
+    stats.discardedPackets = m_jitterBuffer.discardedPackets();
+    stats.recoveredFrames = m_recoveredFrames;
+    stats.concealedFrames = m_concealedFrames;
+    stats.comfortNoiseFrames = m_comfortNoiseFrames;
+    return stats;
+}
+
+std::shared_ptr<const AudioStream::PublishedStatistics> AudioStream::publishedStatistics() const
+{
+    return m_published;
+}
+
+void AudioStream::publishStatistics()
+{
+    const Statistics stats = statistics();
+    m_published->jitterBufferDepth.store(stats.jitterBufferDepth, std::memory_order_relaxed);
+    m_published->jitterBufferTargetDepth.store(stats.jitterBufferTargetDepth, std::memory_order_relaxed);
+    m_published->jitterMs.store(stats.jitterMs, std::memory_order_relaxed);
+    m_published->latePackets.store(stats.latePackets, std::memory_order_relaxed);
+    m_published->discardedPackets.store(stats.discardedPackets, std::memory_order_relaxed);
+    m_published->recoveredFrames.store(stats.recoveredFrames, std::memory_order_relaxed);
+    m_published->concealedFrames.store(stats.concealedFrames, std::memory_order_relaxed);
+    m_published->comfortNoiseFrames.store(stats.comfortNoiseFrames, std::memory_order_relaxed);
+}
+
+AudioStream::Statistics AudioStream::PublishedStatistics::load() const
+{
+    Statistics stats;
+    stats.jitterBufferDepth = jitterBufferDepth.load(std::memory_order_relaxed);
+    stats.jitterBufferTargetDepth = jitterBufferTargetDepth.load(std::memory_order_relaxed);
+    stats.jitterMs = jitterMs.load(std::memory_order_relaxed);
+    stats.latePackets = latePackets.load(std::memory_order_relaxed);
+    stats.discardedPackets = discardedPackets.load(std::memory_order_relaxed);
+    stats.recoveredFrames = recoveredFrames.load(std::memory_order_relaxed);
+    stats.concealedFrames = concealedFrames.load(std::memory_order_relaxed);
+    stats.comfortNoiseFrames = comfortNoiseFrames.load(std::memory_order_relaxed);
+    return stats;
+}
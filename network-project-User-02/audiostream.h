@@ -0,0 +1,110 @@
+#ifndef AUDIOSTREAM_H
+#define AUDIOSTREAM_H
+
+#include <QByteArray>
+#include <QHash>
+#include <opus.h>
+#include <opus_multistream.h>
+#include <atomic>
+#include <memory>
+#include "jitterbuffer.h"
+#include "opuslayout.h"
+
+// Receive state for one remote peer: its own jitter buffer and Opus decoder,
+// so streams from different peers never share decoder history. The decoder
+// follows each packet's payload type: plain Opus and multiopus come under
+// different ones, and a sender falls back from multiopus to plain Opus when a
+// peer joins that cannot take it, so the decoder is rebuilt when the layout
+// changes. A mono or stereo decoder takes plain Opus packets with either
+// channel count and mixes them to its own.
+class AudioStream
+{
+public:
+    struct Statistics {
+        int jitterBufferDepth = 0;
+        int jitterBufferTargetDepth = 0;
+        double jitterMs = 0.0;
+        quint64 latePackets = 0;
+        quint64 discardedPackets = 0;
+        quint64 recoveredFrames = 0;
+        quint64 concealedFrames = 0;
+        quint64 comfortNoiseFrames = 0;
+    };
+
+    // The same counters, published after every frame so any thread can read
+    // them without the playout lock, as RtpStatistics does for the network side.
+    struct PublishedStatistics {
+        std::atomic<int> jitterBufferDepth{0};
+        std::atomic<int> jitterBufferTargetDepth{0};
+        std::atomic<double> jitterMs{0.0};
+        std::atomic<quint64> latePackets{0};
+        std::atomic<quint64> discardedPackets{0};
+        std::atomic<quint64> recoveredFrames{0};
+        std::atomic<quint64> concealedFrames{0};
+        std::atomic<quint64> comfortNoiseFrames{0};
+
+        Statistics load() const;
+    };
+
+    using PayloadLayouts = QHash<int, OpusLayout>;
+
+    explicit AudioStream(int sampleRate = 48000, int frameSize = 960, const OpusLayout &layout = OpusLayout());
+    ~AudioStream();
+
+    AudioStream(const AudioStream &) = delete;
+    AudioStream &operator=(const AudioStream &) = delete;
+
+    bool isValid() const;
+    OpusLayout layout() const;
+    int channels() const;
+
+    // The decoder layout for each payload type. Packets with a payload type not
+    // listed are decoded with the current layout, first the one constructed with.
+    void setPayloadLayouts(const PayloadLayouts &layouts);
+
+    void insertPacket(quint16 sequence, quint32 timestamp, quint8 payloadType, qint64 arrivalNs,
+                      const char *payload, int size);
+    // pcm takes maxFrameSize interleaved samples per channel.
+    int decodeNextFrame(opus_int16 *pcm);
+    void reset();
+
+    int decodeAudioData(const QByteArray &packet, opus_int16 *pcm);
+    int concealAudioData(opus_int16 *pcm);
+    int generateComfortNoise(opus_int16 *pcm);
+
+    Statistics statistics() const;
+    std::shared_ptr<const PublishedStatistics> publishedStatistics() const;
+
+    static const int maxFrameSize = 5760;
+
+private:
+    void createDecoder(const OpusLayout &layout);
+    bool decodesWithCurrentLayout(int payloadType) const;
+    bool packetHasLbrr(const QByteArray &packet) const;
+    void publishStatistics();
+
+    const int m_sampleRate;
+    OpusMSDecoder* m_opusDecoder;
+    OpusLayout m_layout;
+    PayloadLayouts m_payloadLayouts;
+    JitterBuffer m_jitterBuffer;
+
+    QByteArray m_packet;
+    QByteArray m_fecPacket;
+    int m_lastFrameSize;
+
+    // The sender stops transmitting during silence, so an empty buffer after the
+    // stream has started is filled with noise at the level last heard from it.
+    void trackNoiseLevel(const opus_int16 *pcm, int count);
+    bool m_started = false;
+    double m_noiseLevel = 0.0;
+    quint32 m_noiseSeed = 0x9e3779b9u;
+    double m_noiseState = 0.0;
+
+    quint64 m_recoveredFrames = 0;
+    quint64 m_concealedFrames = 0;
+    quint64 m_comfortNoiseFrames = 0;
+    const std::shared_ptr<PublishedStatistics> m_published = std::make_shared<PublishedStatistics>();
+};
+
+#endif
@@ -0,0 +1,25 @@
+QT += core multimedia network websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = callsetupbench
+
+include(../../libraries.pri)
+include(../../app.pri)
+
+INCLUDEPATH += ../../signaling ../../tools/common
+
+SOURCES += \
+    main.cpp \
+    ../../signaling/signalingserver.cpp \
+    ../../signaling/signalingworker.cpp \
+    ../../tools/common/localstunserver.cpp
+
+HEADERS += \
+    ../../signaling/signalingserver.h \
+    ../../signaling/signalingworker.h \
+    ../../tools/common/localstunserver.h
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
@@ -0,0 +1,274 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QThread>
+#include <QVector>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include "localstunserver.h"
+#include "pcmringdevice.h"
+#include "signalingserver.h"
+#include "webrtc.h"
+
+// Time to offer and time to answer, with and without the PeerConnection pool.
+// A caller places a call and the clock stops when its offer is handed to
+// signaling; the offer is then given straight to a callee, and the clock stops
+// again when its answer is. Nobody is at the other end, so this is the local
+// setup cost only: certificate, ICE agent, tracks, description and, without
+// trickle ICE, gathering.
+//
+// With --local-stun and --ice-udp-port, calls after the first take their
+// server reflexive candidates from the cache; stunRequests shows how many
+// Binding requests each case still made.
+
+namespace {
+
+// Runs the event loop until done() or the timeout.
+bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done()) {
+        if (timer.elapsed() > timeoutMs)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+QJsonObject summarize(QVector<double> &valuesMs)
+{
+    QJsonObject result;
+    if (valuesMs.isEmpty())
+        return result;
+
+    std::sort(valuesMs.begin(), valuesMs.end());
+
+    double total = 0.0;
+    for (double value : std::as_const(valuesMs)) {
+        total += value;
+    }
+
+    auto percentile = [&valuesMs](double p) {
+        return valuesMs[qMin(valuesMs.size() - 1, static_cast<int>(p / 100.0 * valuesMs.size()))];
+    };
+
+    result["samples"] = valuesMs.size();
+    result["meanMs"] = total / valuesMs.size();
+    result["p50Ms"] = percentile(50);
+    result["p90Ms"] = percentile(90);
+    result["maxMs"] = valuesMs.last();
+    return result;
+}
+
+struct CaseOptions {
+    QString signalingUrl;
+    QStringList iceServers;
+    int iceUdpPort = 0;
+    bool trickleIce = true;
+    int poolSize = 0;
+    int iterations = 20;
+    int warmupMs = 2000;
+    int intervalMs = 500;
+    int timeoutMs = 10000;
+};
+
+QJsonObject runCase(const CaseOptions &options, int caseIndex, LocalStunServer *stunServer)
+{
+    // Each case starts cold.
+    const QString cacheKey = CandidateCache::key(options.iceServers, QString(), options.iceUdpPort);
+    CandidateCache::invalidate(cacheKey);
+    const int stunRequestsBefore = stunServer ? stunServer->requestCount() : 0;
+
+    PcmRingDevice callerCapture;
+    PcmRingDevice calleeCapture;
+    WebRTC caller;
+    WebRTC callee;
+
+    for (WebRTC *endpoint : { &caller, &callee }) {
+        endpoint->setSignalingUrl(options.signalingUrl);
+        endpoint->setIceServers(options.iceServers);
+        endpoint->setIceUdpPort(options.iceUdpPort);
+        if (options.iceServers.isEmpty())
+            endpoint->setIceBindAddress("127.0.0.1");
+        endpoint->setTrickleIce(options.trickleIce);
+        endpoint->setConnectionPoolSize(options.poolSize);
+    }
+    caller.mediaEngine()->setVirtualAudio(&callerCapture);
+    callee.mediaEngine()->setVirtualAudio(&calleeCapture);
+
+    const QString callerId = QString("setup-caller-%1").arg(caseIndex);
+    const QString calleeId = QString("setup-callee-%1").arg(caseIndex);
+
+    QString pendingPeer;
+    QString pendingCaller;
+    QJsonObject offer;
+    QJsonObject answer;
+    QObject::connect(&caller, &WebRTC::offerIsReady, [&](const QString &peerId, const QJsonObject &description) {
+        if (peerId == pendingPeer)
+            offer = description;
+    });
+    QObject::connect(&callee, &WebRTC::answerIsReady, [&](const QString &peerId, const QJsonObject &description) {
+        if (peerId == pendingCaller)
+            answer = description;
+    });
+
+    caller.init(true, callerId);
+    callee.init(false, calleeId);
+    caller.warmUpConnectionPool();
+    callee.warmUpConnectionPool();
+
+    // The pool fills in the background; give it the time a user would take to dial.
+    waitFor([&]() {
+        return caller.connectionPool()->idleCount(true) >= options.poolSize
+               && callee.connectionPool()->idleCount(false) >= options.poolSize;
+    }, options.warmupMs);
+    waitFor([]() { return false; }, options.warmupMs);
+
+    QVector<double> offerMs;
+    QVector<double> answerMs;
+    int offerPoolHits = 0;
+    int answerPoolHits = 0;
+    int timeouts = 0;
+
+    for (int i = 0; i < options.iterations; ++i) {
+        // Fresh ids each time, so no call reuses a connection from the last one.
+        pendingPeer = QString("%1-%2").arg(calleeId).arg(i);
+        offer = QJsonObject();
+        answer = QJsonObject();
+        if (caller.connectionPool()->idleCount(true) > 0)
+            ++offerPoolHits;
+
+        QElapsedTimer timer;
+        timer.start();
+        caller.startCall(pendingPeer);
+        if (!waitFor([&]() { return !offer.isEmpty(); }, options.timeoutMs)) {
+            ++timeouts;
+            continue;
+        }
+        offerMs.append(timer.nsecsElapsed() / 1e6);
+
+        pendingCaller = QString("%1-%2").arg(callerId).arg(i);
+        if (callee.connectionPool()->idleCount(false) > 0)
+            ++answerPoolHits;
+        timer.restart();
+        callee.setRemoteDescription(pendingCaller, offer);
+        if (!waitFor([&]() { return !answer.isEmpty(); }, options.timeoutMs)) {
+            ++timeouts;
+            continue;
+        }
+        answerMs.append(timer.nsecsElapsed() / 1e6);
+
+        waitFor([]() { return false; }, options.intervalMs);
+    }
+
+    QJsonObject result;
+    result["poolSize"] = options.poolSize;
+    result["trickleIce"] = options.trickleIce;
+    result["iceServers"] = QJsonArray::fromStringList(options.iceServers);
+    result["iceUdpPort"] = options.iceUdpPort;
+    if (stunServer)
+        result["stunRequests"] = stunServer->requestCount() - stunRequestsBefore;
+    result["iterations"] = options.iterations;
+    result["offerPoolHits"] = offerPoolHits;
+    result["answerPoolHits"] = answerPoolHits;
+    result["timeouts"] = timeouts;
+    result["timeToOffer"] = summarize(offerMs);
+    result["timeToAnswer"] = summarize(answerMs);
+    return result;
+}
+
+QList<int> parseIntList(const QString &value)
+{
+    QList<int> values;
+    const QStringList parts = value.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool ok = false;
+        const int number = part.trimmed().toInt(&ok);
+        if (ok)
+            values.append(number);
+    }
+    return values;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("callsetupbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Time to offer and time to answer, with and without pre-built peer connections.");
+    parser.addHelpOption();
+    QCommandLineOption poolSizesOption("pool-sizes", "Comma-separated pool sizes to compare.", "list", "0,1");
+    QCommandLineOption iterationsOption("iterations", "Calls placed per case.", "count", "20");
+    QCommandLineOption intervalOption("interval", "Milliseconds between calls, for the pool to refill.", "ms", "500");
+    QCommandLineOption warmupOption("warmup", "Milliseconds to let the pool fill before the first call.", "ms", "2000");
+    QCommandLineOption iceServerOption("ice-server", "STUN or TURN server URL; may be given more than once. Loopback only by default.", "url");
+    QCommandLineOption localStunOption("local-stun", "Gather against an in-process STUN server.");
+    QCommandLineOption udpPortOption("ice-udp-port", "Share this UDP port between connections, which lets STUN results be reused.", "port", "0");
+    QCommandLineOption noTrickleOption("no-trickle", "Signal as before trickle ICE, for comparison.");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    parser.addOptions({ poolSizesOption, iterationsOption, intervalOption, warmupOption, iceServerOption,
+                        localStunOption, udpPortOption, noTrickleOption, outputOption });
+    parser.process(app);
+
+    // Descriptions go out through a real server; nobody is registered to receive them, which it reports and drops.
+    SignalingServer server(1);
+    if (!server.listen(QHostAddress::LocalHost, 0)) {
+        qWarning() << "Signaling server failed to listen:" << server.errorString();
+        return 1;
+    }
+
+    LocalStunServer stunServer;
+    if (parser.isSet(localStunOption) && !stunServer.listen())
+        return 1;
+
+    CaseOptions options;
+    options.signalingUrl = server.url().toString();
+    options.iceServers = parser.values(iceServerOption);
+    if (parser.isSet(localStunOption))
+        options.iceServers.prepend(stunServer.url());
+    options.iceUdpPort = qBound(0, parser.value(udpPortOption).toInt(), 65535);
+    options.trickleIce = !parser.isSet(noTrickleOption);
+    options.iterations = qMax(1, parser.value(iterationsOption).toInt());
+    options.intervalMs = qMax(0, parser.value(intervalOption).toInt());
+    options.warmupMs = qMax(0, parser.value(warmupOption).toInt());
+
+    QJsonArray cases;
+    int caseIndex = 0;
+    for (int poolSize : parseIntList(parser.value(poolSizesOption))) {
+        options.poolSize = qMax(0, poolSize);
+        cases.append(runCase(options, caseIndex++, parser.isSet(localStunOption) ? &stunServer : nullptr));
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "callsetupbench";
+    report["targetTimeToOfferMs"] = 100;
+    report["cases"] = cases;
+
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+QT += core
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = codecbench
+
+include(../../libraries.pri)
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../audioencoder.cpp \
+    ../../audiostream.cpp \
+    ../../jitterbuffer.cpp \
+    ../../opuslayout.cpp \
+    ../../tracing.cpp
+
+HEADERS += \
+    ../../audioencoder.h \
+    ../../audiostream.h \
+    ../../jitterbuffer.h \
+    ../../opuslayout.h \
+    ../../tracing.h
+
+# Benchmarks time the real code path; only the trace points are compiled out.
+DEFINES += VOICE_CALL_NO_TRACING
@@ -0,0 +1,305 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QVector>
+#include <QtMath>
+#include <QDebug>
+#include <rtc/rtc.hpp>
+#include <algorithm>
+#include <chrono>
+#include "audioencoder.h"
+#include "audiostream.h"
+
+// Times the three per-frame stages of the send and receive paths on synthetic
+// audio: Opus encode (as AudioInput does it), Opus decode (as AudioStream does
+// it) and RTP packetization (as MediaEngine's send does it). Every frame is
+// timed on its own, so the JSON carries latency percentiles as well as
+// throughput. Runs single-threaded; framesPerSecond is per core. Stereo and
+// surround cases go through the same multistream encoder the calls use.
+
+namespace {
+
+const int sampleRate = 48000;
+
+qint64 nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// xorshift32, so every run sees exactly the same signal.
+class Noise
+{
+public:
+    double next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return static_cast<qint32>(m_state) / 2147483648.0;
+    }
+
+private:
+    quint32 m_state = 0x12345678u;
+};
+
+// Lowpassed noise shaped by a syllable-rate envelope, with pauses between
+// "words", which is close enough to speech to exercise SILK, CELT and DTX.
+QVector<opus_int16> speechLikeSignal(int samples)
+{
+    QVector<opus_int16> pcm(samples);
+    Noise noise;
+    double low = 0.0;
+    double band = 0.0;
+
+    for (int i = 0; i < samples; ++i) {
+        const double t = static_cast<double>(i) / sampleRate;
+        const double syllable = qMax(0.0, qSin(2.0 * M_PI * 4.0 * t));
+        const double word = qSin(2.0 * M_PI * 0.4 * t) > -0.3 ? 1.0 : 0.0;
+
+        low += 0.15 * (noise.next() - low);
+        band += 0.5 * (low - band);
+        pcm[i] = static_cast<opus_int16>(qBound(-32768.0, band * syllable * word * 60000.0, 32767.0));
+    }
+    return pcm;
+}
+
+QVector<opus_int16> toneSignal(int samples)
+{
+    QVector<opus_int16> pcm(samples);
+    for (int i = 0; i < samples; ++i) {
+        const double t = static_cast<double>(i) / sampleRate;
+        const double value = 0.5 * qSin(2.0 * M_PI * 440.0 * t)
+                             + 0.2 * qSin(2.0 * M_PI * 880.0 * t)
+                             + 0.1 * qSin(2.0 * M_PI * 1320.0 * t);
+        pcm[i] = static_cast<opus_int16>(value * 16000.0);
+    }
+    return pcm;
+}
+
+QVector<opus_int16> silenceSignal(int samples)
+{
+    return QVector<opus_int16>(samples, 0);
+}
+
+QJsonObject summarize(QVector<qint64> &durationsNs, int frameSize)
+{
+    QJsonObject result;
+    if (durationsNs.isEmpty())
+        return result;
+
+    std::sort(durationsNs.begin(), durationsNs.end());
+
+    double total = 0.0;
+    for (qint64 duration : std::as_const(durationsNs)) {
+        total += duration;
+    }
+    const double meanNs = total / durationsNs.size();
+
+    auto percentileUs = [&durationsNs](double percentile) {
+        const int index = qMin(durationsNs.size() - 1, static_cast<int>(percentile / 100.0 * durationsNs.size()));
+        return durationsNs[index] / 1000.0;
+    };
+
+    result["frames"] = durationsNs.size();
+    result["meanUs"] = meanNs / 1000.0;
+    result["p50Us"] = percentileUs(50);
+    result["p90Us"] = percentileUs(90);
+    result["p99Us"] = percentileUs(99);
+    result["p999Us"] = percentileUs(99.9);
+    result["maxUs"] = durationsNs.last() / 1000.0;
+    result["framesPerSecond"] = meanNs > 0 ? 1e9 / meanNs : 0.0;
+    // How many real-time streams of this frame size one core could carry.
+    result["realtimeFactor"] = meanNs > 0 ? (frameSize * 1e9 / sampleRate) / meanNs : 0.0;
+    return result;
+}
+
+// Each channel reads the mono signal from its own offset, so the channels are
+// correlated the way a real room is but never identical.
+QVector<opus_int16> interleave(const QVector<opus_int16> &signal, int channels)
+{
+    if (channels == 1)
+        return signal;
+
+    const int samples = signal.size();
+    QVector<opus_int16> pcm(samples * channels);
+    for (int i = 0; i < samples; ++i) {
+        for (int channel = 0; channel < channels; ++channel) {
+            pcm[i * channels + channel] = signal[(i + channel * 4801) % samples];
+        }
+    }
+    return pcm;
+}
+
+QJsonObject runCase(const QVector<opus_int16> &signal, int channels, int frameSize, int complexity, int bitrate, int frames)
+{
+    AudioEncoder encoder(sampleRate, channels, bitrate * channels);
+    encoder.setComplexity(complexity);
+    encoder.setDtx(true);
+    AudioStream stream(sampleRate, frameSize, encoder.layout());
+    if (!encoder.isValid() || !stream.isValid())
+        return QJsonObject();
+
+    QByteArray packet;
+    packet.reserve(AudioEncoder::maxPacketSize);
+    QVector<opus_int16> decoded(AudioStream::maxFrameSize * channels);
+
+    auto rtpConfig = std::make_shared<rtc::RtpPacketizationConfig>(
+        0x12345678, "codecbench", 111, rtc::OpusRtpPacketizer::DefaultClockRate);
+    rtc::OpusRtpPacketizer packetizer(rtpConfig);
+    rtc::message_vector messages;
+    messages.reserve(1);
+
+    QVector<qint64> encodeNs;
+    QVector<qint64> decodeNs;
+    QVector<qint64> packetizeNs;
+    encodeNs.reserve(frames);
+    decodeNs.reserve(frames);
+    packetizeNs.reserve(frames);
+
+    qint64 encodedBytes = 0;
+    int dtxFrames = 0;
+    const int framesInSignal = signal.size() / (frameSize * channels);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        const opus_int16 *pcm = signal.constData() + (frame % framesInSignal) * frameSize * channels;
+
+        qint64 start = nowNs();
+        const int size = encoder.encode(pcm, frameSize, packet);
+        encodeNs.append(nowNs() - start);
+        if (size < 0)
+            return QJsonObject();
+
+        // DTX frames are never sent, so they are not decoded or packetized either.
+        if (encoder.isDtxPacket(size)) {
+            ++dtxFrames;
+            continue;
+        }
+        encodedBytes += size;
+
+        start = nowNs();
+        stream.decodeAudioData(packet, decoded.data());
+        decodeNs.append(nowNs() - start);
+
+        const std::byte *data = reinterpret_cast<const std::byte*>(packet.constData());
+        messages.clear();
+        messages.push_back(rtc::make_message(data, data + size));
+        start = nowNs();
+        packetizer.outgoing(messages, nullptr);
+        packetizeNs.append(nowNs() - start);
+        rtpConfig->timestamp += frameSize;
+    }
+
+    const OpusLayout layout = encoder.layout();
+    QJsonObject result;
+    result["channels"] = channels;
+    result["streams"] = layout.streams;
+    result["coupledStreams"] = layout.coupledStreams;
+    result["frameSize"] = frameSize;
+    result["frameMs"] = frameSize * 1000.0 / sampleRate;
+    result["complexity"] = complexity;
+    result["bitrate"] = encoder.bitrate();
+    result["actualKbps"] = frames > 0 ? encodedBytes * 8.0 * sampleRate / (double(frames) * frameSize * 1000.0) : 0.0;
+    result["dtxFrames"] = dtxFrames;
+    result["meanPacketBytes"] = frames > dtxFrames ? double(encodedBytes) / (frames - dtxFrames) : 0.0;
+    result["encode"] = summarize(encodeNs, frameSize);
+    result["decode"] = summarize(decodeNs, frameSize);
+    result["packetize"] = summarize(packetizeNs, frameSize);
+    return result;
+}
+
+QList<int> parseIntList(const QString &value)
+{
+    QList<int> values;
+    const QStringList parts = value.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool ok = false;
+        const int number = part.trimmed().toInt(&ok);
+        if (ok)
+            values.append(number);
+    }
+    return values;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("codecbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Opus encode/decode and RTP packetization microbenchmarks.");
+    parser.addHelpOption();
+    QCommandLineOption framesOption("frames", "Frames timed per case.", "count", "3000");
+    QCommandLineOption frameSizesOption("frame-sizes", "Comma-separated frame sizes in samples at 48 kHz.", "list", "120,240,480,960,1920,2880");
+    QCommandLineOption complexitiesOption("complexities", "Comma-separated Opus complexity settings.", "list", "0,5,10");
+    QCommandLineOption bitrateOption("bitrate", "Encoder bitrate in bit/s per channel.", "bps", "64000");
+    QCommandLineOption channelsOption("channels", "Comma-separated channel counts, up to 8.", "list", "1,2,6");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    parser.addOptions({ framesOption, frameSizesOption, complexitiesOption, bitrateOption, channelsOption, outputOption });
+    parser.process(app);
+
+    const int frames = qMax(1, parser.value(framesOption).toInt());
+    const int bitrate = parser.value(bitrateOption).toInt();
+    const QList<int> frameSizes = parseIntList(parser.value(frameSizesOption));
+    const QList<int> complexities = parseIntList(parser.value(complexitiesOption));
+    const QList<int> channelCounts = parseIntList(parser.value(channelsOption));
+
+    // Ten seconds of each signal, looped when more frames are requested.
+    const int signalSamples = sampleRate * 10;
+    const QList<QPair<QString, QVector<opus_int16>>> testSignals = {
+        { "speech", speechLikeSignal(signalSamples) },
+        { "tone", toneSignal(signalSamples) },
+        { "silence", silenceSignal(signalSamples) },
+    };
+
+    QJsonArray cases;
+    for (int channels : channelCounts) {
+        if (channels < 1 || channels > OpusLayout::maxChannels) {
+            qWarning() << "Skipping unsupported channel count:" << channels;
+            continue;
+        }
+        for (const auto &signal : testSignals) {
+            const QVector<opus_int16> pcm = interleave(signal.second, channels);
+            for (int frameSize : frameSizes) {
+                for (int complexity : complexities) {
+                    QJsonObject result = runCase(pcm, channels, frameSize, complexity, bitrate, frames);
+                    if (result.isEmpty()) {
+                        qWarning() << "Skipping unsupported case:" << channels << "channels, frame size" << frameSize
+                                   << "complexity" << complexity;
+                        continue;
+                    }
+                    result["signal"] = signal.first;
+                    cases.append(result);
+                }
+            }
+        }
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "codecbench";
+    report["opusVersion"] = QString::fromLatin1(opus_get_version_string());
+    report["sampleRate"] = sampleRate;
+    report["framesPerCase"] = frames;
+    report["cases"] = cases;
+
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return 0;
+}
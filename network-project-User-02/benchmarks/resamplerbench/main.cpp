@@ -0,0 +1,233 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QAudioFormat>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QVector>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "audioconverter.h"
+
+// Times AudioConverter between device formats and the codec's 48 kHz mono, in
+// both directions and in chunks the size a sound card period would be: capture
+// is device to codec, playout codec to device. Each chunk is timed on its own.
+// A 1 kHz tone is run through the capture direction as well and compared with
+// the ideal one, delayed by the converter's own latency, which gives toneSnrDb.
+// Runs single-threaded; realtimeFactor is per core.
+
+namespace {
+
+const int codecRate = 48000;
+const double toneFrequency = 1000.0;
+
+qint64 nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+QAudioFormat makeFormat(int sampleRate, int channels, QAudioFormat::SampleFormat sampleFormat)
+{
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(channels);
+    format.setSampleFormat(sampleFormat);
+    return format;
+}
+
+// The same tone on every channel, at half scale.
+QByteArray toneSignal(const QAudioFormat &format, int frames)
+{
+    QByteArray pcm(frames * format.bytesPerFrame(), '\0');
+    for (int i = 0; i < frames; ++i) {
+        const double value = 0.5 * qSin(2.0 * M_PI * toneFrequency * i / format.sampleRate());
+        for (int channel = 0; channel < format.channelCount(); ++channel) {
+            char *sample = pcm.data() + (static_cast<qint64>(i) * format.channelCount() + channel) * format.bytesPerSample();
+            if (format.sampleFormat() == QAudioFormat::Float) {
+                const float converted = static_cast<float>(value);
+                std::memcpy(sample, &converted, sizeof(converted));
+            } else {
+                const qint16 converted = static_cast<qint16>(qRound(value * 32767.0));
+                std::memcpy(sample, &converted, sizeof(converted));
+            }
+        }
+    }
+    return pcm;
+}
+
+QJsonObject summarize(QVector<qint64> &durationsNs, double chunkMs)
+{
+    QJsonObject result;
+    if (durationsNs.isEmpty())
+        return result;
+
+    std::sort(durationsNs.begin(), durationsNs.end());
+
+    double total = 0.0;
+    for (qint64 duration : std::as_const(durationsNs)) {
+        total += duration;
+    }
+    const double meanNs = total / durationsNs.size();
+
+    auto percentileUs = [&durationsNs](double percentile) {
+        const int index = qMin(durationsNs.size() - 1, static_cast<int>(percentile / 100.0 * durationsNs.size()));
+        return durationsNs[index] / 1000.0;
+    };
+
+    result["chunks"] = durationsNs.size();
+    result["meanUs"] = meanNs / 1000.0;
+    result["p50Us"] = percentileUs(50);
+    result["p99Us"] = percentileUs(99);
+    result["maxUs"] = durationsNs.last() / 1000.0;
+    // Seconds of audio converted per second of CPU.
+    result["realtimeFactor"] = meanNs > 0 ? chunkMs * 1e6 / meanNs : 0.0;
+    return result;
+}
+
+// Converts signal chunk by chunk, timing each; returns everything produced.
+QByteArray timeConversion(AudioConverter &converter, const QByteArray &signal, int chunkFrames, QVector<qint64> &durationsNs)
+{
+    const int inputFrameBytes = converter.inputFormat().bytesPerFrame();
+    const qint64 chunkBytes = static_cast<qint64>(chunkFrames) * inputFrameBytes;
+
+    QByteArray output(static_cast<int>(converter.outputBytesFor(signal.size()) + converter.outputBytesFor(chunkBytes)), '\0');
+    qint64 written = 0;
+
+    for (qint64 offset = 0; offset + chunkBytes <= signal.size(); offset += chunkBytes) {
+        const qint64 start = nowNs();
+        written += converter.convert(signal.constData() + offset, chunkBytes, output.data() + written, output.size() - written);
+        durationsNs.append(nowNs() - start);
+    }
+
+    output.truncate(static_cast<int>(written));
+    return output;
+}
+
+double toneSnrDb(const QByteArray &pcm, double latencyMs)
+{
+    const qint16 *samples = reinterpret_cast<const qint16 *>(pcm.constData());
+    const int count = pcm.size() / static_cast<int>(sizeof(qint16));
+
+    double signalEnergy = 0.0;
+    double errorEnergy = 0.0;
+    // The first 100 ms include the filter filling up.
+    for (int i = codecRate / 10; i < count; ++i) {
+        const double t = static_cast<double>(i) / codecRate - latencyMs / 1000.0;
+        const double expected = 0.5 * qSin(2.0 * M_PI * toneFrequency * t);
+        const double error = samples[i] / 32768.0 - expected;
+        signalEnergy += expected * expected;
+        errorEnergy += error * error;
+    }
+    return errorEnergy > 0.0 ? 10.0 * std::log10(signalEnergy / errorEnergy) : 200.0;
+}
+
+QJsonObject runCase(const QAudioFormat &deviceFormat, double maxLatencyMs, int chunkMs, int seconds)
+{
+    const QAudioFormat codecFormat = makeFormat(codecRate, 1, QAudioFormat::Int16);
+    if (!AudioConverter::isSupported(deviceFormat, codecFormat))
+        return QJsonObject();
+
+    AudioConverter capture(deviceFormat, codecFormat, maxLatencyMs);
+    AudioConverter playout(codecFormat, deviceFormat, maxLatencyMs);
+
+    const QByteArray deviceSignal = toneSignal(deviceFormat, deviceFormat.sampleRate() * seconds);
+    const QByteArray codecSignal = toneSignal(codecFormat, codecRate * seconds);
+
+    QVector<qint64> captureNs;
+    QVector<qint64> playoutNs;
+    const QByteArray captured = timeConversion(capture, deviceSignal, deviceFormat.sampleRate() * chunkMs / 1000, captureNs);
+    timeConversion(playout, codecSignal, codecRate * chunkMs / 1000, playoutNs);
+
+    QJsonObject result;
+    result["sampleRate"] = deviceFormat.sampleRate();
+    result["channels"] = deviceFormat.channelCount();
+    result["sampleFormat"] = deviceFormat.sampleFormat() == QAudioFormat::Float ? "float" : "int16";
+    result["maxLatencyMs"] = maxLatencyMs;
+    result["latencyMs"] = capture.latencyMs();
+    result["passthrough"] = capture.isPassthrough();
+    result["toneSnrDb"] = toneSnrDb(captured, capture.latencyMs());
+    result["capture"] = summarize(captureNs, chunkMs);
+    result["playout"] = summarize(playoutNs, chunkMs);
+    return result;
+}
+
+template <typename T>
+QList<T> parseList(const QString &value)
+{
+    QList<T> values;
+    const QStringList parts = value.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool ok = false;
+        const double number = part.trimmed().toDouble(&ok);
+        if (ok)
+            values.append(static_cast<T>(number));
+    }
+    return values;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("resamplerbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Sample rate and channel conversion between device formats and 48 kHz mono.");
+    parser.addHelpOption();
+    QCommandLineOption ratesOption("rates", "Comma-separated device sample rates.", "list", "8000,16000,22050,44100,48000,96000");
+    QCommandLineOption channelsOption("channels", "Comma-separated device channel counts.", "list", "1,2");
+    QCommandLineOption latenciesOption("latencies", "Comma-separated latency bounds in milliseconds.", "list", "0.5,1,2");
+    QCommandLineOption chunkOption("chunk-ms", "Milliseconds of audio per conversion call.", "ms", "10");
+    QCommandLineOption secondsOption("seconds", "Seconds of audio converted per case and direction.", "seconds", "10");
+    QCommandLineOption floatOption("float", "Device samples are 32-bit float rather than 16-bit integers.");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    parser.addOptions({ ratesOption, channelsOption, latenciesOption, chunkOption, secondsOption, floatOption, outputOption });
+    parser.process(app);
+
+    const int chunkMs = qBound(1, parser.value(chunkOption).toInt(), 1000);
+    const int seconds = qMax(1, parser.value(secondsOption).toInt());
+    const QAudioFormat::SampleFormat sampleFormat = parser.isSet(floatOption) ? QAudioFormat::Float : QAudioFormat::Int16;
+
+    QJsonArray cases;
+    for (int rate : parseList<int>(parser.value(ratesOption))) {
+        for (int channels : parseList<int>(parser.value(channelsOption))) {
+            for (double latency : parseList<double>(parser.value(latenciesOption))) {
+                const QJsonObject result = runCase(makeFormat(rate, channels, sampleFormat), latency, chunkMs, seconds);
+                if (result.isEmpty()) {
+                    qWarning() << "Skipping unsupported case:" << rate << "Hz," << channels << "channels";
+                    continue;
+                }
+                cases.append(result);
+            }
+        }
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "resamplerbench";
+    report["implementation"] = QString::fromLatin1(Resampler::implementation());
+    report["codecRate"] = codecRate;
+    report["chunkMs"] = chunkMs;
+    report["cases"] = cases;
+
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+QT += core multimedia
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = resamplerbench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../audioconverter.cpp \
+    ../../resampler.cpp
+
+HEADERS += \
+    ../../audioconverter.h \
+    ../../resampler.h
+
+# Benchmarks time the real code path; only the trace points are compiled out.
+DEFINES += VOICE_CALL_NO_TRACING
@@ -0,0 +1,188 @@
+#include "clientgroup.h"
+#include <QWebSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <chrono>
+
+namespace {
+
+qint64 nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+QString clientId(int index)
+{
+    return QString("bench-%1").arg(index);
+}
+
+QString toJson(const QJsonObject &object)
+{
+    return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+}
+
+ClientGroup::ClientGroup(int index, const QUrl &url, const QVector<int> &clients, int window, int payloadBytes)
+    : m_url(url),
+    m_indices(clients),
+    m_window(qMax(1, window)),
+    m_padding(qMax(0, payloadBytes), QChar('x')),
+    m_context(new QObject)
+{
+    m_thread.setObjectName(QString("ClientGroup%1").arg(index));
+    m_context->moveToThread(&m_thread);
+    m_thread.start();
+}
+
+ClientGroup::~ClientGroup()
+{
+    QMetaObject::invokeMethod(m_context, [this]() { shutdown(); }, Qt::BlockingQueuedConnection);
+
+    m_thread.quit();
+    m_thread.wait();
+
+    delete m_context;
+}
+
+void ClientGroup::shutdown()
+{
+    m_running = false;
+    for (Client &client : m_clients) {
+        client.socket->disconnect(m_context);
+        delete client.socket;
+    }
+    m_clients.clear();
+}
+
+void ClientGroup::connectAll()
+{
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_clients.resize(m_indices.size());
+        for (int i = 0; i < m_indices.size(); ++i) {
+            Client &client = m_clients[i];
+            client.id = clientId(m_indices[i]);
+            client.partner = clientId(m_indices[i] ^ 1);
+            client.sender = (m_indices[i] & 1) == 0;
+            client.socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, m_context);
+
+            QObject::connect(client.socket, &QWebSocket::connected, m_context, [this, i]() { onConnected(i); });
+            QObject::connect(client.socket, &QWebSocket::textMessageReceived, m_context, [this, i](const QString &message) {
+                onMessage(i, message);
+            });
+            QObject::connect(client.socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), m_context, [this, i]() {
+                if (!m_clients[i].registered)
+                    m_failed.fetch_add(1, std::memory_order_relaxed);
+            });
+
+            client.socket->open(m_url);
+        }
+    }, Qt::QueuedConnection);
+}
+
+// Registration is not acknowledged, so each client sends itself a probe; the
+// server handles a connection's messages in order, so the probe coming back
+// means the registration is in place.
+void ClientGroup::onConnected(int index)
+{
+    Client &client = m_clients[index];
+
+    QJsonObject registration;
+    registration["type"] = "register";
+    registration["from"] = client.id;
+    client.socket->sendTextMessage(toJson(registration));
+
+    QJsonObject probe;
+    probe["type"] = "probe";
+    probe["from"] = client.id;
+    probe["to"] = client.id;
+    client.socket->sendTextMessage(toJson(probe));
+}
+
+void ClientGroup::onMessage(int index, const QString &message)
+{
+    Client &client = m_clients[index];
+    const QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object();
+    const QString type = data["type"].toString();
+
+    if (type == "bench") {
+        QJsonObject echo = data;
+        echo["type"] = "echo";
+        echo["from"] = client.id;
+        echo["to"] = data["from"].toString();
+        client.socket->sendTextMessage(toJson(echo));
+    } else if (type == "echo") {
+        m_roundTripsNs.append(nowNs() - static_cast<qint64>(data["t"].toDouble()));
+        m_roundTrips.fetch_add(1, std::memory_order_relaxed);
+        --client.inFlight;
+        if (m_running)
+            send(client);
+    } else if (type == "probe") {
+        if (!client.registered) {
+            client.registered = true;
+            m_registered.fetch_add(1, std::memory_order_relaxed);
+        }
+    } else if (type == "error") {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ClientGroup::send(Client &client)
+{
+    QJsonObject message;
+    message["type"] = "bench";
+    message["from"] = client.id;
+    message["to"] = client.partner;
+    message["t"] = double(nowNs());
+    message["pad"] = m_padding;
+    client.socket->sendTextMessage(toJson(message));
+    ++client.inFlight;
+}
+
+void ClientGroup::startTraffic()
+{
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_running = true;
+        for (Client &client : m_clients) {
+            if (!client.sender || !client.registered)
+                continue;
+            while (client.inFlight < m_window)
+                send(client);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void ClientGroup::stopTraffic()
+{
+    QMetaObject::invokeMethod(m_context, [this]() { m_running = false; }, Qt::QueuedConnection);
+}
+
+QVector<qint64> ClientGroup::takeRoundTripsNs()
+{
+    QVector<qint64> result;
+    QMetaObject::invokeMethod(m_context, [this, &result]() {
+        result.swap(m_roundTripsNs);
+    }, Qt::BlockingQueuedConnection);
+    return result;
+}
+
+int ClientGroup::registered() const
+{
+    return m_registered.load(std::memory_order_relaxed);
+}
+
+int ClientGroup::failed() const
+{
+    return m_failed.load(std::memory_order_relaxed);
+}
+
+quint64 ClientGroup::roundTrips() const
+{
+    return m_roundTrips.load(std::memory_order_relaxed);
+}
+
+quint64 ClientGroup::errors() const
+{
+    return m_errors.load(std::memory_order_relaxed);
+}
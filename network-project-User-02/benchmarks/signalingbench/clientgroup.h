@@ -0,0 +1,68 @@
+#ifndef CLIENTGROUP_H
+#define CLIENTGROUP_H
+
+#include <QObject>
+#include <QThread>
+#include <QUrl>
+#include <QVector>
+#include <QString>
+#include <atomic>
+
+class QWebSocket;
+
+// A share of the benchmark's signaling clients, driven from one thread of its
+// own so the client side does not become the bottleneck. Client i talks to
+// client i ^ 1: even clients keep a window of messages in flight, odd clients
+// echo them back, and each echo gives one round trip through the server.
+class ClientGroup
+{
+public:
+    ClientGroup(int index, const QUrl &url, const QVector<int> &clients, int window, int payloadBytes);
+    ~ClientGroup();
+
+    // All three return at once; progress shows in the counters.
+    void connectAll();
+    void startTraffic();
+    void stopTraffic();
+
+    // Blocks until the group's thread hands them over.
+    QVector<qint64> takeRoundTripsNs();
+
+    int registered() const;
+    int failed() const;
+    quint64 roundTrips() const;
+    quint64 errors() const;
+
+private:
+    struct Client {
+        QWebSocket *socket = nullptr;
+        QString id;
+        QString partner;
+        bool sender = false;
+        bool registered = false;
+        int inFlight = 0;
+    };
+
+    void onConnected(int client);
+    void onMessage(int client, const QString &message);
+    void send(Client &client);
+    void shutdown();
+
+    const QUrl m_url;
+    const QVector<int> m_indices;
+    const int m_window;
+    const QString m_padding;
+
+    QThread m_thread;
+    QObject *m_context = nullptr;
+    QVector<Client> m_clients;
+    QVector<qint64> m_roundTripsNs;
+    bool m_running = false;
+
+    std::atomic<int> m_registered{0};
+    std::atomic<int> m_failed{0};
+    std::atomic<quint64> m_roundTrips{0};
+    std::atomic<quint64> m_errors{0};
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QVector>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include "clientgroup.h"
+#include "processusage.h"
+#include "signalingserver.h"
+
+// Measures the signaling server on one host: how fast N clients connect and
+// register, then how many messages per second it routes between them and at
+// what round-trip latency. Runs the server in-process unless --url points at
+// one; in-process, server and clients share the machine's cores, so client
+// threads are best kept to a fraction of them.
+
+namespace {
+
+// Runs the event loop, which the in-process server accepts on, until done() or the timeout.
+bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done()) {
+        if (timer.elapsed() > timeoutMs)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+QJsonObject summarize(QVector<qint64> &durationsNs)
+{
+    QJsonObject result;
+    if (durationsNs.isEmpty())
+        return result;
+
+    std::sort(durationsNs.begin(), durationsNs.end());
+
+    double total = 0.0;
+    for (qint64 duration : std::as_const(durationsNs)) {
+        total += duration;
+    }
+
+    auto percentileUs = [&durationsNs](double percentile) {
+        const int index = qMin(durationsNs.size() - 1, static_cast<int>(percentile / 100.0 * durationsNs.size()));
+        return durationsNs[index] / 1000.0;
+    };
+
+    result["samples"] = durationsNs.size();
+    result["meanUs"] = total / durationsNs.size() / 1000.0;
+    result["p50Us"] = percentileUs(50);
+    result["p90Us"] = percentileUs(90);
+    result["p99Us"] = percentileUs(99);
+    result["maxUs"] = durationsNs.last() / 1000.0;
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("signalingbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Signaling server connection capacity and message throughput.");
+    parser.addHelpOption();
+    QCommandLineOption urlOption("url", "Signaling server to measure; an in-process one by default.", "url");
+    QCommandLineOption workersOption("workers", "Worker threads of the in-process server.", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption connectionsOption("connections", "Clients to connect; rounded up to an even number.", "count", "1000");
+    QCommandLineOption clientThreadsOption("client-threads", "Threads driving the clients.", "count", "2");
+    QCommandLineOption secondsOption("seconds", "Length of the throughput phase.", "seconds", "10");
+    QCommandLineOption windowOption("window", "Messages each sending client keeps in flight.", "count", "4");
+    QCommandLineOption payloadOption("payload", "Padding per message, in bytes; a trickled candidate is about 200.", "bytes", "200");
+    QCommandLineOption timeoutOption("connect-timeout", "Seconds to wait for every client to register.", "seconds", "60");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    parser.addOptions({ urlOption, workersOption, connectionsOption, clientThreadsOption, secondsOption, windowOption,
+                        payloadOption, timeoutOption, outputOption });
+    parser.process(app);
+
+    const int connections = (qMax(2, parser.value(connectionsOption).toInt()) + 1) & ~1;
+    const int clientThreads = qBound(1, parser.value(clientThreadsOption).toInt(), connections);
+    const int seconds = qMax(1, parser.value(secondsOption).toInt());
+
+    std::unique_ptr<SignalingServer> server;
+    QUrl url(parser.value(urlOption));
+    if (!parser.isSet(urlOption)) {
+        server.reset(new SignalingServer(parser.value(workersOption).toInt()));
+        server->setMaxPendingConnections(connections);
+        if (!server->listen(QHostAddress::LocalHost, 0)) {
+            qWarning() << "Signaling server failed to listen:" << server->errorString();
+            return 1;
+        }
+        url = server->url();
+    }
+
+    QVector<QVector<int>> shares(clientThreads);
+    for (int i = 0; i < connections; ++i) {
+        shares[i % clientThreads].append(i);
+    }
+
+    QVector<ClientGroup*> groups;
+    for (int i = 0; i < clientThreads; ++i) {
+        groups.append(new ClientGroup(i, url, shares[i], parser.value(windowOption).toInt(),
+                                      parser.value(payloadOption).toInt()));
+    }
+
+    auto registered = [&groups]() {
+        int count = 0;
+        for (const ClientGroup *group : std::as_const(groups)) {
+            count += group->registered();
+        }
+        return count;
+    };
+    auto failed = [&groups]() {
+        int count = 0;
+        for (const ClientGroup *group : std::as_const(groups)) {
+            count += group->failed();
+        }
+        return count;
+    };
+
+    // Connection phase.
+    const qint64 residentBefore = ProcessUsage::residentBytes();
+    QElapsedTimer connectTimer;
+    connectTimer.start();
+    for (ClientGroup *group : std::as_const(groups)) {
+        group->connectAll();
+    }
+    waitFor([&]() { return registered() + failed() >= connections; }, parser.value(timeoutOption).toInt() * 1000);
+    const double connectSeconds = connectTimer.nsecsElapsed() / 1e9;
+    const qint64 residentAfter = ProcessUsage::residentBytes();
+
+    QJsonObject connect;
+    connect["requested"] = connections;
+    connect["registered"] = registered();
+    connect["failed"] = failed();
+    connect["seconds"] = connectSeconds;
+    connect["connectionsPerSecond"] = connectSeconds > 0 ? registered() / connectSeconds : 0.0;
+    // Both ends of every connection when the server runs in-process.
+    connect["residentBytesPerConnection"] = registered() > 0 ? double(residentAfter - residentBefore) / registered() : 0.0;
+
+    // Throughput phase; each round trip is two routed messages.
+    const qint64 cpuBefore = ProcessUsage::cpuTimeNs();
+    QElapsedTimer trafficTimer;
+    trafficTimer.start();
+    for (ClientGroup *group : std::as_const(groups)) {
+        group->startTraffic();
+    }
+    waitFor([]() { return false; }, seconds * 1000);
+    for (ClientGroup *group : std::as_const(groups)) {
+        group->stopTraffic();
+    }
+    const double trafficSeconds = trafficTimer.nsecsElapsed() / 1e9;
+    const double cpuCores = (ProcessUsage::cpuTimeNs() - cpuBefore) / 1e9 / trafficSeconds;
+
+    QVector<qint64> roundTripsNs;
+    quint64 errors = 0;
+    for (ClientGroup *group : std::as_const(groups)) {
+        roundTripsNs += group->takeRoundTripsNs();
+        errors += group->errors();
+    }
+
+    QJsonObject throughput;
+    throughput["seconds"] = trafficSeconds;
+    throughput["roundTrips"] = roundTripsNs.size();
+    throughput["messagesPerSecond"] = 2.0 * roundTripsNs.size() / trafficSeconds;
+    throughput["errors"] = double(errors);
+    throughput["cpuCores"] = cpuCores;
+    throughput["roundTrip"] = summarize(roundTripsNs);
+
+    QJsonObject report;
+    report["benchmark"] = "signalingbench";
+    report["server"] = server ? QString("in-process") : url.toString();
+    report["workers"] = server ? server->workerCount() : 0;
+    report["clientThreads"] = clientThreads;
+    report["window"] = parser.value(windowOption).toInt();
+    report["payloadBytes"] = parser.value(payloadOption).toInt();
+    report["connect"] = connect;
+    report["throughput"] = throughput;
+    if (server)
+        report["serverStatistics"] = server->statistics();
+
+    qDeleteAll(groups);
+    server.reset();
+
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+QT += core network websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = signalingbench
+
+INCLUDEPATH += ../../signaling ../../tools/common
+
+SOURCES += \
+    clientgroup.cpp \
+    main.cpp \
+    ../../signaling/signalingserver.cpp \
+    ../../signaling/signalingworker.cpp \
+    ../../tools/common/processusage.cpp
+
+HEADERS += \
+    clientgroup.h \
+    ../../signaling/signalingserver.h \
+    ../../signaling/signalingworker.h \
+    ../../tools/common/processusage.h
+
+win32: LIBS += -lpsapi
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
@@ -0,0 +1,108 @@
+#include "bitratecontroller.h"
+#include <opus.h>
+
+namespace {
+
+const double increaseLossThreshold = 0.02;
+const double decreaseLossThreshold = 0.10;
+const double queueingDelayMs = 100.0;
+const int cleanIntervalsBeforeIncrease = 3;
+const int holdIntervalsAfterDecrease = 2;
+
+}
+
+BitrateController::BitrateController(int minBitrate, int maxBitrate)
+    : m_minBitrate(minBitrate),
+    m_maxBitrate(maxBitrate),
+    m_bitrate(maxBitrate),
+    m_bandwidth(bandwidthFor(maxBitrate))
+{
+}
+
+void BitrateController::setBounds(int minBitrate, int maxBitrate)
+{
+    // Opus accepts 6 kb/s to 510 kb/s.
+    m_minBitrate = qBound(6000, minBitrate, 510000);
+    m_maxBitrate = qBound(m_minBitrate, maxBitrate, 510000);
+    m_bitrate = qBound(m_minBitrate, m_bitrate, m_maxBitrate);
+    m_bandwidth = bandwidthFor(m_bitrate);
+}
+
+int BitrateController::minBitrate() const
+{
+    return m_minBitrate;
+}
+
+int BitrateController::maxBitrate() const
+{
+    return m_maxBitrate;
+}
+
+void BitrateController::reset(int bitrate)
+{
+    m_bitrate = qBound(m_minBitrate, bitrate, m_maxBitrate);
+    m_bandwidth = bandwidthFor(m_bitrate);
+    m_smoothedLoss = 0.0;
+    m_minRttMs = -1.0;
+    m_cleanIntervals = 0;
+    m_holdIntervals = 0;
+}
+
+BitrateController::Settings BitrateController::update(double lossFraction, double rttMs)
+{
+    lossFraction = qBound(0.0, lossFraction, 1.0);
+    m_smoothedLoss += (lossFraction - m_smoothedLoss) / 4.0;
+
+    bool queueBuilding = false;
+    if (rttMs >= 0.0) {
+        if (m_minRttMs < 0.0 || rttMs < m_minRttMs)
+            m_minRttMs = rttMs;
+        queueBuilding = rttMs > m_minRttMs + queueingDelayMs;
+    }
+
+    if (lossFraction > decreaseLossThreshold || queueBuilding) {
+        // Back off in proportion to the loss, and by a fixed step when only the RTT says so.
+        const double factor = lossFraction > decreaseLossThreshold ? 1.0 - 0.5 * lossFraction : 0.85;
+        m_bitrate = qMax(m_minBitrate, static_cast<int>(m_bitrate * factor));
+        m_cleanIntervals = 0;
+        m_holdIntervals = holdIntervalsAfterDecrease;
+    } else if (m_holdIntervals > 0) {
+        --m_holdIntervals;
+    } else if (lossFraction < increaseLossThreshold) {
+        if (++m_cleanIntervals >= cleanIntervalsBeforeIncrease)
+            m_bitrate = qMin(m_maxBitrate, static_cast<int>(m_bitrate * 1.08) + 1000);
+    } else {
+        m_cleanIntervals = 0;
+    }
+
+    // Only switch audio bandwidth once the bitrate is clearly inside the new band,
+    // so a rate sitting on a boundary does not flap between the two.
+    const int wanted = bandwidthFor(m_bitrate);
+    if (wanted > m_bandwidth && bandwidthFor(static_cast<int>(m_bitrate * 0.9)) == wanted)
+        m_bandwidth = wanted;
+    else if (wanted < m_bandwidth && bandwidthFor(static_cast<int>(m_bitrate * 1.1)) == wanted)
+        m_bandwidth = wanted;
+
+    return settings();
+}
+
+BitrateController::Settings BitrateController::settings() const
+{
+    Settings result;
+    result.bitrate = m_bitrate;
+    result.bandwidth = m_bandwidth;
+    // Ask for a bit more FEC than the loss we see, capped where it stops paying off.
+    result.packetLossPercent = qBound(0, qRound(m_smoothedLoss * 100.0) + 2, 30);
+    return result;
+}
+
+int BitrateController::bandwidthFor(int bitrate) const
+{
+    if (bitrate >= 32000)
+        return OPUS_BANDWIDTH_FULLBAND;
+    if (bitrate >= 20000)
+        return OPUS_BANDWIDTH_SUPERWIDEBAND;
+    if (bitrate >= 12000)
+        return OPUS_BANDWIDTH_WIDEBAND;
+    return OPUS_BANDWIDTH_NARROWBAND;
+}
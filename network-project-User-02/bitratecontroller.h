@@ -0,0 +1,49 @@
+#ifndef BITRATECONTROLLER_H
+#define BITRATECONTROLLER_H
+
+#include <QtGlobal>
+
+// Loss- and RTT-driven target for the Opus encoder, updated once per receiver
+// report interval. Cuts quickly on loss or a growing RTT, climbs back slowly
+// once the link has been clean for a few intervals.
+class BitrateController
+{
+public:
+    struct Settings {
+        int bitrate = 0;
+        int bandwidth = 0;
+        int packetLossPercent = 0;
+
+        bool operator==(const Settings &other) const
+        {
+            return bitrate == other.bitrate && bandwidth == other.bandwidth
+                   && packetLossPercent == other.packetLossPercent;
+        }
+        bool operator!=(const Settings &other) const { return !(*this == other); }
+    };
+
+    BitrateController(int minBitrate = 12000, int maxBitrate = 64000);
+
+    void setBounds(int minBitrate, int maxBitrate);
+    int minBitrate() const;
+    int maxBitrate() const;
+
+    void reset(int bitrate);
+    Settings update(double lossFraction, double rttMs);
+    Settings settings() const;
+
+private:
+    int bandwidthFor(int bitrate) const;
+
+    int m_minBitrate;
+    int m_maxBitrate;
+    int m_bitrate;
+    int m_bandwidth;
+
+    double m_smoothedLoss = 0.0;
+    double m_minRttMs = -1.0;
+    int m_cleanIntervals = 0;
+    int m_holdIntervals = 0;
+};
+
+#endif
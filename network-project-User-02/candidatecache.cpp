@@ -0,0 +1,86 @@
+#include "candidatecache.h"
+#include <QStringList>
+#include "tracing.h"
+
+QMutex CandidateCache::s_mutex;
+QHash<QString, CandidateCache::Entry> CandidateCache::s_entries;
+qint64 CandidateCache::s_ttlMs = 60000;
+
+QString CandidateCache::key(const QStringList &iceServers, const QString &bindAddress, int port)
+{
+    return iceServers.join(",") + "|" + bindAddress + "|" + QString::number(port);
+}
+
+std::vector<rtc::Candidate> CandidateCache::serverReflexive(const QString &key)
+{
+    QMutexLocker locker(&s_mutex);
+    auto it = s_entries.constFind(key);
+    if (it == s_entries.constEnd() || !it->age.isValid() || it->age.elapsed() >= s_ttlMs)
+        return {};
+    return it->serverReflexive;
+}
+
+void CandidateCache::record(const QString &key, const rtc::Candidate &candidate)
+{
+    QMutexLocker locker(&s_mutex);
+    Entry &entry = s_entries[key];
+
+    // A full gathering after expiry starts the entry over.
+    if (entry.age.isValid() && entry.age.elapsed() >= s_ttlMs) {
+        entry.hosts.clear();
+        entry.serverReflexive.clear();
+        entry.age.invalidate();
+    }
+
+    if (candidate.type() == rtc::Candidate::Type::Host) {
+        if (!contains(entry.hosts, candidate))
+            entry.hosts.push_back(candidate);
+    } else if (candidate.type() == rtc::Candidate::Type::ServerReflexive) {
+        if (!contains(entry.serverReflexive, candidate))
+            entry.serverReflexive.push_back(candidate);
+        if (!entry.age.isValid())
+            entry.age.start();
+    }
+}
+
+bool CandidateCache::confirmHost(const QString &key, const rtc::Candidate &candidate)
+{
+    QMutexLocker locker(&s_mutex);
+    auto it = s_entries.find(key);
+    if (it == s_entries.end())
+        return false;
+    if (candidate.type() != rtc::Candidate::Type::Host || contains(it->hosts, candidate))
+        return true;
+
+    TRACE_INSTANT(Signaling, "candidateCacheInvalidated", 0);
+    s_entries.erase(it);
+    return false;
+}
+
+void CandidateCache::invalidate(const QString &key)
+{
+    QMutexLocker locker(&s_mutex);
+    s_entries.remove(key);
+}
+
+qint64 CandidateCache::ttlMs()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_ttlMs;
+}
+
+void CandidateCache::setTtlMs(qint64 ttlMs)
+{
+    QMutexLocker locker(&s_mutex);
+    s_ttlMs = qMax<qint64>(0, ttlMs);
+}
+
+bool CandidateCache::contains(const std::vector<rtc::Candidate> &candidates, const rtc::Candidate &candidate)
+{
+    const std::string line = candidate.candidate();
+    for (const rtc::Candidate &known : candidates) {
+        if (known.candidate() == line)
+            return true;
+    }
+    return false;
+}
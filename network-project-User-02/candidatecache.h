@@ -0,0 +1,47 @@
+#ifndef CANDIDATECACHE_H
+#define CANDIDATECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <vector>
+#include <rtc/rtc.hpp>
+
+// Local candidates from earlier calls, per ICE configuration. A server
+// reflexive candidate is the NAT's mapping of one local socket, so it only
+// carries over when every connection shares that socket (an ICE UDP mux on a
+// fixed port). Within the TTL a new connection then gathers host candidates
+// only, which needs no network, and the STUN results are taken from here. Host
+// candidates are kept to notice the network changing under the cache.
+class CandidateCache
+{
+public:
+    static QString key(const QStringList &iceServers, const QString &bindAddress, int port);
+
+    // Fresh server reflexive candidates, or none when a full gathering is due.
+    static std::vector<rtc::Candidate> serverReflexive(const QString &key);
+
+    static void record(const QString &key, const rtc::Candidate &candidate);
+    // True if the candidate matches what was cached; a new host candidate drops the entry.
+    static bool confirmHost(const QString &key, const rtc::Candidate &candidate);
+    static void invalidate(const QString &key);
+
+    static qint64 ttlMs();
+    static void setTtlMs(qint64 ttlMs);
+
+private:
+    struct Entry {
+        std::vector<rtc::Candidate> hosts;
+        std::vector<rtc::Candidate> serverReflexive;
+        QElapsedTimer age;
+    };
+
+    static bool contains(const std::vector<rtc::Candidate> &candidates, const rtc::Candidate &candidate);
+
+    static QMutex s_mutex;
+    static QHash<QString, Entry> s_entries;
+    static qint64 s_ttlMs;
+};
+
+#endif
@@ -0,0 +1,811 @@
+#include "captureprocessing.h"
+#include <QDebug>
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+#include "audiomixer.h"
+#include "tracing.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CAPTUREPROCESSING_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The echo canceller's tap counts are kept to multiples of this, so no kernel needs a tail loop.
+const int tapMultiple = 8;
+
+opus_int16 toSample(double value)
+{
+    return static_cast<opus_int16>(qBound(-32768, qRound(value), 32767));
+}
+
+double meanSquare(const opus_int16 *pcm, int samples)
+{
+    if (samples <= 0)
+        return 0.0;
+
+    qint64 sumOfSquares = 0;
+    for (int i = 0; i < samples; ++i) {
+        sumOfSquares += static_cast<qint32>(pcm[i]) * pcm[i];
+    }
+    return static_cast<double>(sumOfSquares) / samples;
+}
+
+float dotScalar(const float *a, const float *b, int count)
+{
+    float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+    for (int i = 0; i < count; i += 4) {
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+void addScaledScalar(float *destination, const float *source, float scale, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        destination[i] += scale * source[i];
+    }
+}
+
+#ifdef CAPTUREPROCESSING_X86
+
+__attribute__((target("sse2")))
+float dotSse2(const float *a, const float *b, int count)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("sse2")))
+void addScaledSse2(float *destination, const float *source, float scale, int count)
+{
+    const __m128 factor = _mm_set1_ps(scale);
+    for (int i = 0; i < count; i += 4) {
+        _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i),
+                                                  _mm_mul_ps(factor, _mm_loadu_ps(source + i))));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float *a, const float *b, int count)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    if (i < count)
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+
+    const __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    folded = _mm_add_ps(folded, _mm_movehl_ps(folded, folded));
+    folded = _mm_add_ss(folded, _mm_shuffle_ps(folded, folded, 1));
+    return _mm_cvtss_f32(folded);
+}
+
+__attribute__((target("avx2,fma")))
+void addScaledAvx2(float *destination, const float *source, float scale, int count)
+{
+    const __m256 factor = _mm256_set1_ps(scale);
+    for (int i = 0; i < count; i += 8) {
+        _mm256_storeu_ps(destination + i, _mm256_fmadd_ps(factor, _mm256_loadu_ps(source + i),
+                                                          _mm256_loadu_ps(destination + i)));
+    }
+}
+
+#endif
+
+struct Kernels {
+    float (*dot)(const float *, const float *, int);
+    void (*addScaled)(float *, const float *, float, int);
+    const char *name;
+};
+
+Kernels selectKernels()
+{
+#ifdef CAPTUREPROCESSING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { dotAvx2, addScaledAvx2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { dotSse2, addScaledSse2, "sse2" };
+#endif
+    return { dotScalar, addScaledScalar, "scalar" };
+}
+
+const Kernels kernels = selectKernels();
+
+// Applies a gain that moves linearly from one value to the other across the frame.
+void applyGainRamp(opus_int16 *pcm, int frames, int channels, double from, double to)
+{
+    if (from == 1.0 && to == 1.0)
+        return;
+
+    const double step = (to - from) / frames;
+    for (int i = 0; i < frames; ++i) {
+        const double gain = from + step * (i + 1);
+        for (int channel = 0; channel < channels; ++channel) {
+            opus_int16 &sample = pcm[i * channels + channel];
+            sample = toSample(sample * gain);
+        }
+    }
+}
+
+}
+
+
+HighPassFilter::HighPassFilter(double cutoffHz)
+    : m_cutoffHz(cutoffHz)
+{
+}
+
+const char *HighPassFilter::name() const
+{
+    return "highpass";
+}
+
+// The RBJ cookbook high-pass with Q = 1/sqrt(2).
+void HighPassFilter::prepare(int sampleRate, int channels, int frameSize)
+{
+    Q_UNUSED(frameSize)
+
+    const double w0 = 2.0 * M_PI * m_cutoffHz / sampleRate;
+    const double alpha = qSin(w0) / (2.0 * M_SQRT1_2);
+    const double cosW0 = qCos(w0);
+    const double a0 = 1.0 + alpha;
+
+    m_b0 = (1.0 + cosW0) / 2.0 / a0;
+    m_b1 = -(1.0 + cosW0) / a0;
+    m_b2 = m_b0;
+    m_a1 = -2.0 * cosW0 / a0;
+    m_a2 = (1.0 - alpha) / a0;
+
+    m_channels = channels;
+    m_states.assign(channels, State());
+}
+
+void HighPassFilter::process(opus_int16 *pcm, int frames)
+{
+    for (int channel = 0; channel < m_channels; ++channel) {
+        State &state = m_states[channel];
+        for (int i = 0; i < frames; ++i) {
+            opus_int16 &sample = pcm[i * m_channels + channel];
+            const double x = sample;
+            const double y = m_b0 * x + m_b1 * state.x1 + m_b2 * state.x2 - m_a1 * state.y1 - m_a2 * state.y2;
+            state.x2 = state.x1;
+            state.x1 = x;
+            state.y2 = state.y1;
+            state.y1 = y;
+            sample = toSample(y);
+        }
+    }
+}
+
+void HighPassFilter::reset()
+{
+    std::fill(m_states.begin(), m_states.end(), State());
+}
+
+
+EchoCanceller::EchoCanceller(double tailMs, double maxDelayMs)
+    : m_tailMs(tailMs),
+    m_maxDelayMs(maxDelayMs),
+    m_reference(maxReferenceSamples)
+{
+}
+
+const char *EchoCanceller::name() const
+{
+    return "aec";
+}
+
+void EchoCanceller::prepare(int sampleRate, int channels, int frameSize)
+{
+    m_channels = channels;
+    m_taps = qMax(tapMultiple, qRound(m_tailMs * sampleRate / 1000.0) / tapMultiple * tapMultiple);
+    // The sink takes its reference in bursts of up to a period; a longer queue
+    // means playout ran ahead of capture, and the excess is dropped. The delay
+    // estimator then finds the new alignment.
+    m_maxBacklog = qMin(sampleRate / 25, m_reference.capacity() - frameSize);
+    m_blockSize = qMax(1, sampleRate / 500);
+    const int lags = qMax(1, qRound(m_maxDelayMs * sampleRate / 1000.0) / m_blockSize);
+    m_maxDelay = lags * m_blockSize;
+    m_delay = 0;
+
+    m_weights.assign(static_cast<size_t>(m_taps) * channels, 0.0f);
+    m_adaptiveWeights.assign(static_cast<size_t>(m_taps) * channels, 0.0f);
+    m_history.assign(m_maxDelay + m_taps - 1 + frameSize, 0.0f);
+    m_referenceFrame.fill(0, frameSize);
+    m_referenceEnvelope.assign(lags, 0.0f);
+    m_correlation.assign(lags, 0.0f);
+    reset();
+}
+
+void EchoCanceller::process(opus_int16 *pcm, int frames)
+{
+    if (frames > m_referenceFrame.size())
+        return;
+
+    // Playout and capture do not tick together, so a little reference may be queued.
+    while (m_reference.available() > frames + m_maxBacklog) {
+        const int excess = m_reference.available() - frames - m_maxBacklog;
+        m_reference.read(m_referenceFrame.data(), qMin(excess, m_referenceFrame.size()));
+    }
+
+    // A short read means playout had nothing for this stretch, which is silence.
+    const int referenceFrames = m_reference.read(m_referenceFrame.data(), frames);
+    if (referenceFrames < frames)
+        std::memset(m_referenceFrame.data() + referenceFrames, 0, (frames - referenceFrames) * sizeof(opus_int16));
+
+    estimateDelay(pcm, frames);
+
+    float *current = m_history.data() + m_maxDelay + m_taps - 1;
+    float *history = current - (m_taps - 1) - m_delay;
+    float maxReference = 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        current[i] = m_referenceFrame[i];
+    }
+    for (int i = 0; i < m_taps - 1 + frames; ++i) {
+        maxReference = qMax(maxReference, qAbs(history[i]));
+    }
+
+    // Nothing was played over the whole tail, so there is no echo to take out.
+    if (maxReference >= AudioMixer::silenceThreshold) {
+        const float stepSize = 0.5f;
+        const double regularization = 1.0e4 * m_taps;
+
+        for (int channel = 0; channel < m_channels; ++channel) {
+            float *weights = m_weights.data() + static_cast<size_t>(channel) * m_taps;
+            float *adaptiveWeights = m_adaptiveWeights.data() + static_cast<size_t>(channel) * m_taps;
+
+            double energy = 0.0;
+            for (int k = 0; k < m_taps; ++k) {
+                energy += double(history[k]) * history[k];
+            }
+
+            double captureEnergy = 0.0;
+            double adaptiveErrorEnergy = 0.0;
+            double errorEnergy = 0.0;
+            for (int i = 0; i < frames; ++i) {
+                const float *window = history + i;
+                opus_int16 &sample = pcm[i * m_channels + channel];
+
+                const float adaptiveError = sample - kernels.dot(adaptiveWeights, window, m_taps);
+                const float step = stepSize * adaptiveError / static_cast<float>(energy + regularization);
+                kernels.addScaled(adaptiveWeights, window, step, m_taps);
+
+                const float error = sample - kernels.dot(weights, window, m_taps);
+                captureEnergy += double(sample) * sample;
+                adaptiveErrorEnergy += double(adaptiveError) * adaptiveError;
+                errorEnergy += double(error) * error;
+                sample = toSample(error);
+
+                if (i + 1 < frames) {
+                    energy += double(window[m_taps]) * window[m_taps] - double(window[0]) * window[0];
+                    energy = qMax(0.0, energy);
+                }
+            }
+
+            // Near-end talk drags the adaptive filter away from the echo path, but
+            // never makes it cancel better, so it only takes over when it clearly does.
+            if (adaptiveErrorEnergy < 0.5 * errorEnergy && adaptiveErrorEnergy < captureEnergy)
+                std::memcpy(weights, adaptiveWeights, m_taps * sizeof(float));
+        }
+    }
+
+    std::memmove(m_history.data(), m_history.data() + frames, (m_maxDelay + m_taps - 1) * sizeof(float));
+}
+
+void EchoCanceller::reset()
+{
+    std::fill(m_weights.begin(), m_weights.end(), 0.0f);
+    std::fill(m_adaptiveWeights.begin(), m_adaptiveWeights.end(), 0.0f);
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    m_reference.clear();
+
+    m_delay = 0;
+    m_blockFill = 0;
+    m_blockReference = 0.0f;
+    m_blockCapture = 0.0f;
+    std::fill(m_referenceEnvelope.begin(), m_referenceEnvelope.end(), 0.0f);
+    std::fill(m_correlation.begin(), m_correlation.end(), 0.0f);
+    m_envelopePosition = 0;
+    m_silentBlocks = static_cast<int>(m_referenceEnvelope.size());
+    m_referenceMean = 0.0f;
+    m_captureMean = 0.0f;
+    m_referenceVariance = 0.0f;
+    m_captureVariance = 0.0f;
+    m_candidateLag = -1;
+    m_candidateBlocks = 0;
+}
+
+// Runs on the capture before it is cancelled, against this frame's reference.
+// The lag whose envelope tracks the capture best over the last second or so
+// is taken once it has led for 100 ms, and only when it explains a fair part of
+// the capture, so near-end talk and silence leave the delay alone.
+void EchoCanceller::estimateDelay(const opus_int16 *pcm, int frames)
+{
+    const int lags = static_cast<int>(m_referenceEnvelope.size());
+    const float smoothing = 1.0f / 500.0f;
+    const float minCorrelation = 0.4f;
+    const int leadBlocks = 50;
+
+    for (int i = 0; i < frames; ++i) {
+        int capture = 0;
+        for (int channel = 0; channel < m_channels; ++channel) {
+            capture += qAbs(static_cast<int>(pcm[i * m_channels + channel]));
+        }
+        m_blockCapture += static_cast<float>(capture) / m_channels;
+        m_blockReference += qAbs(static_cast<int>(m_referenceFrame[i]));
+        if (++m_blockFill < m_blockSize)
+            continue;
+
+        const float reference = m_blockReference / m_blockSize;
+        const float captured = m_blockCapture / m_blockSize;
+        m_blockFill = 0;
+        m_blockReference = 0.0f;
+        m_blockCapture = 0.0f;
+
+        m_envelopePosition = (m_envelopePosition + 1) % lags;
+        m_referenceEnvelope[m_envelopePosition] = reference;
+        m_silentBlocks = reference < AudioMixer::silenceThreshold ? m_silentBlocks + 1 : 0;
+        // With nothing played over the whole range there is no echo to line up with.
+        if (m_silentBlocks >= lags)
+            continue;
+
+        m_referenceMean += (reference - m_referenceMean) * smoothing;
+        m_captureMean += (captured - m_captureMean) * smoothing;
+        const float referenceDeviation = reference - m_referenceMean;
+        const float captureDeviation = captured - m_captureMean;
+        m_referenceVariance += (referenceDeviation * referenceDeviation - m_referenceVariance) * smoothing;
+        m_captureVariance += (captureDeviation * captureDeviation - m_captureVariance) * smoothing;
+
+        int bestLag = 0;
+        for (int lag = 0, position = m_envelopePosition; lag < lags; ++lag) {
+            const float deviation = m_referenceEnvelope[position] - m_referenceMean;
+            m_correlation[lag] += (captureDeviation * deviation - m_correlation[lag]) * smoothing;
+            if (m_correlation[lag] > m_correlation[bestLag])
+                bestLag = lag;
+            position = position > 0 ? position - 1 : lags - 1;
+        }
+
+        const float scale = qSqrt(m_referenceVariance * m_captureVariance);
+        if (scale <= 0.0f || m_correlation[bestLag] < minCorrelation * scale) {
+            m_candidateBlocks = 0;
+            continue;
+        }
+
+        m_candidateBlocks = bestLag == m_candidateLag ? m_candidateBlocks + 1 : 0;
+        m_candidateLag = bestLag;
+        // The filters start two blocks early, so they hold the onset of the echo
+        // even when the estimate is a block late.
+        if (m_candidateBlocks == leadBlocks)
+            setDelay(qMax(0, (bestLag - 2) * m_blockSize));
+    }
+}
+
+// The weights are moved along with the delay, so what the filters learnt at
+// the old one is not lost when the estimate is refined.
+void EchoCanceller::setDelay(int delay)
+{
+    delay = qBound(0, delay, m_maxDelay);
+    const int shift = delay - m_delay;
+    if (shift == 0)
+        return;
+
+    for (std::vector<float> *filters : { &m_weights, &m_adaptiveWeights }) {
+        for (int channel = 0; channel < m_channels; ++channel) {
+            float *weights = filters->data() + static_cast<size_t>(channel) * m_taps;
+            if (qAbs(shift) >= m_taps) {
+                std::fill(weights, weights + m_taps, 0.0f);
+            } else if (shift > 0) {
+                std::memmove(weights + shift, weights, (m_taps - shift) * sizeof(float));
+                std::fill(weights, weights + shift, 0.0f);
+            } else {
+                std::memmove(weights, weights - shift, (m_taps + shift) * sizeof(float));
+                std::fill(weights + m_taps + shift, weights + m_taps, 0.0f);
+            }
+        }
+    }
+
+    m_delay = delay;
+    TRACE_COUNTER(Capture, "echoDelay", m_delay);
+}
+
+void EchoCanceller::feedReference(const opus_int16 *pcm, int frames, int channels)
+{
+    if (!m_active.load(std::memory_order_relaxed) || frames <= 0)
+        return;
+
+    if (channels == 1) {
+        m_reference.write(pcm, frames);
+        return;
+    }
+
+    opus_int16 mono[256];
+    for (int offset = 0; offset < frames; offset += 256) {
+        const int count = qMin(256, frames - offset);
+        AudioMixer::remix(pcm + offset * channels, channels, mono, 1, count);
+        m_reference.write(mono, count);
+    }
+}
+
+void EchoCanceller::setActive(bool active)
+{
+    m_active.store(active, std::memory_order_relaxed);
+}
+
+const char *EchoCanceller::implementation()
+{
+    return kernels.name;
+}
+
+
+NoiseFloorTracker::NoiseFloorTracker(double minimumFloor)
+    : m_minimumFloor(minimumFloor)
+{
+    reset();
+}
+
+void NoiseFloorTracker::update(double energy, double rise)
+{
+    if (!m_seeded) {
+        m_floor = qMax(energy, m_minimumFloor);
+        m_seeded = true;
+    } else if (energy < m_floor) {
+        m_floor = qMax(energy, m_minimumFloor);
+    } else {
+        m_floor += (energy - m_floor) * rise;
+    }
+}
+
+double NoiseFloorTracker::floor() const
+{
+    return m_floor;
+}
+
+void NoiseFloorTracker::reset()
+{
+    m_floor = m_minimumFloor;
+    m_seeded = false;
+}
+
+
+NoiseGate::NoiseGate(double attenuationDb)
+    : m_closedGain(qPow(10.0, -attenuationDb / 20.0)),
+    m_noiseFloor(minimumOpenEnergy / 4.0)
+{
+}
+
+const char *NoiseGate::name() const
+{
+    return "gate";
+}
+
+void NoiseGate::prepare(int sampleRate, int channels, int frameSize)
+{
+    Q_UNUSED(frameSize)
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    reset();
+}
+
+void NoiseGate::process(opus_int16 *pcm, int frames)
+{
+    const double seconds = double(frames) / m_sampleRate;
+    const double energy = meanSquare(pcm, frames * m_channels);
+
+    // Up by about 10% a second.
+    m_noiseFloor.update(energy, qMin(1.0, 0.1 * seconds));
+
+    const int hangoverSamples = m_sampleRate / 5;
+    bool open = energy > qMax(m_noiseFloor.floor() * 4.0, minimumOpenEnergy);
+    if (open) {
+        m_holdSamples = hangoverSamples;
+    } else if (m_holdSamples > 0) {
+        m_holdSamples -= frames;
+        open = true;
+    }
+
+    // Opens within the frame, closes over about 50 ms.
+    double gain = 1.0;
+    if (!open)
+        gain = qMax(m_closedGain, m_gain * qPow(m_closedGain, seconds / 0.05));
+
+    applyGainRamp(pcm, frames, m_channels, m_gain, gain);
+    m_gain = gain;
+}
+
+void NoiseGate::reset()
+{
+    m_noiseFloor.reset();
+    m_gain = 1.0;
+    m_holdSamples = 0;
+}
+
+
+GainControl::GainControl(double targetDbfs, double maxGainDb)
+    : m_targetDbfs(targetDbfs),
+    m_maxGainDb(maxGainDb)
+{
+}
+
+const char *GainControl::name() const
+{
+    return "agc";
+}
+
+void GainControl::prepare(int sampleRate, int channels, int frameSize)
+{
+    Q_UNUSED(frameSize)
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    reset();
+}
+
+void GainControl::process(opus_int16 *pcm, int frames)
+{
+    const int samples = frames * m_channels;
+    const double seconds = double(frames) / m_sampleRate;
+    const double energy = meanSquare(pcm, samples);
+    const double frameDbfs = energy > 0.0 ? 10.0 * std::log10(energy / (32768.0 * 32768.0)) : -100.0;
+
+    double gainDb = m_gainDb;
+    const double speechThresholdDbfs = -50.0;
+    if (frameDbfs > speechThresholdDbfs) {
+        // About 100 ms to follow a louder talker, a second to follow a quieter one.
+        if (m_levelDbfs <= -100.0) {
+            m_levelDbfs = frameDbfs;
+        } else {
+            const double timeConstant = frameDbfs > m_levelDbfs ? 0.1 : 1.0;
+            m_levelDbfs += (frameDbfs - m_levelDbfs) * (1.0 - qExp(-seconds / timeConstant));
+        }
+
+        const double wantedDb = qBound(-m_maxGainDb, m_targetDbfs - m_levelDbfs, m_maxGainDb);
+        gainDb += qBound(-20.0 * seconds, wantedDb - gainDb, 6.0 * seconds);
+    }
+
+    // Never push the frame's peak past about -0.5 dBFS.
+    const int peak = AudioMixer::peak(pcm, samples);
+    const double ceiling = 31000.0;
+    if (peak > 0 && peak * qPow(10.0, gainDb / 20.0) > ceiling)
+        gainDb = 20.0 * std::log10(ceiling / peak);
+
+    applyGainRamp(pcm, frames, m_channels, qPow(10.0, m_gainDb / 20.0), qPow(10.0, gainDb / 20.0));
+    m_gainDb = gainDb;
+}
+
+void GainControl::reset()
+{
+    m_levelDbfs = -100.0;
+    m_gainDb = 0.0;
+}
+
+
+CaptureProcessingChain::CaptureProcessingChain()
+{
+    m_slots[HighPass].stage.reset(new HighPassFilter());
+    m_echoCanceller = new EchoCanceller();
+    m_slots[Echo].stage.reset(m_echoCanceller);
+    m_slots[Gate].stage.reset(new NoiseGate());
+    m_slots[Gain].stage.reset(new GainControl());
+
+    // Only the filter by default; it changes nothing audible in speech.
+    setEnabled(HighPass, true);
+}
+
+void CaptureProcessingChain::prepare(int sampleRate, int channels, int frameSize)
+{
+    for (Slot &slot : m_slots) {
+        slot.stage->prepare(sampleRate, channels, frameSize);
+    }
+}
+
+void CaptureProcessingChain::process(opus_int16 *pcm, int frames)
+{
+    qint64 frameNs = 0;
+
+    for (Slot &slot : m_slots) {
+        if (!slot.enabled.load(std::memory_order_relaxed))
+            continue;
+
+        const qint64 start = Tracing::now();
+        slot.stage->process(pcm, frames);
+        const qint64 duration = Tracing::now() - start;
+        frameNs += duration;
+
+        // Only this thread writes them, so plain stores are enough.
+        slot.frames.store(slot.frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot.totalNs.store(slot.totalNs.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+        slot.lastNs.store(duration, std::memory_order_relaxed);
+        if (duration > slot.maxNs.load(std::memory_order_relaxed))
+            slot.maxNs.store(duration, std::memory_order_relaxed);
+
+#ifndef VOICE_CALL_NO_TRACING
+        if (Tracing::isEnabled())
+            Tracing::complete(Tracing::Capture, slot.stage->name(), start, duration);
+#endif
+    }
+
+    const qint64 budgetNs = m_budgetNs.load(std::memory_order_relaxed);
+    if (budgetNs > 0 && frameNs > budgetNs) {
+        m_overBudgetFrames.fetch_add(1, std::memory_order_relaxed);
+        TRACE_WARNING(Capture) << "Capture processing took" << frameNs / 1000.0 << "us, over its"
+                               << budgetNs / 1000.0 << "us budget";
+    }
+}
+
+void CaptureProcessingChain::reset()
+{
+    for (Slot &slot : m_slots) {
+        slot.stage->reset();
+    }
+}
+
+bool CaptureProcessingChain::configure(const QString &spec)
+{
+    QVector<bool> enabled;
+    if (!parseSpec(spec, &enabled)) {
+        qWarning() << "Invalid capture processing spec:" << spec << "- expected \"none\" or some of" << stageNames();
+        return false;
+    }
+
+    for (int index = 0; index < StageCount; ++index) {
+        setEnabled(index, enabled[index]);
+    }
+    return true;
+}
+
+bool CaptureProcessingChain::isValidSpec(const QString &spec)
+{
+    QVector<bool> enabled;
+    return parseSpec(spec, &enabled);
+}
+
+QString CaptureProcessingChain::configuration() const
+{
+    QStringList names;
+    for (const Slot &slot : m_slots) {
+        if (slot.enabled.load(std::memory_order_relaxed))
+            names.append(QString::fromLatin1(slot.stage->name()));
+    }
+    return names.isEmpty() ? QStringLiteral("none") : names.join(',');
+}
+
+bool CaptureProcessingChain::setStageEnabled(const QString &name, bool enabled)
+{
+    const int index = stageIndex(name);
+    if (index < 0) {
+        qWarning() << "Unknown capture processing stage:" << name;
+        return false;
+    }
+
+    setEnabled(index, enabled);
+    return true;
+}
+
+bool CaptureProcessingChain::isActive() const
+{
+    for (const Slot &slot : m_slots) {
+        if (slot.enabled.load(std::memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+void CaptureProcessingChain::setBudgetUs(double budgetUs)
+{
+    m_budgetNs.store(static_cast<qint64>(budgetUs * 1000.0), std::memory_order_relaxed);
+}
+
+double CaptureProcessingChain::budgetUs() const
+{
+    return m_budgetNs.load(std::memory_order_relaxed) / 1000.0;
+}
+
+quint64 CaptureProcessingChain::overBudgetFrames() const
+{
+    return m_overBudgetFrames.load(std::memory_order_relaxed);
+}
+
+QVector<CaptureProcessingChain::StageStatistics> CaptureProcessingChain::statistics() const
+{
+    QVector<StageStatistics> result;
+    result.reserve(StageCount);
+
+    for (const Slot &slot : m_slots) {
+        StageStatistics statistics;
+        statistics.name = QString::fromLatin1(slot.stage->name());
+        statistics.enabled = slot.enabled.load(std::memory_order_relaxed);
+        statistics.frames = slot.frames.load(std::memory_order_relaxed);
+        const qint64 totalNs = slot.totalNs.load(std::memory_order_relaxed);
+        statistics.meanUs = statistics.frames > 0 ? totalNs / 1000.0 / statistics.frames : 0.0;
+        statistics.lastUs = slot.lastNs.load(std::memory_order_relaxed) / 1000.0;
+        statistics.maxUs = slot.maxNs.load(std::memory_order_relaxed) / 1000.0;
+        result.append(statistics);
+    }
+    return result;
+}
+
+void CaptureProcessingChain::resetStatistics()
+{
+    for (Slot &slot : m_slots) {
+        slot.frames.store(0, std::memory_order_relaxed);
+        slot.totalNs.store(0, std::memory_order_relaxed);
+        slot.lastNs.store(0, std::memory_order_relaxed);
+        slot.maxNs.store(0, std::memory_order_relaxed);
+    }
+    m_overBudgetFrames.store(0, std::memory_order_relaxed);
+}
+
+EchoCanceller *CaptureProcessingChain::echoCanceller() const
+{
+    return m_echoCanceller;
+}
+
+QStringList CaptureProcessingChain::stageNames()
+{
+    return { "highpass", "aec", "gate", "agc" };
+}
+
+// stageNames() is in Stage order.
+int CaptureProcessingChain::stageIndex(const QString &name)
+{
+    const QStringList names = stageNames();
+    for (int index = 0; index < names.size(); ++index) {
+        if (name.compare(names[index], Qt::CaseInsensitive) == 0)
+            return index;
+    }
+    return -1;
+}
+
+bool CaptureProcessingChain::parseSpec(const QString &spec, QVector<bool> *enabled)
+{
+    enabled->fill(false, StageCount);
+    const QString trimmed = spec.trimmed();
+    if (trimmed.isEmpty() || trimmed.compare("none", Qt::CaseInsensitive) == 0)
+        return true;
+
+    const QStringList names = trimmed.split(',', Qt::SkipEmptyParts);
+    for (const QString &name : names) {
+        const int index = stageIndex(name.trimmed());
+        if (index < 0)
+            return false;
+        (*enabled)[index] = true;
+    }
+    return true;
+}
+
+// A stage switched on starts from a clean state rather than one left from
+// whenever it last ran.
+void CaptureProcessingChain::setEnabled(int index, bool enabled)
+{
+    Slot &slot = m_slots[index];
+    if (slot.enabled.load(std::memory_order_relaxed) == enabled)
+        return;
+
+    if (enabled)
+        slot.stage->reset();
+    if (index == Echo)
+        m_echoCanceller->setActive(enabled);
+    slot.enabled.store(enabled, std::memory_order_relaxed);
+}
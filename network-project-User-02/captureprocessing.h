@@ -0,0 +1,273 @@
+#ifndef CAPTUREPROCESSING_H
+#define CAPTUREPROCESSING_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <opus.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "spscringbuffer.h"
+
+// One step of AudioInput's capture processing. prepare() runs before capture
+// starts and does all the allocation; process() then works on one frame of
+// interleaved PCM in place, and must not allocate, lock or block.
+class CaptureProcessingStage
+{
+public:
+    virtual ~CaptureProcessingStage() = default;
+
+    // A string literal; it is what the chain's spec and the trace use.
+    virtual const char *name() const = 0;
+    virtual void prepare(int sampleRate, int channels, int frameSize) = 0;
+    virtual void process(opus_int16 *pcm, int frames) = 0;
+    // Forgets the signal seen so far, as at the start of a capture.
+    virtual void reset() = 0;
+};
+
+// Second-order Butterworth high-pass that takes out rumble, handling noise and
+// DC before anything measures levels.
+class HighPassFilter : public CaptureProcessingStage
+{
+public:
+    explicit HighPassFilter(double cutoffHz = 80.0);
+
+    const char *name() const override;
+    void prepare(int sampleRate, int channels, int frameSize) override;
+    void process(opus_int16 *pcm, int frames) override;
+    void reset() override;
+
+private:
+    struct State {
+        double x1 = 0.0;
+        double x2 = 0.0;
+        double y1 = 0.0;
+        double y2 = 0.0;
+    };
+
+    const double m_cutoffHz;
+    int m_channels = 1;
+    double m_b0 = 1.0;
+    double m_b1 = 0.0;
+    double m_b2 = 0.0;
+    double m_a1 = 0.0;
+    double m_a2 = 0.0;
+    std::vector<State> m_states;
+};
+
+// NLMS echo canceller against what AudioOutput played. The reference arrives
+// through a wait-free ring from the playout side, mixed down to mono, and every
+// captured channel gets its own filter over tailMs of it. Two filters per
+// channel, in fact: one adapts on every sample, and the one whose output is
+// sent copies it only when it cancels clearly better over a frame, so near-end
+// talk never gets learnt as echo. The reference is taken as the sink is handed
+// it, so the echo comes back only after the sink's buffer, the room and the
+// capture buffer, often much longer than the tail. A coarse estimator
+// cross-correlates 2 ms envelopes of reference and capture over up to
+// maxDelayMs, and the filters run that far behind the reference, with enough
+// history kept to cover it. The filters run on AVX2/FMA or SSE2 kernels picked
+// once at startup, like the Resampler's.
+class EchoCanceller : public CaptureProcessingStage
+{
+public:
+    explicit EchoCanceller(double tailMs = 32.0, double maxDelayMs = 500.0);
+
+    const char *name() const override;
+    void prepare(int sampleRate, int channels, int frameSize) override;
+    void process(opus_int16 *pcm, int frames) override;
+    void reset() override;
+
+    // Playout side, from one thread: the frames just handed to the sink.
+    // Ignored while the stage is not active.
+    void feedReference(const opus_int16 *pcm, int frames, int channels);
+    void setActive(bool active);
+
+    static const char *implementation();
+
+    static const int maxReferenceSamples = 48000;
+
+private:
+    void estimateDelay(const opus_int16 *pcm, int frames);
+    void setDelay(int delay);
+
+    const double m_tailMs;
+    const double m_maxDelayMs;
+    int m_channels = 1;
+    int m_taps = 0;
+    int m_maxBacklog = 0;
+    int m_maxDelay = 0;
+    // How far behind the current frame the filters' newest tap is, in samples.
+    int m_delay = 0;
+
+    // Reversed so the filters run along m_history like a dot product.
+    std::vector<float> m_weights;
+    std::vector<float> m_adaptiveWeights;
+    // The newest m_maxDelay + m_taps - 1 reference samples, then the current frame's.
+    std::vector<float> m_history;
+    QVector<opus_int16> m_referenceFrame;
+
+    // The delay estimator works on the mean magnitude of each block of samples.
+    int m_blockSize = 0;
+    int m_blockFill = 0;
+    float m_blockReference = 0.0f;
+    float m_blockCapture = 0.0f;
+    // The reference envelope, newest block at m_envelopePosition, and for each lag
+    // in blocks, a running covariance of the capture envelope with it.
+    std::vector<float> m_referenceEnvelope;
+    std::vector<float> m_correlation;
+    int m_envelopePosition = 0;
+    int m_silentBlocks = 0;
+    float m_referenceMean = 0.0f;
+    float m_captureMean = 0.0f;
+    float m_referenceVariance = 0.0f;
+    float m_captureVariance = 0.0f;
+    int m_candidateLag = -1;
+    int m_candidateBlocks = 0;
+
+    std::atomic<bool> m_active{false};
+    SpscRingBuffer<opus_int16> m_reference;
+};
+
+// Background level of a signal, from the energy of each frame: it drops to a
+// quieter frame at once and rises by a fraction of the way towards a louder
+// one, so speech cannot drag it along. It is seeded once, by the first frame,
+// and never goes below minimumFloor, so a talkspurt that follows digital
+// silence is not taken for the noise.
+class NoiseFloorTracker
+{
+public:
+    explicit NoiseFloorTracker(double minimumFloor);
+
+    void update(double energy, double rise);
+    double floor() const;
+    void reset();
+
+private:
+    const double m_minimumFloor;
+    double m_floor = 0.0;
+    bool m_seeded = false;
+};
+
+// Gate against a tracked noise floor: frames near the floor are attenuated
+// rather than muted, and the gain moves smoothly across each frame so the
+// gate never clicks. A hangover keeps word endings.
+class NoiseGate : public CaptureProcessingStage
+{
+public:
+    explicit NoiseGate(double attenuationDb = 24.0);
+
+    const char *name() const override;
+    void prepare(int sampleRate, int channels, int frameSize) override;
+    void process(opus_int16 *pcm, int frames) override;
+    void reset() override;
+
+    // Roughly -60 dBFS; quieter frames never open the gate.
+    static constexpr double minimumOpenEnergy = 1000.0;
+
+private:
+    const double m_closedGain;
+    int m_sampleRate = 48000;
+    int m_channels = 1;
+    NoiseFloorTracker m_noiseFloor;
+    double m_gain = 1.0;
+    int m_holdSamples = 0;
+};
+
+// Automatic gain control towards targetDbfs. The level estimate only follows
+// frames loud enough to be speech, so pauses are not pumped up; the gain
+// rises slowly, falls faster, and is cut at once when a frame would clip.
+class GainControl : public CaptureProcessingStage
+{
+public:
+    explicit GainControl(double targetDbfs = -18.0, double maxGainDb = 24.0);
+
+    const char *name() const override;
+    void prepare(int sampleRate, int channels, int frameSize) override;
+    void process(opus_int16 *pcm, int frames) override;
+    void reset() override;
+
+private:
+    const double m_targetDbfs;
+    const double m_maxGainDb;
+    int m_sampleRate = 48000;
+    int m_channels = 1;
+    double m_levelDbfs = -100.0;
+    double m_gainDb = 0.0;
+};
+
+// The stages in the order AudioInput runs them: high-pass, echo canceller,
+// noise gate, gain control. Each can be switched on and off while capture
+// runs; every enabled stage is timed on every frame, and the frame as a whole
+// is checked against a CPU budget. configure() and process() belong to the
+// capture thread; statistics() can be read from any thread.
+class CaptureProcessingChain
+{
+public:
+    struct StageStatistics {
+        QString name;
+        bool enabled = false;
+        quint64 frames = 0;
+        double meanUs = 0.0;
+        double lastUs = 0.0;
+        double maxUs = 0.0;
+    };
+
+    CaptureProcessingChain();
+
+    void prepare(int sampleRate, int channels, int frameSize);
+    void process(opus_int16 *pcm, int frames);
+    void reset();
+
+    // A comma-separated list of stage names, such as "highpass,aec,gate,agc";
+    // "none" or an empty spec turns them all off. False, and no change, when a
+    // name is unknown.
+    bool configure(const QString &spec);
+    static bool isValidSpec(const QString &spec);
+    QString configuration() const;
+    bool setStageEnabled(const QString &name, bool enabled);
+    bool isActive() const;
+
+    // Per frame, for all enabled stages together.
+    void setBudgetUs(double budgetUs);
+    double budgetUs() const;
+    quint64 overBudgetFrames() const;
+
+    QVector<StageStatistics> statistics() const;
+    void resetStatistics();
+
+    // For AudioOutput to feed the playout reference into.
+    EchoCanceller *echoCanceller() const;
+
+    static QStringList stageNames();
+    static constexpr double defaultBudgetUs = 2000.0;
+
+private:
+    enum Stage {
+        HighPass,
+        Echo,
+        Gate,
+        Gain,
+        StageCount
+    };
+
+    struct Slot {
+        std::unique_ptr<CaptureProcessingStage> stage;
+        std::atomic<bool> enabled{false};
+        std::atomic<quint64> frames{0};
+        std::atomic<qint64> totalNs{0};
+        std::atomic<qint64> lastNs{0};
+        std::atomic<qint64> maxNs{0};
+    };
+
+    static int stageIndex(const QString &name);
+    static bool parseSpec(const QString &spec, QVector<bool> *enabled);
+    void setEnabled(int index, bool enabled);
+
+    Slot m_slots[StageCount];
+    EchoCanceller *m_echoCanceller = nullptr;
+    std::atomic<qint64> m_budgetNs{static_cast<qint64>(defaultBudgetUs * 1000.0)};
+    std::atomic<quint64> m_overBudgetFrames{0};
+};
+
+#endif
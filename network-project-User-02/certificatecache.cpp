@@ -0,0 +1,114 @@
+#include "certificatecache.h"
+#include <QRandomGenerator>
+#include <QDebug>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "tracing.h"
+
+QMutex CertificateCache::s_mutex;
+CertificateCache::Certificate CertificateCache::s_certificate;
+QElapsedTimer CertificateCache::s_age;
+qint64 CertificateCache::s_rotationIntervalMs = 24 * 60 * 60 * 1000;
+
+namespace {
+
+// Certificates stay valid a day past their rotation, for the calls still using them.
+constexpr qint64 ValidityMarginMs = 24 * 60 * 60 * 1000;
+
+std::string readBio(BIO *bio)
+{
+    char *data = nullptr;
+    const long size = BIO_get_mem_data(bio, &data);
+    return size > 0 ? std::string(data, static_cast<size_t>(size)) : std::string();
+}
+
+}
+
+CertificateCache::Certificate CertificateCache::current()
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_certificate.certificatePem.empty() || s_age.elapsed() >= s_rotationIntervalMs) {
+        Certificate certificate;
+        certificate.generation = s_certificate.generation + 1;
+        if (generate(certificate, s_rotationIntervalMs + ValidityMarginMs)) {
+            s_certificate = certificate;
+            s_age.start();
+            TRACE_INSTANT(Signaling, "certificateRotated", certificate.generation);
+        } else if (s_certificate.certificatePem.empty()) {
+            return Certificate();
+        }
+        // Otherwise the old one is still good for the margin; the next call tries again.
+    }
+    return s_certificate;
+}
+
+void CertificateCache::rotate()
+{
+    QMutexLocker locker(&s_mutex);
+    s_certificate.certificatePem.clear();
+    s_certificate.keyPem.clear();
+}
+
+qint64 CertificateCache::rotationIntervalMs()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_rotationIntervalMs;
+}
+
+void CertificateCache::setRotationIntervalMs(qint64 intervalMs)
+{
+    QMutexLocker locker(&s_mutex);
+    s_rotationIntervalMs = qMax<qint64>(1000, intervalMs);
+}
+
+// ECDSA P-256, self-signed, which is what libdatachannel generates by default.
+bool CertificateCache::generate(Certificate &certificate, qint64 validityMs)
+{
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    const bool keyMade = context
+                         && EVP_PKEY_keygen_init(context) > 0
+                         && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, NID_X9_62_prime256v1) > 0
+                         && EVP_PKEY_keygen(context, &key) > 0;
+    EVP_PKEY_CTX_free(context);
+    if (!keyMade) {
+        qWarning() << "Failed to generate the DTLS key";
+        EVP_PKEY_free(key);
+        return false;
+    }
+
+    X509 *x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), static_cast<long>(QRandomGenerator::global()->bounded(1 << 30)));
+    X509_gmtime_adj(X509_getm_notBefore(x509), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(x509), static_cast<long>(validityMs / 1000));
+    X509_set_pubkey(x509, key);
+
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("voice-call"), -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+
+    bool ok = X509_sign(x509, key, EVP_sha256()) > 0;
+
+    BIO *certificateBio = BIO_new(BIO_s_mem());
+    BIO *keyBio = BIO_new(BIO_s_mem());
+    ok = ok
+         && PEM_write_bio_X509(certificateBio, x509) > 0
+         && PEM_write_bio_PrivateKey(keyBio, key, nullptr, nullptr, 0, nullptr, nullptr) > 0;
+    if (ok) {
+        certificate.certificatePem = readBio(certificateBio);
+        certificate.keyPem = readBio(keyBio);
+    } else {
+        qWarning() << "Failed to sign the DTLS certificate";
+    }
+
+    BIO_free(certificateBio);
+    BIO_free(keyBio);
+    X509_free(x509);
+    EVP_PKEY_free(key);
+    return ok;
+}
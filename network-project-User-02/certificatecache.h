@@ -0,0 +1,38 @@
+#ifndef CERTIFICATECACHE_H
+#define CERTIFICATECACHE_H
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <string>
+
+// One DTLS certificate for every peer connection in the process. It is made
+// here once and handed to libdatachannel as PEM, so a connection costs no key
+// generation. After the rotation interval the next connection gets a new one;
+// connections already built keep the certificate they were made with.
+class CertificateCache
+{
+public:
+    struct Certificate {
+        std::string certificatePem;
+        std::string keyPem;
+        int generation = 0;
+    };
+
+    // Empty PEM if generation failed; libdatachannel then makes its own.
+    static Certificate current();
+    static void rotate();
+
+    static qint64 rotationIntervalMs();
+    static void setRotationIntervalMs(qint64 intervalMs);
+
+private:
+    static bool generate(Certificate &certificate, qint64 validityMs);
+
+    static QMutex s_mutex;
+    static Certificate s_certificate;
+    static QElapsedTimer s_age;
+    static qint64 s_rotationIntervalMs;
+};
+
+#endif
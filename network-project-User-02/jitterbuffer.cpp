@@ -0,0 +1,252 @@
+#include "jitterbuffer.h"
+#include <QtMath>
+#include <cstring>
+
+namespace {
+
+// Slots are indexed by sequence number modulo the capacity, which only stays
+// consistent across the 16-bit wrap when the capacity divides 65536.
+int slotCount(int capacity)
+{
+    int count = 2;
+    while (count < capacity && count < 65536)
+        count <<= 1;
+    return count;
+}
+
+}
+
+JitterBuffer::JitterBuffer(int clockRate, int frameSize, int capacity)
+    : m_slots(slotCount(capacity)),
+    m_clockRate(clockRate),
+    m_frameSize(frameSize)
+{
+    Q_ASSERT((m_slots.size() & (m_slots.size() - 1)) == 0);
+
+    for (Slot &slot : m_slots) {
+        slot.payload.reserve(maxPayloadSize);
+    }
+
+    m_maxDepth = qMin(m_maxDepth, m_slots.size() / 2);
+}
+
+bool JitterBuffer::insert(quint16 sequence, quint32 timestamp, quint8 payloadType, qint64 arrivalNs,
+                          const char *payload, int size)
+{
+    if (size <= 0 || size > maxPayloadSize) {
+        ++m_discardedPackets;
+        return false;
+    }
+
+    if (m_started && isRestart(sequence, timestamp))
+        reset();
+
+    if (!m_started) {
+        m_started = true;
+        m_nextSequence = sequence;
+        m_highestSequence = sequence;
+        m_highestTimestamp = timestamp;
+    }
+
+    const int offset = static_cast<qint16>(sequence - m_nextSequence);
+    if (offset < 0) {
+        ++m_latePackets;
+        return false;
+    }
+
+    // A packet too far ahead of the playout point means we fell behind; skip forward.
+    while (static_cast<qint16>(sequence - m_nextSequence) >= m_slots.size()) {
+        dropOldest();
+    }
+
+    Slot &slot = slotFor(sequence);
+    if (slot.filled) {
+        ++m_discardedPackets;
+        return false;
+    }
+
+    slot.payload.resize(size);
+    std::memcpy(slot.payload.data(), payload, size);
+    slot.timestamp = timestamp;
+    slot.sequence = sequence;
+    slot.payloadType = payloadType;
+    slot.filled = true;
+    ++m_count;
+
+    if (static_cast<qint16>(sequence - m_highestSequence) > 0) {
+        m_highestSequence = sequence;
+        m_highestTimestamp = timestamp;
+    }
+
+    updateJitter(timestamp, arrivalNs);
+    updateTargetDepth();
+    return true;
+}
+
+JitterBuffer::PopResult JitterBuffer::pop(QByteArray &payload, int *payloadType)
+{
+    if (!m_started)
+        return PopResult::Empty;
+
+    if (m_count == 0) {
+        m_playing = false;
+        return PopResult::Empty;
+    }
+
+    if (!m_playing) {
+        if (depth() < m_targetDepth)
+            return PopResult::Empty;
+        m_playing = true;
+    }
+
+    // Keep latency bounded: if the buffer grew well past its target, catch up.
+    while (depth() > m_targetDepth * 2 && m_count > 0) {
+        dropOldest();
+    }
+
+    Slot &slot = slotFor(m_nextSequence);
+    ++m_nextSequence;
+
+    if (!slot.filled)
+        return PopResult::Lost;
+
+    payload.resize(slot.payload.size());
+    std::memcpy(payload.data(), slot.payload.constData(), slot.payload.size());
+    if (payloadType)
+        *payloadType = slot.payloadType;
+    slot.filled = false;
+    --m_count;
+
+    return PopResult::Packet;
+}
+
+bool JitterBuffer::peekNext(QByteArray &payload, int *payloadType) const
+{
+    if (!m_started || m_count == 0)
+        return false;
+
+    const Slot &slot = m_slots[m_nextSequence % m_slots.size()];
+    if (!slot.filled)
+        return false;
+
+    payload.resize(slot.payload.size());
+    std::memcpy(payload.data(), slot.payload.constData(), slot.payload.size());
+    if (payloadType)
+        *payloadType = slot.payloadType;
+    return true;
+}
+
+void JitterBuffer::reset()
+{
+    for (Slot &slot : m_slots) {
+        slot.filled = false;
+    }
+
+    m_count = 0;
+    m_started = false;
+    m_playing = false;
+    m_hasTransit = false;
+    m_jitter = 0.0;
+    m_targetDepth = m_minDepth;
+    m_packetsSinceShrink = 0;
+}
+
+int JitterBuffer::depth() const
+{
+    if (!m_started)
+        return 0;
+
+    return qMax(0, static_cast<qint16>(m_highestSequence - m_nextSequence) + 1);
+}
+
+int JitterBuffer::targetDepth() const
+{
+    return m_targetDepth;
+}
+
+double JitterBuffer::jitterMs() const
+{
+    return m_jitter * 1000.0 / m_clockRate;
+}
+
+quint64 JitterBuffer::latePackets() const
+{
+    return m_latePackets;
+}
+
+quint64 JitterBuffer::discardedPackets() const
+{
+    return m_discardedPackets;
+}
+
+void JitterBuffer::setDepthLimits(int minDepth, int maxDepth)
+{
+    m_minDepth = qBound(1, minDepth, m_slots.size() / 2);
+    m_maxDepth = qBound(m_minDepth, maxDepth, m_slots.size() / 2);
+    m_targetDepth = qBound(m_minDepth, m_targetDepth, m_maxDepth);
+}
+
+JitterBuffer::Slot &JitterBuffer::slotFor(quint16 sequence)
+{
+    return m_slots[sequence % m_slots.size()];
+}
+
+// A sender that restarts, or a reused SSRC, starts over at some lower sequence
+// number, and would otherwise be dropped as late for up to half the sequence
+// space. A packet is only late if it is behind by no more than the buffer
+// holds, and not newer than the newest packet seen. Silence suppression moves
+// the timestamp on without the sequence, so a late packet can be far behind in
+// time, but never ahead.
+bool JitterBuffer::isRestart(quint16 sequence, quint32 timestamp) const
+{
+    const int offset = static_cast<qint16>(sequence - m_nextSequence);
+    if (offset >= 0)
+        return false;
+
+    const qint32 timestampAhead = static_cast<qint32>(timestamp - m_highestTimestamp);
+    return offset < -m_slots.size() || timestampAhead > m_slots.size() * m_frameSize;
+}
+
+void JitterBuffer::dropOldest()
+{
+    Slot &slot = slotFor(m_nextSequence);
+    if (slot.filled) {
+        slot.filled = false;
+        --m_count;
+        ++m_discardedPackets;
+    }
+    ++m_nextSequence;
+}
+
+void JitterBuffer::updateJitter(quint32 timestamp, qint64 arrivalNs)
+{
+    // RFC 3550 interarrival jitter, kept in RTP timestamp units. Through
+    // microseconds, so the product does not overflow for as long as a call runs.
+    const quint32 arrival = static_cast<quint32>(arrivalNs / 1000 * m_clockRate / 1000000);
+    const quint32 transit = arrival - timestamp;
+
+    if (m_hasTransit) {
+        const qint32 delta = qAbs(static_cast<qint32>(transit - m_lastTransit));
+        m_jitter += (static_cast<double>(delta) - m_jitter) / 16.0;
+    }
+
+    m_lastTransit = transit;
+    m_hasTransit = true;
+}
+
+void JitterBuffer::updateTargetDepth()
+{
+    const int wanted = qBound(m_minDepth,
+                              static_cast<int>(qCeil(3.0 * m_jitter / m_frameSize)) + 1,
+                              m_maxDepth);
+
+    if (wanted > m_targetDepth) {
+        m_targetDepth = wanted;
+        m_packetsSinceShrink = 0;
+    } else if (wanted < m_targetDepth && ++m_packetsSinceShrink >= 50) {
+        // Shrink one frame at a time, roughly once a second, so a single quiet
+        // stretch does not undo the protection against the next burst.
+        --m_targetDepth;
+        m_packetsSinceShrink = 0;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <QByteArray>
+#include <QVector>
+
+class JitterBuffer
+{
+public:
+    enum class PopResult {
+        Packet,
+        Lost,
+        Empty
+    };
+
+    // capacity is rounded up to a power of two.
+    explicit JitterBuffer(int clockRate = 48000, int frameSize = 960, int capacity = 64);
+
+    // arrivalNs is when the packet came off the network, on any monotonic clock the
+    // caller keeps to; it only feeds the jitter estimate.
+    bool insert(quint16 sequence, quint32 timestamp, quint8 payloadType, qint64 arrivalNs,
+                const char *payload, int size);
+    // payloadType, when given, gets the packet's along with its payload.
+    PopResult pop(QByteArray &payload, int *payloadType = nullptr);
+    bool peekNext(QByteArray &payload, int *payloadType = nullptr) const;
+    void reset();
+
+    int depth() const;
+    int targetDepth() const;
+    double jitterMs() const;
+    quint64 latePackets() const;
+    quint64 discardedPackets() const;
+
+    void setDepthLimits(int minDepth, int maxDepth);
+
+private:
+    struct Slot {
+        QByteArray payload;
+        quint32 timestamp = 0;
+        quint16 sequence = 0;
+        quint8 payloadType = 0;
+        bool filled = false;
+    };
+
+    Slot &slotFor(quint16 sequence);
+    bool isRestart(quint16 sequence, quint32 timestamp) const;
+    void dropOldest();
+    void updateJitter(quint32 timestamp, qint64 arrivalNs);
+    void updateTargetDepth();
+
+    QVector<Slot> m_slots;
+
+    const int m_clockRate;
+    const int m_frameSize;
+    const int maxPayloadSize = 1500;
+
+    int m_minDepth = 2;
+    int m_maxDepth = 16;
+    int m_targetDepth = 2;
+    int m_count = 0;
+    int m_packetsSinceShrink = 0;
+
+    bool m_started = false;
+    bool m_playing = false;
+    quint16 m_nextSequence = 0;
+    quint16 m_highestSequence = 0;
+    quint32 m_highestTimestamp = 0;
+
+    bool m_hasTransit = false;
+    quint32 m_lastTransit = 0;
+    double m_jitter = 0.0;
+
+    quint64 m_latePackets = 0;
+    quint64 m_discardedPackets = 0;
+};
+
+#endif
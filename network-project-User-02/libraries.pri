@@ -0,0 +1,42 @@
+# Native libraries shared by the app and the benchmark/tool projects.
+# Each PATH_TO_* can be overridden on the qmake command line, e.g.
+#   qmake PATH_TO_LIBDATACHANNEL=$HOME/libdatachannel/install
+
+
+win32 {
+    isEmpty(PATH_TO_LIBDATACHANNEL): PATH_TO_LIBDATACHANNEL = D:/qtproject/libdatachannel
+    isEmpty(PATH_TO_OPUS): PATH_TO_OPUS = D:/qtproject/opus
+    isEmpty(PATH_TO_OPENSSL): PATH_TO_OPENSSL = "C:/Program Files/OpenSSL-Win64"
+
+
+    INCLUDEPATH += $$PATH_TO_LIBDATACHANNEL/include
+    LIBS += -L$$PATH_TO_LIBDATACHANNEL/Windows/Mingw64 -ldatachannel
+
+
+    INCLUDEPATH += $$PATH_TO_OPENSSL/include
+    LIBS += -L$$PATH_TO_OPENSSL/lib/VC/x64/MT -lssl -lcrypto
+
+
+    INCLUDEPATH += $$PATH_TO_OPUS/include
+    LIBS += -L$$PATH_TO_OPUS/build -lopus
+
+
+    LIBS += -lws2_32
+    LIBS += -lssp
+}
+
+
+# Opus and OpenSSL come from pkg-config. libdatachannel installs no .pc file,
+# so it is looked for under PATH_TO_LIBDATACHANNEL, /usr/local by default.
+unix {
+    isEmpty(PATH_TO_LIBDATACHANNEL): PATH_TO_LIBDATACHANNEL = /usr/local
+
+
+    INCLUDEPATH += $$PATH_TO_LIBDATACHANNEL/include
+    LIBS += -L$$PATH_TO_LIBDATACHANNEL/lib -ldatachannel
+    QMAKE_RPATHDIR += $$PATH_TO_LIBDATACHANNEL/lib
+
+
+    CONFIG += link_pkgconfig
+    PKGCONFIG += opus openssl
+}
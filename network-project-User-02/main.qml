@@ -71,6 +71,27 @@ Window {
                 Layout.preferredHeight: 40
                 enabled: connectButton.connected && !callButton.callInProgress
             }
+
+            Label {
+                id: statsLabel
+                property var stats: ({})
+
+                visible: callButton.callInProgress
+                text: stats.packetsReceived === undefined ? "Waiting for media..."
+                      : "Loss: " + (stats.fractionLost * 100).toFixed(1) + "%"
+                        + "  Jitter: " + stats.jitterMs.toFixed(1) + " ms"
+                        + "\nRTT: " + (stats.rttMs === undefined ? "-" : stats.rttMs.toFixed(0) + " ms")
+                        + "  Bitrate: " + (stats.bitrate / 1000).toFixed(0) + " kbps"
+                        + "\nBuffer: " + stats.jitterBufferDepth + " frames"
+                Layout.fillWidth: true
+            }
+
+            Timer {
+                interval: 1000
+                repeat: true
+                running: callButton.callInProgress
+                onTriggered: statsLabel.stats = webrtc.stats(targetIdField.text)
+            }
         }
 
         Button {
@@ -0,0 +1,382 @@
+#include "mediaengine.h"
+#include <QDebug>
+#include <QStringList>
+#include <QtMath>
+#include "tracing.h"
+
+MediaEngine::MediaEngine(bool dedicatedThread, QThread::Priority priority, QObject *parent)
+    : QObject(parent),
+    m_context(new QObject),
+    m_incomingPackets(256)
+{
+    m_thread.setObjectName("MediaEngine");
+    m_arrivalClock.start();
+
+    if (dedicatedThread) {
+        m_context->moveToThread(&m_thread);
+        m_thread.start(priority);
+    }
+
+    // QAudioSource, QAudioSink and their timers belong to the thread that creates them.
+    QMetaObject::invokeMethod(m_context, [this]() { initialize(); },
+                              m_thread.isRunning() ? Qt::BlockingQueuedConnection : Qt::DirectConnection);
+}
+
+MediaEngine::~MediaEngine()
+{
+    QMetaObject::invokeMethod(m_context, [this]() { shutdown(); },
+                              m_thread.isRunning() ? Qt::BlockingQueuedConnection : Qt::DirectConnection);
+
+    if (m_thread.isRunning()) {
+        m_thread.quit();
+        m_thread.wait();
+    }
+
+    delete m_context;
+}
+
+
+void MediaEngine::start()
+{
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_haveSendTime = false;
+
+        if (m_audioInput && !m_audioInput->isOpen()) {
+            if (!m_audioInput->startAudioCapture(m_virtualCaptureDevice)) {
+                qWarning() << "Failed to start audio capture.";
+            }
+        }
+
+        if (m_audioOutput && !m_audioOutput->isOpen()) {
+            if (!m_audioOutput->open(QIODevice::ReadOnly)) {
+                qWarning() << "Failed to start audio playback.";
+            }
+        }
+    });
+}
+
+void MediaEngine::stop()
+{
+    QMetaObject::invokeMethod(m_context, [this]() {
+        if (m_audioInput)
+            m_audioInput->stopAudioCapture();
+        if (m_audioOutput)
+            m_audioOutput->close();
+    });
+}
+
+void MediaEngine::addSendTrack(const QString &peerId, std::shared_ptr<rtc::Track> track,
+                               std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig)
+{
+    QMetaObject::invokeMethod(m_context, [this, peerId, track, rtpConfig]() {
+        m_sendTracks.insert(peerId, SendTrack{ track, rtpConfig });
+    });
+}
+
+void MediaEngine::removePeer(const QString &peerId)
+{
+    QMetaObject::invokeMethod(m_context, [this, peerId]() {
+        m_sendTracks.remove(peerId);
+
+        // Packets still in the ring for this peer are dropped once their id is gone.
+        const QString streamPrefix = peerId + '#';
+        QStringList streams = { peerId };
+        for (auto it = m_receiveStreams.begin(); it != m_receiveStreams.end();) {
+            if (it.value() == peerId || it.value().startsWith(streamPrefix)) {
+                streams.append(it.value());
+                it = m_receiveStreams.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (m_audioOutput) {
+            for (const QString &stream : std::as_const(streams)) {
+                m_audioOutput->removePeer(stream);
+            }
+        }
+    });
+}
+
+int MediaEngine::registerReceiveStream(const QString &peerId)
+{
+    // Queued before the stream's first packet can arrive, so the id is known when it is drained.
+    const int streamId = m_nextReceiveStream.fetch_add(1, std::memory_order_relaxed);
+    QMetaObject::invokeMethod(m_context, [this, streamId, peerId]() {
+        m_receiveStreams.insert(streamId, peerId);
+    });
+    return streamId;
+}
+
+void MediaEngine::receiveFrame(int streamId, const char *payload, int size, quint16 sequence, quint32 timestamp,
+                               quint8 payloadType)
+{
+    if (!m_incomingPackets.push(streamId, sequence, timestamp, payloadType, m_arrivalClock.nsecsElapsed(), payload, size)) {
+        m_droppedIncomingPackets.fetch_add(1, std::memory_order_relaxed);
+        TRACE_INSTANT(Network, "incomingRingFull", sequence);
+    }
+}
+
+void MediaEngine::setEncoderSettings(int bitrate, int bandwidth, int packetLossPercent)
+{
+    QMetaObject::invokeMethod(m_context, [this, bitrate, bandwidth, packetLossPercent]() {
+        if (m_audioInput)
+            m_audioInput->setEncoderSettings(bitrate, bandwidth, packetLossPercent);
+    });
+}
+
+void MediaEngine::setAudioChannels(int channels)
+{
+    QMetaObject::invokeMethod(m_context, [this, channels]() {
+        if (m_audioInput)
+            m_audioInput->setChannels(channels);
+        if (m_audioOutput)
+            m_audioOutput->setChannels(qMin(channels, 2));
+    });
+}
+
+void MediaEngine::setSendLayout(const OpusLayout &layout)
+{
+    QMetaObject::invokeMethod(m_context, [this, layout]() {
+        if (m_audioInput)
+            m_audioInput->setEncoderLayout(layout);
+    });
+}
+
+// The packetizer reads the payload type for every packet on this thread, so it is only changed here.
+void MediaEngine::setSendPayloadType(const QString &peerId, int payloadType)
+{
+    QMetaObject::invokeMethod(m_context, [this, peerId, payloadType]() {
+        auto it = m_sendTracks.find(peerId);
+        if (it != m_sendTracks.end())
+            it.value().rtpConfig->payloadType = static_cast<uint8_t>(payloadType);
+    });
+}
+
+void MediaEngine::setReceiveLayouts(const QString &peerId, const AudioStream::PayloadLayouts &layouts)
+{
+    QMetaObject::invokeMethod(m_context, [this, peerId, layouts]() {
+        if (m_audioOutput)
+            m_audioOutput->setStreamLayouts(peerId, layouts);
+    });
+}
+
+void MediaEngine::setSilenceSuppression(bool enabled)
+{
+    QMetaObject::invokeMethod(m_context, [this, enabled]() {
+        if (m_audioInput)
+            m_audioInput->setSilenceSuppression(enabled);
+    });
+}
+
+void MediaEngine::setCaptureProcessing(const QString &spec)
+{
+    QMetaObject::invokeMethod(m_context, [this, spec]() {
+        if (m_audioInput)
+            m_audioInput->captureProcessing()->configure(spec);
+    });
+}
+
+void MediaEngine::setCaptureProcessingBudgetUs(double budgetUs)
+{
+    QMetaObject::invokeMethod(m_context, [this, budgetUs]() {
+        if (m_audioInput)
+            m_audioInput->captureProcessing()->setBudgetUs(budgetUs);
+    });
+}
+
+void MediaEngine::setAudioBackends(const QString &captureSpec, const QString &playoutSpec, AudioBackends::Pacing pacing)
+{
+    QMetaObject::invokeMethod(m_context, [this, captureSpec, playoutSpec, pacing]() {
+        applyAudioBackends(captureSpec, playoutSpec, pacing);
+    });
+}
+
+void MediaEngine::setVirtualAudio(QIODevice *captureDevice)
+{
+    QMetaObject::invokeMethod(m_context, [this, captureDevice]() {
+        m_virtualCaptureDevice = captureDevice;
+        if (m_audioOutput)
+            m_audioOutput->setPlayoutBackend(nullptr);
+    });
+}
+
+// AudioOutput::readData() is lock-free, so this may be read from any single thread.
+QIODevice *MediaEngine::playoutDevice() const
+{
+    return m_audioOutput;
+}
+
+
+int MediaEngine::encoderBitrate() const
+{
+    return m_audioInput ? m_audioInput->encoderBitrate() : 0;
+}
+
+quint64 MediaEngine::suppressedFrames() const
+{
+    return m_audioInput ? m_audioInput->suppressedFrames() : 0;
+}
+
+AudioStream::Statistics MediaEngine::streamStatistics(const QString &peerId) const
+{
+    return m_audioOutput ? m_audioOutput->streamStatistics(peerId) : AudioStream::Statistics();
+}
+
+double MediaEngine::sendJitterMs() const
+{
+    return m_sendJitterNs.load(std::memory_order_relaxed) / 1e6;
+}
+
+double MediaEngine::maxSendDeviationMs() const
+{
+    return m_maxSendDeviationNs.load(std::memory_order_relaxed) / 1e6;
+}
+
+quint64 MediaEngine::droppedIncomingPackets() const
+{
+    return m_droppedIncomingPackets.load(std::memory_order_relaxed);
+}
+
+QVector<CaptureProcessingChain::StageStatistics> MediaEngine::captureProcessingStatistics() const
+{
+    return m_audioInput ? m_audioInput->captureProcessing()->statistics() : QVector<CaptureProcessingChain::StageStatistics>();
+}
+
+quint64 MediaEngine::captureProcessingOverBudgetFrames() const
+{
+    return m_audioInput ? m_audioInput->captureProcessing()->overBudgetFrames() : 0;
+}
+
+
+void MediaEngine::initialize()
+{
+    m_audioInput = new AudioInput(m_context);
+    m_audioOutput = new AudioOutput(m_context);
+    m_audioOutput->setEchoReference(m_audioInput->captureProcessing()->echoCanceller());
+    m_sendClock.start();
+
+    // The playout tick already runs every 10 ms on this thread and needs the packets
+    // first, so it drains the incoming ring directly; nothing is posted per packet.
+    connect(m_audioOutput, &AudioOutput::playoutTick, m_context, [this]() {
+        drainIncoming();
+    }, Qt::DirectConnection);
+
+    connect(m_audioInput, &AudioInput::encodedAudioReady, m_context, [this](const QByteArray &encodedData, quint32 timestamp) {
+        sendFrame(encodedData, timestamp);
+    });
+
+    applyAudioBackends(qEnvironmentVariable("VOICE_CALL_CAPTURE"), qEnvironmentVariable("VOICE_CALL_PLAYOUT"),
+                       AudioBackends::pacingFromString(qEnvironmentVariable("VOICE_CALL_AUDIO_PACING")));
+}
+
+// Backends are created here so they live on the media thread with the objects that drive them.
+void MediaEngine::applyAudioBackends(const QString &captureSpec, const QString &playoutSpec, AudioBackends::Pacing pacing)
+{
+    if (!captureSpec.isEmpty() && m_audioInput) {
+        if (AudioCaptureBackend *backend = AudioBackends::createCapture(captureSpec, pacing))
+            m_audioInput->setCaptureBackend(backend);
+    }
+
+    if (!playoutSpec.isEmpty() && m_audioOutput) {
+        if (AudioPlayoutBackend *backend = AudioBackends::createPlayout(playoutSpec, pacing))
+            m_audioOutput->setPlayoutBackend(backend);
+    }
+}
+
+void MediaEngine::shutdown()
+{
+    m_sendTracks.clear();
+
+    if (m_audioInput)
+        m_audioInput->stopAudioCapture();
+
+    // Playout feeds the capture side's echo canceller until it stops.
+    delete m_audioOutput;
+    delete m_audioInput;
+    m_audioOutput = nullptr;
+    m_audioInput = nullptr;
+}
+
+void MediaEngine::drainIncoming()
+{
+    int drained = 0;
+    while (const MpscPacketRing::Packet *packet = m_incomingPackets.front()) {
+        auto it = m_receiveStreams.constFind(packet->stream);
+        if (it != m_receiveStreams.constEnd() && m_audioOutput)
+            m_audioOutput->addData(it.value(), packet->sequence, packet->timestamp, packet->payloadType,
+                                   packet->arrivalNs,
+                                   packet->payload, packet->size);
+        m_incomingPackets.release();
+        ++drained;
+    }
+    TRACE_COUNTER(Network, "drainedPackets", drained);
+}
+
+void MediaEngine::sendFrame(const QByteArray &buffer, quint32 timestamp)
+{
+    TRACE_SCOPE(Network, "send");
+    updateSendTiming(timestamp);
+
+    const int samples = opus_packet_get_nb_samples(reinterpret_cast<const unsigned char*>(buffer.constData()),
+                                                   buffer.size(), rtc::OpusRtpPacketizer::DefaultClockRate);
+    if (samples <= 0) {
+        TRACE_WARNING(Network) << "Refusing to send invalid Opus packet";
+        return;
+    }
+
+    for (auto it = m_sendTracks.constBegin(); it != m_sendTracks.constEnd(); ++it) {
+        const SendTrack &sendTrack = it.value();
+        if (!sendTrack.track->isOpen())
+            continue;
+
+        try {
+            // The packetizer stamps the frame with the config's current timestamp. Capture time is
+            // used rather than a running sum so frames skipped during silence still advance it.
+            sendTrack.rtpConfig->timestamp = sendTrack.rtpConfig->startTimestamp + timestamp;
+            sendTrack.track->send(reinterpret_cast<const std::byte*>(buffer.constData()), buffer.size());
+        } catch (const std::exception &e) {
+            TRACE_WARNING(Network) << "Failed to send RTP packet to peer" << it.key() << ":" << e.what();
+        }
+    }
+}
+
+// How much later than its best each frame goes out, on the capture timeline;
+// this is what GUI stalls show up in. Each frame is measured on its own, so
+// frames drained back to back from one read only count for the time they
+// really waited, not for the gap between them.
+void MediaEngine::updateSendTiming(quint32 timestamp)
+{
+    const qint64 now = m_sendClock.nsecsElapsed();
+    const qint64 captureDelta = qint64(quint32(timestamp - m_lastSendTimestamp)) * 1000000000
+                                / rtc::OpusRtpPacketizer::DefaultClockRate;
+    m_lastSendTimestamp = timestamp;
+
+    // A restarted capture starts its timeline over.
+    const qint64 maxCaptureDeltaNs = 10 * qint64(1000000000);
+    if (!m_haveSendTime || captureDelta > maxCaptureDeltaNs) {
+        m_haveSendTime = true;
+        m_captureNs = 0;
+        m_sendFloorNs = now;
+        return;
+    }
+    m_captureNs += captureDelta;
+
+    // The floor is the earliest any frame went out relative to its capture. It
+    // drops to every faster frame and rises by at most 250 ppm, so it follows
+    // the sound card's clock drift without soaking up stalls.
+    qint64 deviation = now - m_captureNs - m_sendFloorNs;
+    if (deviation < 0) {
+        m_sendFloorNs += deviation;
+        deviation = 0;
+    } else {
+        m_sendFloorNs += qMin(deviation, captureDelta / 4000);
+    }
+
+    qint64 jitter = m_sendJitterNs.load(std::memory_order_relaxed);
+    jitter += (deviation - jitter) / 16;
+    m_sendJitterNs.store(jitter, std::memory_order_relaxed);
+
+    if (deviation > m_maxSendDeviationNs.load(std::memory_order_relaxed))
+        m_maxSendDeviationNs.store(deviation, std::memory_order_relaxed);
+}
@@ -0,0 +1,120 @@
+#ifndef MEDIAENGINE_H
+#define MEDIAENGINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QElapsedTimer>
+#include <rtc/rtc.hpp>
+#include <atomic>
+#include "audioinput.h"
+#include "audiooutput.h"
+#include "mpscpacketring.h"
+
+// Owns capture, playout, the codecs and the outgoing packetizers on a thread of
+// their own, so GUI work never delays a frame. Every public method is called
+// from the GUI thread and only queues a command for the media thread, except
+// the statistics getters, which read atomics or take the playout lock.
+class MediaEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MediaEngine(bool dedicatedThread = true,
+                         QThread::Priority priority = QThread::TimeCriticalPriority,
+                         QObject *parent = nullptr);
+    ~MediaEngine();
+
+    void start();
+    void stop();
+
+    void addSendTrack(const QString &peerId, std::shared_ptr<rtc::Track> track,
+                      std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig);
+    void removePeer(const QString &peerId);
+
+    // Returns the id that receiveFrame() takes for packets from this peer. Any thread.
+    // A peer that sends several streams (an SFU) registers each as "peerId#ssrc".
+    int registerReceiveStream(const QString &peerId);
+
+    // Called from libdatachannel's threads. The payload is copied into a preallocated
+    // ring slot with its arrival time; the media thread drains the ring on every
+    // playout tick, so nothing is posted to its event loop.
+    void receiveFrame(int streamId, const char *payload, int size, quint16 sequence, quint32 timestamp,
+                      quint8 payloadType);
+
+    void setEncoderSettings(int bitrate, int bandwidth, int packetLossPercent);
+
+    // Before start(): channels captured and played out. Playout stops at stereo;
+    // surround streams are folded down to it.
+    void setAudioChannels(int channels);
+    // What negotiation settled on: the one encoder's layout, the payload type each
+    // peer receives it under, and how each peer's streams are decoded, by payload type.
+    void setSendLayout(const OpusLayout &layout);
+    void setSendPayloadType(const QString &peerId, int payloadType);
+    void setReceiveLayouts(const QString &peerId, const AudioStream::PayloadLayouts &layouts);
+
+    // Capture processing by CaptureProcessingChain spec, such as "highpass,aec,gate,agc";
+    // takes effect from the next captured frame. The budget is per frame, in microseconds.
+    void setCaptureProcessing(const QString &spec);
+    void setCaptureProcessingBudgetUs(double budgetUs);
+    // Whether silent frames are held back on the send path; on by default.
+    void setSilenceSuppression(bool enabled);
+
+    // Before start(): where capture comes from and playout goes, by AudioBackends spec.
+    // An empty spec keeps the current backend. VOICE_CALL_CAPTURE, VOICE_CALL_PLAYOUT
+    // and VOICE_CALL_AUDIO_PACING set the same at construction.
+    void setAudioBackends(const QString &captureSpec, const QString &playoutSpec,
+                          AudioBackends::Pacing pacing = AudioBackends::Pacing::RealTime);
+
+    // For headless runs, before start(): capture is read from captureDevice instead of the
+    // default input, and playout is left for the caller to pull from playoutDevice().
+    void setVirtualAudio(QIODevice *captureDevice);
+    QIODevice *playoutDevice() const;
+
+    int encoderBitrate() const;
+    quint64 suppressedFrames() const;
+    AudioStream::Statistics streamStatistics(const QString &peerId) const;
+    double sendJitterMs() const;
+    double maxSendDeviationMs() const;
+    quint64 droppedIncomingPackets() const;
+    QVector<CaptureProcessingChain::StageStatistics> captureProcessingStatistics() const;
+    quint64 captureProcessingOverBudgetFrames() const;
+
+private:
+    struct SendTrack {
+        std::shared_ptr<rtc::Track> track;
+        std::shared_ptr<rtc::RtpPacketizationConfig> rtpConfig;
+    };
+
+    void initialize();
+    void applyAudioBackends(const QString &captureSpec, const QString &playoutSpec, AudioBackends::Pacing pacing);
+    void shutdown();
+    void sendFrame(const QByteArray &buffer, quint32 timestamp);
+    void updateSendTiming(quint32 timestamp);
+    void drainIncoming();
+
+    QThread m_thread;
+    QObject *m_context = nullptr;
+
+    // Created on the media thread and only touched there, apart from the getters.
+    AudioInput *m_audioInput = nullptr;
+    AudioOutput *m_audioOutput = nullptr;
+    QIODevice *m_virtualCaptureDevice = nullptr;
+    QHash<QString, SendTrack> m_sendTracks;
+    QHash<int, QString> m_receiveStreams;
+
+    MpscPacketRing m_incomingPackets;
+    std::atomic<quint64> m_droppedIncomingPackets{0};
+    std::atomic<int> m_nextReceiveStream{0};
+    QElapsedTimer m_arrivalClock;
+
+    // Send times measured against the capture clock, see updateSendTiming().
+    QElapsedTimer m_sendClock;
+    bool m_haveSendTime = false;
+    quint32 m_lastSendTimestamp = 0;
+    qint64 m_captureNs = 0;
+    qint64 m_sendFloorNs = 0;
+    std::atomic<qint64> m_sendJitterNs{0};
+    std::atomic<qint64> m_maxSendDeviationNs{0};
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef MPSCPACKETRING_H
+#define MPSCPACKETRING_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+// Bounded queue of RTP payloads for any number of producer threads and one
+// consumer. Every slot is preallocated, and each carries a sequence counter that
+// says whether it is free, being written or ready (Vyukov's bounded queue), so a
+// push is one CAS and a memcpy. Nothing is allocated after construction.
+class MpscPacketRing
+{
+public:
+    static const int maxPayloadSize = 1500;
+
+    struct Packet {
+        int stream = 0;
+        quint16 sequence = 0;
+        quint32 timestamp = 0;
+        quint8 payloadType = 0;
+        qint64 arrivalNs = 0;
+        int size = 0;
+        char payload[maxPayloadSize];
+    };
+
+    explicit MpscPacketRing(int capacity)
+    {
+        size_t size = 1;
+        while (size < static_cast<size_t>(capacity))
+            size <<= 1;
+
+        m_slots.reset(new Slot[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    int capacity() const
+    {
+        return static_cast<int>(m_mask + 1);
+    }
+
+    // Producer side. Returns false when the ring is full or the payload does not fit a slot.
+    bool push(int stream, quint16 sequence, quint32 timestamp, quint8 payloadType, qint64 arrivalNs, const char *payload, int size)
+    {
+        if (size < 0 || size > maxPayloadSize)
+            return false;
+
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &m_slots[position & m_mask];
+            const size_t slotSequence = slot->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(slotSequence - position);
+            if (difference == 0) {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        Packet &packet = slot->packet;
+        packet.stream = stream;
+        packet.sequence = sequence;
+        packet.timestamp = timestamp;
+        packet.payloadType = payloadType;
+        packet.arrivalNs = arrivalNs;
+        packet.size = size;
+        std::memcpy(packet.payload, payload, size);
+
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. The packet stays valid until release() is called.
+    const Packet *front() const
+    {
+        const Slot &slot = m_slots[m_dequeuePosition & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+            return nullptr;
+        return &slot.packet;
+    }
+
+    // Consumer side; hands the slot at front() back to the producers.
+    void release()
+    {
+        Slot &slot = m_slots[m_dequeuePosition & m_mask];
+        slot.sequence.store(m_dequeuePosition + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePosition;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        Packet packet;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask = 0;
+
+    alignas(64) std::atomic<size_t> m_enqueuePosition{0};
+    alignas(64) size_t m_dequeuePosition = 0;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "opuslayout.h"
+#include <QStringList>
+
+namespace {
+
+struct SurroundLayout {
+    int streams;
+    int coupledStreams;
+    unsigned char mapping[OpusLayout::maxChannels];
+};
+
+// The Vorbis channel mappings from libopus's surround encoder, indexed by channel count - 1.
+const SurroundLayout surroundLayouts[OpusLayout::maxChannels] = {
+    { 1, 0, { 0 } },
+    { 1, 1, { 0, 1 } },
+    { 2, 1, { 0, 2, 1 } },
+    { 2, 2, { 0, 1, 2, 3 } },
+    { 3, 2, { 0, 4, 1, 2, 3 } },
+    { 4, 2, { 0, 4, 1, 2, 3, 5 } },
+    { 4, 3, { 0, 4, 1, 2, 3, 5, 6 } },
+    { 5, 3, { 0, 6, 1, 2, 3, 4, 5, 7 } },
+};
+
+}
+
+OpusLayout OpusLayout::forChannels(int channels)
+{
+    OpusLayout layout;
+    if (channels < 1 || channels > maxChannels) {
+        layout.channels = 0;
+        layout.mapping.clear();
+        return layout;
+    }
+
+    const SurroundLayout &surround = surroundLayouts[channels - 1];
+    layout.channels = channels;
+    layout.streams = surround.streams;
+    layout.coupledStreams = surround.coupledStreams;
+    layout.mapping = QVector<unsigned char>(surround.mapping, surround.mapping + channels);
+    return layout;
+}
+
+OpusLayout OpusLayout::fromFmtp(int channels, const QString &fmtp)
+{
+    OpusLayout layout;
+    layout.channels = channels;
+    layout.streams = fmtpParameter(fmtp, "num_streams").toInt();
+    layout.coupledStreams = fmtpParameter(fmtp, "coupled_streams").toInt();
+    layout.mapping.clear();
+
+    const QStringList mapping = fmtpParameter(fmtp, "channel_mapping").split(',', Qt::SkipEmptyParts);
+    for (const QString &entry : mapping) {
+        bool ok = false;
+        const int index = entry.trimmed().toInt(&ok);
+        layout.mapping.append(ok && index >= 0 && index <= 255 ? static_cast<unsigned char>(index) : 255);
+    }
+    return layout;
+}
+
+QString OpusLayout::fmtp() const
+{
+    QStringList mappingEntries;
+    for (unsigned char index : mapping) {
+        mappingEntries.append(QString::number(index));
+    }
+    return "channel_mapping=" + mappingEntries.join(',') + ";num_streams=" + QString::number(streams)
+           + ";coupled_streams=" + QString::number(coupledStreams);
+}
+
+bool OpusLayout::isValid() const
+{
+    if (channels < 1 || channels > maxChannels || mapping.size() != channels)
+        return false;
+    if (streams < 1 || coupledStreams < 0 || coupledStreams > streams || streams + coupledStreams > 255)
+        return false;
+
+    // 255 is a silent channel; anything else has to name one of the coded channels.
+    for (unsigned char index : mapping) {
+        if (index != 255 && index >= streams + coupledStreams)
+            return false;
+    }
+    return true;
+}
+
+bool OpusLayout::isMultistream() const
+{
+    return streams > 1;
+}
+
+bool OpusLayout::operator==(const OpusLayout &other) const
+{
+    return channels == other.channels && streams == other.streams
+           && coupledStreams == other.coupledStreams && mapping == other.mapping;
+}
+
+bool OpusLayout::operator!=(const OpusLayout &other) const
+{
+    return !(*this == other);
+}
+
+QString OpusLayout::fmtpParameter(const QString &fmtp, const QString &name)
+{
+    const QStringList parameters = fmtp.split(';', Qt::SkipEmptyParts);
+    for (const QString &parameter : parameters) {
+        const QString key = parameter.section('=', 0, 0).trimmed();
+        if (key.compare(name, Qt::CaseInsensitive) == 0)
+            return parameter.section('=', 1).trimmed();
+    }
+    return QString();
+}
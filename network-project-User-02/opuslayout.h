@@ -0,0 +1,38 @@
+#ifndef OPUSLAYOUT_H
+#define OPUSLAYOUT_H
+
+#include <QString>
+#include <QVector>
+
+// How the channels of an Opus stream are coded. One or two channels are a
+// plain Opus stream; more go out as an RFC 7845 multistream, which WebRTC
+// offers as multiopus and describes with channel_mapping, num_streams and
+// coupled_streams in the fmtp. Interleaved PCM with more than two channels is
+// in Vorbis order: FL, FC, FR, RL, RR, LFE for 5.1.
+struct OpusLayout
+{
+    int channels = 1;
+    int streams = 1;
+    int coupledStreams = 0;
+    QVector<unsigned char> mapping = { 0 };
+
+    // The layout libopus picks for this many channels: mono, stereo, or surround up to 7.1.
+    static OpusLayout forChannels(int channels);
+    // From a multiopus rtpmap's channel count and its fmtp; invalid when they disagree.
+    static OpusLayout fromFmtp(int channels, const QString &fmtp);
+    // The multiopus fmtp parameters, without the ones plain Opus shares.
+    QString fmtp() const;
+
+    bool isValid() const;
+    bool isMultistream() const;
+
+    bool operator==(const OpusLayout &other) const;
+    bool operator!=(const OpusLayout &other) const;
+
+    // One parameter of an fmtp line such as "minptime=10;useinbandfec=1", or an empty string.
+    static QString fmtpParameter(const QString &fmtp, const QString &name);
+
+    static const int maxChannels = 8;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "pcmringdevice.h"
+
+PcmRingDevice::PcmRingDevice(int capacitySamples, QObject *parent)
+    : QIODevice(parent),
+    m_ring(capacitySamples)
+{
+    QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+int PcmRingDevice::pushSamples(const opus_int16 *pcm, int count)
+{
+    const int written = m_ring.write(pcm, count);
+    if (written > 0)
+        Q_EMIT readyRead();
+    return written;
+}
+
+int PcmRingDevice::freeSpace() const
+{
+    return m_ring.freeSpace();
+}
+
+// Consumer side, like read().
+void PcmRingDevice::clear()
+{
+    m_ring.clear();
+}
+
+bool PcmRingDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 PcmRingDevice::bytesAvailable() const
+{
+    return m_ring.available() * qint64(sizeof(opus_int16)) + QIODevice::bytesAvailable();
+}
+
+qint64 PcmRingDevice::readData(char *data, qint64 maxlen)
+{
+    const int wanted = static_cast<int>(maxlen / qint64(sizeof(opus_int16)));
+    return m_ring.read(reinterpret_cast<opus_int16*>(data), wanted) * qint64(sizeof(opus_int16));
+}
+
+qint64 PcmRingDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(len)
+    return -1;
+}
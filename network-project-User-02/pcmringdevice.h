@@ -0,0 +1,33 @@
+#ifndef PCMRINGDEVICE_H
+#define PCMRINGDEVICE_H
+
+#include <QIODevice>
+#include <opus.h>
+#include "spscringbuffer.h"
+
+// Push-mode capture device backed by an SPSC ring, standing in for the device
+// QAudioSource::start() returns. One thread pushes samples; AudioInput reads
+// them on its own thread, and the ring is the only state the two share.
+class PcmRingDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit PcmRingDevice(int capacitySamples = 48000, QObject *parent = nullptr);
+
+    // Returns how many samples fit; the rest are dropped, as a real device would drop them.
+    int pushSamples(const opus_int16 *pcm, int count);
+    int freeSpace() const;
+    void clear();
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    SpscRingBuffer<opus_int16> m_ring;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "peerconnectionpool.h"
+#include <QDebug>
+#include "tracing.h"
+
+PeerConnectionPool::PeerConnectionPool(const Factory &factory, QObject *parent)
+    : QObject(parent),
+    m_factory(factory)
+{
+    m_clock.start();
+
+    m_fillTimer.setSingleShot(true);
+    m_fillTimer.setInterval(0);
+    connect(&m_fillTimer, &QTimer::timeout, this, &PeerConnectionPool::fillOne);
+
+    m_expiryTimer.setInterval(m_maxAgeMs / 4);
+    connect(&m_expiryTimer, &QTimer::timeout, this, &PeerConnectionPool::expire);
+}
+
+PeerConnectionPool::~PeerConnectionPool()
+{
+    clear();
+}
+
+int PeerConnectionPool::size() const
+{
+    return m_size;
+}
+
+void PeerConnectionPool::setSize(int size)
+{
+    m_size = qMax(0, size);
+
+    while (m_offering.size() > m_size) {
+        m_offering.takeLast().peerConnection->close();
+    }
+    while (m_answering.size() > m_size) {
+        m_answering.takeLast().peerConnection->close();
+    }
+
+    if (m_size > 0)
+        m_expiryTimer.start();
+    else
+        m_expiryTimer.stop();
+    scheduleFill();
+}
+
+int PeerConnectionPool::maxAgeMs() const
+{
+    return m_maxAgeMs;
+}
+
+void PeerConnectionPool::setMaxAgeMs(int maxAgeMs)
+{
+    m_maxAgeMs = qMax(1000, maxAgeMs);
+    m_expiryTimer.setInterval(m_maxAgeMs / 4);
+}
+
+bool PeerConnectionPool::take(bool offering, Connection &connection)
+{
+    QVector<Connection> &idle = offering ? m_offering : m_answering;
+    if (idle.isEmpty()) {
+        TRACE_INSTANT(Signaling, "poolMiss", offering);
+        return false;
+    }
+
+    // Oldest first, so none sits in the pool for long.
+    connection = idle.takeFirst();
+    TRACE_INSTANT(Signaling, "poolHit", m_clock.elapsed() - connection.createdMs);
+    scheduleFill();
+    return true;
+}
+
+int PeerConnectionPool::idleCount(bool offering) const
+{
+    return offering ? m_offering.size() : m_answering.size();
+}
+
+void PeerConnectionPool::clear()
+{
+    m_fillTimer.stop();
+    m_expiryTimer.stop();
+
+    for (const Connection &connection : std::as_const(m_offering)) {
+        connection.peerConnection->close();
+    }
+    for (const Connection &connection : std::as_const(m_answering)) {
+        connection.peerConnection->close();
+    }
+    m_offering.clear();
+    m_answering.clear();
+}
+
+void PeerConnectionPool::scheduleFill()
+{
+    if (m_offering.size() < m_size || m_answering.size() < m_size)
+        m_fillTimer.start();
+}
+
+// One connection per pass keeps a refill from holding up whatever else the thread has to do.
+void PeerConnectionPool::fillOne()
+{
+    // Offering connections first: theirs is the gathering worth getting out of the way.
+    const bool offering = m_offering.size() < m_size;
+    if (!offering && m_answering.size() >= m_size)
+        return;
+    QVector<Connection> &idle = offering ? m_offering : m_answering;
+
+    Connection connection = m_factory(offering);
+    if (!connection.peerConnection) {
+        qWarning() << "Failed to build a pooled PeerConnection";
+        return;
+    }
+
+    connection.createdMs = m_clock.elapsed();
+    idle.append(connection);
+    scheduleFill();
+}
+
+void PeerConnectionPool::expire()
+{
+    const qint64 now = m_clock.elapsed();
+    for (QVector<Connection> *idle : { &m_offering, &m_answering }) {
+        while (!idle->isEmpty() && now - idle->first().createdMs > m_maxAgeMs) {
+            idle->takeFirst().peerConnection->close();
+        }
+    }
+    scheduleFill();
+}
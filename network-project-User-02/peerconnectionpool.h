@@ -0,0 +1,84 @@
+#ifndef PEERCONNECTIONPOOL_H
+#define PEERCONNECTIONPOOL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include <rtc/rtc.hpp>
+
+// Who a connection belongs to. Its callbacks are installed when it is built,
+// before anybody knows, and do nothing until it is claimed for a peer.
+struct ConnectionBinding {
+    QString peer() const
+    {
+        QMutexLocker locker(&mutex);
+        return peerId;
+    }
+
+    mutable QMutex mutex;
+    QString peerId;
+    // Set when the claim itself sent the offer or reported gathering, so the callbacks do not repeat it.
+    bool offerSent = false;
+    bool gatheringReported = false;
+    // Server reflexive candidates from the cache, sent in the descriptions; set before the callbacks.
+    std::vector<rtc::Candidate> reusedCandidates;
+};
+
+// Peer connections built ahead of time, so a call does not wait for the DTLS
+// certificate, the ICE agent or candidate gathering. Offering connections have
+// their offer made and gathering under way; answering ones are built but idle,
+// as their description has to wait for the remote offer. Claimed connections
+// are replaced one per event loop pass, and idle ones are rebuilt once they
+// are old enough for their server reflexive candidates to have gone stale.
+class PeerConnectionPool : public QObject
+{
+    Q_OBJECT
+public:
+    struct Connection {
+        std::shared_ptr<rtc::PeerConnection> peerConnection;
+        std::shared_ptr<rtc::DataChannel> dataChannel;
+        std::shared_ptr<rtc::Track> track;
+        std::shared_ptr<ConnectionBinding> binding;
+        rtc::SSRC ssrc = 0;
+        bool offering = false;
+        qint64 createdMs = 0;
+    };
+
+    using Factory = std::function<Connection(bool offering)>;
+
+    explicit PeerConnectionPool(const Factory &factory, QObject *parent = nullptr);
+    ~PeerConnectionPool();
+
+    // Idle connections kept of each kind; 0 turns the pool off.
+    int size() const;
+    void setSize(int size);
+
+    int maxAgeMs() const;
+    void setMaxAgeMs(int maxAgeMs);
+
+    bool take(bool offering, Connection &connection);
+    int idleCount(bool offering) const;
+
+    // Closes every idle connection; the pool refills on the next setSize().
+    void clear();
+
+private:
+    void scheduleFill();
+    void fillOne();
+    void expire();
+
+    Factory m_factory;
+    QVector<Connection> m_offering;
+    QVector<Connection> m_answering;
+    int m_size = 0;
+    int m_maxAgeMs = 60000;
+    QTimer m_fillTimer;
+    QTimer m_expiryTimer;
+    QElapsedTimer m_clock;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "qtaudiobackend.h"
+#include <QAudioFormat>
+#include <QMediaDevices>
+#include <QAudioDevice>
+#include <QDebug>
+
+namespace {
+
+QAudioFormat pcmFormat(int channels)
+{
+    QAudioFormat format;
+    format.setSampleRate(48000);
+    format.setChannelCount(channels);
+    format.setSampleFormat(QAudioFormat::Int16);
+    return format;
+}
+
+// The device's preferred format when it can be converted, otherwise the pipeline's
+// own if the device takes it; an invalid format when neither works.
+QAudioFormat deviceFormat(const QAudioDevice &device, const QAudioFormat &pcm)
+{
+    const QAudioFormat preferred = device.preferredFormat();
+    if (preferred.isValid() && AudioConverter::isSupported(preferred, pcm))
+        return preferred;
+    if (device.isFormatSupported(pcm))
+        return pcm;
+    return QAudioFormat();
+}
+
+// A second of device audio per read; the sink asks for far less.
+const int maxChunkMs = 1000;
+
+}
+
+QtCaptureBackend::QtCaptureBackend(QObject *parent)
+    : AudioCaptureBackend(parent),
+    m_device(48000)
+{
+}
+
+void QtCaptureBackend::setMaxConversionLatencyMs(double latencyMs)
+{
+    m_maxConversionLatencyMs = latencyMs;
+}
+
+QIODevice *QtCaptureBackend::start()
+{
+    const QAudioDevice device = QMediaDevices::defaultAudioInput();
+    const QAudioFormat pcm = pcmFormat(m_channelCount);
+    const QAudioFormat format = deviceFormat(device, pcm);
+    if (!format.isValid()) {
+        qWarning() << "No usable format on audio input:" << device.description();
+        return nullptr;
+    }
+
+    delete m_audioSource;
+    m_audioSource = new QAudioSource(device, format, this);
+
+    if (format == pcm) {
+        m_converter.reset();
+        QIODevice *io = m_audioSource->start();
+        if (!io)
+            qWarning() << "Failed to start audio source:" << m_audioSource->error();
+        return io;
+    }
+
+    m_converter = std::make_unique<AudioConverter>(format, pcm, m_maxConversionLatencyMs);
+    m_deviceChunk.resize(format.bytesForDuration(maxChunkMs * 1000));
+    m_pcmChunk.resize(static_cast<int>(m_converter->outputBytesFor(m_deviceChunk.size()) / qint64(sizeof(opus_int16))));
+
+    m_deviceIo = m_audioSource->start();
+    if (!m_deviceIo) {
+        qWarning() << "Failed to start audio source:" << m_audioSource->error();
+        return nullptr;
+    }
+    connect(m_deviceIo, &QIODevice::readyRead, this, &QtCaptureBackend::convertCaptured);
+
+    qInfo() << "Audio input opened at" << format.sampleRate() << "Hz," << format.channelCount()
+            << "channels; conversion adds" << m_converter->latencyMs() << "ms";
+
+    m_device.clear();
+    return &m_device;
+}
+
+void QtCaptureBackend::stop()
+{
+    if (m_deviceIo) {
+        disconnect(m_deviceIo, nullptr, this, nullptr);
+        m_deviceIo = nullptr;
+    }
+    if (m_audioSource)
+        m_audioSource->stop();
+}
+
+void QtCaptureBackend::convertCaptured()
+{
+    const int frameBytes = m_converter->inputFormat().bytesPerFrame();
+
+    for (;;) {
+        const qint64 available = m_deviceIo->bytesAvailable() / frameBytes * frameBytes;
+        const qint64 wanted = qMin<qint64>(available, m_deviceChunk.size() / frameBytes * frameBytes);
+        if (wanted <= 0)
+            break;
+
+        const qint64 bytesRead = m_deviceIo->read(m_deviceChunk.data(), wanted);
+        if (bytesRead <= 0)
+            break;
+
+        const qint64 converted = m_converter->convert(m_deviceChunk.constData(), bytesRead,
+                                                      reinterpret_cast<char *>(m_pcmChunk.data()),
+                                                      m_pcmChunk.size() * qint64(sizeof(opus_int16)));
+        m_device.pushSamples(m_pcmChunk.constData(), static_cast<int>(converted / qint64(sizeof(opus_int16))));
+    }
+}
+
+
+ConvertingPlayoutDevice::ConvertingPlayoutDevice(QIODevice *source, const QAudioFormat &sourceFormat,
+                                                 const QAudioFormat &deviceFormat, double maxLatencyMs, QObject *parent)
+    : QIODevice(parent),
+    m_source(source),
+    m_converter(sourceFormat, deviceFormat, maxLatencyMs),
+    m_maxOutputBytes(deviceFormat.bytesForDuration(maxChunkMs * 1000))
+{
+    // Enough source for the largest read, plus the filter's worth of slack.
+    m_sourceChunk.resize(static_cast<int>(sourceFormat.bytesForDuration(maxChunkMs * 1000)
+                                          + (Resampler::maxTaps + 2) * sourceFormat.bytesPerFrame()));
+    QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+double ConvertingPlayoutDevice::latencyMs() const
+{
+    return m_converter.latencyMs();
+}
+
+bool ConvertingPlayoutDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 ConvertingPlayoutDevice::bytesAvailable() const
+{
+    return m_converter.outputBytesFor(m_source->bytesAvailable()) + QIODevice::bytesAvailable();
+}
+
+// AudioOutput always fills what is asked for, so each read converts to exactly maxlen.
+qint64 ConvertingPlayoutDevice::readData(char *data, qint64 maxlen)
+{
+    const int frameBytes = m_converter.outputFormat().bytesPerFrame();
+    const qint64 outputBytes = qMin(maxlen, m_maxOutputBytes) / frameBytes * frameBytes;
+    if (outputBytes <= 0)
+        return 0;
+
+    const qint64 inputBytes = qMin<qint64>(m_converter.inputBytesFor(outputBytes), m_sourceChunk.size());
+    const qint64 bytesRead = inputBytes > 0 ? m_source->read(m_sourceChunk.data(), inputBytes) : 0;
+    if (bytesRead < 0)
+        return 0;
+
+    return m_converter.convert(m_sourceChunk.constData(), bytesRead, data, outputBytes);
+}
+
+qint64 ConvertingPlayoutDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(len)
+    return -1;
+}
+
+
+QtPlayoutBackend::QtPlayoutBackend(QObject *parent)
+    : AudioPlayoutBackend(parent)
+{
+}
+
+void QtPlayoutBackend::setMaxConversionLatencyMs(double latencyMs)
+{
+    m_maxConversionLatencyMs = latencyMs;
+}
+
+bool QtPlayoutBackend::start(QIODevice *source)
+{
+    const QAudioDevice device = QMediaDevices::defaultAudioOutput();
+    const QAudioFormat pcm = pcmFormat(m_channelCount);
+    const QAudioFormat format = deviceFormat(device, pcm);
+    if (!format.isValid()) {
+        qWarning() << "No usable format on audio output:" << device.description();
+        return false;
+    }
+
+    delete m_audioSink;
+    m_audioSink = new QAudioSink(device, format, this);
+    delete m_converter;
+    m_converter = nullptr;
+
+    if (format == pcm) {
+        m_audioSink->start(source);
+    } else {
+        m_converter = new ConvertingPlayoutDevice(source, pcm, format, m_maxConversionLatencyMs, this);
+        m_audioSink->start(m_converter);
+        qInfo() << "Audio output opened at" << format.sampleRate() << "Hz," << format.channelCount()
+                << "channels; conversion adds" << m_converter->latencyMs() << "ms";
+    }
+
+    if (m_audioSink->error() != QAudio::NoError) {
+        qWarning() << "Failed to start audio output device:" << m_audioSink->error();
+        return false;
+    }
+    return true;
+}
+
+void QtPlayoutBackend::stop()
+{
+    if (m_audioSink)
+        m_audioSink->stop();
+}
@@ -0,0 +1,87 @@
+#ifndef QTAUDIOBACKEND_H
+#define QTAUDIOBACKEND_H
+
+#include <QAudioSource>
+#include <QAudioSink>
+#include <QAudioDevice>
+#include <QByteArray>
+#include <QVector>
+#include <memory>
+#include "audiobackend.h"
+#include "audioconverter.h"
+
+// The system's default input, through QtMultimedia. The device is opened in its
+// own preferred format and converted to 48 kHz at the backend's channel count
+// here, rather than asking for that and leaving the OS to resample it or refuse.
+class QtCaptureBackend : public AudioCaptureBackend
+{
+    Q_OBJECT
+public:
+    explicit QtCaptureBackend(QObject *parent = nullptr);
+
+    // Upper bound on the delay the resampler adds; takes effect at the next start().
+    void setMaxConversionLatencyMs(double latencyMs);
+
+    QIODevice *start() override;
+    void stop() override;
+
+private slots:
+    void convertCaptured();
+
+private:
+    QAudioSource *m_audioSource = nullptr;
+    QIODevice *m_deviceIo = nullptr;
+    std::unique_ptr<AudioConverter> m_converter;
+    PcmRingDevice m_device;
+    QByteArray m_deviceChunk;
+    QVector<opus_int16> m_pcmChunk;
+    double m_maxConversionLatencyMs = Resampler::defaultMaxLatencyMs;
+};
+
+// Pull-mode adapter between AudioOutput's 48 kHz PCM and the output device's
+// format. Reads from the source on the sink's thread, and like
+// AudioOutput::readData() it neither locks nor allocates there.
+class ConvertingPlayoutDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    ConvertingPlayoutDevice(QIODevice *source, const QAudioFormat &sourceFormat, const QAudioFormat &deviceFormat,
+                            double maxLatencyMs, QObject *parent = nullptr);
+
+    double latencyMs() const;
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    QIODevice *m_source;
+    AudioConverter m_converter;
+    QByteArray m_sourceChunk;
+    qint64 m_maxOutputBytes;
+};
+
+// The system's default output, through QtMultimedia. The sink pulls from the
+// source on its own thread whenever it needs samples, converted to the
+// device's preferred format when that is not the pipeline's own.
+class QtPlayoutBackend : public AudioPlayoutBackend
+{
+    Q_OBJECT
+public:
+    explicit QtPlayoutBackend(QObject *parent = nullptr);
+
+    void setMaxConversionLatencyMs(double latencyMs);
+
+    bool start(QIODevice *source) override;
+    void stop() override;
+
+private:
+    QAudioSink *m_audioSink = nullptr;
+    ConvertingPlayoutDevice *m_converter = nullptr;
+    double m_maxConversionLatencyMs = Resampler::defaultMaxLatencyMs;
+};
+
+#endif
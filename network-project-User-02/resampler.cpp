@@ -0,0 +1,270 @@
+#include "resampler.h"
+#include <QtGlobal>
+#include <QtMath>
+#include <numeric>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// About 70 dB of stopband attenuation.
+const double kaiserBeta = 7.0;
+
+// Tap counts are kept to multiples of this, so no kernel needs a tail loop.
+const int tapMultiple = 8;
+
+float dotScalar(const float *a, const float *b, int count)
+{
+    float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+    for (int i = 0; i < count; i += 4) {
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+#ifdef RESAMPLER_X86
+
+__attribute__((target("sse2")))
+float dotSse2(const float *a, const float *b, int count)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float *a, const float *b, int count)
+{
+    __m256 sum = _mm256_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+    }
+
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    folded = _mm_add_ps(folded, _mm_movehl_ps(folded, folded));
+    folded = _mm_add_ss(folded, _mm_shuffle_ps(folded, folded, 1));
+    return _mm_cvtss_f32(folded);
+}
+
+#endif
+
+struct Kernels {
+    float (*dot)(const float *, const float *, int);
+    const char *name;
+};
+
+Kernels selectKernels()
+{
+#ifdef RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { dotAvx2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { dotSse2, "sse2" };
+#endif
+    return { dotScalar, "scalar" };
+}
+
+const Kernels kernels = selectKernels();
+
+// Zeroth-order modified Bessel function, for the Kaiser window.
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+}
+
+Resampler::Resampler(int inputRate, int outputRate, double maxLatencyMs)
+    : m_inputRate(inputRate),
+    m_outputRate(outputRate)
+{
+    if (!isSupported(inputRate, outputRate))
+        return;
+
+    const int divisor = std::gcd(inputRate, outputRate);
+    m_up = outputRate / divisor;
+    m_down = inputRate / divisor;
+
+    if (inputRate != outputRate) {
+        // The delay is half the taps at the input rate.
+        const int taps = static_cast<int>(2.0 * maxLatencyMs * inputRate / 1000.0);
+        m_taps = qBound(minTaps, taps / tapMultiple * tapMultiple, maxTaps);
+        designFilter();
+    }
+
+    // A second of input per call without reallocating.
+    m_history.reserve(m_taps + inputRate);
+    reset();
+}
+
+bool Resampler::isSupported(int inputRate, int outputRate)
+{
+    if (inputRate <= 0 || outputRate <= 0)
+        return false;
+    return outputRate / std::gcd(inputRate, outputRate) <= maxPhases;
+}
+
+bool Resampler::isValid() const
+{
+    return isSupported(m_inputRate, m_outputRate);
+}
+
+bool Resampler::isPassthrough() const
+{
+    return m_inputRate == m_outputRate;
+}
+
+int Resampler::inputRate() const
+{
+    return m_inputRate;
+}
+
+int Resampler::outputRate() const
+{
+    return m_outputRate;
+}
+
+int Resampler::tapsPerPhase() const
+{
+    return m_taps;
+}
+
+double Resampler::latencyMs() const
+{
+    if (isPassthrough() || !isValid())
+        return 0.0;
+    return (static_cast<double>(m_taps) * m_up - 1.0) / 2.0 / m_up * 1000.0 / m_inputRate;
+}
+
+int Resampler::inputFor(int outputCount) const
+{
+    if (outputCount <= 0)
+        return 0;
+    if (isPassthrough())
+        return qMax(0, outputCount - static_cast<int>(m_history.size()));
+
+    // The last output's window has to end inside the history.
+    const qint64 lastStart = m_position + (m_phase + static_cast<qint64>(outputCount - 1) * m_down) / m_up;
+    const qint64 needed = lastStart + m_taps - static_cast<qint64>(m_history.size());
+    return static_cast<int>(qMax<qint64>(0, needed));
+}
+
+int Resampler::outputFor(int inputCount) const
+{
+    if (isPassthrough())
+        return static_cast<int>(m_history.size()) + qMax(0, inputCount);
+
+    const qint64 room = static_cast<qint64>(m_history.size()) + inputCount - m_taps - m_position;
+    if (room < 0)
+        return 0;
+    return static_cast<int>(((room + 1) * m_up - 1 - m_phase) / m_down + 1);
+}
+
+int Resampler::process(const float *input, int count, float *output, int maxOutput)
+{
+    if (count < 0 || !isValid())
+        return 0;
+
+    if (isPassthrough()) {
+        if (m_history.empty() && count <= maxOutput) {
+            std::memcpy(output, input, count * sizeof(float));
+            return count;
+        }
+        m_history.insert(m_history.end(), input, input + count);
+        const int produced = qBound(0, maxOutput, static_cast<int>(m_history.size()));
+        std::memcpy(output, m_history.data(), produced * sizeof(float));
+        m_history.erase(m_history.begin(), m_history.begin() + produced);
+        return produced;
+    }
+
+    m_history.insert(m_history.end(), input, input + count);
+
+    const int available = static_cast<int>(m_history.size());
+    const float *history = m_history.data();
+    int produced = 0;
+
+    while (m_position + m_taps <= available && produced < maxOutput) {
+        output[produced++] = kernels.dot(m_coefficients.data() + static_cast<size_t>(m_phase) * m_taps,
+                                         history + m_position, m_taps);
+        m_phase += m_down;
+        m_position += m_phase / m_up;
+        m_phase %= m_up;
+    }
+
+    const int consumed = qMin(m_position, available);
+    m_history.erase(m_history.begin(), m_history.begin() + consumed);
+    m_position -= consumed;
+    return produced;
+}
+
+void Resampler::reset()
+{
+    // Primed with silence so the first input comes out after exactly latencyMs().
+    m_history.assign(m_taps > 0 ? m_taps - 1 : 0, 0.0f);
+    m_position = 0;
+    m_phase = 0;
+}
+
+const char *Resampler::implementation()
+{
+    return kernels.name;
+}
+
+// The prototype lowpass runs at L times the input rate and is cut off just
+// below the lower of the two Nyquist frequencies; phase p holds its taps
+// p, p + L, p + 2L and so on. Each phase is normalized to unity gain at DC.
+void Resampler::designFilter()
+{
+    const int length = m_taps * m_up;
+    const double center = (length - 1) / 2.0;
+    const double rolloff = m_taps >= 64 ? 0.92 : (m_taps >= 32 ? 0.88 : 0.8);
+    const double cutoff = rolloff * qMin(m_inputRate, m_outputRate) / (2.0 * m_inputRate * m_up);
+    const double windowNorm = besselI0(kaiserBeta);
+
+    std::vector<double> prototype(length);
+    for (int k = 0; k < length; ++k) {
+        const double x = k - center;
+        const double sinc = x == 0.0 ? 1.0 : qSin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+        const double ratio = length > 1 ? 2.0 * k / (length - 1) - 1.0 : 0.0;
+        const double window = besselI0(kaiserBeta * qSqrt(qMax(0.0, 1.0 - ratio * ratio))) / windowNorm;
+        prototype[k] = sinc * window;
+    }
+
+    m_coefficients.assign(static_cast<size_t>(length), 0.0f);
+    for (int phase = 0; phase < m_up; ++phase) {
+        double sum = 0.0;
+        for (int tap = 0; tap < m_taps; ++tap) {
+            sum += prototype[phase + tap * m_up];
+        }
+        const double gain = sum != 0.0 ? 1.0 / sum : 0.0;
+
+        float *coefficients = m_coefficients.data() + static_cast<size_t>(phase) * m_taps;
+        for (int tap = 0; tap < m_taps; ++tap) {
+            coefficients[m_taps - 1 - tap] = static_cast<float>(prototype[phase + tap * m_up] * gain);
+        }
+    }
+}
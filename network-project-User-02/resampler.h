@@ -0,0 +1,64 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+#include <climits>
+
+// Streaming polyphase FIR resampler between two sample rates, on mono float
+// samples. The rate ratio is reduced to L/M, and every output sample is one
+// dot product of a Kaiser-windowed sinc phase with the newest input, so the
+// cost per output is the tap count whatever the ratio. The taps follow from
+// the latency bound: the filter delays by half of them at the input rate.
+// The dot product is AVX2/FMA or SSE2 where the CPU has it, picked once at
+// startup like AudioMixer's kernels.
+class Resampler
+{
+public:
+    Resampler(int inputRate, int outputRate, double maxLatencyMs = defaultMaxLatencyMs);
+
+    // False for rates that need more than maxPhases filter phases (or are not positive).
+    static bool isSupported(int inputRate, int outputRate);
+    bool isValid() const;
+    bool isPassthrough() const;
+
+    int inputRate() const;
+    int outputRate() const;
+    int tapsPerPhase() const;
+    double latencyMs() const;
+
+    // Input samples process() needs to produce exactly outputCount samples.
+    int inputFor(int outputCount) const;
+    // Samples process() produces from inputCount more samples of input.
+    int outputFor(int inputCount) const;
+
+    // Takes all of input and writes at most maxOutput samples, returning how
+    // many; input it had no room to use is kept for the next call.
+    int process(const float *input, int count, float *output, int maxOutput = INT_MAX);
+    void reset();
+
+    static const char *implementation();
+
+    static constexpr double defaultMaxLatencyMs = 1.0;
+    static const int maxPhases = 1024;
+    static const int minTaps = 8;
+    static const int maxTaps = 128;
+
+private:
+    void designFilter();
+
+    int m_inputRate = 0;
+    int m_outputRate = 0;
+    int m_up = 1;
+    int m_down = 1;
+    int m_taps = 0;
+
+    // m_up phases of m_taps coefficients, each reversed to run along the input.
+    std::vector<float> m_coefficients;
+    // Input from the start of the next output's window on.
+    std::vector<float> m_history;
+    // Where that window starts in m_history; past its end while skipping input.
+    int m_position = 0;
+    int m_phase = 0;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "rtpframedepacketizer.h"
+#include <QtEndian>
+
+namespace {
+
+bool parseRtpPacket(const uchar *data, int size, quint8 &payloadType, quint32 &ssrc, quint16 &sequence, quint32 &timestamp,
+                    int &payloadOffset, int &payloadSize)
+{
+    const int headerSize = 12;
+    if (size < headerSize || (data[0] >> 6) != 2)
+        return false;
+
+    const bool hasPadding = data[0] & 0x20;
+    const bool hasExtension = data[0] & 0x10;
+    const int csrcCount = data[0] & 0x0F;
+
+    payloadType = data[1] & 0x7F;
+    sequence = qFromBigEndian<quint16>(data + 2);
+    timestamp = qFromBigEndian<quint32>(data + 4);
+    ssrc = qFromBigEndian<quint32>(data + 8);
+
+    int offset = headerSize + csrcCount * 4;
+    if (hasExtension) {
+        if (size < offset + 4)
+            return false;
+        offset += 4 + qFromBigEndian<quint16>(data + offset + 2) * 4;
+    }
+
+    int end = size;
+    if (hasPadding)
+        end -= data[end - 1];
+
+    if (offset > end)
+        return false;
+
+    payloadOffset = offset;
+    payloadSize = end - offset;
+    return true;
+}
+
+}
+
+RtpFrameDepacketizer::RtpFrameDepacketizer(const QVector<quint8> &payloadTypes, FrameCallback callback)
+    : m_payloadTypes(payloadTypes),
+    m_callback(std::move(callback))
+{
+}
+
+void RtpFrameDepacketizer::incoming(rtc::message_vector &messages, const rtc::message_callback &send)
+{
+    Q_UNUSED(send)
+
+    auto it = messages.begin();
+    while (it != messages.end()) {
+        const rtc::message_ptr &message = *it;
+        if (!message || message->type == rtc::Message::Control) {
+            ++it;
+            continue;
+        }
+
+        const uchar *data = reinterpret_cast<const uchar*>(message->data());
+        quint8 payloadType;
+        quint32 ssrc;
+        quint16 sequence;
+        quint32 timestamp;
+        int payloadOffset;
+        int payloadSize;
+        if (parseRtpPacket(data, static_cast<int>(message->size()), payloadType, ssrc, sequence, timestamp,
+                           payloadOffset, payloadSize)
+            && m_payloadTypes.contains(payloadType) && payloadSize > 0) {
+            m_callback(reinterpret_cast<const char*>(data + payloadOffset), payloadSize, ssrc, sequence, timestamp,
+                       payloadType);
+        }
+
+        it = messages.erase(it);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef RTPFRAMEDEPACKETIZER_H
+#define RTPFRAMEDEPACKETIZER_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <functional>
+#include <rtc/rtc.hpp>
+
+// Last incoming stage of an audio track's media handler chain. It strips the
+// RTP header from each packet and hands the bare payload on together with its
+// SSRC, sequence number, timestamp and payload type, which rtc::FrameInfo alone
+// does not carry.
+// RTCP is left in the message vector for the other handlers, and RTP with a
+// payload type that was not offered is dropped.
+class RtpFrameDepacketizer : public rtc::MediaHandler
+{
+public:
+    using FrameCallback = std::function<void(const char *payload, int size, quint32 ssrc, quint16 sequence, quint32 timestamp,
+                                       quint8 payloadType)>;
+
+    RtpFrameDepacketizer(const QVector<quint8> &payloadTypes, FrameCallback callback);
+
+    void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+    const QVector<quint8> m_payloadTypes;
+    FrameCallback m_callback;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "rtpstatistics.h"
+#include <QtEndian>
+#include <chrono>
+
+namespace {
+
+// Middle 32 bits of the current NTP timestamp, the unit RTCP uses for LSR and DLSR.
+quint32 compactNtpNow()
+{
+    using namespace std::chrono;
+    const quint64 micros = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    const quint64 seconds = micros / 1000000 + 2208988800ULL;
+    const quint64 fraction = (micros % 1000000) * 65536 / 1000000;
+    return static_cast<quint32>(((seconds & 0xFFFF) << 16) | fraction);
+}
+
+qint64 steadyNowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+quint32 rtpClockNow(quint32 clockRate)
+{
+    return static_cast<quint32>(quint64(steadyNowNs()) / 1000 * clockRate / 1000000);
+}
+
+const qint64 receiverReportIntervalNs = 1000000000;
+
+}
+
+RtpStatisticsHandler::RtpStatisticsHandler(std::shared_ptr<RtpStatistics> statistics, rtc::SSRC localSsrc, quint32 clockRate)
+    : m_statistics(std::move(statistics)),
+    m_localSsrc(localSsrc),
+    m_clockRate(clockRate)
+{
+}
+
+void RtpStatisticsHandler::incoming(rtc::message_vector &messages, const rtc::message_callback &send)
+{
+    for (const rtc::message_ptr &message : messages) {
+        if (!message)
+            continue;
+
+        const uchar *data = reinterpret_cast<const uchar*>(message->data());
+        const int size = static_cast<int>(message->size());
+        if (message->type == rtc::Message::Control)
+            processRtcp(data, size);
+        else
+            processRtp(data, size);
+    }
+
+    // Incoming traffic is the clock: a silent track has nothing to report on.
+    if (m_receiveStates.isEmpty())
+        return;
+    const qint64 nowNs = steadyNowNs();
+    if (nowNs - m_lastReportNs >= receiverReportIntervalNs) {
+        m_lastReportNs = nowNs;
+        sendReceiverReport(send, nowNs);
+    }
+}
+
+void RtpStatisticsHandler::outgoing(rtc::message_vector &messages, const rtc::message_callback &send)
+{
+    Q_UNUSED(send)
+
+    for (const rtc::message_ptr &message : messages) {
+        if (!message || message->type == rtc::Message::Control)
+            continue;
+
+        m_statistics->packetsSent.fetch_add(1, std::memory_order_relaxed);
+        m_statistics->bytesSent.fetch_add(message->size(), std::memory_order_relaxed);
+    }
+}
+
+void RtpStatisticsHandler::processRtp(const uchar *data, int size)
+{
+    if (size < 12 || (data[0] >> 6) != 2)
+        return;
+
+    const quint16 sequence = qFromBigEndian<quint16>(data + 2);
+    const quint32 timestamp = qFromBigEndian<quint32>(data + 4);
+    const quint32 ssrc = qFromBigEndian<quint32>(data + 8);
+
+    m_statistics->packetsReceived.fetch_add(1, std::memory_order_relaxed);
+    m_statistics->bytesReceived.fetch_add(size, std::memory_order_relaxed);
+
+    // Extended highest sequence number, RFC 3550 appendix A.1 without the probation logic.
+    auto it = m_receiveStates.find(ssrc);
+    if (it == m_receiveStates.end()) {
+        it = m_receiveStates.insert(ssrc, ReceiveState());
+        it->baseSequence = sequence;
+        it->maxSequence = sequence;
+    } else if (static_cast<qint16>(sequence - it->maxSequence) > 0) {
+        if (sequence < it->maxSequence)
+            it->cycles += 1 << 16;
+        it->maxSequence = sequence;
+    }
+    ReceiveState &state = *it;
+    ++state.received;
+
+    const quint64 expected = quint64(state.cycles) + state.maxSequence - state.baseSequence + 1;
+    m_expected += expected - state.expected;
+    state.expected = expected;
+    m_statistics->packetsExpected.store(m_expected, std::memory_order_relaxed);
+
+    // Interarrival jitter, RFC 3550 appendix A.8.
+    const quint32 transit = rtpClockNow(m_clockRate) - timestamp;
+    if (state.hasTransit) {
+        const qint32 delta = qAbs(static_cast<qint32>(transit - state.lastTransit));
+        state.jitter += (static_cast<double>(delta) - state.jitter) / 16.0;
+
+        double worstJitter = 0.0;
+        for (const ReceiveState &other : std::as_const(m_receiveStates)) {
+            worstJitter = qMax(worstJitter, other.jitter);
+        }
+        m_statistics->jitter.store(static_cast<quint32>(worstJitter), std::memory_order_relaxed);
+    }
+    state.lastTransit = transit;
+    state.hasTransit = true;
+}
+
+void RtpStatisticsHandler::processRtcp(const uchar *data, int size)
+{
+    // Walk the compound packet; only SR (200) and RR (201) carry report blocks.
+    int offset = 0;
+    while (offset + 8 <= size) {
+        const uchar *packet = data + offset;
+        if ((packet[0] >> 6) != 2)
+            return;
+
+        const int reportCount = packet[0] & 0x1F;
+        const int packetType = packet[1];
+        const int packetSize = (qFromBigEndian<quint16>(packet + 2) + 1) * 4;
+        if (offset + packetSize > size)
+            return;
+
+        int blocksOffset = -1;
+        if (packetType == 200 && packetSize >= 28) {
+            blocksOffset = 28;
+            SenderReport &report = m_senderReports[qFromBigEndian<quint32>(packet + 4)];
+            report.compactNtp = qFromBigEndian<quint32>(packet + 10);
+            report.arrivalNs = steadyNowNs();
+        } else if (packetType == 201) {
+            blocksOffset = 8;
+        }
+
+        if (blocksOffset > 0) {
+            for (int i = 0; i < reportCount && blocksOffset + (i + 1) * 24 <= packetSize; ++i) {
+                processReportBlock(packet + blocksOffset + i * 24);
+            }
+        }
+
+        offset += packetSize;
+    }
+}
+
+void RtpStatisticsHandler::processReportBlock(const uchar *block)
+{
+    if (qFromBigEndian<quint32>(block) != m_localSsrc)
+        return;
+
+    m_statistics->remoteFractionLost.store(block[4], std::memory_order_relaxed);
+    m_statistics->remoteJitter.store(qFromBigEndian<quint32>(block + 12), std::memory_order_relaxed);
+    m_statistics->reportsReceived.fetch_add(1, std::memory_order_relaxed);
+
+    const quint32 lastSenderReport = qFromBigEndian<quint32>(block + 16);
+    const quint32 delaySinceLastReport = qFromBigEndian<quint32>(block + 20);
+    if (lastSenderReport == 0)
+        return;
+
+    // RFC 3550 section 6.4.1: RTT = A - LSR - DLSR, in units of 1/65536 s.
+    const qint32 rtt = static_cast<qint32>(compactNtpNow() - lastSenderReport - delaySinceLastReport);
+    if (rtt >= 0)
+        m_statistics->rttMicroseconds.store(static_cast<qint32>(qint64(rtt) * 1000000 / 65536), std::memory_order_relaxed);
+}
+
+// RFC 3550 section 6.4.2, with the loss figures worked out as in its appendix A.3.
+void RtpStatisticsHandler::sendReceiverReport(const rtc::message_callback &send, qint64 nowNs)
+{
+    const int blocks = qMin(m_receiveStates.size(), 31);
+    const int size = 8 + 24 * blocks;
+    rtc::message_ptr message = rtc::make_message(size, rtc::Message::Control);
+    uchar *data = reinterpret_cast<uchar*>(message->data());
+
+    data[0] = 0x80 | blocks;
+    data[1] = 201;
+    qToBigEndian<quint16>(size / 4 - 1, data + 2);
+    qToBigEndian<quint32>(m_localSsrc, data + 4);
+
+    uchar *block = data + 8;
+    for (auto it = m_receiveStates.begin(); it != m_receiveStates.end() && block < data + size; ++it, block += 24) {
+        ReceiveState &state = it.value();
+
+        const quint64 expectedInterval = state.expected - state.expectedPrior;
+        const qint64 lostInterval = qint64(expectedInterval) - qint64(state.received - state.receivedPrior);
+        state.expectedPrior = state.expected;
+        state.receivedPrior = state.received;
+        const quint32 fractionLost = expectedInterval == 0 || lostInterval <= 0
+            ? 0 : quint32(qMin<qint64>(255, (lostInterval << 8) / qint64(expectedInterval)));
+        // Duplicates can make more arrive than were sent; the field is signed 24-bit.
+        const qint64 cumulativeLost = qBound<qint64>(-0x800000, qint64(state.expected) - qint64(state.received), 0x7FFFFF);
+
+        quint32 lastSenderReport = 0;
+        quint32 delaySinceLastReport = 0;
+        auto report = m_senderReports.constFind(it.key());
+        if (report != m_senderReports.constEnd()) {
+            lastSenderReport = report->compactNtp;
+            delaySinceLastReport = static_cast<quint32>((nowNs - report->arrivalNs) * 65536 / 1000000000);
+        }
+
+        qToBigEndian<quint32>(it.key(), block);
+        qToBigEndian<quint32>((fractionLost << 24) | (static_cast<quint32>(cumulativeLost) & 0xFFFFFF), block + 4);
+        qToBigEndian<quint32>(state.cycles + state.maxSequence, block + 8);
+        qToBigEndian<quint32>(static_cast<quint32>(state.jitter), block + 12);
+        qToBigEndian<quint32>(lastSenderReport, block + 16);
+        qToBigEndian<quint32>(delaySinceLastReport, block + 20);
+    }
+
+    send(message);
+}
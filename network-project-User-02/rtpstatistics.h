@@ -0,0 +1,83 @@
+#ifndef RTPSTATISTICS_H
+#define RTPSTATISTICS_H
+
+#include <QtGlobal>
+#include <QHash>
+#include <atomic>
+#include <memory>
+#include <rtc/rtc.hpp>
+
+// Counters for one peer's audio track. Written by the media handler chain on
+// libdatachannel's threads and read from anywhere, so everything published is atomic.
+struct RtpStatistics
+{
+    std::atomic<quint64> packetsSent{0};
+    std::atomic<quint64> bytesSent{0};
+    std::atomic<quint64> packetsReceived{0};
+    std::atomic<quint64> bytesReceived{0};
+    std::atomic<quint64> packetsExpected{0};
+
+    // RFC 3550 interarrival jitter of the incoming stream, in RTP timestamp units;
+    // the worst one when an SFU sends several streams on the track.
+    std::atomic<quint32> jitter{0};
+
+    // From the report blocks the remote side sends about our stream; -1 until the first one.
+    std::atomic<qint32> rttMicroseconds{-1};
+    std::atomic<quint32> remoteFractionLost{0};
+    std::atomic<quint32> remoteJitter{0};
+    std::atomic<quint64> reportsReceived{0};
+};
+
+// Sits in the chain where it sees outgoing RTP after packetization and incoming
+// RTP and RTCP before anything consumes them. It is also the receiving end of
+// RTCP for the track, in place of rtc::RtcpReceivingSession, whose reports
+// always say nothing was lost: once a second it sends a receiver report with a
+// block per incoming stream, built from the counters kept here as RFC 3550
+// section 6.4.2 describes. localSsrc is what the reports are sent from.
+class RtpStatisticsHandler : public rtc::MediaHandler
+{
+public:
+    RtpStatisticsHandler(std::shared_ptr<RtpStatistics> statistics, rtc::SSRC localSsrc, quint32 clockRate);
+
+    void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+    void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+    struct ReceiveState {
+        quint16 baseSequence = 0;
+        quint16 maxSequence = 0;
+        quint32 cycles = 0;
+        quint64 expected = 0;
+        quint64 received = 0;
+        // As of the last receiver report, for its fraction lost.
+        quint64 expectedPrior = 0;
+        quint64 receivedPrior = 0;
+
+        bool hasTransit = false;
+        quint32 lastTransit = 0;
+        double jitter = 0.0;
+    };
+
+    void processRtp(const uchar *data, int size);
+    void processRtcp(const uchar *data, int size);
+    void processReportBlock(const uchar *block);
+    void sendReceiverReport(const rtc::message_callback &send, qint64 nowNs);
+
+    // The last sender report from each remote SSRC, echoed back as LSR and DLSR.
+    struct SenderReport {
+        quint32 compactNtp = 0;
+        qint64 arrivalNs = 0;
+    };
+
+    std::shared_ptr<RtpStatistics> m_statistics;
+    const rtc::SSRC m_localSsrc;
+    const quint32 m_clockRate;
+
+    // Keyed by SSRC: a mesh peer sends one stream, an SFU one per forwarded speaker.
+    QHash<quint32, ReceiveState> m_receiveStates;
+    QHash<quint32, SenderReport> m_senderReports;
+    quint64 m_expected = 0;
+    qint64 m_lastReportNs = 0;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include "sfuserver.h"
+
+// Selective forwarding unit for calls too large for a full mesh. Clients with
+// WebRTC::sfuId set send their audio here once, and get back the few loudest
+// other participants instead of a stream from everybody.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sfu");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Selective forwarding unit for voice calls.");
+    parser.addHelpOption();
+    QCommandLineOption signalingOption("signaling-url", "Signaling server to register with.", "url", "ws://localhost:3000");
+    QCommandLineOption idOption("id", "Id to register under; clients set it as their sfuId.", "id", "sfu");
+    QCommandLineOption iceServerOption("ice-server", "STUN or TURN server URL; may be given more than once.", "url");
+    QCommandLineOption bindOption("bind", "Local address to gather ICE candidates on.", "address");
+    QCommandLineOption slotsOption("slots", "Speakers forwarded to each participant at most.", "count", "3");
+    QCommandLineOption thresholdOption("speech-threshold", "Activity, 0 to 1, a speaker needs to be forwarded.", "value", "0.5");
+    QCommandLineOption forwardSilentOption("forward-silent", "Also fill slots with participants who are not speaking.");
+    QCommandLineOption statisticsOption("stats-interval", "Seconds between statistics lines; 0 disables them.", "seconds", "10");
+    parser.addOptions({ signalingOption, idOption, iceServerOption, bindOption, slotsOption, thresholdOption,
+                        forwardSilentOption, statisticsOption });
+    parser.process(app);
+
+    SfuServer::Options options;
+    options.signalingUrl = parser.value(signalingOption);
+    options.id = parser.value(idOption);
+    options.iceServers = parser.values(iceServerOption);
+    options.iceBindAddress = parser.value(bindOption);
+    options.statisticsIntervalSeconds = parser.value(statisticsOption).toInt();
+    options.router.slotCount = qMax(1, parser.value(slotsOption).toInt());
+    options.router.speechThreshold = qBound(0.0, parser.value(thresholdOption).toDouble(), 1.0);
+    options.router.dropSilent = !parser.isSet(forwardSilentOption);
+
+    SfuServer server(options);
+    server.start();
+
+    return app.exec();
+}
@@ -0,0 +1,28 @@
+QT += core websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = sfu
+
+include(../libraries.pri)
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    sfurouter.cpp \
+    sfuserver.cpp \
+    ../rtpstatistics.cpp \
+    ../signalingclient.cpp \
+    ../tracing.cpp
+
+HEADERS += \
+    sfurouter.h \
+    sfuserver.h \
+    ../rtpstatistics.h \
+    ../signalingclient.h \
+    ../tracing.h
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
@@ -0,0 +1,285 @@
+#include "sfurouter.h"
+#include <QtEndian>
+#include <QtMath>
+#include <QJsonArray>
+#include <QStringList>
+#include <QPair>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <opus.h>
+
+namespace {
+
+const int sampleRate = 48000;
+const int headerSize = 12;
+// Activity averages over about half a second of media time.
+const double activityWindowSamples = 0.5 * sampleRate;
+// Assumed gap when a slot switches speaker; one 20 ms frame.
+const quint32 switchGapSamples = 960;
+// A speaker on a slot keeps it until activity falls this far under the threshold.
+const double holdFactor = 0.5;
+
+bool parseRtp(const uchar *data, int size, int &payloadOffset, int &payloadSize)
+{
+    if (size < headerSize || (data[0] >> 6) != 2)
+        return false;
+
+    int offset = headerSize + (data[0] & 0x0F) * 4;
+    if (data[0] & 0x10) {
+        if (size < offset + 4)
+            return false;
+        offset += 4 + qFromBigEndian<quint16>(data + offset + 2) * 4;
+    }
+
+    int end = size;
+    if (data[0] & 0x20)
+        end -= data[end - 1];
+
+    if (offset >= end)
+        return false;
+
+    payloadOffset = offset;
+    payloadSize = end - offset;
+    return true;
+}
+
+}
+
+SfuRouter::SfuRouter(const Options &options)
+    : m_options(options)
+{
+    m_clock.start();
+}
+
+void SfuRouter::addParticipant(const QString &id, std::shared_ptr<rtc::Track> track, quint8 payloadType,
+                               const QVector<rtc::SSRC> &slotSsrcs)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Participant participant;
+    participant.track = std::move(track);
+    participant.payloadType = payloadType;
+    for (rtc::SSRC ssrc : slotSsrcs) {
+        Slot slot;
+        slot.ssrc = ssrc;
+        participant.forwardSlots.append(slot);
+    }
+    m_participants.insert(id, participant);
+}
+
+void SfuRouter::removeParticipant(const QString &id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_participants.remove(id);
+
+    for (Participant &participant : m_participants) {
+        for (Slot &slot : participant.forwardSlots) {
+            if (slot.source == id)
+                slot.source.clear();
+        }
+    }
+}
+
+void SfuRouter::forward(const QString &sourceId, const uchar *data, int size)
+{
+    int payloadOffset;
+    int payloadSize;
+    if (!parseRtp(data, size, payloadOffset, payloadSize))
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    auto source = m_participants.find(sourceId);
+    if (source == m_participants.end())
+        return;
+
+    ++m_packetsIn;
+    ++source->packetsIn;
+    updateActivity(*source, qFromBigEndian<quint32>(data + 4), data + payloadOffset, payloadSize);
+
+    QVector<Outgoing> outgoing;
+    for (auto it = m_participants.begin(); it != m_participants.end(); ++it) {
+        if (it.key() == sourceId)
+            continue;
+
+        Participant &destination = it.value();
+        auto slot = std::find_if(destination.forwardSlots.begin(), destination.forwardSlots.end(),
+                                 [&sourceId](const Slot &candidate) { return candidate.source == sourceId; });
+        if (slot == destination.forwardSlots.end()) {
+            ++m_packetsNotSelected;
+            continue;
+        }
+
+        Outgoing packet;
+        packet.track = destination.track;
+        rewrite(*slot, destination.payloadType, data, data + payloadOffset, payloadSize, packet.packet);
+        outgoing.append(std::move(packet));
+        ++m_packetsForwarded;
+    }
+
+    // Sent outside the lock so one slow transport does not stall every other sender.
+    locker.unlock();
+
+    for (const Outgoing &packet : outgoing) {
+        if (!packet.track->isOpen())
+            continue;
+
+        try {
+            packet.track->send(packet.packet.data(), packet.packet.size());
+        } catch (const std::exception &e) {
+            qWarning() << "Failed to forward RTP packet:" << e.what();
+        }
+    }
+}
+
+// Sent audio pulls activity towards 1 over its duration, gaps let it decay.
+void SfuRouter::updateActivity(Participant &participant, quint32 timestamp, const uchar *payload, int payloadSize)
+{
+    participant.lastPacketNs = m_clock.nsecsElapsed();
+
+    const int samples = opus_packet_get_nb_samples(payload, payloadSize, sampleRate);
+    if (samples <= 0)
+        return;
+
+    if (participant.haveTimestamp) {
+        const qint32 gap = static_cast<qint32>(timestamp - participant.nextTimestamp);
+        if (gap > 0)
+            participant.activity *= qExp(-gap / activityWindowSamples);
+    }
+    participant.haveTimestamp = true;
+    participant.nextTimestamp = timestamp + samples;
+
+    // Opus DTX packets of a byte or two stand for silence.
+    if (payloadSize <= 2)
+        participant.activity *= qExp(-samples / activityWindowSamples);
+    else
+        participant.activity = 1.0 - (1.0 - participant.activity) * qExp(-samples / activityWindowSamples);
+}
+
+// Someone who stopped sending altogether decays in wall-clock time instead.
+double SfuRouter::currentActivity(const Participant &participant, qint64 nowNs) const
+{
+    const double silentSamples = (nowNs - participant.lastPacketNs) * 1e-9 * sampleRate;
+    return participant.activity * qExp(-qMax(0.0, silentSamples - switchGapSamples) / activityWindowSamples);
+}
+
+// Fresh 12-byte header: the slot's SSRC, the destination's payload type, and the
+// source's numbering shifted onto the slot's. Extensions and CSRCs are dropped,
+// as their ids were negotiated with the source, not with the destination.
+void SfuRouter::rewrite(Slot &slot, quint8 payloadType, const uchar *header, const uchar *payload, int payloadSize,
+                        rtc::binary &packet)
+{
+    const quint16 sequence = qFromBigEndian<quint16>(header + 2);
+    const quint32 timestamp = qFromBigEndian<quint32>(header + 4);
+
+    const bool switched = slot.resync;
+    if (slot.resync) {
+        if (slot.started) {
+            slot.sequenceOffset = static_cast<quint16>(slot.lastSequence + 1 - sequence);
+            slot.timestampOffset = slot.lastTimestamp + switchGapSamples - timestamp;
+        } else {
+            slot.sequenceOffset = 0;
+            slot.timestampOffset = 0;
+        }
+        slot.resync = false;
+        slot.started = true;
+    }
+
+    const quint16 outSequence = static_cast<quint16>(sequence + slot.sequenceOffset);
+    const quint32 outTimestamp = timestamp + slot.timestampOffset;
+    if (static_cast<qint16>(outSequence - slot.lastSequence) > 0 || switched) {
+        slot.lastSequence = outSequence;
+        slot.lastTimestamp = outTimestamp;
+    }
+
+    packet.resize(headerSize + payloadSize);
+    uchar *out = reinterpret_cast<uchar*>(packet.data());
+    out[0] = 0x80;
+    // The marker bit starts a talkspurt, which is what a new speaker on the slot is.
+    out[1] = (switched ? 0x80 : 0x00) | (payloadType & 0x7F);
+    qToBigEndian<quint16>(outSequence, out + 2);
+    qToBigEndian<quint32>(outTimestamp, out + 4);
+    qToBigEndian<quint32>(slot.ssrc, out + 8);
+    std::memcpy(out + headerSize, payload, payloadSize);
+}
+
+void SfuRouter::updateSelection()
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 nowNs = m_clock.nsecsElapsed();
+
+    QHash<QString, double> activity;
+    for (auto it = m_participants.constBegin(); it != m_participants.constEnd(); ++it) {
+        activity.insert(it.key(), currentActivity(it.value(), nowNs));
+    }
+
+    for (auto it = m_participants.begin(); it != m_participants.end(); ++it) {
+        Participant &destination = it.value();
+
+        // Speakers already on a slot only need to stay above the hold level, which stops flapping.
+        QVector<QPair<double, QString>> candidates;
+        for (auto source = activity.constBegin(); source != activity.constEnd(); ++source) {
+            if (source.key() == it.key())
+                continue;
+
+            const bool onSlot = std::any_of(destination.forwardSlots.cbegin(), destination.forwardSlots.cend(),
+                                            [&source](const Slot &slot) { return slot.source == source.key(); });
+            const double threshold = m_options.speechThreshold * (onSlot ? holdFactor : 1.0);
+            if (m_options.dropSilent && source.value() < threshold)
+                continue;
+
+            candidates.append(qMakePair(source.value(), source.key()));
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const QPair<double, QString> &a, const QPair<double, QString> &b) {
+            return a.first > b.first;
+        });
+        if (candidates.size() > destination.forwardSlots.size())
+            candidates.resize(destination.forwardSlots.size());
+
+        QStringList selected;
+        for (const auto &candidate : std::as_const(candidates)) {
+            selected.append(candidate.second);
+        }
+
+        // Speakers keep their slots; freed slots go to the newly selected.
+        for (Slot &slot : destination.forwardSlots) {
+            if (!slot.source.isEmpty() && !selected.removeOne(slot.source))
+                slot.source.clear();
+        }
+        for (Slot &slot : destination.forwardSlots) {
+            if (slot.source.isEmpty() && !selected.isEmpty()) {
+                slot.source = selected.takeFirst();
+                slot.resync = true;
+            }
+        }
+    }
+}
+
+QJsonObject SfuRouter::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 nowNs = m_clock.nsecsElapsed();
+
+    QJsonObject participants;
+    for (auto it = m_participants.constBegin(); it != m_participants.constEnd(); ++it) {
+        QJsonArray forwardSlots;
+        for (const Slot &slot : it.value().forwardSlots) {
+            forwardSlots.append(slot.source);
+        }
+
+        QJsonObject participant;
+        participant["activity"] = currentActivity(it.value(), nowNs);
+        participant["packetsIn"] = double(it.value().packetsIn);
+        participant["slots"] = forwardSlots;
+        participants[it.key()] = participant;
+    }
+
+    QJsonObject result;
+    result["participants"] = participants;
+    result["packetsIn"] = double(m_packetsIn);
+    result["packetsForwarded"] = double(m_packetsForwarded);
+    result["packetsNotSelected"] = double(m_packetsNotSelected);
+    return result;
+}
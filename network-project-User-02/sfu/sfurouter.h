@@ -0,0 +1,92 @@
+#ifndef SFUROUTER_H
+#define SFUROUTER_H
+
+#include <QtGlobal>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <memory>
+#include <rtc/rtc.hpp>
+
+// Decides who hears whom and rewrites RTP on the way through. Every participant
+// has a fixed number of outgoing slots, announced as SSRCs in its SDP answer, and
+// the most active speakers are mapped onto them, so nobody joining or leaving
+// ever needs a renegotiation. A slot that changes speaker keeps its sequence
+// numbers and timestamps continuous, and the client's jitter buffer sees one
+// steady stream.
+//
+// forward() runs on libdatachannel's threads, everything else on the server's.
+class SfuRouter
+{
+public:
+    struct Options {
+        int slotCount = 3;
+        // Leave speakers whose activity is under speechThreshold off every slot.
+        bool dropSilent = true;
+        double speechThreshold = 0.5;
+    };
+
+    explicit SfuRouter(const Options &options);
+
+    void addParticipant(const QString &id, std::shared_ptr<rtc::Track> track, quint8 payloadType,
+                        const QVector<rtc::SSRC> &slotSsrcs);
+    void removeParticipant(const QString &id);
+
+    void forward(const QString &sourceId, const uchar *data, int size);
+
+    // Re-ranks the speakers and reassigns slots.
+    void updateSelection();
+
+    QJsonObject statistics() const;
+
+private:
+    struct Slot {
+        rtc::SSRC ssrc = 0;
+        QString source;
+        bool resync = true;
+        bool started = false;
+        quint16 sequenceOffset = 0;
+        quint32 timestampOffset = 0;
+        quint16 lastSequence = 0;
+        quint32 lastTimestamp = 0;
+    };
+
+    struct Participant {
+        std::shared_ptr<rtc::Track> track;
+        quint8 payloadType = 111;
+        QVector<Slot> forwardSlots;
+
+        // Fraction of recent media time the participant actually sent audio for.
+        // Senders stop sending in silence (VAD, DTX), so this follows speech.
+        double activity = 0.0;
+        bool haveTimestamp = false;
+        quint32 nextTimestamp = 0;
+        qint64 lastPacketNs = 0;
+        quint64 packetsIn = 0;
+    };
+
+    struct Outgoing {
+        std::shared_ptr<rtc::Track> track;
+        rtc::binary packet;
+    };
+
+    void updateActivity(Participant &participant, quint32 timestamp, const uchar *payload, int payloadSize);
+    double currentActivity(const Participant &participant, qint64 nowNs) const;
+    void rewrite(Slot &slot, quint8 payloadType, const uchar *header, const uchar *payload, int payloadSize,
+                 rtc::binary &packet);
+
+    const Options m_options;
+    QElapsedTimer m_clock;
+
+    mutable QMutex m_mutex;
+    QHash<QString, Participant> m_participants;
+
+    quint64 m_packetsIn = 0;
+    quint64 m_packetsForwarded = 0;
+    quint64 m_packetsNotSelected = 0;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "sfuserver.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QDebug>
+#include "rtpstatistics.h"
+
+namespace {
+
+const int selectionIntervalMs = 100;
+const int defaultPayloadType = 111;
+
+// Hands RTP from one participant's track to the router. The packets stop here,
+// nothing in the SFU decodes them.
+class IngressHandler : public rtc::MediaHandler
+{
+public:
+    IngressHandler(SfuRouter *router, const QString &participantId)
+        : m_router(router),
+        m_participantId(participantId)
+    {
+    }
+
+    void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override
+    {
+        Q_UNUSED(send);
+
+        rtc::message_vector kept;
+        for (const rtc::message_ptr &message : messages) {
+            if (message->type == rtc::Message::Control) {
+                kept.push_back(message);
+                continue;
+            }
+            m_router->forward(m_participantId, reinterpret_cast<const uchar*>(message->data()), int(message->size()));
+        }
+        messages.swap(kept);
+    }
+
+private:
+    SfuRouter *m_router;
+    const QString m_participantId;
+};
+
+}
+
+SfuServer::SfuServer(const Options &options, QObject *parent)
+    : QObject(parent),
+    m_options(options),
+    m_router(options.router)
+{
+    for (const QString &iceServer : std::as_const(m_options.iceServers)) {
+        m_config.iceServers.push_back(rtc::IceServer(iceServer.toStdString()));
+    }
+    if (!m_options.iceBindAddress.isEmpty())
+        m_config.bindAddress = m_options.iceBindAddress.toStdString();
+
+    m_selectionTimer.setInterval(selectionIntervalMs);
+    connect(&m_selectionTimer, &QTimer::timeout, this, [this]() { m_router.updateSelection(); });
+
+    m_statisticsTimer.setInterval(qMax(1, m_options.statisticsIntervalSeconds) * 1000);
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &SfuServer::printStatistics);
+}
+
+SfuServer::~SfuServer()
+{
+    for (auto it = m_participants.begin(); it != m_participants.end(); ++it) {
+        it.value().peerConnection->close();
+    }
+}
+
+void SfuServer::start()
+{
+    m_signalingClient = new SignalingClient(m_options.signalingUrl, m_options.id, this);
+    connect(m_signalingClient, &SignalingClient::sdpReceived, this, &SfuServer::onSdpReceived);
+    connect(m_signalingClient, &SignalingClient::iceCandidateReceived, this, &SfuServer::onIceCandidateReceived);
+
+    m_selectionTimer.start();
+    if (m_options.statisticsIntervalSeconds > 0)
+        m_statisticsTimer.start();
+
+    qInfo() << "SFU" << m_options.id << "with" << m_options.router.slotCount << "slots per participant, signaling at"
+            << m_options.signalingUrl;
+}
+
+void SfuServer::onSdpReceived(const QString &from, const QJsonObject &sdp)
+{
+    if (sdp.value("type").toString() != "offer") {
+        qWarning() << "SFU ignoring" << sdp.value("type").toString() << "from" << from;
+        return;
+    }
+
+    const QString offer = sdp.value("sdp").toString();
+    auto it = m_participants.constFind(from);
+    if (it != m_participants.constEnd()) {
+        // Clients send their offer again once gathering completes.
+        if (it.value().offer == offer)
+            return;
+
+        // Anything else is a new session from the same client.
+        removeParticipant(from);
+    }
+
+    addParticipant(from, offer);
+}
+
+void SfuServer::onIceCandidateReceived(const QString &from, const QString &candidate, const QString &sdpMid)
+{
+    auto it = m_participants.constFind(from);
+    if (it == m_participants.constEnd())
+        return;
+
+    try {
+        it.value().peerConnection->addRemoteCandidate(rtc::Candidate(candidate.toStdString(), sdpMid.toStdString()));
+    } catch (const std::exception &e) {
+        qWarning() << "Failed to add ICE candidate from" << from << ":" << e.what();
+    }
+}
+
+void SfuServer::addParticipant(const QString &id, const QString &offer)
+{
+    try {
+        rtc::Description remote(offer.toStdString(), rtc::Description::Type::Offer);
+
+        // Answer on the client's own audio mid, with its Opus payload type.
+        std::string mid = "0";
+        int payloadType = defaultPayloadType;
+        for (unsigned int i = 0; i < remote.mediaCount(); ++i) {
+            auto entry = remote.media(i);
+            auto media = std::get_if<rtc::Description::Media*>(&entry);
+            if (!media || (*media)->type() != "audio")
+                continue;
+
+            mid = (*media)->mid();
+            for (int candidate : (*media)->payloadTypes()) {
+                const rtc::Description::Media::RtpMap *rtpMap = (*media)->rtpMap(candidate);
+                if (rtpMap && QString::fromStdString(rtpMap->format).compare("opus", Qt::CaseInsensitive) == 0) {
+                    payloadType = candidate;
+                    break;
+                }
+            }
+            break;
+        }
+
+        auto peerConnection = std::make_shared<rtc::PeerConnection>(m_config);
+
+        // The slot SSRCs go into the answer, so the client knows every stream it
+        // will ever receive from the start.
+        rtc::Description::Audio audio(mid, rtc::Description::Direction::SendRecv);
+        audio.addOpusCodec(payloadType);
+        QVector<rtc::SSRC> slotSsrcs;
+        for (int slot = 0; slot < m_options.router.slotCount; ++slot) {
+            const rtc::SSRC ssrc = QRandomGenerator::global()->generate();
+            slotSsrcs.append(ssrc);
+            audio.addSSRC(ssrc, m_options.id.toStdString(), "sfu", "slot" + std::to_string(slot));
+        }
+
+        auto track = peerConnection->addTrack(audio);
+        auto ingress = std::make_shared<IngressHandler>(&m_router, id);
+        // Receiver reports with real loss and jitter for the participant's uplink.
+        ingress->addToChain(std::make_shared<RtpStatisticsHandler>(
+            std::make_shared<RtpStatistics>(), QRandomGenerator::global()->generate(),
+            rtc::OpusRtpPacketizer::DefaultClockRate));
+        track->setMediaHandler(ingress);
+        m_router.addParticipant(id, track, static_cast<quint8>(payloadType), slotSsrcs);
+
+        // libdatachannel calls back on its own threads; signaling lives on this one.
+        peerConnection->onLocalDescription([this, id](const rtc::Description &description) {
+            const QJsonObject sdp = descriptionToJson(description);
+            QMetaObject::invokeMethod(this, [this, id, sdp]() {
+                m_signalingClient->sendSdp(id, sdp);
+            }, Qt::QueuedConnection);
+        });
+
+        peerConnection->onLocalCandidate([this, id](const rtc::Candidate &candidate) {
+            const QString candidateStr = QString::fromStdString(candidate.candidate());
+            const QString sdpMid = QString::fromStdString(candidate.mid());
+            QMetaObject::invokeMethod(this, [this, id, candidateStr, sdpMid]() {
+                m_signalingClient->sendIceCandidate(id, candidateStr, sdpMid);
+            }, Qt::QueuedConnection);
+        });
+
+        std::weak_ptr<rtc::PeerConnection> weakConnection = peerConnection;
+        peerConnection->onStateChange([this, id, weakConnection](rtc::PeerConnection::State state) {
+            if (state == rtc::PeerConnection::State::Connected) {
+                qInfo() << "SFU participant connected:" << id;
+            } else if (state == rtc::PeerConnection::State::Disconnected
+                       || state == rtc::PeerConnection::State::Failed
+                       || state == rtc::PeerConnection::State::Closed) {
+                QMetaObject::invokeMethod(this, [this, id, weakConnection]() {
+                    // Only if the participant has not reconnected in the meantime.
+                    auto it = m_participants.constFind(id);
+                    if (it != m_participants.constEnd() && it.value().peerConnection == weakConnection.lock())
+                        removeParticipant(id);
+                }, Qt::QueuedConnection);
+            }
+        });
+
+        Participant participant;
+        participant.peerConnection = peerConnection;
+        participant.offer = offer;
+        m_participants.insert(id, participant);
+
+        peerConnection->setRemoteDescription(remote);
+        qInfo() << "SFU participant joined:" << id << "(" << m_participants.size() << "in total)";
+    } catch (const std::exception &e) {
+        qWarning() << "Failed to add SFU participant" << id << ":" << e.what();
+        m_router.removeParticipant(id);
+    }
+}
+
+void SfuServer::removeParticipant(const QString &id)
+{
+    auto it = m_participants.find(id);
+    if (it == m_participants.end())
+        return;
+
+    m_router.removeParticipant(id);
+    const std::shared_ptr<rtc::PeerConnection> peerConnection = it.value().peerConnection;
+    m_participants.erase(it);
+    peerConnection->close();
+
+    qInfo() << "SFU participant left:" << id << "(" << m_participants.size() << "in total)";
+}
+
+void SfuServer::printStatistics()
+{
+    qInfo().noquote() << QJsonDocument(m_router.statistics()).toJson(QJsonDocument::Compact);
+}
+
+QJsonObject SfuServer::descriptionToJson(const rtc::Description &description)
+{
+    QJsonObject jsonObject;
+    jsonObject.insert("type", QString::fromStdString(description.typeString()));
+    jsonObject.insert("sdp", QString::fromStdString(description.generateSdp()));
+    return jsonObject;
+}
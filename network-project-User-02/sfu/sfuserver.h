@@ -0,0 +1,57 @@
+#ifndef SFUSERVER_H
+#define SFUSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QStringList>
+#include <memory>
+#include <rtc/rtc.hpp>
+#include "signalingclient.h"
+#include "sfurouter.h"
+
+// Registers with the signaling server like any client and answers every offer
+// it gets. Each caller has one PeerConnection with one audio track: its own
+// audio comes in on it, and the router's slots go back out on it.
+class SfuServer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString signalingUrl;
+        QString id = "sfu";
+        QStringList iceServers;
+        QString iceBindAddress;
+        int statisticsIntervalSeconds = 10;
+        SfuRouter::Options router;
+    };
+
+    explicit SfuServer(const Options &options, QObject *parent = nullptr);
+    ~SfuServer();
+
+    void start();
+
+private:
+    struct Participant {
+        std::shared_ptr<rtc::PeerConnection> peerConnection;
+        QString offer;
+    };
+
+    void onSdpReceived(const QString &from, const QJsonObject &sdp);
+    void onIceCandidateReceived(const QString &from, const QString &candidate, const QString &sdpMid);
+    void addParticipant(const QString &id, const QString &offer);
+    void removeParticipant(const QString &id);
+    void printStatistics();
+
+    static QJsonObject descriptionToJson(const rtc::Description &description);
+
+    const Options m_options;
+    rtc::Configuration m_config;
+    SfuRouter m_router;
+    SignalingClient *m_signalingClient = nullptr;
+    QHash<QString, Participant> m_participants;
+    QTimer m_selectionTimer;
+    QTimer m_statisticsTimer;
+};
+
+#endif
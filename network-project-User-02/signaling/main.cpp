@@ -0,0 +1,46 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QTimer>
+#include <QDebug>
+#include "signalingserver.h"
+
+// Drop-in replacement for server.js on the same port. Unlike it, this logs no
+// per-message traffic and never broadcasts a message it cannot route.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("signaling");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WebSocket signaling server for voice calls.");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Port to listen on.", "port", "3000");
+    QCommandLineOption addressOption("address", "Address to listen on; all interfaces by default.", "address");
+    QCommandLineOption workersOption("workers", "Worker threads; one per core by default.", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption statisticsOption("stats-interval", "Seconds between statistics lines; 0 disables them.", "seconds", "0");
+    parser.addOptions({ portOption, addressOption, workersOption, statisticsOption });
+    parser.process(app);
+
+    const QHostAddress address = parser.isSet(addressOption) ? QHostAddress(parser.value(addressOption)) : QHostAddress(QHostAddress::Any);
+    SignalingServer server(parser.value(workersOption).toInt());
+    if (!server.listen(address, static_cast<quint16>(parser.value(portOption).toUInt()))) {
+        qWarning() << "Signaling server failed to listen:" << server.errorString();
+        return 1;
+    }
+    qInfo() << "Signaling server on" << server.url().toString() << "with" << server.workerCount() << "workers";
+
+    QTimer statisticsTimer;
+    const int statisticsInterval = parser.value(statisticsOption).toInt();
+    if (statisticsInterval > 0) {
+        QObject::connect(&statisticsTimer, &QTimer::timeout, [&server]() {
+            qInfo().noquote() << QJsonDocument(server.statistics()).toJson(QJsonDocument::Compact);
+        });
+        statisticsTimer.start(statisticsInterval * 1000);
+    }
+
+    return app.exec();
+}
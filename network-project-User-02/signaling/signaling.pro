@@ -0,0 +1,18 @@
+QT += core network websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = signaling
+
+SOURCES += \
+    main.cpp \
+    signalingserver.cpp \
+    signalingworker.cpp
+
+HEADERS += \
+    signalingserver.h \
+    signalingworker.h
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
@@ -0,0 +1,139 @@
+#include "signalingserver.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDebug>
+#include "signalingworker.h"
+
+SignalingServer::SignalingServer(int workerCount, QObject *parent)
+    : QTcpServer(parent)
+{
+    for (int i = 0; i < qMax(1, workerCount); ++i) {
+        m_workers.append(new SignalingWorker(this, i));
+    }
+}
+
+SignalingServer::~SignalingServer()
+{
+    close();
+
+    // Every worker stops before any is deleted, as they deliver into each other.
+    for (SignalingWorker *worker : std::as_const(m_workers)) {
+        worker->stop();
+    }
+    qDeleteAll(m_workers);
+}
+
+QUrl SignalingServer::url() const
+{
+    QUrl url;
+    url.setScheme("ws");
+    url.setHost(serverAddress().toString());
+    url.setPort(serverPort());
+    return url;
+}
+
+int SignalingServer::workerCount() const
+{
+    return m_workers.size();
+}
+
+int SignalingServer::clientCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_routes.size();
+}
+
+QJsonObject SignalingServer::statistics() const
+{
+    int connections = 0;
+    quint64 received = 0;
+    quint64 undeliverable = 0;
+    for (const SignalingWorker *worker : m_workers) {
+        connections += worker->connectionCount();
+        received += worker->messagesReceived();
+        undeliverable += worker->messagesUndeliverable();
+    }
+
+    QReadLocker locker(&m_lock);
+    QJsonObject result;
+    result["workers"] = m_workers.size();
+    result["connections"] = connections;
+    result["clients"] = m_routes.size();
+    result["rooms"] = m_rooms.size();
+    result["messagesReceived"] = double(received);
+    result["messagesUndeliverable"] = double(undeliverable);
+    return result;
+}
+
+void SignalingServer::incomingConnection(qintptr socketDescriptor)
+{
+    m_workers[m_nextWorker]->addConnection(socketDescriptor);
+    m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+}
+
+// The latest registration for an id wins, as in server.js.
+void SignalingServer::registerClient(const QString &id, const Route &route)
+{
+    QWriteLocker locker(&m_lock);
+    m_routes.insert(id, route);
+}
+
+// Only if the id still belongs to that connection; it may have registered again elsewhere.
+void SignalingServer::unregisterClient(const QString &id, quint64 connection)
+{
+    QWriteLocker locker(&m_lock);
+    auto it = m_routes.find(id);
+    if (it != m_routes.end() && it.value().connection == connection)
+        m_routes.erase(it);
+}
+
+bool SignalingServer::deliver(const QString &id, const QString &message) const
+{
+    Route route;
+    {
+        QReadLocker locker(&m_lock);
+        auto it = m_routes.constFind(id);
+        if (it == m_routes.constEnd())
+            return false;
+        route = it.value();
+    }
+
+    route.worker->send(route.connection, message);
+    return true;
+}
+
+bool SignalingServer::acceptsCandidateBatches(const QString &id) const
+{
+    QReadLocker locker(&m_lock);
+    auto it = m_routes.constFind(id);
+    return it == m_routes.constEnd() || it.value().candidateBatching;
+}
+
+QStringList SignalingServer::joinRoom(const QString &room, const QString &id)
+{
+    QWriteLocker locker(&m_lock);
+    QSet<QString> &members = m_rooms[room];
+    QStringList others;
+    others.reserve(members.size());
+    for (const QString &member : std::as_const(members)) {
+        if (member != id)
+            others.append(member);
+    }
+    members.insert(id);
+    return others;
+}
+
+QStringList SignalingServer::leaveRoom(const QString &room, const QString &id)
+{
+    QWriteLocker locker(&m_lock);
+    auto it = m_rooms.find(room);
+    if (it == m_rooms.end())
+        return QStringList();
+
+    it.value().remove(id);
+    if (it.value().isEmpty()) {
+        m_rooms.erase(it);
+        return QStringList();
+    }
+    return it.value().values();
+}
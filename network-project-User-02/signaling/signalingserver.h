@@ -0,0 +1,63 @@
+#ifndef SIGNALINGSERVER_H
+#define SIGNALINGSERVER_H
+
+#include <QTcpServer>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QUrl>
+#include <QJsonObject>
+#include <QReadWriteLock>
+#include <QThread>
+
+class SignalingWorker;
+
+// Native replacement for server.js, speaking the same register/sdp/candidate
+// protocol plus rooms. Batched "candidates" messages are split into single
+// "candidate" ones for clients that did not register as taking them. Accepted sockets are dealt out round-robin to worker
+// threads, which run the WebSocket handshake and own the connection from then
+// on. Client ids and rooms live in one registry shared by all workers, so a
+// message goes straight to the worker holding its recipient. Messages for an
+// unknown recipient are answered with an error, never broadcast.
+class SignalingServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    struct Route {
+        SignalingWorker *worker = nullptr;
+        quint64 connection = 0;
+        bool candidateBatching = false;
+    };
+
+    explicit SignalingServer(int workerCount = QThread::idealThreadCount(), QObject *parent = nullptr);
+    ~SignalingServer();
+
+    QUrl url() const;
+    int workerCount() const;
+    int clientCount() const;
+    QJsonObject statistics() const;
+
+    // The registry; called from the worker threads.
+    void registerClient(const QString &id, const Route &route);
+    void unregisterClient(const QString &id, quint64 connection);
+    bool deliver(const QString &id, const QString &message) const;
+    // False only for a registered client that did not ask for "candidates" messages.
+    bool acceptsCandidateBatches(const QString &id) const;
+
+    // Both return the other members of the room, before the join or after the leave.
+    QStringList joinRoom(const QString &room, const QString &id);
+    QStringList leaveRoom(const QString &room, const QString &id);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    QVector<SignalingWorker*> m_workers;
+    int m_nextWorker = 0;
+
+    mutable QReadWriteLock m_lock;
+    QHash<QString, Route> m_routes;
+    QHash<QString, QSet<QString>> m_rooms;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "signalingworker.h"
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <QTcpSocket>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include "signalingserver.h"
+
+namespace {
+
+std::atomic<quint64> nextConnection{1};
+
+QString toJson(const QJsonObject &object)
+{
+    return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+}
+
+SignalingWorker::SignalingWorker(SignalingServer *server, int index)
+    : m_server(server),
+    m_context(new QObject)
+{
+    m_thread.setObjectName(QString("SignalingWorker%1").arg(index));
+    m_context->moveToThread(&m_thread);
+    m_thread.start();
+
+    QMetaObject::invokeMethod(m_context, [this]() { initialize(); }, Qt::BlockingQueuedConnection);
+}
+
+SignalingWorker::~SignalingWorker()
+{
+    stop();
+    delete m_context;
+}
+
+void SignalingWorker::stop()
+{
+    if (!m_thread.isRunning())
+        return;
+
+    QMetaObject::invokeMethod(m_context, [this]() { shutdown(); }, Qt::BlockingQueuedConnection);
+
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void SignalingWorker::initialize()
+{
+    m_handshakes = new QWebSocketServer("signaling", QWebSocketServer::NonSecureMode, m_context);
+    QObject::connect(m_handshakes, &QWebSocketServer::newConnection, m_context, [this]() { onNewConnection(); });
+}
+
+void SignalingWorker::shutdown()
+{
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        it.value().socket->disconnect(m_context);
+        delete it.value().socket;
+    }
+    m_connections.clear();
+    m_connectionCount.store(0, std::memory_order_relaxed);
+
+    delete m_handshakes;
+    m_handshakes = nullptr;
+}
+
+// The socket is created on this thread, so the handshake and every read and write happen here.
+void SignalingWorker::addConnection(qintptr socketDescriptor)
+{
+    QMetaObject::invokeMethod(m_context, [this, socketDescriptor]() {
+        QTcpSocket *socket = new QTcpSocket;
+        if (!socket->setSocketDescriptor(socketDescriptor)) {
+            qWarning() << "Signaling worker failed to take over socket:" << socket->errorString();
+            delete socket;
+            return;
+        }
+        m_handshakes->handleConnection(socket);
+    }, Qt::QueuedConnection);
+}
+
+void SignalingWorker::send(quint64 connection, const QString &message)
+{
+    auto sendNow = [this, connection, message]() {
+        auto it = m_connections.constFind(connection);
+        if (it != m_connections.constEnd())
+            it.value().socket->sendTextMessage(message);
+    };
+
+    if (QThread::currentThread() == &m_thread)
+        sendNow();
+    else
+        QMetaObject::invokeMethod(m_context, sendNow, Qt::QueuedConnection);
+}
+
+int SignalingWorker::connectionCount() const
+{
+    return m_connectionCount.load(std::memory_order_relaxed);
+}
+
+quint64 SignalingWorker::messagesReceived() const
+{
+    return m_messagesReceived.load(std::memory_order_relaxed);
+}
+
+quint64 SignalingWorker::messagesUndeliverable() const
+{
+    return m_messagesUndeliverable.load(std::memory_order_relaxed);
+}
+
+void SignalingWorker::onNewConnection()
+{
+    while (QWebSocket *socket = m_handshakes->nextPendingConnection()) {
+        const quint64 connection = nextConnection.fetch_add(1, std::memory_order_relaxed);
+        socket->setParent(m_context);
+
+        QObject::connect(socket, &QWebSocket::textMessageReceived, m_context, [this, connection](const QString &message) {
+            onTextMessage(connection, message);
+        });
+        QObject::connect(socket, &QWebSocket::disconnected, m_context, [this, connection]() {
+            onDisconnected(connection);
+        });
+
+        Connection state;
+        state.socket = socket;
+        m_connections.insert(connection, state);
+        m_connectionCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SignalingWorker::onTextMessage(quint64 connection, const QString &message)
+{
+    auto it = m_connections.find(connection);
+    if (it == m_connections.end())
+        return;
+
+    m_messagesReceived.fetch_add(1, std::memory_order_relaxed);
+
+    const QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object();
+    if (data.isEmpty()) {
+        sendError(connection, "invalid-json", QString());
+        return;
+    }
+
+    const QString type = data["type"].toString();
+    const QString from = data["from"].toString();
+
+    if (type == "register") {
+        if (from.isEmpty()) {
+            sendError(connection, "missing-id", QString());
+            return;
+        }
+        if (!it.value().id.isEmpty() && it.value().id != from)
+            m_server->unregisterClient(it.value().id, connection);
+
+        it.value().id = from;
+        SignalingServer::Route route;
+        route.worker = this;
+        route.connection = connection;
+        route.candidateBatching = data["candidateBatching"].toBool();
+        m_server->registerClient(from, route);
+        return;
+    }
+
+    if (type == "join" || type == "leave") {
+        const QString room = data["room"].toString();
+        if (it.value().id.isEmpty() || room.isEmpty()) {
+            sendError(connection, it.value().id.isEmpty() ? "not-registered" : "missing-room", room);
+            return;
+        }
+
+        if (type == "leave") {
+            leave(it.value(), room);
+            return;
+        }
+
+        if (it.value().rooms.contains(room))
+            return;
+        it.value().rooms.insert(room);
+
+        const QString id = it.value().id;
+        const QStringList others = m_server->joinRoom(room, id);
+
+        QJsonObject presence;
+        presence["type"] = "presence";
+        presence["to"] = id;
+        presence["room"] = room;
+        presence["members"] = QJsonArray::fromStringList(others);
+        it.value().socket->sendTextMessage(toJson(presence));
+
+        for (const QString &member : others) {
+            sendPresence(member, room, "joined", id);
+        }
+        return;
+    }
+
+    // Everything else is for one recipient and passes through untouched.
+    const QString to = data["to"].toString();
+    if (type == "candidates" && !m_server->acceptsCandidateBatches(to)) {
+        deliverCandidates(connection, data);
+        return;
+    }
+    if (to.isEmpty() || !m_server->deliver(to, message)) {
+        m_messagesUndeliverable.fetch_add(1, std::memory_order_relaxed);
+        sendError(connection, "unknown-recipient", to);
+    }
+}
+
+void SignalingWorker::deliverCandidates(quint64 connection, const QJsonObject &data)
+{
+    const QString to = data["to"].toString();
+    const QJsonArray candidates = data["candidates"].toArray();
+    for (const QJsonValue &value : candidates) {
+        const QJsonObject entry = value.toObject();
+        QJsonObject message;
+        message["type"] = "candidate";
+        message["from"] = data["from"];
+        message["to"] = to;
+        message["candidate"] = entry["candidate"];
+        message["sdpMid"] = entry["sdpMid"];
+
+        // The recipient may have gone in the meantime; the rest would not arrive either.
+        if (!m_server->deliver(to, toJson(message))) {
+            m_messagesUndeliverable.fetch_add(1, std::memory_order_relaxed);
+            sendError(connection, "unknown-recipient", to);
+            return;
+        }
+    }
+}
+
+void SignalingWorker::onDisconnected(quint64 connection)
+{
+    auto it = m_connections.find(connection);
+    if (it == m_connections.end())
+        return;
+
+    Connection &state = it.value();
+    if (!state.id.isEmpty()) {
+        const QSet<QString> rooms = state.rooms;
+        for (const QString &room : rooms) {
+            leave(state, room);
+        }
+        m_server->unregisterClient(state.id, connection);
+    }
+
+    state.socket->deleteLater();
+    m_connections.erase(it);
+    m_connectionCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void SignalingWorker::leave(Connection &connection, const QString &room)
+{
+    if (!connection.rooms.remove(room))
+        return;
+
+    const QStringList others = m_server->leaveRoom(room, connection.id);
+    for (const QString &member : others) {
+        sendPresence(member, room, "left", connection.id);
+    }
+}
+
+void SignalingWorker::sendPresence(const QString &to, const QString &room, const QString &key, const QString &value)
+{
+    QJsonObject presence;
+    presence["type"] = "presence";
+    presence["to"] = to;
+    presence["room"] = room;
+    presence[key] = value;
+    m_server->deliver(to, toJson(presence));
+}
+
+void SignalingWorker::sendError(quint64 connection, const QString &reason, const QString &target)
+{
+    auto it = m_connections.constFind(connection);
+    if (it == m_connections.constEnd())
+        return;
+
+    QJsonObject error;
+    error["type"] = "error";
+    error["to"] = it.value().id;
+    error["reason"] = reason;
+    if (!target.isEmpty())
+        error["target"] = target;
+    it.value().socket->sendTextMessage(toJson(error));
+}
@@ -0,0 +1,64 @@
+#ifndef SIGNALINGWORKER_H
+#define SIGNALINGWORKER_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <atomic>
+
+class QWebSocket;
+class QWebSocketServer;
+class SignalingServer;
+
+// One shard of the signaling server: a thread with its own event loop that
+// upgrades the sockets it is handed and routes whatever they send.
+class SignalingWorker
+{
+public:
+    SignalingWorker(SignalingServer *server, int index);
+    ~SignalingWorker();
+
+    // Closes every connection and stops the thread; the destructor does it too.
+    void stop();
+
+    // Both are thread-safe.
+    void addConnection(qintptr socketDescriptor);
+    void send(quint64 connection, const QString &message);
+
+    int connectionCount() const;
+    quint64 messagesReceived() const;
+    quint64 messagesUndeliverable() const;
+
+private:
+    struct Connection {
+        QWebSocket *socket = nullptr;
+        QString id;
+        QSet<QString> rooms;
+    };
+
+    void initialize();
+    void shutdown();
+    void onNewConnection();
+    void onTextMessage(quint64 connection, const QString &message);
+    void deliverCandidates(quint64 connection, const QJsonObject &data);
+    void onDisconnected(quint64 connection);
+    void sendPresence(const QString &to, const QString &room, const QString &key, const QString &value);
+    void sendError(quint64 connection, const QString &reason, const QString &target);
+    void leave(Connection &connection, const QString &room);
+
+    SignalingServer *m_server;
+    QThread m_thread;
+    QObject *m_context = nullptr;
+
+    // Never listens; it only runs handshakes on sockets the acceptor hands over.
+    QWebSocketServer *m_handshakes = nullptr;
+    QHash<quint64, Connection> m_connections;
+
+    std::atomic<int> m_connectionCount{0};
+    std::atomic<quint64> m_messagesReceived{0};
+    std::atomic<quint64> m_messagesUndeliverable{0};
+};
+
+#endif
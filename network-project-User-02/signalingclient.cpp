@@ -1,6 +1,8 @@
 #include "signalingclient.h"
 #include <QJsonDocument>
+#include <QJsonArray>
 #include <QDebug>
+#include "tracing.h"
 
 SignalingClient::SignalingClient(const QString &serverUrl, const QString &localId, QObject *parent)
     : QObject(parent), m_localId(localId)
@@ -10,6 +12,10 @@ SignalingClient::SignalingClient(const QString &serverUrl, const QString &localI
     connect(&m_socket, &QWebSocket::disconnected, this, &SignalingClient::onDisconnected);
     connect(&m_socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, &SignalingClient::onError);
 
+    m_candidateTimer.setSingleShot(true);
+    m_candidateTimer.setInterval(10);
+    connect(&m_candidateTimer, &QTimer::timeout, this, &SignalingClient::flushCandidates);
+
     qDebug() << "Connecting to signaling server at:" << serverUrl;
     m_socket.open(QUrl(serverUrl));
 }
@@ -24,12 +30,23 @@ void SignalingClient::sendSdp(const QString &peerID, const QJsonObject &sdp)
 
     QJsonDocument doc(message);
     QString jsonString = doc.toJson(QJsonDocument::Compact);
-    qDebug() << "Sending SDP to peerId:" << peerID << ", message:" << jsonString;
+    qDebug() << "Sending SDP to peerId:" << peerID;
+    TRACE_INSTANT(Signaling, "sdpSent", jsonString.size());
     m_socket.sendTextMessage(jsonString);
 }
 
 void SignalingClient::sendIceCandidate(const QString &peerID, const QString &candidate, const QString &sdpMid)
 {
+    if (m_candidateTimer.interval() > 0) {
+        QJsonObject entry;
+        entry["candidate"] = candidate;
+        entry["sdpMid"] = sdpMid;
+        m_pendingCandidates[peerID].append(entry);
+        if (!m_candidateTimer.isActive())
+            m_candidateTimer.start();
+        return;
+    }
+
     QJsonObject message;
     message["type"] = "candidate";
     message["from"] = m_localId;
@@ -39,20 +56,64 @@ void SignalingClient::sendIceCandidate(const QString &peerID, const QString &can
 
     QJsonDocument doc(message);
     QString jsonString = doc.toJson(QJsonDocument::Compact);
-    qDebug() << "Sending ICE Candidate to peerId:" << peerID << ", message:" << jsonString;
+    TRACE_INSTANT(Signaling, "candidateSent", jsonString.size());
     m_socket.sendTextMessage(jsonString);
 }
 
+void SignalingClient::setCandidateBatchInterval(int milliseconds)
+{
+    m_candidateTimer.setInterval(qMax(0, milliseconds));
+    if (milliseconds <= 0)
+        flushCandidates();
+}
+
+void SignalingClient::flushCandidates()
+{
+    m_candidateTimer.stop();
+
+    for (auto it = m_pendingCandidates.constBegin(); it != m_pendingCandidates.constEnd(); ++it) {
+        QJsonObject message;
+        message["type"] = "candidates";
+        message["from"] = m_localId;
+        message["to"] = it.key();
+        message["candidates"] = it.value();
+
+        QJsonDocument doc(message);
+        QString jsonString = doc.toJson(QJsonDocument::Compact);
+        TRACE_INSTANT(Signaling, "candidatesSent", it.value().size());
+        m_socket.sendTextMessage(jsonString);
+    }
+    m_pendingCandidates.clear();
+}
+
+void SignalingClient::joinRoom(const QString &room)
+{
+    QJsonObject message;
+    message["type"] = "join";
+    message["from"] = m_localId;
+    message["room"] = room;
+    m_socket.sendTextMessage(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void SignalingClient::leaveRoom(const QString &room)
+{
+    QJsonObject message;
+    message["type"] = "leave";
+    message["from"] = m_localId;
+    message["room"] = room;
+    m_socket.sendTextMessage(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
 
 
 
 void SignalingClient::onMessageReceived(const QString &message)
 {
-    qDebug() << "Message received:" << message;
+    TRACE_INSTANT(Signaling, "messageReceived", message.size());
 
     QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
     if (doc.isNull()) {
-        qWarning() << "Received invalid JSON message:" << message;
+        TRACE_WARNING(Signaling) << "Received invalid JSON message of" << message.size() << "characters";
         return;
     }
 
@@ -73,14 +134,41 @@ void SignalingClient::onMessageReceived(const QString &message)
         } else if (type == "candidate") {
             QString candidate = obj["candidate"].toString();
             QString sdpMid = obj["sdpMid"].toString();
-            qDebug() << "ICE Candidate received from peerId:" << peerId;
+            TRACE_INSTANT(Signaling, "candidateReceived", candidate.size());
 
             emit iceCandidateReceived(peerId, candidate, sdpMid);
+        } else if (type == "candidates") {
+            const QJsonArray candidates = obj["candidates"].toArray();
+            TRACE_INSTANT(Signaling, "candidatesReceived", candidates.size());
+
+            for (const QJsonValue &value : candidates) {
+                const QJsonObject entry = value.toObject();
+                emit iceCandidateReceived(peerId, entry["candidate"].toString(), entry["sdpMid"].toString());
+            }
+        } else if (type == "presence") {
+            const QString room = obj["room"].toString();
+            if (obj.contains("members")) {
+                QStringList members;
+                const QJsonArray array = obj["members"].toArray();
+                for (const QJsonValue &member : array) {
+                    members.append(member.toString());
+                }
+                emit roomMembersReceived(room, members);
+            } else if (obj.contains("joined")) {
+                emit peerJoinedRoom(room, obj["joined"].toString());
+            } else if (obj.contains("left")) {
+                emit peerLeftRoom(room, obj["left"].toString());
+            }
+        } else if (type == "error") {
+            const QString target = obj["target"].toString();
+            const QString reason = obj["reason"].toString();
+            TRACE_WARNING(Signaling) << "Signaling server could not deliver to" << target << ":" << reason;
+            emit deliveryFailed(target, reason);
         } else {
             qDebug() << "Unknown message type received.";
         }
     } else {
-        qDebug() << "Message not intended for this client. Ignoring.";
+        TRACE_INSTANT(Signaling, "messageIgnored", message.size());
     }
 }
 
@@ -93,10 +181,12 @@ void SignalingClient::onConnected()
     QJsonObject message;
     message["type"] = "register";
     message["from"] = m_localId;
+    // The native server splits batches up for clients that do not say this.
+    message["candidateBatching"] = true;
     QJsonDocument doc(message);
     QString jsonString = doc.toJson(QJsonDocument::Compact);
 
-    qDebug() << "Sending registration message:" << jsonString;
+    qDebug() << "Registering with signaling server as:" << m_localId;
     m_socket.sendTextMessage(jsonString);
 }
 
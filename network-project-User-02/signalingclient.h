@@ -4,6 +4,10 @@
 #include <QObject>
 #include <QWebSocket>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QHash>
+#include <QTimer>
+#include <QStringList>
 
 class SignalingClient : public QObject
 {
@@ -14,9 +18,22 @@ public:
     void sendSdp(const QString &peerID, const QJsonObject &sdp);
     void sendIceCandidate(const QString &peerId, const QString &candidate, const QString &sdpMid);
 
+    // Candidates for a peer are coalesced over this many milliseconds into one
+    // message; 0 sends each on its own, which older clients also understand.
+    void setCandidateBatchInterval(int milliseconds);
+    void flushCandidates();
+
+    // Rooms need the native signaling server; server.js ignores them.
+    void joinRoom(const QString &room);
+    void leaveRoom(const QString &room);
+
 signals:
     void sdpReceived(const QString &from, const QJsonObject &sdp);
     void iceCandidateReceived(const QString &from, const QString &candidate, const QString &sdpMid);
+    void roomMembersReceived(const QString &room, const QStringList &members);
+    void peerJoinedRoom(const QString &room, const QString &peerId);
+    void peerLeftRoom(const QString &room, const QString &peerId);
+    void deliveryFailed(const QString &peerId, const QString &reason);
 
 private slots:
     void onMessageReceived(const QString &message);
@@ -27,6 +44,8 @@ private slots:
 private:
     QWebSocket m_socket;
     QString m_localId;
+    QTimer m_candidateTimer;
+    QHash<QString, QJsonArray> m_pendingCandidates;
 };
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <QVector>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+// Wait-free ring for exactly one producer thread and one consumer thread.
+// Indices grow monotonically and are masked on access, so capacity is a power of two.
+template <typename T>
+class SpscRingBuffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRingBuffer copies elements with memcpy");
+
+public:
+    explicit SpscRingBuffer(int capacity)
+    {
+        int size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        m_buffer.fill(T(), size);
+        m_mask = static_cast<size_t>(size - 1);
+    }
+
+    int capacity() const
+    {
+        return static_cast<int>(m_mask + 1);
+    }
+
+    int available() const
+    {
+        return static_cast<int>(m_writeIndex.load(std::memory_order_acquire) - m_readIndex.load(std::memory_order_acquire));
+    }
+
+    int freeSpace() const
+    {
+        return capacity() - available();
+    }
+
+    // Producer side.
+    int write(const T *data, int count)
+    {
+        const size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+        const size_t readIndex = m_readIndex.load(std::memory_order_acquire);
+        const int space = capacity() - static_cast<int>(writeIndex - readIndex);
+        const int n = count < space ? count : space;
+        if (n <= 0)
+            return 0;
+
+        copyIn(writeIndex, data, n);
+        m_writeIndex.store(writeIndex + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side.
+    int read(T *data, int count)
+    {
+        const size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+        const size_t writeIndex = m_writeIndex.load(std::memory_order_acquire);
+        const int filled = static_cast<int>(writeIndex - readIndex);
+        const int n = count < filled ? count : filled;
+        if (n <= 0)
+            return 0;
+
+        copyOut(readIndex, data, n);
+        m_readIndex.store(readIndex + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side; drops everything currently readable.
+    void clear()
+    {
+        m_readIndex.store(m_writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    void copyIn(size_t index, const T *data, int count)
+    {
+        const size_t start = index & m_mask;
+        const size_t first = qMin<size_t>(static_cast<size_t>(count), m_mask + 1 - start);
+        std::memcpy(m_buffer.data() + start, data, first * sizeof(T));
+        std::memcpy(m_buffer.data(), data + first, (count - first) * sizeof(T));
+    }
+
+    void copyOut(size_t index, T *data, int count) const
+    {
+        const size_t start = index & m_mask;
+        const size_t first = qMin<size_t>(static_cast<size_t>(count), m_mask + 1 - start);
+        std::memcpy(data, m_buffer.constData() + start, first * sizeof(T));
+        std::memcpy(data + first, m_buffer.constData(), (count - first) * sizeof(T));
+    }
+
+    QVector<T> m_buffer;
+    size_t m_mask = 0;
+
+    alignas(64) std::atomic<size_t> m_writeIndex{0};
+    alignas(64) std::atomic<size_t> m_readIndex{0};
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "syntheticaudiobackend.h"
+#include <QtMath>
+
+namespace {
+
+const int sampleRate = 48000;
+const double toneFrequency = 440.0;
+const double toneAmplitude = 8000.0;
+// About -30 dBFS.
+const double noiseAmplitude = 1000.0;
+
+}
+
+GeneratorCaptureBackend::GeneratorCaptureBackend(Waveform waveform, AudioBackends::Pacing pacing, QObject *parent)
+    : PacedCaptureBackend(pacing, parent),
+    m_waveform(waveform)
+{
+}
+
+bool GeneratorCaptureBackend::waveformFromString(const QString &name, Waveform *waveform)
+{
+    if (name == "tone")
+        *waveform = Waveform::Tone;
+    else if (name == "noise")
+        *waveform = Waveform::Noise;
+    else if (name == "speech")
+        *waveform = Waveform::Speech;
+    else if (name == "silence")
+        *waveform = Waveform::Silence;
+    else
+        return false;
+    return true;
+}
+
+bool GeneratorCaptureBackend::openSource()
+{
+    m_position = 0;
+    m_noiseState = 0x12345678u;
+    m_low = 0.0;
+    m_band = 0.0;
+    return true;
+}
+
+// xorshift32, in [-1, 1).
+double GeneratorCaptureBackend::noise()
+{
+    m_noiseState ^= m_noiseState << 13;
+    m_noiseState ^= m_noiseState >> 17;
+    m_noiseState ^= m_noiseState << 5;
+    return static_cast<qint32>(m_noiseState) / 2147483648.0;
+}
+
+void GeneratorCaptureBackend::produce(opus_int16 *pcm, int count)
+{
+    for (int i = 0; i < count; ++i, ++m_position) {
+        const double t = static_cast<double>(m_position) / sampleRate;
+        double value = 0.0;
+
+        switch (m_waveform) {
+        case Waveform::Tone:
+            value = toneAmplitude * qSin(2.0 * M_PI * toneFrequency * t);
+            break;
+        case Waveform::Noise:
+            value = noiseAmplitude * noise();
+            break;
+        case Waveform::Speech: {
+            // Lowpassed noise under a syllable-rate envelope, with pauses between "words".
+            const double syllable = qMax(0.0, qSin(2.0 * M_PI * 4.0 * t));
+            const double word = qSin(2.0 * M_PI * 0.4 * t) > -0.3 ? 1.0 : 0.0;
+            m_low += 0.15 * (noise() - m_low);
+            m_band += 0.5 * (m_low - m_band);
+            value = m_band * syllable * word * 60000.0;
+            break;
+        }
+        case Waveform::Silence:
+            break;
+        }
+
+        pcm[i] = static_cast<opus_int16>(qBound(-32768.0, value, 32767.0));
+    }
+}
+
+
+NullPlayoutBackend::NullPlayoutBackend(AudioBackends::Pacing pacing, QObject *parent)
+    : PacedPlayoutBackend(pacing, parent)
+{
+}
+
+qint64 NullPlayoutBackend::consumedSamples() const
+{
+    return m_consumedSamples;
+}
+
+void NullPlayoutBackend::consume(const opus_int16 *pcm, int count)
+{
+    Q_UNUSED(pcm)
+    m_consumedSamples += count;
+}
@@ -0,0 +1,53 @@
+#ifndef SYNTHETICAUDIOBACKEND_H
+#define SYNTHETICAUDIOBACKEND_H
+
+#include "audiobackend.h"
+
+// A test signal in place of a microphone. The same waveform always gives the
+// same samples, so runs can be compared with each other.
+class GeneratorCaptureBackend : public PacedCaptureBackend
+{
+    Q_OBJECT
+public:
+    enum class Waveform {
+        Tone,
+        Noise,
+        Speech,
+        Silence
+    };
+
+    GeneratorCaptureBackend(Waveform waveform, AudioBackends::Pacing pacing, QObject *parent = nullptr);
+
+    static bool waveformFromString(const QString &name, Waveform *waveform);
+
+protected:
+    bool openSource() override;
+    void produce(opus_int16 *pcm, int count) override;
+
+private:
+    double noise();
+
+    const Waveform m_waveform;
+    qint64 m_position = 0;
+    quint32 m_noiseState = 0x12345678u;
+    double m_low = 0.0;
+    double m_band = 0.0;
+};
+
+// Throws playout away, at the pace of a sound card or as fast as it is mixed.
+class NullPlayoutBackend : public PacedPlayoutBackend
+{
+    Q_OBJECT
+public:
+    explicit NullPlayoutBackend(AudioBackends::Pacing pacing, QObject *parent = nullptr);
+
+    qint64 consumedSamples() const;
+
+protected:
+    void consume(const opus_int16 *pcm, int count) override;
+
+private:
+    qint64 m_consumedSamples = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "localsignalingserver.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+LocalSignalingServer::LocalSignalingServer(QObject *parent)
+    : QObject(parent),
+    m_server("loopback-signaling", QWebSocketServer::NonSecureMode)
+{
+    connect(&m_server, &QWebSocketServer::newConnection, this, &LocalSignalingServer::onNewConnection);
+}
+
+LocalSignalingServer::~LocalSignalingServer()
+{
+    m_server.close();
+    qDeleteAll(m_sockets);
+}
+
+bool LocalSignalingServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!m_server.listen(address, port)) {
+        qWarning() << "Local signaling server failed to listen:" << m_server.errorString();
+        return false;
+    }
+    return true;
+}
+
+QUrl LocalSignalingServer::url() const
+{
+    return m_server.serverUrl();
+}
+
+QStringList LocalSignalingServer::registeredClients() const
+{
+    return m_clients.keys();
+}
+
+void LocalSignalingServer::onNewConnection()
+{
+    while (QWebSocket *socket = m_server.nextPendingConnection()) {
+        connect(socket, &QWebSocket::textMessageReceived, this, &LocalSignalingServer::onTextMessageReceived);
+        connect(socket, &QWebSocket::disconnected, this, &LocalSignalingServer::onDisconnected);
+        m_sockets.append(socket);
+    }
+}
+
+void LocalSignalingServer::onTextMessageReceived(const QString &message)
+{
+    QWebSocket *sender = qobject_cast<QWebSocket*>(this->sender());
+    const QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object();
+    if (data.isEmpty()) {
+        qWarning() << "Local signaling server received invalid JSON";
+        return;
+    }
+
+    const QString from = data["from"].toString();
+    if (data["type"].toString() == "register" && !from.isEmpty()) {
+        m_clients.insert(from, sender);
+        Q_EMIT clientRegistered(from);
+        return;
+    }
+
+    // Same fallback as server.js: unknown recipients get a broadcast.
+    QWebSocket *recipient = m_clients.value(data["to"].toString());
+    if (recipient) {
+        recipient->sendTextMessage(message);
+        return;
+    }
+
+    for (QWebSocket *socket : std::as_const(m_sockets)) {
+        if (socket != sender)
+            socket->sendTextMessage(message);
+    }
+}
+
+void LocalSignalingServer::onDisconnected()
+{
+    QWebSocket *socket = qobject_cast<QWebSocket*>(sender());
+    if (!socket)
+        return;
+
+    for (auto it = m_clients.begin(); it != m_clients.end();) {
+        if (it.value() == socket)
+            it = m_clients.erase(it);
+        else
+            ++it;
+    }
+
+    m_sockets.removeAll(socket);
+    socket->deleteLater();
+}
@@ -0,0 +1,38 @@
+#ifndef LOCALSIGNALINGSERVER_H
+#define LOCALSIGNALINGSERVER_H
+
+#include <QObject>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QHostAddress>
+#include <QHash>
+#include <QUrl>
+
+// In-process stand-in for server.js: the same register/forward/broadcast
+// protocol, listening on loopback so the tools need neither Node nor a network.
+class LocalSignalingServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LocalSignalingServer(QObject *parent = nullptr);
+    ~LocalSignalingServer();
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    QUrl url() const;
+    QStringList registeredClients() const;
+
+signals:
+    void clientRegistered(const QString &clientId);
+
+private slots:
+    void onNewConnection();
+    void onTextMessageReceived(const QString &message);
+    void onDisconnected();
+
+private:
+    QWebSocketServer m_server;
+    QHash<QString, QWebSocket*> m_clients;
+    QList<QWebSocket*> m_sockets;
+};
+
+#endif
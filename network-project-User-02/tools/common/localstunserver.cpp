@@ -0,0 +1,86 @@
+#include "localstunserver.h"
+#include <QNetworkDatagram>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+constexpr quint16 BindingRequest = 0x0001;
+constexpr quint16 BindingSuccess = 0x0101;
+constexpr quint16 XorMappedAddress = 0x0020;
+constexpr quint32 MagicCookie = 0x2112A442;
+constexpr int HeaderSize = 20;
+
+}
+
+LocalStunServer::LocalStunServer(QObject *parent)
+    : QObject(parent)
+{
+    connect(&m_socket, &QUdpSocket::readyRead, this, &LocalStunServer::onReadyRead);
+}
+
+bool LocalStunServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!m_socket.bind(address, port)) {
+        qWarning() << "Local STUN server failed to bind:" << m_socket.errorString();
+        return false;
+    }
+    return true;
+}
+
+QString LocalStunServer::url() const
+{
+    return QString("stun:%1:%2").arg(m_socket.localAddress().toString()).arg(m_socket.localPort());
+}
+
+int LocalStunServer::requestCount() const
+{
+    return m_requests;
+}
+
+void LocalStunServer::onReadyRead()
+{
+    while (m_socket.hasPendingDatagrams()) {
+        const QNetworkDatagram datagram = m_socket.receiveDatagram();
+        const QByteArray request = datagram.data();
+        if (request.size() < HeaderSize)
+            continue;
+
+        const uchar *header = reinterpret_cast<const uchar *>(request.constData());
+        if (qFromBigEndian<quint16>(header) != BindingRequest
+            || qFromBigEndian<quint32>(header + 4) != MagicCookie)
+            continue;
+        ++m_requests;
+
+        // XOR-MAPPED-ADDRESS: the port is XORed with the cookie's top half, the
+        // address with the cookie and, for IPv6, the transaction id after it.
+        const QHostAddress sender = datagram.senderAddress();
+        bool isIPv4 = false;
+        const quint32 ipv4 = sender.toIPv4Address(&isIPv4);
+
+        QByteArray attribute(isIPv4 ? 12 : 24, '\0');
+        uchar *out = reinterpret_cast<uchar *>(attribute.data());
+        qToBigEndian<quint16>(XorMappedAddress, out);
+        qToBigEndian<quint16>(static_cast<quint16>(attribute.size() - 4), out + 2);
+        out[5] = isIPv4 ? 0x01 : 0x02;
+        qToBigEndian<quint16>(static_cast<quint16>(datagram.senderPort() ^ (MagicCookie >> 16)), out + 6);
+        if (isIPv4) {
+            qToBigEndian<quint32>(ipv4 ^ MagicCookie, out + 8);
+        } else {
+            const Q_IPV6ADDR ipv6 = sender.toIPv6Address();
+            for (int i = 0; i < 16; ++i) {
+                out[8 + i] = ipv6[i] ^ header[4 + i];
+            }
+        }
+
+        QByteArray response(HeaderSize, '\0');
+        uchar *responseHeader = reinterpret_cast<uchar *>(response.data());
+        qToBigEndian<quint16>(BindingSuccess, responseHeader);
+        qToBigEndian<quint16>(static_cast<quint16>(attribute.size()), responseHeader + 2);
+        memcpy(responseHeader + 4, header + 4, 16);
+        response.append(attribute);
+
+        m_socket.writeDatagram(response, sender, static_cast<quint16>(datagram.senderPort()));
+    }
+}
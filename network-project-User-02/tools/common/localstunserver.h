@@ -0,0 +1,30 @@
+#ifndef LOCALSTUNSERVER_H
+#define LOCALSTUNSERVER_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QHostAddress>
+
+// In-process stand-in for a public STUN server: answers RFC 5389 Binding
+// requests with the sender's address, so server reflexive gathering can be
+// timed and counted without leaving the machine.
+class LocalStunServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LocalStunServer(QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    // The address to give WebRTC::setIceServers().
+    QString url() const;
+    int requestCount() const;
+
+private slots:
+    void onReadyRead();
+
+private:
+    QUdpSocket m_socket;
+    int m_requests = 0;
+};
+
+#endif
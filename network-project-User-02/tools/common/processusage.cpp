@@ -0,0 +1,60 @@
+#include "processusage.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+namespace ProcessUsage {
+
+qint64 cpuTimeNs()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    auto toNs = [](const FILETIME &time) {
+        return ((qint64(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100;
+    };
+    return toNs(kernel) + toNs(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return (qint64(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000000
+           + (qint64(usage.ru_utime.tv_usec) + usage.ru_stime.tv_usec) * 1000;
+#endif
+}
+
+qint64 residentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return qint64(counters.WorkingSetSize);
+#elif defined(Q_OS_LINUX)
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+
+    long size = 0;
+    long resident = 0;
+    const int fields = std::fscanf(statm, "%ld %ld", &size, &resident);
+    std::fclose(statm);
+    return fields == 2 ? qint64(resident) * sysconf(_SC_PAGESIZE) : 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return qint64(usage.ru_maxrss);
+#endif
+}
+
+}
@@ -0,0 +1,17 @@
+#ifndef PROCESSUSAGE_H
+#define PROCESSUSAGE_H
+
+#include <QtGlobal>
+
+// CPU time and memory of the current process, for the load tools' reports.
+namespace ProcessUsage {
+
+// User plus system time across all threads.
+qint64 cpuTimeNs();
+
+// Resident set size; where only the peak is available (macOS), the peak.
+qint64 residentBytes();
+
+}
+
+#endif
@@ -0,0 +1,27 @@
+QT += core multimedia websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = loadgen
+
+include(../../libraries.pri)
+include(../../app.pri)
+
+INCLUDEPATH += ../common
+
+SOURCES += \
+    loadgenerator.cpp \
+    main.cpp \
+    ../common/localsignalingserver.cpp \
+    ../common/processusage.cpp
+
+HEADERS += \
+    loadgenerator.h \
+    ../common/localsignalingserver.h \
+    ../common/processusage.h
+
+win32: LIBS += -lpsapi
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
@@ -0,0 +1,339 @@
+#include "loadgenerator.h"
+#include <QTimer>
+#include <QDebug>
+#include "processusage.h"
+#include "webrtc.h"
+
+namespace {
+
+// Matches AudioInput's default frame size.
+const double frameMs = 20.0;
+
+double average(double sum, int count)
+{
+    return count > 0 ? sum / count : 0.0;
+}
+
+}
+
+LoadGenerator::LoadGenerator(const Options &options, QObject *parent)
+    : QObject(parent),
+    m_options(options)
+{
+    connect(&m_signalingServer, &LocalSignalingServer::clientRegistered, this, &LoadGenerator::onClientRegistered);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for (const Client &client : std::as_const(m_clients)) {
+        delete client.endpoint;
+    }
+}
+
+bool LoadGenerator::start()
+{
+    m_clock.start();
+    m_baselineResidentBytes = ProcessUsage::residentBytes();
+
+    m_signalingUrl = m_options.signalingUrl;
+    if (m_signalingUrl.isEmpty()) {
+        if (!m_signalingServer.listen())
+            return false;
+        m_signalingUrl = m_signalingServer.url().toString();
+    }
+    qInfo() << "Signaling at" << m_signalingUrl;
+
+    addClients(m_options.initialClients);
+    return true;
+}
+
+void LoadGenerator::addClients(int count)
+{
+    m_stepStartNs = m_clock.nsecsElapsed();
+    m_firstNewClient = m_clients.size();
+
+    for (int i = 0; i < count; ++i) {
+        Client client;
+        client.id = QString("load-%1").arg(m_clients.size());
+        client.endpoint = new WebRTC;
+        client.endpoint->setSignalingUrl(m_signalingUrl);
+        client.endpoint->setIceServers(QStringList());
+        client.endpoint->setIceBindAddress("127.0.0.1");
+        // Idle pooled connections would count against every peer connection's cost.
+        client.endpoint->setConnectionPoolSize(0);
+        client.endpoint->mediaEngine()->setAudioBackends(m_options.captureSpec, "null", m_options.pacing);
+
+        const int index = m_clients.size();
+        connect(client.endpoint, &WebRTC::connected, this, [this, index]() {
+            ++m_clients[index].connectedPeers;
+        });
+        connect(client.endpoint, &WebRTC::disconnected, this, [this, index]() {
+            --m_clients[index].connectedPeers;
+        });
+
+        m_clients.append(client);
+        client.endpoint->init(false, client.id);
+    }
+    qInfo() << "Running" << m_clients.size() << "clients";
+
+    // Calls are placed once every new client is registered, so no offer is broadcast to nobody.
+    if (m_options.signalingUrl.isEmpty()) {
+        m_waitingForRegistration = true;
+        onClientRegistered();
+    } else {
+        QTimer::singleShot(1000, this, &LoadGenerator::placeCalls);
+    }
+}
+
+void LoadGenerator::onClientRegistered()
+{
+    if (!m_waitingForRegistration || m_signalingServer.registeredClients().size() < m_clients.size())
+        return;
+
+    m_waitingForRegistration = false;
+    placeCalls();
+}
+
+void LoadGenerator::placeCalls()
+{
+    for (int i = m_firstNewClient; i < m_clients.size(); ++i) {
+        if (m_options.topology == Topology::Pairs) {
+            if (i % 2 == 1)
+                m_clients[i - 1].endpoint->startCall(m_clients[i].id);
+        } else {
+            for (int j = 0; j < i; ++j) {
+                m_clients[i].endpoint->startCall(m_clients[j].id);
+            }
+        }
+    }
+
+    waitForConnections();
+}
+
+void LoadGenerator::waitForConnections()
+{
+    if (m_finished)
+        return;
+
+    if (connectedPeerConnections() >= expectedPeerConnections()) {
+        QTimer::singleShot(m_options.settleSeconds * 1000, this, &LoadGenerator::beginMeasurement);
+        return;
+    }
+
+    if (m_clock.nsecsElapsed() - m_stepStartNs > qint64(m_options.setupTimeoutSeconds) * 1000000000) {
+        qWarning() << "Only" << connectedPeerConnections() << "of" << expectedPeerConnections()
+                   << "peer connections came up within" << m_options.setupTimeoutSeconds << "seconds";
+        m_degradedAtClients = m_clients.size();
+        m_error = "setup timeout";
+        finish(m_sustainedClients > 0);
+        return;
+    }
+
+    QTimer::singleShot(100, this, &LoadGenerator::waitForConnections);
+}
+
+void LoadGenerator::beginMeasurement()
+{
+    // Counters are snapshotted so each step reports only its own window.
+    for (Client &client : m_clients) {
+        const QStringList peers = client.endpoint->peers();
+        for (const QString &peerId : peers) {
+            const QVariantMap stats = client.endpoint->stats(peerId);
+            PeerCounters &counters = client.counters[peerId];
+            counters.packetsSent = stats.value("packetsSent").toULongLong();
+            counters.packetsReceived = stats.value("packetsReceived").toULongLong();
+            counters.packetsLost = stats.value("packetsLost").toLongLong();
+            counters.concealedFrames = stats.value("concealedFrames").toULongLong();
+        }
+    }
+
+    m_measureStartNs = m_clock.nsecsElapsed();
+    m_measureStartCpuNs = ProcessUsage::cpuTimeNs();
+    QTimer::singleShot(m_options.measureSeconds * 1000, this, &LoadGenerator::endMeasurement);
+}
+
+void LoadGenerator::endMeasurement()
+{
+    const QJsonObject step = measureStep();
+    m_steps.append(step);
+
+    if (step["degraded"].toBool()) {
+        m_degradedAtClients = m_clients.size();
+        finish(m_sustainedClients > 0);
+        return;
+    }
+
+    m_sustainedClients = m_clients.size();
+    if (m_clients.size() >= m_options.maxClients) {
+        finish(true);
+        return;
+    }
+
+    addClients(qMin(m_options.stepClients, m_options.maxClients - m_clients.size()));
+}
+
+QJsonObject LoadGenerator::measureStep()
+{
+    const double wallSeconds = (m_clock.nsecsElapsed() - m_measureStartNs) / 1e9;
+    const double cpuSeconds = (ProcessUsage::cpuTimeNs() - m_measureStartCpuNs) / 1e9;
+    const qint64 residentBytes = ProcessUsage::residentBytes();
+
+    quint64 packetsSent = 0;
+    quint64 packetsReceived = 0;
+    qint64 packetsLost = 0;
+    quint64 concealedFrames = 0;
+    double rttSum = 0.0;
+    int rttCount = 0;
+    double latencySum = 0.0;
+    double maxLatencyMs = 0.0;
+    int latencyCount = 0;
+    double sendJitterSum = 0.0;
+    double maxSendJitterMs = 0.0;
+    int streams = 0;
+
+    for (const Client &client : std::as_const(m_clients)) {
+        const QStringList peers = client.endpoint->peers();
+        double clientSendJitterMs = 0.0;
+
+        for (const QString &peerId : peers) {
+            const QVariantMap stats = client.endpoint->stats(peerId);
+            if (stats.isEmpty())
+                continue;
+
+            const PeerCounters counters = client.counters.value(peerId);
+            packetsSent += stats.value("packetsSent").toULongLong() - counters.packetsSent;
+            packetsReceived += stats.value("packetsReceived").toULongLong() - counters.packetsReceived;
+            packetsLost += stats.value("packetsLost").toLongLong() - counters.packetsLost;
+            concealedFrames += stats.value("concealedFrames").toULongLong() - counters.concealedFrames;
+            clientSendJitterMs = stats.value("sendJitterMs").toDouble();
+            ++streams;
+
+            // One-way estimate: half the round trip plus what the jitter buffer holds back.
+            const QVariant rtt = stats.value("rttMs");
+            const double halfRttMs = rtt.isValid() && !rtt.isNull() ? rtt.toDouble() / 2.0 : 0.0;
+            if (rtt.isValid() && !rtt.isNull()) {
+                rttSum += rtt.toDouble();
+                ++rttCount;
+            }
+            const double latencyMs = halfRttMs + stats.value("jitterBufferDepth").toDouble() * frameMs;
+            latencySum += latencyMs;
+            maxLatencyMs = qMax(maxLatencyMs, latencyMs);
+            ++latencyCount;
+        }
+
+        sendJitterSum += clientSendJitterMs;
+        maxSendJitterMs = qMax(maxSendJitterMs, clientSendJitterMs);
+    }
+
+    const double expectedPackets = double(packetsReceived) + double(qMax<qint64>(0, packetsLost));
+    const double loss = expectedPackets > 0 ? qMax<qint64>(0, packetsLost) / expectedPackets : 0.0;
+    const double concealment = packetsReceived > 0 ? double(concealedFrames) / double(packetsReceived) : 0.0;
+    const double meanLatencyMs = average(latencySum, latencyCount);
+    const int peerConnections = expectedPeerConnections();
+    const int connected = connectedPeerConnections();
+
+    QJsonArray reasons;
+    if (connected < peerConnections)
+        reasons.append("disconnected");
+    if (loss > m_options.maxLoss)
+        reasons.append("loss");
+    if (concealment > m_options.maxConcealment)
+        reasons.append("concealment");
+    if (maxSendJitterMs > m_options.maxSendJitterMs)
+        reasons.append("sendJitter");
+    if (meanLatencyMs > m_options.maxLatencyMs)
+        reasons.append("latency");
+
+    QJsonObject step;
+    step["clients"] = m_clients.size();
+    step["peerConnections"] = peerConnections;
+    step["connectedPeerConnections"] = connected;
+    step["streams"] = streams;
+    step["measuredSeconds"] = wallSeconds;
+
+    // Cores in use, and what one outgoing stream costs as a share of one core.
+    const double cores = wallSeconds > 0 ? cpuSeconds / wallSeconds : 0.0;
+    step["cpuCores"] = cores;
+    step["cpuPercentPerStream"] = streams > 0 ? cores * 100.0 / streams : 0.0;
+    step["streamsPerCore"] = cores > 0 ? streams / cores : 0.0;
+
+    step["residentBytes"] = double(residentBytes);
+    step["bytesPerPeerConnection"] = peerConnections > 0
+        ? double(residentBytes - m_baselineResidentBytes) / peerConnections : 0.0;
+
+    step["packetsSentPerSecond"] = wallSeconds > 0 ? packetsSent / wallSeconds : 0.0;
+    step["packetsReceivedPerSecond"] = wallSeconds > 0 ? packetsReceived / wallSeconds : 0.0;
+    step["loss"] = loss;
+    step["concealment"] = concealment;
+    step["meanRttMs"] = average(rttSum, rttCount);
+    step["meanLatencyMs"] = meanLatencyMs;
+    step["maxLatencyMs"] = maxLatencyMs;
+    step["meanSendJitterMs"] = average(sendJitterSum, m_clients.size());
+    step["maxSendJitterMs"] = maxSendJitterMs;
+    step["degraded"] = !reasons.isEmpty();
+    step["degradedBy"] = reasons;
+
+    qInfo().noquote() << QString("%1 clients: %2 cores, loss %3, latency %4 ms, send jitter %5 ms%6")
+                             .arg(m_clients.size())
+                             .arg(cores, 0, 'f', 2)
+                             .arg(loss, 0, 'f', 4)
+                             .arg(meanLatencyMs, 0, 'f', 1)
+                             .arg(maxSendJitterMs, 0, 'f', 2)
+                             .arg(reasons.isEmpty() ? QString() : QString(" (degraded)"));
+    return step;
+}
+
+int LoadGenerator::expectedPeerConnections() const
+{
+    const int clients = m_clients.size();
+    if (m_options.topology == Topology::Pairs)
+        return clients - clients % 2;
+    return clients * (clients - 1);
+}
+
+int LoadGenerator::connectedPeerConnections() const
+{
+    int connected = 0;
+    for (const Client &client : m_clients) {
+        connected += client.connectedPeers;
+    }
+    return connected;
+}
+
+void LoadGenerator::finish(bool success)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+
+    Q_EMIT finished(success);
+}
+
+QJsonObject LoadGenerator::report() const
+{
+    QJsonObject options;
+    options["topology"] = m_options.topology == Topology::Mesh ? "mesh" : "pairs";
+    options["initialClients"] = m_options.initialClients;
+    options["maxClients"] = m_options.maxClients;
+    options["stepClients"] = m_options.stepClients;
+    options["measureSeconds"] = m_options.measureSeconds;
+    options["capture"] = m_options.captureSpec;
+    options["pacing"] = m_options.pacing == AudioBackends::Pacing::Fast ? "fast" : "realtime";
+
+    QJsonObject thresholds;
+    thresholds["maxLoss"] = m_options.maxLoss;
+    thresholds["maxConcealment"] = m_options.maxConcealment;
+    thresholds["maxSendJitterMs"] = m_options.maxSendJitterMs;
+    thresholds["maxLatencyMs"] = m_options.maxLatencyMs;
+    options["thresholds"] = thresholds;
+
+    QJsonObject result;
+    result["tool"] = "loadgen";
+    result["options"] = options;
+    result["steps"] = m_steps;
+    result["sustainedClients"] = m_sustainedClients;
+    result["degradedAtClients"] = m_degradedAtClients;
+    if (!m_error.isEmpty())
+        result["error"] = m_error;
+    return result;
+}
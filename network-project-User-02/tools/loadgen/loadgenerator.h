@@ -0,0 +1,102 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QVector>
+#include "audiobackend.h"
+#include "localsignalingserver.h"
+
+class WebRTC;
+
+// Runs simulated clients in this process and adds more, step by step, until
+// the calls degrade or the client limit is reached. Every client is a full
+// WebRTC endpoint with its own media thread, generated capture and a null
+// sink, so a step costs what the same number of real clients would.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Topology {
+        Pairs,  // client 2k calls client 2k+1
+        Mesh    // every client calls every other
+    };
+
+    struct Options {
+        QString signalingUrl;
+        Topology topology = Topology::Pairs;
+        int initialClients = 2;
+        int maxClients = 2;
+        int stepClients = 2;
+        int setupTimeoutSeconds = 15;
+        int settleSeconds = 3;
+        int measureSeconds = 10;
+        QString captureSpec = "generator:speech";
+        AudioBackends::Pacing pacing = AudioBackends::Pacing::RealTime;
+
+        // A step past any of these counts as degraded and ends the ramp.
+        double maxLoss = 0.01;
+        double maxConcealment = 0.02;
+        double maxSendJitterMs = 5.0;
+        double maxLatencyMs = 150.0;
+    };
+
+    explicit LoadGenerator(const Options &options, QObject *parent = nullptr);
+    ~LoadGenerator();
+
+    bool start();
+    QJsonObject report() const;
+
+signals:
+    void finished(bool success);
+
+private:
+    struct PeerCounters {
+        quint64 packetsSent = 0;
+        quint64 packetsReceived = 0;
+        qint64 packetsLost = 0;
+        quint64 concealedFrames = 0;
+    };
+
+    struct Client {
+        QString id;
+        WebRTC *endpoint = nullptr;
+        int connectedPeers = 0;
+        QHash<QString, PeerCounters> counters;
+    };
+
+    void addClients(int count);
+    void onClientRegistered();
+    void placeCalls();
+    void waitForConnections();
+    void beginMeasurement();
+    void endMeasurement();
+    QJsonObject measureStep();
+    int expectedPeerConnections() const;
+    int connectedPeerConnections() const;
+    void finish(bool success);
+
+    Options m_options;
+    LocalSignalingServer m_signalingServer;
+    QString m_signalingUrl;
+    QVector<Client> m_clients;
+    int m_firstNewClient = 0;
+    bool m_waitingForRegistration = false;
+    bool m_finished = false;
+
+    QElapsedTimer m_clock;
+    qint64 m_stepStartNs = 0;
+    qint64 m_measureStartNs = 0;
+    qint64 m_measureStartCpuNs = 0;
+    qint64 m_baselineResidentBytes = 0;
+
+    QJsonArray m_steps;
+    int m_sustainedClients = 0;
+    int m_degradedAtClients = -1;
+    QString m_error;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QFile>
+#include <QDebug>
+#include "loadgenerator.h"
+
+// Finds how many concurrent calls one process sustains: starts with a few
+// headless clients on a local signaling server and keeps adding more until
+// loss, concealment, send jitter or latency cross their limits.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Ramps up simulated clients until calls degrade and reports the cost of each step.");
+    parser.addHelpOption();
+    QCommandLineOption clientsOption("clients", "Clients to start with.", "count", "2");
+    QCommandLineOption maxClientsOption("max-clients", "Stop ramping at this many clients.", "count");
+    QCommandLineOption stepOption("step", "Clients added per step.", "count", "2");
+    QCommandLineOption topologyOption("topology", "pairs (one call per two clients) or mesh (everyone calls everyone).", "name", "pairs");
+    QCommandLineOption measureOption("measure", "Seconds measured per step.", "seconds", "10");
+    QCommandLineOption settleOption("settle", "Seconds to wait after connecting before measuring.", "seconds", "3");
+    QCommandLineOption timeoutOption("setup-timeout", "Seconds allowed for a step's calls to connect.", "seconds", "15");
+    QCommandLineOption signalingOption("signaling-url", "Use this signaling server instead of the built-in one.", "url");
+    QCommandLineOption captureOption("capture", "Capture backend spec for every client.", "spec", "generator:speech");
+    QCommandLineOption pacingOption("pacing", "realtime or fast.", "name", "realtime");
+    QCommandLineOption maxLossOption("max-loss", "Loss fraction that counts as degraded.", "fraction", "0.01");
+    QCommandLineOption maxConcealmentOption("max-concealment", "Concealed frame fraction that counts as degraded.", "fraction", "0.02");
+    QCommandLineOption maxSendJitterOption("max-send-jitter", "Send jitter in ms that counts as degraded.", "ms", "5");
+    QCommandLineOption maxLatencyOption("max-latency", "Estimated one-way latency in ms that counts as degraded.", "ms", "150");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    parser.addOptions({ clientsOption, maxClientsOption, stepOption, topologyOption, measureOption, settleOption,
+                        timeoutOption, signalingOption, captureOption, pacingOption, maxLossOption,
+                        maxConcealmentOption, maxSendJitterOption, maxLatencyOption, outputOption });
+    parser.process(app);
+
+    LoadGenerator::Options options;
+    options.signalingUrl = parser.value(signalingOption);
+    options.topology = parser.value(topologyOption) == "mesh" ? LoadGenerator::Topology::Mesh : LoadGenerator::Topology::Pairs;
+    options.initialClients = qMax(2, parser.value(clientsOption).toInt());
+    options.maxClients = parser.isSet(maxClientsOption)
+        ? qMax(options.initialClients, parser.value(maxClientsOption).toInt()) : options.initialClients;
+    options.stepClients = qMax(1, parser.value(stepOption).toInt());
+    options.measureSeconds = qMax(1, parser.value(measureOption).toInt());
+    options.settleSeconds = qMax(0, parser.value(settleOption).toInt());
+    options.setupTimeoutSeconds = qMax(1, parser.value(timeoutOption).toInt());
+    options.captureSpec = parser.value(captureOption);
+    options.pacing = AudioBackends::pacingFromString(parser.value(pacingOption));
+    options.maxLoss = parser.value(maxLossOption).toDouble();
+    options.maxConcealment = parser.value(maxConcealmentOption).toDouble();
+    options.maxSendJitterMs = parser.value(maxSendJitterOption).toDouble();
+    options.maxLatencyMs = parser.value(maxLatencyOption).toDouble();
+
+    // Pairs only make calls out of even client counts.
+    if (options.topology == LoadGenerator::Topology::Pairs) {
+        options.initialClients += options.initialClients % 2;
+        options.stepClients += options.stepClients % 2;
+        options.maxClients -= options.maxClients % 2;
+    }
+
+    LoadGenerator generator(options);
+    bool success = false;
+    QObject::connect(&generator, &LoadGenerator::finished, &app, [&app, &success](bool ok) {
+        success = ok;
+        app.quit();
+    });
+
+    if (!generator.start())
+        return 2;
+
+    app.exec();
+
+    const QByteArray json = QJsonDocument(generator.report()).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 2;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return success ? 0 : 1;
+}
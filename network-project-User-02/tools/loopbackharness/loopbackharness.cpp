@@ -0,0 +1,350 @@
+#include "loopbackharness.h"
+#include <QJsonArray>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include "webrtc.h"
+
+namespace {
+
+const int sampleRate = 48000;
+const int tickMs = 5;
+// Detection runs on 2.5 ms blocks, which bounds its own timing error.
+const int detectionBlock = 120;
+const double detectionRms = 1500.0;
+const double toneAmplitude = 12000.0;
+// Matches AudioInput's default frame size.
+const double frameMs = 20.0;
+
+double percentile(const QVector<double> &sorted, double p)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    const int index = qMin(sorted.size() - 1, static_cast<int>(p / 100.0 * sorted.size()));
+    return sorted[index];
+}
+
+double nsToMs(qint64 ns)
+{
+    return ns >= 0 ? ns / 1e6 : -1.0;
+}
+
+}
+
+LoopbackHarness::LoopbackHarness(const Options &options, QObject *parent)
+    : QObject(parent),
+    m_options(options)
+{
+    m_tickTimer.setTimerType(Qt::PreciseTimer);
+    m_tickTimer.setInterval(tickMs);
+    connect(&m_tickTimer, &QTimer::timeout, this, &LoopbackHarness::tick);
+
+    m_statisticsTimer.setInterval(100);
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &LoopbackHarness::sampleStatistics);
+
+    m_silenceChunk.fill(0, sampleRate);
+    m_captureChunk.reserve(sampleRate);
+    m_playoutChunk.reserve(sampleRate);
+}
+
+LoopbackHarness::~LoopbackHarness()
+{
+    delete m_caller;
+    delete m_callee;
+}
+
+bool LoopbackHarness::start()
+{
+    m_clock.start();
+
+    QString signalingUrl = m_options.signalingUrl;
+    if (signalingUrl.isEmpty()) {
+        if (!m_signalingServer.listen())
+            return false;
+        signalingUrl = m_signalingServer.url().toString();
+    }
+    qInfo() << "Signaling at" << signalingUrl;
+
+    if (m_options.localStun) {
+        if (!m_stunServer.listen())
+            return false;
+        m_options.iceServers.prepend(m_stunServer.url());
+        qInfo() << "STUN at" << m_stunServer.url();
+    }
+
+    m_caller = new WebRTC;
+    m_callee = new WebRTC;
+    for (WebRTC *endpoint : { m_caller, m_callee }) {
+        endpoint->setSignalingUrl(signalingUrl);
+        endpoint->setIceServers(m_options.iceServers);
+        // A STUN server needs more than loopback to reach.
+        if (m_options.iceServers.isEmpty())
+            endpoint->setIceBindAddress("127.0.0.1");
+        endpoint->setTrickleIce(m_options.trickleIce);
+        endpoint->setCandidateBatchMs(m_options.candidateBatchMs);
+        endpoint->setConnectionPoolSize(m_options.connectionPoolSize);
+    }
+    m_caller->mediaEngine()->setVirtualAudio(&m_callerCapture);
+    m_callee->mediaEngine()->setVirtualAudio(&m_calleeCapture);
+    m_caller->mediaEngine()->setSilenceSuppression(m_options.silenceSuppression);
+    m_callee->mediaEngine()->setSilenceSuppression(m_options.silenceSuppression);
+
+    connect(m_caller, &WebRTC::offerIsReady, this, [this]() {
+        if (m_offerSentNs < 0)
+            m_offerSentNs = m_clock.nsecsElapsed();
+    });
+    connect(m_caller, &WebRTC::connected, this, [this]() {
+        if (m_connectedNs < 0)
+            m_connectedNs = m_clock.nsecsElapsed();
+    });
+
+    // The call is placed once both ends are registered, so an offer is never sent into the void.
+    if (m_options.signalingUrl.isEmpty()) {
+        connect(&m_signalingServer, &LocalSignalingServer::clientRegistered, this, [this]() {
+            if (m_callStartNs < 0 && m_signalingServer.registeredClients().size() >= 2)
+                placeCall();
+        });
+    } else {
+        QTimer::singleShot(1000, this, &LoopbackHarness::placeCall);
+    }
+
+    m_caller->init(true, "loopback-caller");
+    m_callee->init(false, "loopback-callee");
+    // As if the call were about to be placed, so setup can take pooled connections.
+    m_caller->warmUpConnectionPool();
+    m_callee->warmUpConnectionPool();
+
+    QTimer::singleShot(m_options.setupTimeoutSeconds * 1000, this, [this]() {
+        if (m_firstDecodedFrameNs < 0) {
+            qWarning() << "No audio reached the callee within" << m_options.setupTimeoutSeconds << "seconds";
+            finish(false);
+        }
+    });
+
+    return true;
+}
+
+void LoopbackHarness::placeCall()
+{
+    m_callStartNs = m_clock.nsecsElapsed();
+    m_caller->startCall("loopback-callee");
+
+    m_tickTimer.start();
+    m_statisticsTimer.start();
+}
+
+qint64 LoopbackHarness::samplesToNs(qint64 samples) const
+{
+    return samples * 1000000000 / sampleRate;
+}
+
+void LoopbackHarness::tick()
+{
+    const qint64 nowNs = m_clock.nsecsElapsed();
+    generateCapture(nowNs);
+    pullPlayout(nowNs);
+
+    if (m_firstDecodedFrameNs >= 0 && nowNs - m_firstDecodedFrameNs >= qint64(m_options.durationSeconds) * 1000000000)
+        finish(!m_latenciesMs.isEmpty());
+}
+
+// Writes every sample whose time has come: silence, with a tone burst at the start of each interval.
+void LoopbackHarness::generateCapture(qint64 nowNs)
+{
+    if (m_captureStartNs < 0)
+        m_captureStartNs = nowNs;
+
+    const qint64 due = (nowNs - m_captureStartNs) * sampleRate / 1000000000 - m_capturedSamples;
+    if (due <= 0)
+        return;
+
+    const qint64 intervalSamples = qint64(m_options.burstIntervalMs) * sampleRate / 1000;
+    const qint64 burstSamples = qint64(m_options.burstLengthMs) * sampleRate / 1000;
+
+    m_captureChunk.resize(static_cast<int>(qMin<qint64>(due, sampleRate)));
+    for (int i = 0; i < m_captureChunk.size(); ++i) {
+        const qint64 n = m_capturedSamples + i;
+        const qint64 phase = n % intervalSamples;
+        if (phase == 0) {
+            m_burstMouthNs.enqueue(m_captureStartNs + samplesToNs(n));
+            ++m_burstsSent;
+        }
+        m_captureChunk[i] = phase < burstSamples
+            ? static_cast<opus_int16>(toneAmplitude * qSin(2.0 * M_PI * m_options.toneFrequency * n / sampleRate))
+            : 0;
+    }
+
+    m_callerCapture.pushSamples(m_captureChunk.constData(), m_captureChunk.size());
+    m_capturedSamples += m_captureChunk.size();
+
+    // The callee has to send something too, or its side of the call never starts.
+    m_calleeCapture.pushSamples(m_silenceChunk.constData(), m_captureChunk.size());
+}
+
+void LoopbackHarness::pullPlayout(qint64 nowNs)
+{
+    QIODevice *playout = m_callee->mediaEngine()->playoutDevice();
+    if (!playout || !playout->isOpen())
+        return;
+
+    if (m_playoutStartNs < 0)
+        m_playoutStartNs = nowNs;
+
+    if (m_firstDecodedFrameNs < 0 && playout->bytesAvailable() > 0)
+        m_firstDecodedFrameNs = nowNs;
+
+    // Whole detection blocks only, so block boundaries stay on the playout timeline.
+    qint64 due = (nowNs - m_playoutStartNs) * sampleRate / 1000000000 - m_playedSamples;
+    due -= due % detectionBlock;
+    if (due <= 0)
+        return;
+
+    m_playoutChunk.resize(static_cast<int>(qMin<qint64>(due, sampleRate)));
+    const qint64 bytesRead = playout->read(reinterpret_cast<char*>(m_playoutChunk.data()),
+                                           m_playoutChunk.size() * qint64(sizeof(opus_int16)));
+    if (bytesRead <= 0)
+        return;
+
+    detectBursts(m_playoutChunk.constData(), static_cast<int>(bytesRead / qint64(sizeof(opus_int16))));
+}
+
+void LoopbackHarness::detectBursts(const opus_int16 *pcm, int count)
+{
+    const int quietBlocksBeforeOnset = m_options.burstLengthMs * sampleRate / 1000 / detectionBlock;
+
+    for (int offset = 0; offset + detectionBlock <= count; offset += detectionBlock) {
+        double sumOfSquares = 0.0;
+        for (int i = 0; i < detectionBlock; ++i) {
+            sumOfSquares += static_cast<double>(pcm[offset + i]) * pcm[offset + i];
+        }
+        const bool loud = qSqrt(sumOfSquares / detectionBlock) > detectionRms;
+
+        if (!loud) {
+            ++m_quietBlocks;
+            m_inBurst = false;
+            continue;
+        }
+
+        if (!m_inBurst && m_quietBlocks >= quietBlocksBeforeOnset) {
+            const qint64 earNs = m_playoutStartNs + samplesToNs(m_playedSamples + offset);
+
+            // Pair with the latest burst that was already in the microphone by then.
+            qint64 mouthNs = -1;
+            while (!m_burstMouthNs.isEmpty() && m_burstMouthNs.head() <= earNs)
+                mouthNs = m_burstMouthNs.dequeue();
+
+            if (mouthNs >= 0)
+                m_latenciesMs.append((earNs - mouthNs) / 1e6);
+            else
+                ++m_unmatchedDetections;
+        }
+
+        m_inBurst = true;
+        m_quietBlocks = 0;
+    }
+
+    m_playedSamples += count;
+}
+
+void LoopbackHarness::sampleStatistics()
+{
+    if (m_firstDecodedFrameNs < 0)
+        return;
+
+    const QVariantMap calleeStats = m_callee->stats("loopback-caller");
+    const QVariantMap callerStats = m_caller->stats("loopback-callee");
+    QIODevice *playout = m_callee->mediaEngine()->playoutDevice();
+
+    m_jitterBufferFramesSum += calleeStats.value("jitterBufferDepth").toDouble();
+    m_playoutBufferedMsSum += playout ? playout->bytesAvailable() / 2.0 * 1000.0 / sampleRate : 0.0;
+    ++m_statisticsSamples;
+
+    const QVariant rtt = callerStats.value("rttMs");
+    if (rtt.isValid() && !rtt.isNull()) {
+        m_rttMsSum += rtt.toDouble();
+        ++m_rttSamples;
+    }
+}
+
+void LoopbackHarness::finish(bool success)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+
+    m_tickTimer.stop();
+    m_statisticsTimer.stop();
+    Q_EMIT finished(success);
+}
+
+QJsonObject LoopbackHarness::report() const
+{
+    const QVariantMap callerStats = m_caller ? m_caller->stats("loopback-callee") : QVariantMap();
+    const QVariantMap calleeStats = m_callee ? m_callee->stats("loopback-caller") : QVariantMap();
+
+    QVector<double> sorted = m_latenciesMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (double latency : std::as_const(sorted)) {
+        sum += latency;
+    }
+    const double meanMs = sorted.isEmpty() ? 0.0 : sum / sorted.size();
+
+    QJsonObject latency;
+    latency["burstsSent"] = m_burstsSent;
+    latency["burstsDetected"] = sorted.size();
+    latency["unmatchedDetections"] = m_unmatchedDetections;
+    // Frames the caller held back as silence; with suppression on, a burst
+    // onset it misjudged arrives late or not at all.
+    latency["silenceSuppression"] = m_options.silenceSuppression;
+    latency["suppressedFrames"] = callerStats.value("suppressedFrames").toLongLong();
+    latency["meanMs"] = meanMs;
+    latency["minMs"] = sorted.isEmpty() ? 0.0 : sorted.first();
+    latency["p50Ms"] = percentile(sorted, 50);
+    latency["p90Ms"] = percentile(sorted, 90);
+    latency["p99Ms"] = percentile(sorted, 99);
+    latency["maxMs"] = sorted.isEmpty() ? 0.0 : sorted.last();
+
+    QJsonArray samples;
+    for (double value : m_latenciesMs) {
+        samples.append(value);
+    }
+    latency["samplesMs"] = samples;
+
+    QJsonObject setup;
+    setup["trickleIce"] = m_options.trickleIce;
+    setup["candidateBatchMs"] = m_options.candidateBatchMs;
+    setup["iceServers"] = QJsonArray::fromStringList(m_options.iceServers);
+    if (m_options.localStun)
+        setup["stunRequests"] = m_stunServer.requestCount();
+    setup["connectionPoolSize"] = m_options.connectionPoolSize;
+    setup["offerSentMs"] = m_offerSentNs >= 0 && m_callStartNs >= 0 ? nsToMs(m_offerSentNs - m_callStartNs) : -1.0;
+    setup["connectedMs"] = m_connectedNs >= 0 && m_callStartNs >= 0 ? nsToMs(m_connectedNs - m_callStartNs) : -1.0;
+    setup["firstDecodedFrameMs"] = m_firstDecodedFrameNs >= 0 && m_callStartNs >= 0
+        ? nsToMs(m_firstDecodedFrameNs - m_callStartNs) : -1.0;
+
+    // Buffering stages come from the statistics sampled during the call; the
+    // remainder is encode, decode, packetization and the thread handoffs.
+    const double jitterBufferMs = m_statisticsSamples ? m_jitterBufferFramesSum / m_statisticsSamples * frameMs : 0.0;
+    const double playoutBufferMs = m_statisticsSamples ? m_playoutBufferedMsSum / m_statisticsSamples : 0.0;
+    const double networkMs = m_rttSamples ? m_rttMsSum / m_rttSamples / 2.0 : 0.0;
+    const double captureFramingMs = frameMs;
+
+    QJsonObject stages;
+    stages["captureFramingMs"] = captureFramingMs;
+    stages["networkMs"] = networkMs;
+    stages["jitterBufferMs"] = jitterBufferMs;
+    stages["playoutBufferMs"] = playoutBufferMs;
+    stages["processingMs"] = qMax(0.0, meanMs - captureFramingMs - networkMs - jitterBufferMs - playoutBufferMs);
+
+    QJsonObject result;
+    result["harness"] = "loopback";
+    result["durationSeconds"] = m_options.durationSeconds;
+    result["setup"] = setup;
+    result["mouthToEar"] = latency;
+    result["stages"] = stages;
+    result["caller"] = QJsonObject::fromVariantMap(callerStats);
+    result["callee"] = QJsonObject::fromVariantMap(calleeStats);
+    return result;
+}
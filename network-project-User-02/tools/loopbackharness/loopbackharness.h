@@ -0,0 +1,109 @@
+#ifndef LOOPBACKHARNESS_H
+#define LOOPBACKHARNESS_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVector>
+#include <QQueue>
+#include <QStringList>
+#include <opus.h>
+#include "localsignalingserver.h"
+#include "localstunserver.h"
+#include "pcmringdevice.h"
+
+class WebRTC;
+
+// Calls one WebRTC instance from another over loopback. Tone bursts go into
+// the caller's virtual microphone, the callee's playout is pulled in real time,
+// and each burst onset found there gives one mouth-to-ear latency sample.
+// Both ends are timed against the same clock, using the sample position rather
+// than the moment a timer happened to fire.
+class LoopbackHarness : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString signalingUrl;
+        int durationSeconds = 20;
+        int setupTimeoutSeconds = 15;
+        double toneFrequency = 1000.0;
+        int burstIntervalMs = 500;
+        int burstLengthMs = 40;
+        // Setup time with and without trickle ICE is the comparison to make here.
+        bool trickleIce = true;
+        int candidateBatchMs = 10;
+        QStringList iceServers;
+        bool localStun = false;
+        int connectionPoolSize = 1;
+        // Off, so every burst onset is sent as it is captured rather than waiting
+        // on the silence detector; suppressedFrames in the report shows if not.
+        bool silenceSuppression = false;
+    };
+
+    explicit LoopbackHarness(const Options &options, QObject *parent = nullptr);
+    ~LoopbackHarness();
+
+    bool start();
+    QJsonObject report() const;
+
+signals:
+    void finished(bool success);
+
+private:
+    void placeCall();
+    void tick();
+    void generateCapture(qint64 nowNs);
+    void pullPlayout(qint64 nowNs);
+    void detectBursts(const opus_int16 *pcm, int count);
+    void sampleStatistics();
+    void finish(bool success);
+
+    qint64 samplesToNs(qint64 samples) const;
+
+    Options m_options;
+    LocalSignalingServer m_signalingServer;
+    LocalStunServer m_stunServer;
+    WebRTC *m_caller = nullptr;
+    WebRTC *m_callee = nullptr;
+    PcmRingDevice m_callerCapture;
+    PcmRingDevice m_calleeCapture;
+
+    QElapsedTimer m_clock;
+    QTimer m_tickTimer;
+    QTimer m_statisticsTimer;
+
+    // Capture side: sample n enters the microphone at m_captureStartNs + n / 48 kHz.
+    qint64 m_captureStartNs = -1;
+    qint64 m_capturedSamples = 0;
+    QVector<opus_int16> m_captureChunk;
+    QVector<opus_int16> m_silenceChunk;
+    QQueue<qint64> m_burstMouthNs;
+
+    // Playout side: sample m leaves the speaker at m_playoutStartNs + m / 48 kHz.
+    qint64 m_playoutStartNs = -1;
+    qint64 m_playedSamples = 0;
+    QVector<opus_int16> m_playoutChunk;
+    bool m_inBurst = false;
+    int m_quietBlocks = 0;
+
+    qint64 m_callStartNs = -1;
+    qint64 m_offerSentNs = -1;
+    qint64 m_connectedNs = -1;
+    qint64 m_firstDecodedFrameNs = -1;
+    bool m_finished = false;
+
+    QVector<double> m_latenciesMs;
+    int m_burstsSent = 0;
+    int m_unmatchedDetections = 0;
+
+    // Averaged over the run to split the latency into stages.
+    double m_jitterBufferFramesSum = 0.0;
+    double m_playoutBufferedMsSum = 0.0;
+    double m_rttMsSum = 0.0;
+    int m_statisticsSamples = 0;
+    int m_rttSamples = 0;
+};
+
+#endif
@@ -0,0 +1,25 @@
+QT += core multimedia network websockets
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = loopbackharness
+
+include(../../libraries.pri)
+include(../../app.pri)
+
+INCLUDEPATH += ../common
+
+SOURCES += \
+    loopbackharness.cpp \
+    main.cpp \
+    ../common/localsignalingserver.cpp \
+    ../common/localstunserver.cpp
+
+HEADERS += \
+    loopbackharness.h \
+    ../common/localsignalingserver.h \
+    ../common/localstunserver.h
+
+QMAKE_CXXFLAGS += -Wno-deprecated-declarations -Wno-unused-parameter -Wno-deprecated-copy -Wno-class-memaccess
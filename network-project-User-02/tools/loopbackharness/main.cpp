@@ -0,0 +1,83 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QFile>
+#include <QDebug>
+#include "loopbackharness.h"
+#include "tracing.h"
+
+// Headless end-to-end latency run: two WebRTC endpoints in one process, a
+// local signaling server, virtual capture and playout, loopback ICE only.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("loopbackharness");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures mouth-to-ear latency and call setup time over loopback.");
+    parser.addHelpOption();
+    QCommandLineOption durationOption("duration", "Seconds of audio to measure once the first frame arrives.", "seconds", "20");
+    QCommandLineOption timeoutOption("setup-timeout", "Seconds to wait for the first decoded frame.", "seconds", "15");
+    QCommandLineOption signalingOption("signaling-url", "Use this signaling server instead of the built-in one.", "url");
+    QCommandLineOption frequencyOption("tone-frequency", "Test tone frequency in Hz.", "hz", "1000");
+    QCommandLineOption intervalOption("burst-interval", "Milliseconds between tone bursts.", "ms", "500");
+    QCommandLineOption lengthOption("burst-length", "Tone burst length in milliseconds.", "ms", "40");
+    QCommandLineOption noTrickleOption("no-trickle", "Signal as before trickle ICE: auto negotiation, one message per candidate, "
+                                                     "and the description again once gathering completes.");
+    QCommandLineOption batchOption("candidate-batch-ms", "Window for coalescing trickled candidates; 0 sends each alone.", "ms", "10");
+    QCommandLineOption iceServerOption("ice-server", "STUN or TURN server URL; may be given more than once. Loopback only by default.", "url");
+    QCommandLineOption localStunOption("local-stun", "Gather against an in-process STUN server.");
+    QCommandLineOption suppressionOption("silence-suppression", "Let the caller hold back silent frames, as the app does.");
+    QCommandLineOption poolOption("pool-size", "Pre-built peer connections per direction; 0 builds them on demand.", "count", "1");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report here instead of stdout.", "file");
+    QCommandLineOption traceOption("trace", "Also write a Chrome trace of the run.", "file");
+    parser.addOptions({ durationOption, timeoutOption, signalingOption, frequencyOption,
+                        intervalOption, lengthOption, noTrickleOption, batchOption, iceServerOption, localStunOption, poolOption,
+                        suppressionOption, outputOption, traceOption });
+    parser.process(app);
+
+    LoopbackHarness::Options options;
+    options.signalingUrl = parser.value(signalingOption);
+    options.durationSeconds = qMax(1, parser.value(durationOption).toInt());
+    options.setupTimeoutSeconds = qMax(1, parser.value(timeoutOption).toInt());
+    options.toneFrequency = parser.value(frequencyOption).toDouble();
+    options.burstIntervalMs = qMax(100, parser.value(intervalOption).toInt());
+    options.burstLengthMs = qBound(10, parser.value(lengthOption).toInt(), options.burstIntervalMs / 2);
+    options.trickleIce = !parser.isSet(noTrickleOption);
+    options.candidateBatchMs = qMax(0, parser.value(batchOption).toInt());
+    options.iceServers = parser.values(iceServerOption);
+    options.localStun = parser.isSet(localStunOption);
+    options.connectionPoolSize = qMax(0, parser.value(poolOption).toInt());
+    options.silenceSuppression = parser.isSet(suppressionOption);
+
+    LoopbackHarness harness(options);
+    bool success = false;
+    QObject::connect(&harness, &LoopbackHarness::finished, &app, [&app, &success](bool ok) {
+        success = ok;
+        app.quit();
+    });
+
+    if (!harness.start())
+        return 2;
+
+    app.exec();
+
+    if (parser.isSet(traceOption))
+        Tracing::dumpChromeTrace(parser.value(traceOption));
+
+    const QByteArray json = QJsonDocument(harness.report()).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Failed to open output file:" << file.fileName();
+            return 2;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+
+    return success ? 0 : 1;
+}
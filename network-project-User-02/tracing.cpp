@@ -0,0 +1,186 @@
+#include "tracing.h"
+#include <QFile>
+#include <QTextStream>
+#include <QCoreApplication>
+#include <chrono>
+#include <memory>
+
+namespace {
+
+struct TraceEvent {
+    // Odd while a writer is filling the slot, so a dump can skip torn events.
+    std::atomic<quint64> sequence{0};
+    qint64 timestampNs = 0;
+    qint64 durationNs = 0;
+    qint64 value = 0;
+    const char *name = nullptr;
+    quint32 threadId = 0;
+    quint8 category = 0;
+    char phase = 0;
+};
+
+const size_t eventCapacity = 16384;
+std::unique_ptr<TraceEvent[]> events(new TraceEvent[eventCapacity]);
+std::atomic<quint64> nextEvent{0};
+
+std::atomic<quint32> nextThreadId{1};
+thread_local quint32 currentThreadId = 0;
+
+quint32 threadId()
+{
+    if (currentThreadId == 0)
+        currentThreadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return currentThreadId;
+}
+
+void record(Tracing::Category category, char phase, const char *name, qint64 timestampNs, qint64 durationNs, qint64 value)
+{
+    const quint64 index = nextEvent.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent &event = events[index % eventCapacity];
+
+    event.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.timestampNs = timestampNs;
+    event.durationNs = durationNs;
+    event.value = value;
+    event.name = name;
+    event.threadId = threadId();
+    event.category = static_cast<quint8>(category);
+    event.phase = phase;
+
+    event.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+struct WarningWindow {
+    std::atomic<qint64> start{0};
+    std::atomic<int> count{0};
+    std::atomic<int> suppressed{0};
+};
+
+WarningWindow warningWindows[Tracing::CategoryCount];
+const int warningsPerSecond = 5;
+
+}
+
+std::atomic<bool> Tracing::s_enabled{qEnvironmentVariableIsEmpty("VOICE_CALL_TRACE") || qEnvironmentVariableIntValue("VOICE_CALL_TRACE") != 0};
+
+void Tracing::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Tracing::now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracing::instant(Category category, const char *name, qint64 value)
+{
+    record(category, 'i', name, now(), 0, value);
+}
+
+void Tracing::counter(Category category, const char *name, qint64 value)
+{
+    record(category, 'C', name, now(), 0, value);
+}
+
+void Tracing::complete(Category category, const char *name, qint64 startNs, qint64 durationNs)
+{
+    record(category, 'X', name, startNs, durationNs, 0);
+}
+
+bool Tracing::allowWarning(Category category)
+{
+    WarningWindow &window = warningWindows[category];
+    const qint64 timestamp = now();
+    qint64 start = window.start.load(std::memory_order_relaxed);
+
+    if (timestamp - start >= 1000000000 && window.start.compare_exchange_strong(start, timestamp, std::memory_order_relaxed)) {
+        window.count.store(0, std::memory_order_relaxed);
+        const int suppressed = window.suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed > 0)
+            qWarning() << suppressed << "warnings suppressed in category" << categoryName(category);
+    }
+
+    if (window.count.fetch_add(1, std::memory_order_relaxed) < warningsPerSecond)
+        return true;
+
+    window.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+const char *Tracing::categoryName(Category category)
+{
+    switch (category) {
+    case Capture:
+        return "capture";
+    case Codec:
+        return "codec";
+    case Network:
+        return "network";
+    case Playout:
+        return "playout";
+    case Signaling:
+        return "signaling";
+    case CategoryCount:
+        break;
+    }
+    return "unknown";
+}
+
+// Copies each slot out before formatting it; slots rewritten during the copy are skipped.
+bool Tracing::dumpChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "Failed to open trace file:" << fileName;
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[";
+
+    const quint64 end = nextEvent.load(std::memory_order_acquire);
+    const quint64 begin = end > eventCapacity ? end - eventCapacity : 0;
+    const qint64 pid = QCoreApplication::applicationPid();
+    bool first = true;
+
+    for (quint64 index = begin; index < end; ++index) {
+        const TraceEvent &event = events[index % eventCapacity];
+        if (event.sequence.load(std::memory_order_acquire) != index * 2 + 2)
+            continue;
+
+        const qint64 timestampNs = event.timestampNs;
+        const qint64 durationNs = event.durationNs;
+        const qint64 value = event.value;
+        const char *name = event.name;
+        const quint32 tid = event.threadId;
+        const Category category = static_cast<Category>(event.category);
+        const char phase = event.phase;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load(std::memory_order_relaxed) != index * 2 + 2)
+            continue;
+
+        out << (first ? "\n" : ",\n");
+        first = false;
+
+        out << "{\"name\":\"" << name << "\",\"cat\":\"" << categoryName(category)
+            << "\",\"ph\":\"" << phase << "\",\"pid\":" << pid << ",\"tid\":" << tid
+            << ",\"ts\":" << QString::number(timestampNs / 1000.0, 'f', 3);
+
+        if (phase == 'X')
+            out << ",\"dur\":" << QString::number(durationNs / 1000.0, 'f', 3);
+        else if (phase == 'C')
+            out << ",\"args\":{\"" << name << "\":" << value << "}";
+        else
+            out << ",\"s\":\"t\",\"args\":{\"value\":" << value << "}";
+
+        out << "}";
+    }
+
+    out << "\n]}\n";
+    return out.status() == QTextStream::Ok;
+}
@@ -0,0 +1,97 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QDebug>
+#include <atomic>
+
+// Binary trace events for the media path. Recording one is a relaxed load, a
+// fetch_add and a handful of stores into a preallocated ring: no formatting, no
+// locks, no allocation. The ring keeps the most recent events and can be dumped
+// as Chrome trace JSON (chrome://tracing, Perfetto) whenever it is needed.
+//
+// Names must be string literals; only their pointers are stored. Building with
+// DEFINES += VOICE_CALL_NO_TRACING compiles every trace point away.
+class Tracing
+{
+public:
+    enum Category {
+        Capture,
+        Codec,
+        Network,
+        Playout,
+        Signaling,
+        CategoryCount
+    };
+
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool enabled);
+
+    static void instant(Category category, const char *name, qint64 value);
+    static void counter(Category category, const char *name, qint64 value);
+    static void complete(Category category, const char *name, qint64 startNs, qint64 durationNs);
+
+    static qint64 now();
+
+    // Lets through five warnings per category per second; the rest are counted
+    // and reported with the next warning that gets through.
+    static bool allowWarning(Category category);
+
+    static bool dumpChromeTrace(const QString &fileName);
+
+    static const char *categoryName(Category category);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceScope
+{
+public:
+    TraceScope(Tracing::Category category, const char *name)
+        : m_category(category),
+        m_name(name),
+        m_start(Tracing::isEnabled() ? Tracing::now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start >= 0)
+            Tracing::complete(m_category, m_name, m_start, Tracing::now() - m_start);
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const Tracing::Category m_category;
+    const char *m_name;
+    const qint64 m_start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifndef VOICE_CALL_NO_TRACING
+#define TRACE_INSTANT(category, name, value) \
+    do { if (Tracing::isEnabled()) Tracing::instant(Tracing::category, name, value); } while (0)
+#define TRACE_COUNTER(category, name, value) \
+    do { if (Tracing::isEnabled()) Tracing::counter(Tracing::category, name, value); } while (0)
+#define TRACE_SCOPE(category, name) \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(Tracing::category, name)
+#else
+#define TRACE_INSTANT(category, name, value) do { } while (0)
+#define TRACE_COUNTER(category, name, value) do { } while (0)
+#define TRACE_SCOPE(category, name) do { } while (0)
+#endif
+
+// Use as a stream: TRACE_WARNING(Playout) << "..."; the message is only formatted when it is let through.
+#define TRACE_WARNING(category) \
+    if (!Tracing::allowWarning(Tracing::category)) {} else qWarning()
+
+#endif
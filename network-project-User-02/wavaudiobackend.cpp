@@ -0,0 +1,212 @@
+#include "wavaudiobackend.h"
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const int sampleRate = 48000;
+const int headerSize = 44;
+const quint16 pcmFormatTag = 1;
+
+quint16 readUInt16(const char *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 readUInt32(const char *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+}
+
+WavCaptureBackend::WavCaptureBackend(const QString &fileName, AudioBackends::Pacing pacing, QObject *parent)
+    : PacedCaptureBackend(pacing, parent),
+    m_file(fileName)
+{
+}
+
+bool WavCaptureBackend::openSource()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open WAV file:" << m_file.fileName();
+        return false;
+    }
+
+    if (!readHeader()) {
+        m_file.close();
+        return false;
+    }
+
+    m_dataRead = 0;
+    return true;
+}
+
+void WavCaptureBackend::closeSource()
+{
+    m_file.close();
+}
+
+// Walks the RIFF chunks for "fmt " and "data", skipping anything else.
+bool WavCaptureBackend::readHeader()
+{
+    const QByteArray riff = m_file.read(12);
+    if (riff.size() < 12 || !riff.startsWith("RIFF") || riff.mid(8, 4) != "WAVE") {
+        qWarning() << "Not a WAV file:" << m_file.fileName();
+        return false;
+    }
+
+    bool haveFormat = false;
+    for (;;) {
+        const QByteArray chunk = m_file.read(8);
+        if (chunk.size() < 8) {
+            qWarning() << "No audio data in WAV file:" << m_file.fileName();
+            return false;
+        }
+
+        const QByteArray id = chunk.left(4);
+        const quint32 size = readUInt32(chunk.constData() + 4);
+
+        if (id == "fmt ") {
+            const QByteArray format = m_file.read(size);
+            if (format.size() < 16) {
+                qWarning() << "Truncated WAV format chunk:" << m_file.fileName();
+                return false;
+            }
+
+            const quint16 formatTag = readUInt16(format.constData());
+            m_channels = readUInt16(format.constData() + 2);
+            const quint32 rate = readUInt32(format.constData() + 4);
+            const quint16 bitsPerSample = readUInt16(format.constData() + 14);
+
+            if (formatTag != pcmFormatTag || bitsPerSample != 16 || rate != quint32(sampleRate)
+                || m_channels < 1 || m_channels > 2) {
+                qWarning() << "Unsupported WAV format in" << m_file.fileName() << "- need 16-bit PCM, 48 kHz, mono or stereo; got"
+                           << formatTag << bitsPerSample << "bit" << rate << "Hz" << m_channels << "channels";
+                return false;
+            }
+            haveFormat = true;
+        } else if (id == "data") {
+            if (!haveFormat) {
+                qWarning() << "WAV data before format chunk:" << m_file.fileName();
+                return false;
+            }
+            m_dataOffset = m_file.pos();
+            m_dataSize = qMin<qint64>(size, m_file.size() - m_dataOffset);
+            m_dataSize -= m_dataSize % (m_channels * 2);
+            if (m_dataSize <= 0) {
+                qWarning() << "Empty WAV file:" << m_file.fileName();
+                return false;
+            }
+            return true;
+        } else if (!m_file.seek(m_file.pos() + size + (size & 1))) {
+            return false;
+        }
+    }
+}
+
+void WavCaptureBackend::produce(opus_int16 *pcm, int count)
+{
+    const int frameBytes = m_channels * 2;
+    int produced = 0;
+
+    while (produced < count) {
+        if (m_dataRead >= m_dataSize) {
+            m_file.seek(m_dataOffset);
+            m_dataRead = 0;
+        }
+
+        const int frames = static_cast<int>(qMin<qint64>(count - produced, (m_dataSize - m_dataRead) / frameBytes));
+        m_readBuffer.resize(frames * frameBytes);
+        const qint64 bytesRead = m_file.read(m_readBuffer.data(), m_readBuffer.size());
+        if (bytesRead < frameBytes) {
+            qWarning() << "Failed to read WAV file:" << m_file.fileName();
+            std::fill(pcm + produced, pcm + count, opus_int16(0));
+            return;
+        }
+        m_dataRead += bytesRead;
+
+        const char *data = m_readBuffer.constData();
+        const int framesRead = static_cast<int>(bytesRead / frameBytes);
+        for (int i = 0; i < framesRead; ++i) {
+            if (m_channels == 2) {
+                const qint32 left = qFromLittleEndian<qint16>(data + i * 4);
+                const qint32 right = qFromLittleEndian<qint16>(data + i * 4 + 2);
+                pcm[produced + i] = static_cast<opus_int16>((left + right) / 2);
+            } else {
+                pcm[produced + i] = qFromLittleEndian<qint16>(data + i * 2);
+            }
+        }
+        produced += framesRead;
+    }
+}
+
+
+WavPlayoutBackend::WavPlayoutBackend(const QString &fileName, AudioBackends::Pacing pacing, QObject *parent)
+    : PacedPlayoutBackend(pacing, parent),
+    m_file(fileName)
+{
+}
+
+WavPlayoutBackend::~WavPlayoutBackend()
+{
+    stop();
+}
+
+bool WavPlayoutBackend::openSink()
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to create WAV file:" << m_file.fileName();
+        return false;
+    }
+
+    m_dataSize = 0;
+    writeHeader(0);
+    return true;
+}
+
+void WavPlayoutBackend::closeSink()
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_file.seek(0);
+    writeHeader(m_dataSize);
+    m_file.close();
+}
+
+void WavPlayoutBackend::consume(const opus_int16 *pcm, int count)
+{
+    m_writeBuffer.resize(count * 2);
+    char *data = m_writeBuffer.data();
+    for (int i = 0; i < count; ++i) {
+        qToLittleEndian<qint16>(pcm[i], data + i * 2);
+    }
+
+    if (m_file.write(m_writeBuffer) != m_writeBuffer.size()) {
+        qWarning() << "Failed to write WAV file:" << m_file.fileName();
+        return;
+    }
+    m_dataSize += quint32(m_writeBuffer.size());
+}
+
+void WavPlayoutBackend::writeHeader(quint32 dataSize)
+{
+    char header[headerSize];
+    std::memcpy(header, "RIFF", 4);
+    qToLittleEndian<quint32>(headerSize - 8 + dataSize, header + 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, header + 16);
+    qToLittleEndian<quint16>(pcmFormatTag, header + 20);
+    qToLittleEndian<quint16>(1, header + 22);
+    qToLittleEndian<quint32>(sampleRate, header + 24);
+    qToLittleEndian<quint32>(sampleRate * 2, header + 28);
+    qToLittleEndian<quint16>(2, header + 32);
+    qToLittleEndian<quint16>(16, header + 34);
+    std::memcpy(header + 36, "data", 4);
+    qToLittleEndian<quint32>(dataSize, header + 40);
+
+    m_file.write(header, headerSize);
+}
@@ -0,0 +1,54 @@
+#ifndef WAVAUDIOBACKEND_H
+#define WAVAUDIOBACKEND_H
+
+#include <QFile>
+#include <QByteArray>
+#include "audiobackend.h"
+
+// Plays a 16-bit PCM WAV file into the microphone path, looping at the end.
+// The file must be 48 kHz; stereo files are mixed down to mono.
+class WavCaptureBackend : public PacedCaptureBackend
+{
+    Q_OBJECT
+public:
+    WavCaptureBackend(const QString &fileName, AudioBackends::Pacing pacing, QObject *parent = nullptr);
+
+protected:
+    bool openSource() override;
+    void closeSource() override;
+    void produce(opus_int16 *pcm, int count) override;
+
+private:
+    bool readHeader();
+
+    QFile m_file;
+    QByteArray m_readBuffer;
+    qint64 m_dataOffset = 0;
+    qint64 m_dataSize = 0;
+    qint64 m_dataRead = 0;
+    int m_channels = 1;
+};
+
+// Records playout to a 16-bit mono 48 kHz WAV file. The header's sizes are
+// filled in when playout stops.
+class WavPlayoutBackend : public PacedPlayoutBackend
+{
+    Q_OBJECT
+public:
+    WavPlayoutBackend(const QString &fileName, AudioBackends::Pacing pacing, QObject *parent = nullptr);
+    ~WavPlayoutBackend();
+
+protected:
+    bool openSink() override;
+    void closeSink() override;
+    void consume(const opus_int16 *pcm, int count) override;
+
+private:
+    void writeHeader(quint32 dataSize);
+
+    QFile m_file;
+    QByteArray m_writeBuffer;
+    quint32 m_dataSize = 0;
+};
+
+#endif
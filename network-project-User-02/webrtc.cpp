@@ -4,36 +4,34 @@
 #include <QJsonObject>
 #include <QtWebSockets/QWebSocket>
 #include <QTimer>
+#include <QRandomGenerator>
+#include "tracing.h"
 
+namespace {
 
-static_assert(true);
-
-#pragma pack(push, 1)
-struct RtpHeader {
-    uint8_t version:2;
-    uint8_t padding:1;
-    uint8_t extension:1;
-    uint8_t csrcCount:4;
-    uint8_t marker:1;
-    uint8_t payloadType:7;
-    uint16_t sequenceNumber;
-    uint32_t timestamp;
-    uint32_t ssrc;
-};
-#pragma pack(pop)
+// Offered ahead of Opus on 111 when more than two channels are configured.
+const int multiopusPayloadType = 112;
 
+}
 
 WebRTC::WebRTC(QObject *parent)
     : QObject{parent},
-    m_timestamp(0),
     m_ssrc(0),
     m_isOfferer(false),
-    audioInput(nullptr),
-    audioOutput(nullptr)
+    m_mediaEngine(nullptr)
 {
 
-    connect(this, &WebRTC::gatheringCompleted, [this](const QString &peerID) {
-        m_localDescription = descriptionToJson(m_peerConnections[peerID]->localDescription().value());
+    connect(this, &WebRTC::gatheringCompleted, this, [this](const QString &peerID) {
+        // Whatever is still batched goes out now, there will be no more. Without
+        // trickle ICE the description goes out again, now with every candidate.
+        if (m_trickleIce) {
+            m_signalingClient->flushCandidates();
+            return;
+        }
+
+        const std::shared_ptr<ConnectionBinding> binding = m_peerBindings.value(peerID);
+        m_localDescription = descriptionToJson(m_peerConnections[peerID]->localDescription().value(),
+                                               binding ? binding->reusedCandidates : std::vector<rtc::Candidate>());
         emit localDescriptionGenerated(peerID, m_localDescription);
 
         if (m_isOfferer)
@@ -43,28 +41,49 @@ WebRTC::WebRTC(QObject *parent)
     });
 
 
-    audioInput = new AudioInput(this);
-    audioOutput = new AudioOutput(this);
+    // Set VOICE_CALL_MEDIA_ON_GUI_THREAD=1 to run the old single-threaded pipeline, e.g. to
+    // compare the sendJitterMs statistic against the dedicated media thread.
+    const bool dedicatedMediaThread = !qEnvironmentVariableIntValue("VOICE_CALL_MEDIA_ON_GUI_THREAD");
+    m_mediaEngine = new MediaEngine(dedicatedMediaThread, QThread::TimeCriticalPriority, this);
 
+    m_connectionPool = new PeerConnectionPool([this](bool offering) { return buildConnection(offering); }, this);
 
-    connect(audioInput, &AudioInput::encodedAudioReady, this, [this](const QByteArray& encodedData){
+    // VOICE_CALL_SFU=<id> routes every call through that SFU instead of the mesh.
+    m_sfuId = qEnvironmentVariable("VOICE_CALL_SFU");
 
-        for(auto it = m_peerConnections.begin(); it != m_peerConnections.end(); ++it){
-            sendTrack(it.key(), encodedData);
-        }
-    });
+    // VOICE_CALL_STUN=<url>[,<url>...] replaces the public STUN server, e.g. with a local stand-in.
+    if (qEnvironmentVariableIsSet("VOICE_CALL_STUN"))
+        m_iceServers = qEnvironmentVariable("VOICE_CALL_STUN").split(',', Qt::SkipEmptyParts);
+
+    // VOICE_CALL_AUDIO_CHANNELS=2 captures, sends and plays stereo; more offers multiopus surround.
+    if (qEnvironmentVariableIsSet("VOICE_CALL_AUDIO_CHANNELS"))
+        setAudioChannels(qEnvironmentVariableIntValue("VOICE_CALL_AUDIO_CHANNELS"));
 
+    // VOICE_CALL_CAPTURE_PROCESSING=highpass,aec,gate,agc (or none) picks the capture
+    // processing stages; VOICE_CALL_CAPTURE_BUDGET_US sets the per-frame CPU budget they
+    // are checked against.
+    if (qEnvironmentVariableIsSet("VOICE_CALL_CAPTURE_PROCESSING"))
+        setCaptureProcessing(qEnvironmentVariable("VOICE_CALL_CAPTURE_PROCESSING"));
+    if (qEnvironmentVariableIsSet("VOICE_CALL_CAPTURE_BUDGET_US"))
+        m_mediaEngine->setCaptureProcessingBudgetUs(qEnvironmentVariable("VOICE_CALL_CAPTURE_BUDGET_US").toDouble());
 
-    connect(this, &WebRTC::incommingPacket, this, &WebRTC::handleIncommingAudioData);
+
+    m_bitrateTimer.setInterval(1000);
+    connect(&m_bitrateTimer, &QTimer::timeout, this, &WebRTC::updateBitrate);
 
 }
 
 WebRTC::~WebRTC()
 {
+    m_connectionPool->clear();
 
-    if(audioInput){
-        audioInput->stopAudioCapture();
+    // Closing first stops libdatachannel calling into the media engine while it shuts down.
+    for (auto it = m_peerConnections.begin(); it != m_peerConnections.end(); ++it) {
+        it.value()->close();
     }
+
+    delete m_mediaEngine;
+    m_mediaEngine = nullptr;
 }
 
 /**
@@ -79,18 +98,47 @@ void WebRTC::init(bool isOfferer, const QString &localId)
     m_isOfferer = isOfferer;
 
     rtc::Configuration config;
-    config.iceServers.push_back(rtc::IceServer("stun:stun.l.google.com:19302"));
+    for (const QString &iceServer : std::as_const(m_iceServers)) {
+        config.iceServers.push_back(rtc::IceServer(iceServer.toStdString()));
+    }
+    if (!m_iceBindAddress.isEmpty())
+        config.bindAddress = m_iceBindAddress.toStdString();
+    if (m_iceUdpPort > 0) {
+        config.enableIceUdpMux = true;
+        config.portRangeBegin = static_cast<uint16_t>(m_iceUdpPort);
+        config.portRangeEnd = static_cast<uint16_t>(m_iceUdpPort);
+    }
+    // With trickle ICE the offer is made once the data channel and the audio
+    // track are both in place, so it goes out once and complete. Without it,
+    // negotiation runs as it did before trickle ICE, to compare against.
+    config.disableAutoNegotiation = m_trickleIce;
     m_config = config;
 
-    m_sequenceNumber = 0;
-    m_timestamp = 0;
+    // Relay allocations are per connection, so only STUN-only configurations skip gathering.
+    m_candidateCacheKey.clear();
+    if (m_iceUdpPort > 0 && !m_iceServers.isEmpty()) {
+        bool stunOnly = true;
+        for (const QString &iceServer : std::as_const(m_iceServers)) {
+            if (!iceServer.startsWith("stun:") && !iceServer.startsWith("stuns:"))
+                stunOnly = false;
+        }
+        if (stunOnly)
+            m_candidateCacheKey = CandidateCache::key(m_iceServers, m_iceBindAddress, m_iceUdpPort);
+    }
+
+    // Pooled connections carry the old configuration and local id.
+    m_connectionPool->clear();
+    if (m_connectionPoolStarted)
+        m_connectionPool->setSize(m_connectionPoolSize);
 
     setBitRate(48000);
     setPayloadType(111);
     setSsrc(2);
 
 
-    m_signalingClient = new SignalingClient("ws://localhost:3000", m_localId, this);
+    m_signalingClient = new SignalingClient(m_signalingUrl, m_localId, this);
+    m_signalingClient->setCandidateBatchInterval(m_trickleIce ? m_candidateBatchMs : 0);
+    connect(m_signalingClient, &SignalingClient::roomMembersReceived, this, &WebRTC::warmUpConnectionPool);
 
     connect(this, &WebRTC::offerIsReady, m_signalingClient, &SignalingClient::sendSdp);
     connect(this, &WebRTC::answerIsReady, m_signalingClient, &SignalingClient::sendSdp);
@@ -103,61 +151,120 @@ void WebRTC::init(bool isOfferer, const QString &localId)
 
 void WebRTC::startCall(const QString &peerId)
 {
-    m_isOfferer = true;
-    addPeer(peerId);
-    generateOfferSDP(peerId);
+    // In SFU mode there is one connection, to the SFU, whoever is being called.
+    QString callee = peerId;
+    if (!m_sfuId.isEmpty()) {
+        if (m_peerConnections.contains(m_sfuId))
+            return;
+        callee = m_sfuId;
+    }
 
+    m_isOfferer = true;
+    createPeer(callee, true);
+    // After the call took what there was, so the pool does not compete with it.
+    warmUpConnectionPool();
 
-    if(audioInput){
-        if(!audioInput->startAudioCapture()){
-            qWarning() << "Failed to start audio capture.";
-        }
-    }
+    startAudio();
 }
 
 
 void WebRTC::addPeer(const QString &peerId)
+{
+    createPeer(peerId, m_isOfferer);
+}
+
+
+// Only the per-peer wiring is left on the call's critical path when the pool has a connection ready.
+void WebRTC::createPeer(const QString &peerId, bool offering)
 {
     qDebug() << "addPeer called for peerId:" << peerId;
 
+    PeerConnectionPool::Connection connection;
+    if (!m_connectionPool->take(offering, connection))
+        connection = buildConnection(offering);
+
+    if (!connection.peerConnection) {
+        qWarning() << "Failed to create PeerConnection for peerId:" << peerId;
+        return;
+    }
+
+    m_peerConnections[peerId] = connection.peerConnection;
+    m_peerBindings[peerId] = connection.binding;
+    Q_EMIT peersChanged();
+
+    if (connection.track)
+        attachAudioTrack(peerId, connection.track, connection.ssrc);
+    bindConnection(peerId, connection);
+
+    qDebug() << "addPeer finished for peerId:" << peerId;
+}
+
+
+PeerConnectionPool::Connection WebRTC::buildConnection(bool offering)
+{
+    PeerConnectionPool::Connection connection;
+    connection.offering = offering;
+    connection.binding = std::make_shared<ConnectionBinding>();
+    const std::shared_ptr<ConnectionBinding> binding = connection.binding;
+
+    // Every connection shares the process's DTLS certificate, and with a fresh
+    // cache entry it skips the STUN round trips.
+    rtc::Configuration config = m_config;
+    const CertificateCache::Certificate certificate = CertificateCache::current();
+    if (!certificate.certificatePem.empty()) {
+        config.certificatePemFile = certificate.certificatePem;
+        config.keyPemFile = certificate.keyPem;
+    }
+
+    const QString candidateCacheKey = m_candidateCacheKey;
+    if (!candidateCacheKey.isEmpty()) {
+        binding->reusedCandidates = CandidateCache::serverReflexive(candidateCacheKey);
+        if (!binding->reusedCandidates.empty())
+            config.iceServers.clear();
+        TRACE_INSTANT(Signaling, "candidateCacheHit", static_cast<qint64>(binding->reusedCandidates.size()));
+    }
+    const bool reusingCandidates = !binding->reusedCandidates.empty();
+
     try {
 
-        auto newPeer = std::make_shared<rtc::PeerConnection>(m_config);
-        m_peerConnections[peerId] = newPeer;
-        qDebug() << "PeerConnection created for peerId:" << peerId;
+        auto newPeer = std::make_shared<rtc::PeerConnection>(config);
 
 
         auto dataChannel = newPeer->createDataChannel("data_channel");
         if (dataChannel) {
-            qDebug() << "DataChannel created for peerId:" << peerId;
-
-
-            dataChannel->onOpen([peerId]() {
-                qDebug() << "DataChannel opened for peerId:" << peerId;
+            dataChannel->onOpen([binding]() {
+                qDebug() << "DataChannel opened for peerId:" << binding->peer();
             });
 
 
-            dataChannel->onMessage([peerId](const rtc::message_variant &message) {
+            dataChannel->onMessage([binding](const rtc::message_variant &message) {
                 if (std::holds_alternative<rtc::string>(message))
-                    qDebug() << "Message received on DataChannel for peerId:" << peerId << ": " << std::get<rtc::string>(message).c_str();
+                    qDebug() << "Message received on DataChannel for peerId:" << binding->peer() << ": " << std::get<rtc::string>(message).c_str();
                 else
-                    qDebug() << "Binary message received on DataChannel for peerId:" << peerId;
+                    qDebug() << "Binary message received on DataChannel for peerId:" << binding->peer();
             });
         } else {
-            qWarning() << "Failed to create DataChannel for peerId:" << peerId;
+            qWarning() << "Failed to create DataChannel";
         }
+        connection.dataChannel = dataChannel;
 
 
-
-        addAudioTrack(peerId, "audio_track");
+        connection.track = createAudioTrack(newPeer, "audio_track", connection.ssrc);
 
 
-        newPeer->onLocalDescription([this, peerId](const rtc::Description &description) {
-
-            m_localDescription = descriptionToJson(description);
-            qDebug() << "SDP generated for peer:" << peerId << "\n"
-                     << QJsonDocument(m_localDescription).toJson(QJsonDocument::Compact);
+        newPeer->onLocalDescription([this, binding](const rtc::Description &description) {
+            QString peerId;
+            {
+                QMutexLocker locker(&binding->mutex);
+                if (binding->peerId.isEmpty())
+                    return;
+                if (description.type() == rtc::Description::Type::Offer && binding->offerSent)
+                    return;
+                peerId = binding->peerId;
+            }
 
+            m_localDescription = descriptionToJson(description, binding->reusedCandidates);
+            qDebug() << "SDP generated for peer:" << peerId;
 
             if (description.type() == rtc::Description::Type::Offer) {
                 emit offerIsReady(peerId, m_localDescription);
@@ -169,7 +276,19 @@ void WebRTC::addPeer(const QString &peerId)
         });
 
 
-        newPeer->onLocalCandidate([this, peerId](const rtc::Candidate &candidate) {
+        // Candidates found before the claim are in the description the claim sends.
+        newPeer->onLocalCandidate([this, binding, candidateCacheKey, reusingCandidates](const rtc::Candidate &candidate) {
+            if (!candidateCacheKey.isEmpty()) {
+                if (reusingCandidates)
+                    CandidateCache::confirmHost(candidateCacheKey, candidate);
+                else
+                    CandidateCache::record(candidateCacheKey, candidate);
+            }
+
+            const QString peerId = binding->peer();
+            if (peerId.isEmpty())
+                return;
+
             QString candidateStr = QString::fromStdString(candidate.candidate());
             QString sdpMid = QString::fromStdString(candidate.mid());
             emit localCandidateGenerated(peerId, candidateStr, sdpMid);
@@ -178,40 +297,106 @@ void WebRTC::addPeer(const QString &peerId)
 
 
 
-        newPeer->onStateChange([this, peerId](rtc::PeerConnection::State state) {
+        newPeer->onStateChange([this, binding](rtc::PeerConnection::State state) {
+            const QString peerId = binding->peer();
+            if (peerId.isEmpty())
+                return;
+
             if (state == rtc::PeerConnection::State::Connected) {
                 qDebug() << "Peer connected for peerId:" << peerId;
                 Q_EMIT connected(peerId);
             } else if (state == rtc::PeerConnection::State::Disconnected) {
                 qDebug() << "Peer disconnected for peerId:" << peerId;
+                m_mediaEngine->removePeer(peerId);
+                // The remaining peers may now agree on a layout again.
+                QMetaObject::invokeMethod(this, [this, peerId]() {
+                    m_peerAudio.remove(peerId);
+                    updateSendLayout();
+                    // removePeer() dropped the slots' streams; a new answer registers them again.
+                    if (peerId == m_sfuId) {
+                        QMutexLocker locker(&m_sfuStreams->mutex);
+                        m_sfuStreams->ids.clear();
+                    }
+                });
                 Q_EMIT disconnected(peerId);
             }
         });
 
 
-        newPeer->onGatheringStateChange([this, peerId](rtc::PeerConnection::GatheringState state) {
-            if (state == rtc::PeerConnection::GatheringState::Complete) {
-                qDebug() << "Gathering completed for peerId:" << peerId;
-                emit gatheringCompleted(peerId);
+        newPeer->onGatheringStateChange([this, binding](rtc::PeerConnection::GatheringState state) {
+            if (state != rtc::PeerConnection::GatheringState::Complete)
+                return;
+
+            QString peerId;
+            {
+                QMutexLocker locker(&binding->mutex);
+                if (binding->peerId.isEmpty() || binding->gatheringReported)
+                    return;
+                binding->gatheringReported = true;
+                peerId = binding->peerId;
             }
+
+            qDebug() << "Gathering completed for peerId:" << peerId;
+            emit gatheringCompleted(peerId);
         });
 
 
 
-        newPeer->onTrack([this, peerId](std::shared_ptr<rtc::Track> track) {
+        newPeer->onTrack([this, binding](std::shared_ptr<rtc::Track> track) {
+            const QString peerId = binding->peer();
             qDebug() << "Track received for peerId:" << peerId;
-            track->onMessage([this, peerId](rtc::message_variant data) {
-                QByteArray audioData = readVariant(data);
-                qDebug() << "Incoming audio packet for peerId:" << peerId << ", size:" << audioData.size();
-                Q_EMIT incommingPacket(audioData);
-            });
+
+            // Only fires for tracks the remote side added on its own: receive only.
+            // Nothing shows its counters, but it sends the receiver reports.
+            auto depacketizer = createDepacketizer(peerId);
+            depacketizer->addToChain(std::make_shared<RtpStatisticsHandler>(
+                std::make_shared<RtpStatistics>(), QRandomGenerator::global()->generate(),
+                rtc::OpusRtpPacketizer::DefaultClockRate));
+            track->setMediaHandler(depacketizer);
         });
 
+
+        // Starts gathering, which from the pool happens long before anyone calls.
+        if (offering)
+            newPeer->setLocalDescription(rtc::Description::Type::Offer);
+
+        connection.peerConnection = newPeer;
+
     } catch (const std::exception &e) {
-        qWarning() << "Exception in addPeer:" << e.what();
+        qWarning() << "Exception while building PeerConnection:" << e.what();
+        return PeerConnectionPool::Connection();
     }
 
-    qDebug() << "addPeer finished for peerId:" << peerId;
+    return connection;
+}
+
+
+void WebRTC::bindConnection(const QString &peerId, const PeerConnectionPool::Connection &connection)
+{
+    std::optional<rtc::Description> offer;
+    bool reportGathering = false;
+    {
+        QMutexLocker locker(&connection.binding->mutex);
+        connection.binding->peerId = peerId;
+
+        if (connection.offering) {
+            offer = connection.peerConnection->localDescription();
+            connection.binding->offerSent = offer.has_value();
+            if (!m_trickleIce
+                && connection.peerConnection->gatheringState() == rtc::PeerConnection::GatheringState::Complete) {
+                connection.binding->gatheringReported = true;
+                reportGathering = true;
+            }
+        }
+    }
+
+    // A pooled offer already carries every candidate gathered so far.
+    if (offer.has_value()) {
+        m_localDescription = descriptionToJson(offer.value(), connection.binding->reusedCandidates);
+        emit offerIsReady(peerId, m_localDescription);
+    }
+    if (reportGathering)
+        emit gatheringCompleted(peerId);
 }
 
 
@@ -220,17 +405,10 @@ void WebRTC::addPeer(const QString &peerId)
 
 void WebRTC::generateOfferSDP(const QString &peerId)
 {
+    // onLocalDescription sends it, or gatheringCompleted without trickle ICE.
     if (m_peerConnections.contains(peerId)) {
-        auto description = m_peerConnections[peerId]->localDescription();
-        if (description.has_value()) {
-
-            QJsonObject sdpObj = descriptionToJson(description.value());
-
-
-            emit offerIsReady(peerId, sdpObj);
-        } else {
-            qWarning() << "No local description available for peerId:" << peerId;
-        }
+        if (!m_peerConnections[peerId]->localDescription().has_value())
+            m_peerConnections[peerId]->setLocalDescription(rtc::Description::Type::Offer);
     } else {
         qWarning() << "No peer connection found for peerId:" << peerId;
     }
@@ -242,7 +420,9 @@ void WebRTC::generateOfferSDP(const QString &peerId)
 
 void WebRTC::generateAnswerSDP(const QString &peerId)
 {
-    if (m_peerConnections.contains(peerId)) {
+    // Auto negotiation, without trickle ICE, has answered already.
+    if (m_peerConnections.contains(peerId)
+        && m_peerConnections[peerId]->signalingState() == rtc::PeerConnection::SignalingState::HaveRemoteOffer) {
         m_peerConnections[peerId]->setLocalDescription(rtc::Description::Type::Answer);
     }
 }
@@ -253,122 +433,172 @@ void WebRTC::addAudioTrack(const QString &peerId, const QString &trackName)
     qDebug() << "addAudioTrack called for peerId:" << peerId << ", trackName:" << trackName;
 
     if (m_peerConnections.contains(peerId)) {
-        auto peerConnection = m_peerConnections[peerId];
-
-        try {
-
-            std::string mline = "audio 9 UDP/TLS/RTP/SAVPF 111";
-            std::string mid = "0";
-            rtc::Description::Media audio(mline, mid, rtc::Description::Direction::SendRecv);
-
-
-            audio.addAttribute("rtpmap:111 opus/48000/2");
-            audio.addAttribute("fmtp:111 minptime=10;useinbandfec=1");
-            audio.addAttribute("rtcp-mux");
-            audio.addAttribute("rtcp-rsize");
-
-
-            std::string msid = "msid:stream_id " + trackName.toStdString();
-            audio.addAttribute(msid);
-
-
-            auto track = peerConnection->addTrack(audio);
-
-            if (track) {
-                qDebug() << "Audio track successfully added for peerId:" << peerId;
-
-
-                track->onOpen([this, peerId]() {
-                    qDebug() << "Audio track is open for peerId:" << peerId;
-                    isTrackOpen = true;
+        rtc::SSRC trackSsrc = 0;
+        auto track = createAudioTrack(m_peerConnections[peerId], trackName, trackSsrc);
+        if (track)
+            attachAudioTrack(peerId, track, trackSsrc);
+    } else {
+        qWarning() << "PeerConnection not found for peerId:" << peerId;
+    }
 
+    qDebug() << "addAudioTrack finished for peerId:" << peerId;
+}
 
-                    if (iceGatheringComplete) {
-                        qDebug() << "Starting to send audio data to peerId:" << peerId;
 
-                    } else {
-                        qDebug() << "ICE gathering not complete yet for peerId:" << peerId;
-                    }
-                });
+std::shared_ptr<rtc::Track> WebRTC::createAudioTrack(const std::shared_ptr<rtc::PeerConnection> &peerConnection,
+                                                     const QString &trackName, rtc::SSRC &trackSsrc)
+{
+    try {
 
+        // stereo=1 asks the far end to send stereo and sprop-stereo=1 says this side
+        // will (RFC 7587). Surround goes out as multiopus, with Opus as the fallback.
+        const bool offerMultiopus = m_audioChannels > 2;
+        std::string mline = offerMultiopus ? "audio 9 UDP/TLS/RTP/SAVPF 112 111" : "audio 9 UDP/TLS/RTP/SAVPF 111";
+        std::string mid = "0";
+        rtc::Description::Media audio(mline, mid, rtc::Description::Direction::SendRecv);
 
-                peerConnection->onGatheringStateChange([this, peerId](rtc::PeerConnection::GatheringState newState) {
-                    qDebug() << "Gathering state changed for peerId:" << peerId << ", newState:" << static_cast<int>(newState);
-                    if (newState == rtc::PeerConnection::GatheringState::Complete) {
-                        qDebug() << "ICE gathering is now complete for peerId:" << peerId;
-                        iceGatheringComplete = true;
 
+        if (offerMultiopus) {
+            const OpusLayout layout = OpusLayout::forChannels(m_audioChannels);
+            const std::string payloadType = std::to_string(multiopusPayloadType);
+            audio.addAttribute("rtpmap:" + payloadType + " multiopus/48000/" + std::to_string(layout.channels));
+            audio.addAttribute("fmtp:" + payloadType + " " + layout.fmtp().toStdString() + ";minptime=10;useinbandfec=1");
+        }
+        audio.addAttribute("rtpmap:111 opus/48000/2");
+        audio.addAttribute(m_audioChannels > 1 ? "fmtp:111 minptime=10;useinbandfec=1;stereo=1;sprop-stereo=1"
+                                               : "fmtp:111 minptime=10;useinbandfec=1");
+        audio.addAttribute("rtcp-mux");
+        audio.addAttribute("rtcp-rsize");
 
-                        if (isTrackOpen) {
-                            qDebug() << "Both track open and ICE complete for peerId:" << peerId << ". Ready to send audio.";
 
-                        } else {
-                            qDebug() << "Track is not open yet for peerId:" << peerId;
-                        }
-                    }
-                });
+        std::string msid = "msid:stream_id " + trackName.toStdString();
+        audio.addAttribute(msid);
 
+        trackSsrc = QRandomGenerator::global()->generate();
+        const std::string cname = m_localId.toStdString();
+        audio.addSSRC(trackSsrc, cname, "stream_id", trackName.toStdString());
 
-                track->onMessage([this, peerId](rtc::message_variant data) {
-                    QByteArray audioData = readVariant(data);
-                    qDebug() << "Incoming audio packet for peerId:" << peerId << ", size:" << audioData.size();
-                    Q_EMIT incommingPacket(audioData);
-                });
 
+        auto track = peerConnection->addTrack(audio);
+        if (!track)
+            qWarning() << "Failed to add audio track";
+        return track;
 
-                m_peerTracks[peerId] = track;
-            } else {
-                qWarning() << "Failed to add audio track for peerId:" << peerId;
-            }
-        } catch (const std::exception &e) {
-            qWarning() << "Exception while adding audio track:" << e.what();
-        }
-    } else {
-        qWarning() << "PeerConnection not found for peerId:" << peerId;
+    } catch (const std::exception &e) {
+        qWarning() << "Exception while adding audio track:" << e.what();
     }
-
-    qDebug() << "addAudioTrack finished for peerId:" << peerId;
+    return nullptr;
 }
 
 
+void WebRTC::attachAudioTrack(const QString &peerId, const std::shared_ptr<rtc::Track> &track, rtc::SSRC trackSsrc)
+{
+    qDebug() << "Audio track successfully added for peerId:" << peerId;
 
 
+    track->onOpen([this, peerId]() {
+        qDebug() << "Audio track is open for peerId:" << peerId;
+        isTrackOpen = true;
+    });
 
 
+    // Outgoing frames run packetizer -> statistics -> SR reporter -> NACK responder;
+    // incoming packets run the chain backwards, so RTCP reaches the NACK responder
+    // and the statistics, which also send the receiver reports, and RTP is
+    // depacketized last.
+    const std::string cname = m_localId.toStdString();
+    auto rtpConfig = std::make_shared<rtc::RtpPacketizationConfig>(
+        trackSsrc, cname, static_cast<uint8_t>(payloadType()), rtc::OpusRtpPacketizer::DefaultClockRate);
+    auto statistics = std::make_shared<RtpStatistics>();
+    auto packetizer = std::make_shared<rtc::OpusRtpPacketizer>(rtpConfig);
+    packetizer->addToChain(createDepacketizer(peerId));
+    packetizer->addToChain(std::make_shared<RtpStatisticsHandler>(statistics, trackSsrc, rtpConfig->clockRate));
+    packetizer->addToChain(std::make_shared<rtc::RtcpSrReporter>(rtpConfig));
+    packetizer->addToChain(std::make_shared<rtc::RtcpNackResponder>());
+    track->setMediaHandler(packetizer);
+
+
+    m_peerTracks[peerId] = track;
+    m_peerStatistics[peerId] = statistics;
+    m_reportsUsed.remove(peerId);
+    m_mediaEngine->addSendTrack(peerId, track, rtpConfig);
+}
 
 
 
-
-void WebRTC::sendTrack(const QString &peerId, const QByteArray &buffer)
+bool WebRTC::dumpTrace(const QString &fileName) const
 {
+    return Tracing::dumpChromeTrace(fileName);
+}
 
-    RtpHeader rtpHeader;
-    rtpHeader.version = 2;
-    rtpHeader.padding = 0;
-    rtpHeader.extension = 0;
-    rtpHeader.csrcCount = 0;
-    rtpHeader.marker = 0;
-    rtpHeader.payloadType = payloadType();
-    rtpHeader.sequenceNumber = qToBigEndian(static_cast<uint16_t>(m_sequenceNumber++));
-    rtpHeader.timestamp = qToBigEndian(m_timestamp += 160);
-    rtpHeader.ssrc = qToBigEndian(ssrc());
-
-
-    QByteArray headerData(reinterpret_cast<char*>(&rtpHeader), sizeof(RtpHeader));
 
+QStringList WebRTC::peers() const
+{
+    return m_peerConnections.keys();
+}
 
-    QByteArray packet = headerData + buffer;
 
-    try {
-        if (m_peerTracks.contains(peerId)) {
-            auto &track = m_peerTracks[peerId];
-            track->send(reinterpret_cast<const std::byte*>(packet.data()), packet.size());
-        } else {
-            qWarning() << "Audio track not found for peer:" << peerId;
-        }
-    } catch (const std::exception &e) {
-        qWarning() << "Failed to send RTP packet over audio track:" << e.what();
+QVariantMap WebRTC::stats(const QString &peerId) const
+{
+    QVariantMap result;
+
+    auto it = m_peerStatistics.constFind(peerId);
+    if (it == m_peerStatistics.constEnd())
+        return result;
+
+    const RtpStatistics &statistics = *it.value();
+    const quint64 received = statistics.packetsReceived.load(std::memory_order_relaxed);
+    const quint64 expected = statistics.packetsExpected.load(std::memory_order_relaxed);
+    const qint64 lost = qMax<qint64>(0, qint64(expected) - qint64(received));
+    const qint32 rtt = statistics.rttMicroseconds.load(std::memory_order_relaxed);
+    const double clockKhz = rtc::OpusRtpPacketizer::DefaultClockRate / 1000.0;
+
+    result["packetsSent"] = statistics.packetsSent.load(std::memory_order_relaxed);
+    result["bytesSent"] = statistics.bytesSent.load(std::memory_order_relaxed);
+    result["packetsReceived"] = received;
+    result["bytesReceived"] = statistics.bytesReceived.load(std::memory_order_relaxed);
+    result["packetsLost"] = lost;
+    result["fractionLost"] = expected > 0 ? double(lost) / double(expected) : 0.0;
+    result["jitterMs"] = statistics.jitter.load(std::memory_order_relaxed) / clockKhz;
+    result["rttMs"] = rtt >= 0 ? rtt / 1000.0 : QVariant();
+    result["remoteFractionLost"] = statistics.remoteFractionLost.load(std::memory_order_relaxed) / 256.0;
+    result["remoteJitterMs"] = statistics.remoteJitter.load(std::memory_order_relaxed) / clockKhz;
+    result["bitrate"] = m_mediaEngine->encoderBitrate();
+    result["suppressedFrames"] = m_mediaEngine->suppressedFrames();
+    result["sendJitterMs"] = m_mediaEngine->sendJitterMs();
+    result["maxSendDeviationMs"] = m_mediaEngine->maxSendDeviationMs();
+    result["droppedIncomingPackets"] = m_mediaEngine->droppedIncomingPackets();
+
+    const PeerAudio audio = m_peerAudio.value(peerId);
+    result["sendChannels"] = audio.sendLayout.channels;
+    result["receiveChannels"] = audio.receiveLayout.channels;
+    result["multiopus"] = audio.sendLayout.isMultistream();
+
+    QVariantList captureStages;
+    const QVector<CaptureProcessingChain::StageStatistics> stages = m_mediaEngine->captureProcessingStatistics();
+    for (const CaptureProcessingChain::StageStatistics &stage : stages) {
+        if (!stage.enabled)
+            continue;
+        QVariantMap entry;
+        entry["stage"] = stage.name;
+        entry["frames"] = stage.frames;
+        entry["meanUs"] = stage.meanUs;
+        entry["lastUs"] = stage.lastUs;
+        entry["maxUs"] = stage.maxUs;
+        captureStages.append(entry);
     }
+    result["captureProcessing"] = captureStages;
+    result["captureOverBudgetFrames"] = m_mediaEngine->captureProcessingOverBudgetFrames();
+
+    const AudioStream::Statistics stream = m_mediaEngine->streamStatistics(peerId);
+    result["jitterBufferDepth"] = stream.jitterBufferDepth;
+    result["jitterBufferTargetDepth"] = stream.jitterBufferTargetDepth;
+    result["latePackets"] = stream.latePackets;
+    result["concealedFrames"] = stream.concealedFrames;
+    result["recoveredFrames"] = stream.recoveredFrames;
+    result["comfortNoiseFrames"] = stream.comfortNoiseFrames;
+
+    return result;
 }
 
 
@@ -382,8 +612,9 @@ void WebRTC::sendTrack(const QString &peerId, const QByteArray &buffer)
 void WebRTC::setRemoteDescription(const QString &peerID, const QJsonObject &sdpObj)
 {
 
+    // An offer needs an answering connection, whatever this side did before.
     if (!m_peerConnections.contains(peerID)) {
-        addPeer(peerID);
+        createPeer(peerID, sdpObj["type"].toString() != "offer");
     }
 
     if (m_peerConnections.contains(peerID)) {
@@ -403,10 +634,20 @@ void WebRTC::setRemoteDescription(const QString &peerID, const QJsonObject &sdpO
 
         rtc::Description description(sdpStr.toStdString(), descType);
         m_peerConnections[peerID]->setRemoteDescription(description);
+        negotiateAudio(peerID, description);
+        if (peerID == m_sfuId)
+            registerSfuStreams(description);
+
+        const QVector<rtc::Candidate> pending = m_pendingRemoteCandidates.take(peerID);
+        for (const rtc::Candidate &candidate : pending) {
+            addRemoteCandidate(peerID, candidate);
+        }
 
         if (!isOfferer() && descType == rtc::Description::Type::Offer) {
 
             generateAnswerSDP(peerID);
+            warmUpConnectionPool();
+            startAudio();
         }
     } else {
         qWarning() << "Failed to create peer connection for peerId:" << peerID;
@@ -418,13 +659,17 @@ void WebRTC::setRemoteDescription(const QString &peerID, const QJsonObject &sdpO
 
 void WebRTC::setRemoteCandidate(const QString &peerID, const QString &candidate, const QString &sdpMid)
 {
-    if (m_peerConnections.contains(peerID)) {
-        rtc::Candidate rtcCandidate(candidate.toStdString());
-        m_peerConnections[peerID]->addRemoteCandidate(rtcCandidate);
-        qDebug() << "Remote ICE candidate added for peerId:" << peerID;
-    } else {
-        qWarning() << "No peer connection found for peerId:" << peerID;
+    const rtc::Candidate rtcCandidate(candidate.toStdString(), sdpMid.toStdString());
+
+    // Trickled candidates can overtake the description they belong to; they wait for it here.
+    auto it = m_peerConnections.constFind(peerID);
+    if (it == m_peerConnections.constEnd() || !it.value()->remoteDescription().has_value()) {
+        m_pendingRemoteCandidates[peerID].append(rtcCandidate);
+        TRACE_INSTANT(Signaling, "remoteCandidateBuffered", candidate.size());
+        return;
     }
+
+    addRemoteCandidate(peerID, rtcCandidate);
 }
 
 
@@ -435,24 +680,235 @@ void WebRTC::setRemoteCandidate(const QString &peerID, const QString &candidate,
  * ====================================================
  */
 
-QByteArray WebRTC::readVariant(const rtc::message_variant &data)
+void WebRTC::updateBitrate()
+{
+    // One encoder feeds every peer, so follow the worst uplink. Only receiver
+    // reports that arrived since the last update count; otherwise one lossy
+    // report would keep pushing the bitrate down until the next one came.
+    double worstLoss = 0.0;
+    double worstRttMs = -1.0;
+    bool haveReports = false;
+
+    for (auto it = m_peerStatistics.constBegin(); it != m_peerStatistics.constEnd(); ++it) {
+        const RtpStatistics &statistics = *it.value();
+        const quint64 reports = statistics.reportsReceived.load(std::memory_order_relaxed);
+        if (reports == m_reportsUsed.value(it.key()))
+            continue;
+
+        m_reportsUsed[it.key()] = reports;
+        haveReports = true;
+        worstLoss = qMax(worstLoss, statistics.remoteFractionLost.load(std::memory_order_relaxed) / 256.0);
+
+        const qint32 rtt = statistics.rttMicroseconds.load(std::memory_order_relaxed);
+        if (rtt >= 0)
+            worstRttMs = qMax(worstRttMs, rtt / 1000.0);
+    }
+
+    if (!haveReports)
+        return;
+
+    applyEncoderSettings(m_bitrateController.update(worstLoss, worstRttMs));
+}
+
+void WebRTC::applyEncoderSettings(const BitrateController::Settings &settings)
+{
+    if (settings == m_encoderSettings)
+        return;
+
+    m_encoderSettings = settings;
+    m_mediaEngine->setEncoderSettings(settings.bitrate, settings.bandwidth, settings.packetLossPercent);
+
+    if (m_bitRate != settings.bitrate) {
+        m_bitRate = settings.bitrate;
+        Q_EMIT bitRateChanged(m_bitRate);
+    }
+}
+
+void WebRTC::addRemoteCandidate(const QString &peerId, const rtc::Candidate &candidate)
+{
+    try {
+        m_peerConnections[peerId]->addRemoteCandidate(candidate);
+        TRACE_INSTANT(Signaling, "remoteCandidateAdded", 0);
+    } catch (const std::exception &e) {
+        qWarning() << "Failed to add remote candidate for peerId:" << peerId << ":" << e.what();
+    }
+}
+
+void WebRTC::startAudio()
+{
+    m_mediaEngine->start();
+    m_bitrateTimer.start();
+}
+
+std::shared_ptr<RtpFrameDepacketizer> WebRTC::createDepacketizer(const QString &peerId)
+{
+    // Runs on libdatachannel's thread; the payload goes straight into the media engine's packet ring.
+    MediaEngine *mediaEngine = m_mediaEngine;
+    QVector<quint8> payloadTypes = { static_cast<quint8>(payloadType()) };
+    if (m_audioChannels > 2)
+        payloadTypes.append(static_cast<quint8>(multiopusPayloadType));
+
+    if (peerId != m_sfuId) {
+        const int streamId = m_mediaEngine->registerReceiveStream(peerId);
+        return std::make_shared<RtpFrameDepacketizer>(payloadTypes,
+            [mediaEngine, streamId](const char *payload, int size, quint32 ssrc, quint16 sequence, quint32 timestamp,
+                                    quint8 payloadType) {
+                Q_UNUSED(ssrc)
+                mediaEngine->receiveFrame(streamId, payload, size, sequence, timestamp, payloadType);
+            });
+    }
+
+    // The SFU forwards each speaker under an SSRC of its own, and each needs its own jitter buffer.
+    // Its answer announced them all; anything else is not a slot and is dropped.
+    std::shared_ptr<SfuStreams> sfuStreams = m_sfuStreams;
+    return std::make_shared<RtpFrameDepacketizer>(payloadTypes,
+        [mediaEngine, sfuStreams](const char *payload, int size, quint32 ssrc, quint16 sequence, quint32 timestamp,
+                                  quint8 payloadType) {
+            int streamId;
+            {
+                QMutexLocker locker(&sfuStreams->mutex);
+                auto it = sfuStreams->ids.constFind(ssrc);
+                if (it == sfuStreams->ids.constEnd())
+                    return;
+                streamId = it.value();
+            }
+            mediaEngine->receiveFrame(streamId, payload, size, sequence, timestamp, payloadType);
+        });
+}
+
+
+// The SFU's answer lists the SSRC of every slot it forwards. Registering them
+// here queues each stream to the media thread long before its first packet,
+// which cannot arrive until ICE and DTLS are through.
+void WebRTC::registerSfuStreams(rtc::Description &description)
 {
-    if (auto binaryData = std::get_if<rtc::binary>(&data)) {
-        return QByteArray(reinterpret_cast<const char*>(binaryData->data()), binaryData->size());
+    for (unsigned int i = 0; i < description.mediaCount(); ++i) {
+        auto entry = description.media(i);
+        auto media = std::get_if<rtc::Description::Media*>(&entry);
+        if (!media || (*media)->type() != "audio")
+            continue;
+
+        QMutexLocker locker(&m_sfuStreams->mutex);
+        for (uint32_t ssrc : (*media)->getSSRCs()) {
+            if (!m_sfuStreams->ids.contains(ssrc))
+                m_sfuStreams->ids.insert(ssrc, m_mediaEngine->registerReceiveStream(m_sfuId + '#' + QString::number(ssrc)));
+        }
+        break;
     }
-    return QByteArray();
 }
 
 
-QJsonObject WebRTC::descriptionToJson(const rtc::Description &description)
+QJsonObject WebRTC::descriptionToJson(const rtc::Description &description,
+                                      const std::vector<rtc::Candidate> &reusedCandidates)
 {
+    // Reused candidates are not the ICE agent's own; the remote side learns them from the description only.
+    rtc::Description withCandidates = description;
+    for (const rtc::Candidate &candidate : reusedCandidates) {
+        withCandidates.addCandidate(candidate);
+    }
+
     QJsonObject jsonObject;
-    jsonObject.insert("type", QString::fromStdString(description.typeString()));
-    jsonObject.insert("sdp", QString::fromStdString(description.generateSdp()));
+    jsonObject.insert("type", QString::fromStdString(withCandidates.typeString()));
+    jsonObject.insert("sdp", QString::fromStdString(withCandidates.generateSdp()));
     return jsonObject;
 }
 
 
+// Both sides run this on the other's description, so each sends what the other
+// asked for. Plain Opus goes out in stereo when the remote fmtp has stereo=1;
+// multiopus is used when both sides offered it, in the layout the remote gave,
+// and what comes back is in the layout this side offered.
+void WebRTC::negotiateAudio(const QString &peerId, rtc::Description &description)
+{
+    int opusPayloadType = -1;
+    QString opusFmtp;
+    int remoteMultiopusPayloadType = -1;
+    OpusLayout remoteMultiopusLayout;
+
+    for (unsigned int i = 0; i < description.mediaCount(); ++i) {
+        auto entry = description.media(i);
+        auto media = std::get_if<rtc::Description::Media*>(&entry);
+        if (!media || (*media)->type() != "audio")
+            continue;
+
+        for (int candidate : (*media)->payloadTypes()) {
+            const rtc::Description::Media::RtpMap *rtpMap = (*media)->rtpMap(candidate);
+            if (!rtpMap)
+                continue;
+
+            QStringList fmtps;
+            for (const std::string &fmtp : rtpMap->fmtps) {
+                fmtps.append(QString::fromStdString(fmtp));
+            }
+            const QString format = QString::fromStdString(rtpMap->format);
+            if (format.compare("opus", Qt::CaseInsensitive) == 0 && opusPayloadType < 0) {
+                opusPayloadType = candidate;
+                opusFmtp = fmtps.join(';');
+            } else if (format.compare("multiopus", Qt::CaseInsensitive) == 0 && remoteMultiopusPayloadType < 0) {
+                const OpusLayout layout = OpusLayout::fromFmtp(QString::fromStdString(rtpMap->encParams).toInt(),
+                                                               fmtps.join(';'));
+                if (layout.isValid()) {
+                    remoteMultiopusPayloadType = candidate;
+                    remoteMultiopusLayout = layout;
+                }
+            }
+        }
+        break;
+    }
+
+    PeerAudio audio;
+    audio.opusPayloadType = opusPayloadType >= 0 ? opusPayloadType : payloadType();
+    const bool remoteReceivesStereo = OpusLayout::fmtpParameter(opusFmtp, "stereo") == "1";
+    const bool remoteSendsStereo = OpusLayout::fmtpParameter(opusFmtp, "sprop-stereo") == "1";
+    const OpusLayout opusReceiveLayout = OpusLayout::forChannels(m_audioChannels > 1 && remoteSendsStereo ? 2 : 1);
+
+    // The remote falls back to plain Opus whenever one of its peers cannot take
+    // multiopus, so both are decoded for as long as both were offered.
+    AudioStream::PayloadLayouts receiveLayouts;
+    receiveLayouts.insert(payloadType(), opusReceiveLayout);
+    if (m_audioChannels > 2 && remoteMultiopusPayloadType >= 0) {
+        audio.sendLayout = remoteMultiopusLayout;
+        audio.sendPayloadType = remoteMultiopusPayloadType;
+        audio.receiveLayout = OpusLayout::forChannels(m_audioChannels);
+        receiveLayouts.insert(multiopusPayloadType, audio.receiveLayout);
+    } else {
+        audio.sendLayout = OpusLayout::forChannels(m_audioChannels > 1 && remoteReceivesStereo ? 2 : 1);
+        audio.sendPayloadType = audio.opusPayloadType;
+        audio.receiveLayout = opusReceiveLayout;
+    }
+
+    qDebug() << "Audio for peerId:" << peerId << "sends" << audio.sendLayout.channels
+             << "channels, receives" << audio.receiveLayout.channels;
+    m_peerAudio[peerId] = audio;
+    m_mediaEngine->setReceiveLayouts(peerId, receiveLayouts);
+    updateSendLayout();
+}
+
+// One encoder feeds every peer, so they all get the same layout. When peers
+// disagree it falls back to plain Opus, which every one of them decodes; a
+// peer that would rather have mono still decodes stereo.
+void WebRTC::updateSendLayout()
+{
+    if (m_peerAudio.isEmpty())
+        return;
+
+    OpusLayout layout = m_peerAudio.constBegin()->sendLayout;
+    bool shared = true;
+    int plainChannels = 1;
+    for (const PeerAudio &audio : std::as_const(m_peerAudio)) {
+        shared = shared && audio.sendLayout == layout;
+        plainChannels = qMax(plainChannels, qMin(audio.sendLayout.channels, 2));
+    }
+    if (!shared)
+        layout = OpusLayout::forChannels(plainChannels);
+
+    m_mediaEngine->setSendLayout(layout);
+    for (auto it = m_peerAudio.constBegin(); it != m_peerAudio.constEnd(); ++it) {
+        m_mediaEngine->setSendPayloadType(it.key(), shared ? it.value().sendPayloadType : it.value().opusPayloadType);
+    }
+}
+
+
 
 
 int WebRTC::bitRate() const
@@ -462,8 +918,32 @@ int WebRTC::bitRate() const
 
 void WebRTC::setBitRate(int newBitRate)
 {
-    m_bitRate = newBitRate;
-    Q_EMIT bitRateChanged(newBitRate);
+    m_bitrateController.reset(newBitRate);
+    applyEncoderSettings(m_bitrateController.settings());
+}
+
+int WebRTC::minBitRate() const
+{
+    return m_bitrateController.minBitrate();
+}
+
+void WebRTC::setMinBitRate(int newMinBitRate)
+{
+    m_bitrateController.setBounds(newMinBitRate, m_bitrateController.maxBitrate());
+    applyEncoderSettings(m_bitrateController.settings());
+    Q_EMIT bitRateBoundsChanged();
+}
+
+int WebRTC::maxBitRate() const
+{
+    return m_bitrateController.maxBitrate();
+}
+
+void WebRTC::setMaxBitRate(int newMaxBitRate)
+{
+    m_bitrateController.setBounds(m_bitrateController.minBitrate(), newMaxBitRate);
+    applyEncoderSettings(m_bitrateController.settings());
+    Q_EMIT bitRateBoundsChanged();
 }
 
 void WebRTC::resetBitRate()
@@ -519,8 +999,173 @@ void WebRTC::setIsOfferer(bool isOfferer)
     m_isOfferer = isOfferer;
 }
 
+// The signaling and ICE settings below are read by init().
+QString WebRTC::signalingUrl() const
+{
+    return m_signalingUrl;
+}
+
+void WebRTC::setSignalingUrl(const QString &newSignalingUrl)
+{
+    if (m_signalingUrl == newSignalingUrl)
+        return;
+    m_signalingUrl = newSignalingUrl;
+    Q_EMIT signalingUrlChanged();
+}
+
+QStringList WebRTC::iceServers() const
+{
+    return m_iceServers;
+}
+
+void WebRTC::setIceServers(const QStringList &newIceServers)
+{
+    if (m_iceServers == newIceServers)
+        return;
+    m_iceServers = newIceServers;
+    Q_EMIT iceServersChanged();
+}
+
+QString WebRTC::iceBindAddress() const
+{
+    return m_iceBindAddress;
+}
+
+void WebRTC::setIceBindAddress(const QString &newIceBindAddress)
+{
+    if (m_iceBindAddress == newIceBindAddress)
+        return;
+    m_iceBindAddress = newIceBindAddress;
+    Q_EMIT iceBindAddressChanged();
+}
+
+int WebRTC::iceUdpPort() const
+{
+    return m_iceUdpPort;
+}
+
+void WebRTC::setIceUdpPort(int newIceUdpPort)
+{
+    if (m_iceUdpPort == newIceUdpPort)
+        return;
+    m_iceUdpPort = newIceUdpPort;
+    Q_EMIT iceUdpPortChanged();
+}
+
+QString WebRTC::sfuId() const
+{
+    return m_sfuId;
+}
+
+void WebRTC::setSfuId(const QString &newSfuId)
+{
+    if (m_sfuId == newSfuId)
+        return;
+    m_sfuId = newSfuId;
+    Q_EMIT sfuIdChanged();
+}
+
+bool WebRTC::trickleIce() const
+{
+    return m_trickleIce;
+}
+
+void WebRTC::setTrickleIce(bool newTrickleIce)
+{
+    if (m_trickleIce == newTrickleIce)
+        return;
+    m_trickleIce = newTrickleIce;
+    if (m_signalingClient)
+        m_signalingClient->setCandidateBatchInterval(m_trickleIce ? m_candidateBatchMs : 0);
+    Q_EMIT trickleIceChanged();
+}
+
+int WebRTC::candidateBatchMs() const
+{
+    return m_candidateBatchMs;
+}
+
+void WebRTC::setCandidateBatchMs(int newCandidateBatchMs)
+{
+    if (m_candidateBatchMs == newCandidateBatchMs)
+        return;
+    m_candidateBatchMs = newCandidateBatchMs;
+    if (m_signalingClient && m_trickleIce)
+        m_signalingClient->setCandidateBatchInterval(m_candidateBatchMs);
+    Q_EMIT candidateBatchMsChanged();
+}
+
+int WebRTC::connectionPoolSize() const
+{
+    return m_connectionPoolSize;
+}
+
+void WebRTC::setConnectionPoolSize(int newConnectionPoolSize)
+{
+    if (m_connectionPoolSize == newConnectionPoolSize)
+        return;
+    m_connectionPoolSize = newConnectionPoolSize;
+    if (m_connectionPoolStarted)
+        m_connectionPool->setSize(m_connectionPoolSize);
+    Q_EMIT connectionPoolSizeChanged();
+}
+
+PeerConnectionPool *WebRTC::connectionPool() const
+{
+    return m_connectionPool;
+}
+
+// Once started, the pool refills after every take and rebuilds stale connections for later calls.
+void WebRTC::warmUpConnectionPool()
+{
+    if (m_connectionPoolStarted || !m_signalingClient)
+        return;
+    m_connectionPoolStarted = true;
+    m_connectionPool->setSize(m_connectionPoolSize);
+}
+
+int WebRTC::audioChannels() const
+{
+    return m_audioChannels;
+}
+
+void WebRTC::setAudioChannels(int newAudioChannels)
+{
+    newAudioChannels = qBound(1, newAudioChannels, OpusLayout::maxChannels);
+    if (m_audioChannels == newAudioChannels)
+        return;
+    m_audioChannels = newAudioChannels;
+    m_mediaEngine->setAudioChannels(m_audioChannels);
+
+    // Pooled connections were offered with the old channel count.
+    if (m_connectionPoolStarted) {
+        m_connectionPool->clear();
+        m_connectionPool->setSize(m_connectionPoolSize);
+    }
+    Q_EMIT audioChannelsChanged();
+}
 
+QString WebRTC::captureProcessing() const
+{
+    return m_captureProcessing;
+}
+
+void WebRTC::setCaptureProcessing(const QString &newCaptureProcessing)
+{
+    if (m_captureProcessing == newCaptureProcessing)
+        return;
+    if (!CaptureProcessingChain::isValidSpec(newCaptureProcessing)) {
+        qWarning() << "Invalid capture processing spec:" << newCaptureProcessing
+                   << "- expected \"none\" or some of" << CaptureProcessingChain::stageNames();
+        return;
+    }
+    m_captureProcessing = newCaptureProcessing;
+    m_mediaEngine->setCaptureProcessing(m_captureProcessing);
+    Q_EMIT captureProcessingChanged();
+}
 
-void WebRTC::handleIncommingAudioData(const QByteArray &data) {
-    audioOutput->addData(data);
+MediaEngine *WebRTC::mediaEngine() const
+{
+    return m_mediaEngine;
 }
+
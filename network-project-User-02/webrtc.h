@@ -3,13 +3,20 @@
 
 #include <QObject>
 #include <QMap>
+#include <QStringList>
+#include <QVariantMap>
+#include <QTimer>
 #include <rtc/rtc.h>
 #include <rtc/rtc.hpp>
 #include "signalingclient.h"
-
-
-#include "AudioInput.h"
-#include "AudioOutput.h"
+#include "rtpframedepacketizer.h"
+#include "rtpstatistics.h"
+#include "bitratecontroller.h"
+#include "mediaengine.h"
+#include "peerconnectionpool.h"
+#include "certificatecache.h"
+#include "candidatecache.h"
+#include "opuslayout.h"
 
 class WebRTC : public QObject
 {
@@ -25,12 +32,67 @@ public:
     Q_INVOKABLE void generateOfferSDP(const QString &peerId);
     Q_INVOKABLE void generateAnswerSDP(const QString &peerId);
     Q_INVOKABLE void addAudioTrack(const QString &peerId, const QString &trackName);
-    Q_INVOKABLE void sendTrack(const QString &peerId, const QByteArray &buffer);
+
+    QStringList peers() const;
+    Q_INVOKABLE QVariantMap stats(const QString &peerId) const;
+    Q_INVOKABLE bool dumpTrace(const QString &fileName) const;
 
 
     bool isOfferer() const;
     Q_INVOKABLE void setIsOfferer(bool newIsOfferer);
 
+    QString signalingUrl() const;
+    void setSignalingUrl(const QString &newSignalingUrl);
+
+    QStringList iceServers() const;
+    void setIceServers(const QStringList &newIceServers);
+
+    QString iceBindAddress() const;
+    void setIceBindAddress(const QString &newIceBindAddress);
+
+    // One UDP port shared by every connection; lets STUN results carry over between calls. 0 disables.
+    int iceUdpPort() const;
+    void setIceUdpPort(int newIceUdpPort);
+
+    // When set, calls go to this SFU rather than to each peer (see sfu/).
+    QString sfuId() const;
+    void setSfuId(const QString &newSfuId);
+
+    // Trickle ICE sends the offer or answer once, at once, and candidates as they
+    // are found. Off, signaling works as it did before, to measure against: auto
+    // negotiation, each candidate in a message of its own, and the description
+    // sent again once gathering completes. Set before init().
+    bool trickleIce() const;
+    void setTrickleIce(bool newTrickleIce);
+
+    // With trickle ICE, candidates are coalesced over this window into one
+    // "candidates" message; 0 sends each in a "candidate" message of its own.
+    // Clients register as taking batches, and the native signaling server
+    // splits them up again for those that do not.
+    int candidateBatchMs() const;
+    void setCandidateBatchMs(int newCandidateBatchMs);
+
+    // Pre-built connections kept per direction, so a call skips their setup; 0 disables.
+    // The pool starts filling at the first sign of a call: a room joined, or a call
+    // placed or received. An app nobody calls from gathers no candidates.
+    // warmUpConnectionPool() starts it earlier, when a call is expected.
+    int connectionPoolSize() const;
+    void setConnectionPoolSize(int newConnectionPoolSize);
+    PeerConnectionPool *connectionPool() const;
+    Q_INVOKABLE void warmUpConnectionPool();
+
+    // Channels captured, sent and played out; 2 negotiates stereo Opus and more
+    // also offers multiopus surround. Set before the first call.
+    int audioChannels() const;
+    void setAudioChannels(int newAudioChannels);
+
+    // Capture processing stages, see CaptureProcessingChain::configure(); can be
+    // changed during a call. stats() reports how long each one takes per frame.
+    QString captureProcessing() const;
+    void setCaptureProcessing(const QString &newCaptureProcessing);
+
+    MediaEngine *mediaEngine() const;
+
     rtc::SSRC ssrc() const;
     void setSsrc(rtc::SSRC newSsrc);
     void resetSsrc();
@@ -43,32 +105,61 @@ public:
     void setBitRate(int newBitRate);
     void resetBitRate();
 
+    int minBitRate() const;
+    void setMinBitRate(int newMinBitRate);
+
+    int maxBitRate() const;
+    void setMaxBitRate(int newMaxBitRate);
+
 
 signals:
     void openedDataChannel(const QString &peerId);
     void closedDataChannel(const QString &peerId);
-    void incommingPacket(const QByteArray &data);
     void localDescriptionGenerated(const QString &peerID, const QJsonObject &sdp);
     void localCandidateGenerated(const QString &peerID, const QString &candidate, const QString &sdpMid);
     void isOffererChanged();
+    void signalingUrlChanged();
+    void iceServersChanged();
+    void iceBindAddressChanged();
+    void iceUdpPortChanged();
+    void sfuIdChanged();
+    void trickleIceChanged();
+    void candidateBatchMsChanged();
+    void connectionPoolSizeChanged();
+    void audioChannelsChanged();
+    void captureProcessingChanged();
     void gatheringCompleted(const QString &peerID);
     void offerIsReady(const QString &peerID, const QJsonObject &description);
     void answerIsReady(const QString &peerID, const QJsonObject &description);
     void ssrcChanged(rtc::SSRC newSsrc);
     void payloadTypeChanged(int newPayloadType);
     void bitRateChanged(int newBitRate);
+    void bitRateBoundsChanged();
+    void peersChanged();
     void connected(const QString &peerID);
     void disconnected(const QString &peerID);
-    void incomingFrame(const rtc::binary &frame, const rtc::FrameInfo &info);
 
 public slots:
     void setRemoteDescription(const QString &peerID, const QJsonObject &sdp);
     void setRemoteCandidate(const QString &peerID, const QString &candidate, const QString &sdpMid);
-    void handleIncommingAudioData(const QByteArray &data);
 
 private:
-    QByteArray readVariant(const rtc::message_variant &data);
-    QJsonObject descriptionToJson(const rtc::Description &description);
+    void startAudio();
+    void updateBitrate();
+    void applyEncoderSettings(const BitrateController::Settings &settings);
+    void addRemoteCandidate(const QString &peerId, const rtc::Candidate &candidate);
+    void createPeer(const QString &peerId, bool offering);
+    PeerConnectionPool::Connection buildConnection(bool offering);
+    void bindConnection(const QString &peerId, const PeerConnectionPool::Connection &connection);
+    std::shared_ptr<rtc::Track> createAudioTrack(const std::shared_ptr<rtc::PeerConnection> &peerConnection,
+                                                 const QString &trackName, rtc::SSRC &trackSsrc);
+    void attachAudioTrack(const QString &peerId, const std::shared_ptr<rtc::Track> &track, rtc::SSRC trackSsrc);
+    std::shared_ptr<RtpFrameDepacketizer> createDepacketizer(const QString &peerId);
+    QJsonObject descriptionToJson(const rtc::Description &description,
+                                  const std::vector<rtc::Candidate> &reusedCandidates = {});
+    void negotiateAudio(const QString &peerId, rtc::Description &description);
+    void registerSfuStreams(rtc::Description &description);
+    void updateSendLayout();
 
     inline uint32_t getCurrentTimestamp() {
         using namespace std::chrono;
@@ -78,26 +169,62 @@ private:
     }
 
 private:
-    static inline uint16_t m_sequenceNumber = 0;
-    uint32_t m_timestamp = 0;
     bool m_gatheringCompleted = false;
     int m_bitRate = 48000;
+    BitrateController m_bitrateController;
+    BitrateController::Settings m_encoderSettings;
+    QTimer m_bitrateTimer;
     int m_payloadType = 111;
     rtc::SSRC m_ssrc = 2;
     bool m_isOfferer = false;
     QString m_localId;
+    QString m_signalingUrl = "ws://localhost:3000";
+    QStringList m_iceServers = { "stun:stun.l.google.com:19302" };
+    QString m_iceBindAddress;
+    int m_iceUdpPort = 0;
+    // Empty unless STUN results can be reused, see init().
+    QString m_candidateCacheKey;
+    QString m_sfuId;
+    bool m_trickleIce = true;
+    int m_candidateBatchMs = 10;
+    int m_connectionPoolSize = 1;
+    bool m_connectionPoolStarted = false;
+    int m_audioChannels = 1;
+    QString m_captureProcessing = "highpass";
     rtc::Configuration m_config;
     QMap<QString, rtc::Description> m_peerSdps;
     QMap<QString, std::shared_ptr<rtc::PeerConnection>> m_peerConnections;
+    QMap<QString, std::shared_ptr<ConnectionBinding>> m_peerBindings;
     QMap<QString, std::shared_ptr<rtc::Track>> m_peerTracks;
+    QMap<QString, std::shared_ptr<RtpStatistics>> m_peerStatistics;
+    // reportsReceived as of the last bitrate update, see updateBitrate().
+    QMap<QString, quint64> m_reportsUsed;
+    QMap<QString, QVector<rtc::Candidate>> m_pendingRemoteCandidates;
+
+    // The receive stream of each SFU slot by SSRC, see registerSfuStreams(). The
+    // SFU connection's depacketizer looks them up on libdatachannel's thread.
+    struct SfuStreams {
+        QMutex mutex;
+        QHash<quint32, int> ids;
+    };
+    const std::shared_ptr<SfuStreams> m_sfuStreams = std::make_shared<SfuStreams>();
+
+    // What the remote description settled for each peer, see negotiateAudio().
+    struct PeerAudio {
+        OpusLayout sendLayout;
+        int sendPayloadType = 111;
+        int opusPayloadType = 111;
+        OpusLayout receiveLayout;
+    };
+    QMap<QString, PeerAudio> m_peerAudio;
     QJsonObject m_localDescription;
     QString m_remoteDescription;
 
-    SignalingClient *m_signalingClient;
+    SignalingClient *m_signalingClient = nullptr;
 
 
-    AudioInput* audioInput;
-    AudioOutput* audioOutput;
+    MediaEngine* m_mediaEngine;
+    PeerConnectionPool *m_connectionPool = nullptr;
     bool isTrackOpen = false;
     bool iceGatheringComplete = false;
 
@@ -106,6 +233,19 @@ private:
     Q_PROPERTY(rtc::SSRC ssrc READ ssrc WRITE setSsrc RESET resetSsrc NOTIFY ssrcChanged FINAL)
     Q_PROPERTY(int payloadType READ payloadType WRITE setPayloadType RESET resetPayloadType NOTIFY payloadTypeChanged FINAL)
     Q_PROPERTY(int bitRate READ bitRate WRITE setBitRate RESET resetBitRate NOTIFY bitRateChanged FINAL)
+    Q_PROPERTY(int minBitRate READ minBitRate WRITE setMinBitRate NOTIFY bitRateBoundsChanged FINAL)
+    Q_PROPERTY(int maxBitRate READ maxBitRate WRITE setMaxBitRate NOTIFY bitRateBoundsChanged FINAL)
+    Q_PROPERTY(QStringList peers READ peers NOTIFY peersChanged FINAL)
+    Q_PROPERTY(QString signalingUrl READ signalingUrl WRITE setSignalingUrl NOTIFY signalingUrlChanged FINAL)
+    Q_PROPERTY(QStringList iceServers READ iceServers WRITE setIceServers NOTIFY iceServersChanged FINAL)
+    Q_PROPERTY(QString iceBindAddress READ iceBindAddress WRITE setIceBindAddress NOTIFY iceBindAddressChanged FINAL)
+    Q_PROPERTY(int iceUdpPort READ iceUdpPort WRITE setIceUdpPort NOTIFY iceUdpPortChanged FINAL)
+    Q_PROPERTY(QString sfuId READ sfuId WRITE setSfuId NOTIFY sfuIdChanged FINAL)
+    Q_PROPERTY(bool trickleIce READ trickleIce WRITE setTrickleIce NOTIFY trickleIceChanged FINAL)
+    Q_PROPERTY(int candidateBatchMs READ candidateBatchMs WRITE setCandidateBatchMs NOTIFY candidateBatchMsChanged FINAL)
+    Q_PROPERTY(int connectionPoolSize READ connectionPoolSize WRITE setConnectionPoolSize NOTIFY connectionPoolSizeChanged FINAL)
+    Q_PROPERTY(int audioChannels READ audioChannels WRITE setAudioChannels NOTIFY audioChannelsChanged FINAL)
+    Q_PROPERTY(QString captureProcessing READ captureProcessing WRITE setCaptureProcessing NOTIFY captureProcessingChanged FINAL)
 };
 
 #endif